@@ -0,0 +1,339 @@
+// Circuit build rate on a loopback testnet
+//
+// Starts five relays in-process, each behind a link emulator that delays
+// every byte in both directions by a fixed one-way time, so each hop costs
+// a round trip. Three-hop circuits on rotating paths are then built:
+//   serial        one build(path) at a time
+//   concurrent    up to a given number of launch() builds in flight
+// each with EXTENDs sent one per answered hop and pipelined behind CREATE.
+// Reports circuits built per second and the mean build time.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_circuit_build.cpp $(find src -name '*.cpp' ! -name main.cpp)
+//       -lssl -lcrypto -pthread -o bench_circuit_build
+//
+// Usage: ./bench_circuit_build [circuits] [in_flight] [delay_ms] > /dev/null
+// (results go to stderr; relays log every hop on stdout)
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "src/include/kermit/node_manager.h"
+#include "src/include/kermit/network.h"
+#include "src/include/kermit/cell.h"
+#include "src/include/kermit/core.h"
+#include "src/include/kermit/circuit_manager.h"
+#include "src/include/kermit/circuit_switch.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr uint16_t kRelayPort = 19600;
+constexpr uint16_t kLinkPort = 19700;   // Link emulator in front of relay i listens on kLinkPort + i
+constexpr uint16_t kRelays = 5;
+constexpr uint32_t kBuildTimeoutMs = 10000;
+
+// A relay answering on its listen port, as the router wires one up
+class Relay {
+public:
+    explicit Relay(uint16_t port) {
+        network_.initialize(port, "127.0.0.1");
+        nodes_.initialize();
+
+        switch_ = std::make_unique<kermit::CircuitSwitch>(nodes_, network_);
+        kermit::CircuitSwitch* circuit_switch = switch_.get();
+        nodes_.getChannelPool()->setCellCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+                circuit_switch->handleChannelCell(channel, cell);
+            });
+        nodes_.getChannelPool()->setCloseCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+                circuit_switch->handleChannelClosed(channel);
+            });
+
+        network_.setConnectionCallback([this](kermit::ConnectionHandle id, bool connected) {
+            if (!connected) {
+                assemblers_.erase(id);
+                switch_->handleInboundClosed(id);
+            }
+        });
+        network_.setDataCallback([this](kermit::ConnectionHandle id, const std::vector<uint8_t>& data) {
+            std::vector<kermit::Cell> cells;
+            assemblers_[id].feed(data.data(), data.size(), cells);
+            std::vector<uint8_t> reply;
+            for (const auto& cell : cells) {
+                if (cell.command == kermit::CellCommand::PING) {
+                    kermit::Cell::make(cell.circuit_id, kermit::CellCommand::PONG).appendTo(reply);
+                } else if (cell.command != kermit::CellCommand::PONG &&
+                           cell.command != kermit::CellCommand::PADDING) {
+                    switch_->handleInboundCell(id, cell);
+                }
+            }
+            if (!reply.empty()) network_.sendData(id, reply);
+        });
+
+        network_.start();
+        switch_->start();
+    }
+
+    ~Relay() {
+        network_.stop();
+        switch_->stop();
+    }
+
+    // Relays this one may extend circuits to; EXTENDs naming others are refused
+    void addPeer(const std::string& id, uint16_t port) {
+        nodes_.addRelayNode(id, "127.0.0.1", port);
+    }
+
+private:
+    kermit::NetworkManager network_;
+    kermit::NodeManager nodes_;
+    std::unique_ptr<kermit::CircuitSwitch> switch_;
+    std::unordered_map<kermit::ConnectionHandle, kermit::CellAssembler> assemblers_;
+};
+
+int listenOn(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        std::cerr << "Cannot listen on port " << port << std::endl;
+        std::exit(1);
+    }
+    return fd;
+}
+
+// Copy from one socket to another, each chunk held for the delay
+void delayDirection(int from, int to, int delay_ms) {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::pair<Clock::time_point, std::vector<char>>> queue;
+    bool done = false;
+
+    std::thread writer([&] {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return done || !queue.empty(); });
+            if (queue.empty()) return;
+            auto chunk = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            std::this_thread::sleep_until(chunk.first + std::chrono::milliseconds(delay_ms));
+            for (size_t off = 0; off < chunk.second.size();) {
+                ssize_t n = send(to, chunk.second.data() + off, chunk.second.size() - off, MSG_NOSIGNAL);
+                if (n <= 0) return;
+                off += n;
+            }
+        }
+    });
+
+    char buffer[16384];
+    while (true) {
+        ssize_t n = recv(from, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(Clock::now(), std::vector<char>(buffer, buffer + n));
+        ready.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        ready.notify_one();
+    }
+    writer.join();
+    shutdown(to, SHUT_WR);
+}
+
+void startLink(uint16_t port, uint16_t target, int delay_ms) {
+    int listener = listenOn(port);
+    std::thread([listener, target, delay_ms] {
+        while (true) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) return;
+
+            int relay = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(target);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(relay, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                close(client);
+                close(relay);
+                continue;
+            }
+            std::thread([client, relay, delay_ms] { delayDirection(client, relay, delay_ms); }).detach();
+            std::thread([client, relay, delay_ms] { delayDirection(relay, client, delay_ms); }).detach();
+        }
+    }).detach();
+}
+
+std::string linkId(uint16_t relay) {
+    return "127.0.0.1:" + std::to_string(kLinkPort + relay);
+}
+
+// Every ordered choice of three distinct relays
+std::vector<std::vector<std::string>> allPaths() {
+    std::vector<std::vector<std::string>> paths;
+    for (uint16_t a = 0; a < kRelays; ++a) {
+        for (uint16_t b = 0; b < kRelays; ++b) {
+            for (uint16_t c = 0; c < kRelays; ++c) {
+                if (a != b && b != c && a != c) {
+                    paths.push_back({linkId(a), linkId(b), linkId(c)});
+                }
+            }
+        }
+    }
+    return paths;
+}
+
+struct Result {
+    size_t built = 0;
+    size_t failed = 0;
+    double seconds = 0.0;
+    double build_ms_sum = 0.0;
+};
+
+Result serial(kermit::CircuitManager& manager, const std::vector<std::vector<std::string>>& paths, size_t count) {
+    Result result;
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto circuit = manager.build(kermit::CircuitPurpose::GENERAL, paths[i % paths.size()], kBuildTimeoutMs);
+        if (circuit) {
+            result.built++;
+            result.build_ms_sum += circuit->getBuildTimeMs();
+            manager.destroy(circuit);
+        } else {
+            result.failed++;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+Result concurrent(kermit::CircuitManager& manager, const std::vector<std::vector<std::string>>& paths,
+                  size_t count, size_t in_flight) {
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t running = 0;
+    std::vector<std::shared_ptr<kermit::Circuit>> built;
+    Result result;
+
+    auto start = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; ++i) {
+        finished.wait(lock, [&] { return running < in_flight; });
+        running++;
+        lock.unlock();
+        auto circuit = manager.launch(kermit::CircuitPurpose::GENERAL, paths[i % paths.size()],
+                                      [&](const std::shared_ptr<kermit::Circuit>& done) {
+                                          std::lock_guard<std::mutex> guard(mutex);
+                                          if (done) {
+                                              built.push_back(done);
+                                          } else {
+                                              result.failed++;
+                                          }
+                                          running--;
+                                          finished.notify_all();
+                                      });
+        lock.lock();
+        if (!circuit) {
+            running--;
+            result.failed++;
+        }
+    }
+    finished.wait_for(lock, std::chrono::milliseconds(kBuildTimeoutMs), [&] { return running == 0; });
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.failed += running;
+    lock.unlock();
+
+    for (const auto& circuit : built) {
+        result.built++;
+        result.build_ms_sum += circuit->getBuildTimeMs();
+        manager.destroy(circuit);
+    }
+    return result;
+}
+
+void report(const char* name, const Result& result) {
+    std::cerr << "  " << std::left << std::setw(24) << name << std::right << std::setw(8)
+              << result.built / result.seconds << " circuits/s   build " << std::setw(7)
+              << (result.built ? result.build_ms_sum / result.built : 0.0) << " ms mean   failed "
+              << result.failed << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    size_t in_flight = argc > 2 ? std::stoul(argv[2]) : 200;
+    int delay_ms = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    std::vector<std::unique_ptr<Relay>> relays;
+    for (uint16_t i = 0; i < kRelays; ++i) {
+        relays.push_back(std::make_unique<Relay>(kRelayPort + i));
+        startLink(kLinkPort + i, kRelayPort + i, delay_ms);
+    }
+    for (auto& relay : relays) {
+        for (uint16_t i = 0; i < kRelays; ++i) {
+            relay->addPeer(linkId(i), kLinkPort + i);
+        }
+    }
+
+    kermit::NodeManager nodes;
+    nodes.initialize();
+    kermit::CircuitManager manager(nodes);
+    nodes.getChannelPool()->setCellCallback(
+        [&manager](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+            manager.handleCell(channel, cell);
+        });
+    nodes.getChannelPool()->setCloseCallback([&manager](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+        manager.handleChannelClosed(channel);
+    });
+    for (uint16_t i = 0; i < kRelays; ++i) {
+        nodes.addRelayNode(linkId(i), "127.0.0.1", kLinkPort + i, true);
+        nodes.connectToRelayNode(linkId(i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // Open the channels between relays before measuring
+    auto paths = allPaths();
+    for (int round = 0; round < 3; ++round) {
+        concurrent(manager, paths, paths.size(), paths.size());
+    }
+
+    std::cerr << std::fixed << std::setprecision(1);
+    std::cerr << kRelays << " relays, " << delay_ms << " ms each way on every link, 3 hops" << std::endl;
+    for (bool pipelining : {false, true}) {
+        manager.setPipelining(pipelining);
+        std::cerr << (pipelining ? "EXTENDs pipelined behind CREATE" : "one EXTEND per answered hop") << std::endl;
+        report("serial", serial(manager, paths, std::max<size_t>(count / 20, 10)));
+        std::string name = "concurrent, " + std::to_string(in_flight) + " in flight";
+        report(name.c_str(), concurrent(manager, paths, count, in_flight));
+    }
+
+    // Relays and link threads are not joined
+    std::cerr.flush();
+    _exit(0);
+}
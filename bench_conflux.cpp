@@ -0,0 +1,426 @@
+// Linked circuit measurement on a loopback testnet
+//
+// Starts five relays in-process (the last one an exit), a bulk server that
+// sends 4 MiB per connection and an echo server. The client reaches the
+// two guards through link emulators that add a one-way delay and limit the
+// rate, then downloads from the bulk server while pinging the echo server
+// every 50 ms, over:
+//   single      one circuit through guard A
+//   linked      circuits through guards A and B, linked at the exit
+// with both links alike, with link B slower, and with link B stalling one
+// second into the transfer. Reports throughput, the echo round trip, and
+// how many cells arrived out of order.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_conflux.cpp $(find src -name '*.cpp' ! -name main.cpp)
+//       -lssl -lcrypto -pthread -o bench_conflux
+//
+// Usage: ./bench_conflux [rate_kib_per_sec] [delay_ms]
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "src/include/kermit/node_manager.h"
+#include "src/include/kermit/network.h"
+#include "src/include/kermit/cell.h"
+#include "src/include/kermit/core.h"
+#include "src/include/kermit/circuit_manager.h"
+#include "src/include/kermit/circuit_switch.h"
+#include "src/include/kermit/stream_mux.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr uint16_t kRelayPort = 19300;
+constexpr uint16_t kBulkPort = 19400;
+constexpr uint16_t kEchoPort = 19401;
+constexpr uint16_t kLinkPortA = 19500;
+constexpr uint16_t kLinkPortB = 19501;
+constexpr size_t kBulkBytes = 4 * 1024 * 1024;
+constexpr auto kPingInterval = std::chrono::milliseconds(50);
+constexpr auto kTransferTimeout = std::chrono::seconds(30);
+
+// A relay answering on its listen port, as the router wires one up
+class Relay {
+public:
+    Relay(uint16_t port, bool exit) {
+        network_.initialize(port, "127.0.0.1");
+        network_.setKistInterval(0);
+        kermit::ChannelPoolConfig config;
+        config.kist_interval_ms = 0;
+        nodes_.initialize(config);
+
+        switch_ = std::make_unique<kermit::CircuitSwitch>(nodes_, network_);
+        switch_->setExitEnabled(exit);
+        switch_->setExitAllowPrivate(true);  // Targets are on loopback
+        kermit::CircuitSwitch* circuit_switch = switch_.get();
+        nodes_.getChannelPool()->setCellCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+                circuit_switch->handleChannelCell(channel, cell);
+            });
+        nodes_.getChannelPool()->setCloseCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+                circuit_switch->handleChannelClosed(channel);
+            });
+
+        network_.setConnectionCallback([this](kermit::ConnectionHandle id, bool connected) {
+            if (!connected) {
+                assemblers_.erase(id);
+                switch_->handleInboundClosed(id);
+            }
+        });
+        network_.setDataCallback([this](kermit::ConnectionHandle id, const std::vector<uint8_t>& data) {
+            std::vector<kermit::Cell> cells;
+            assemblers_[id].feed(data.data(), data.size(), cells);
+            std::vector<uint8_t> reply;
+            for (const auto& cell : cells) {
+                if (cell.command == kermit::CellCommand::PING) {
+                    kermit::Cell::make(cell.circuit_id, kermit::CellCommand::PONG).appendTo(reply);
+                } else if (cell.command != kermit::CellCommand::PONG &&
+                           cell.command != kermit::CellCommand::PADDING) {
+                    switch_->handleInboundCell(id, cell);
+                }
+            }
+            if (!reply.empty()) network_.sendData(id, reply);
+        });
+
+        network_.start();
+        switch_->start();
+    }
+
+    ~Relay() {
+        network_.stop();
+        switch_->stop();
+    }
+
+    // Relays this one may extend circuits to; EXTENDs naming others are refused
+    void addPeer(const std::string& id, uint16_t port) {
+        nodes_.addRelayNode(id, "127.0.0.1", port);
+    }
+
+private:
+    kermit::NetworkManager network_;
+    kermit::NodeManager nodes_;
+    std::unique_ptr<kermit::CircuitSwitch> switch_;
+    std::unordered_map<kermit::ConnectionHandle, kermit::CellAssembler> assemblers_;
+};
+
+// One-way delay and rate limit, applied to both directions of a link
+struct LinkShape {
+    std::atomic<int> delay_ms;
+    std::atomic<long> bytes_per_sec;
+};
+
+int listenOn(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        std::cerr << "Cannot listen on port " << port << std::endl;
+        std::exit(1);
+    }
+    return fd;
+}
+
+// Copy from one socket to another, each chunk held for the delay and
+// released no faster than the rate
+void shapeDirection(int from, int to, LinkShape* shape) {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::pair<Clock::time_point, std::vector<char>>> queue;
+    bool done = false;
+
+    std::thread writer([&] {
+        auto next = Clock::now();
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return done || !queue.empty(); });
+            if (queue.empty()) return;
+            auto chunk = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            std::this_thread::sleep_until(std::max(chunk.first + std::chrono::milliseconds(shape->delay_ms), next));
+            for (size_t off = 0; off < chunk.second.size();) {
+                ssize_t n = send(to, chunk.second.data() + off, chunk.second.size() - off, MSG_NOSIGNAL);
+                if (n <= 0) return;
+                off += n;
+            }
+            next = std::max(next, Clock::now()) +
+                   std::chrono::microseconds(chunk.second.size() * 1000000 / shape->bytes_per_sec);
+        }
+    });
+
+    char buffer[4096];
+    while (true) {
+        ssize_t n = recv(from, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(Clock::now(), std::vector<char>(buffer, buffer + n));
+        ready.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        ready.notify_one();
+    }
+    writer.join();
+    shutdown(to, SHUT_WR);
+}
+
+void startLink(uint16_t port, uint16_t target, LinkShape* shape) {
+    int listener = listenOn(port);
+    std::thread([listener, target, shape] {
+        while (true) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) return;
+
+            int relay = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(target);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(relay, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                close(client);
+                close(relay);
+                continue;
+            }
+            std::thread([client, relay, shape] { shapeDirection(client, relay, shape); }).detach();
+            std::thread([client, relay, shape] { shapeDirection(relay, client, shape); }).detach();
+        }
+    }).detach();
+}
+
+void startServer(uint16_t port, bool bulk) {
+    int listener = listenOn(port);
+    std::thread([listener, bulk] {
+        while (true) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) return;
+            std::thread([fd, bulk] {
+                char buffer[16384];
+                if (bulk) {
+                    memset(buffer, 'B', sizeof(buffer));
+                    for (size_t total = 0; total < kBulkBytes;) {
+                        ssize_t n = send(fd, buffer, sizeof(buffer), MSG_NOSIGNAL);
+                        if (n <= 0) break;
+                        total += n;
+                    }
+                } else {
+                    while (true) {
+                        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                        if (n <= 0 || send(fd, buffer, n, MSG_NOSIGNAL) <= 0) break;
+                    }
+                }
+                close(fd);
+            }).detach();
+        }
+    }).detach();
+}
+
+struct Result {
+    double seconds = 0.0;
+    double echo_ms = 0.0;
+    bool complete = false;
+    kermit::StreamMuxStats stats{};
+};
+
+// Download kBulkBytes while pinging the echo server
+Result transfer(kermit::StreamMux& streams) {
+    std::atomic<int> connected(0);
+    streams.setEventCallback([&connected](uint16_t, kermit::StreamEvent event) {
+        if (event == kermit::StreamEvent::CONNECTED) connected++;
+    });
+    uint16_t bulk = streams.open("127.0.0.1:" + std::to_string(kBulkPort));
+    uint16_t echo = streams.open("127.0.0.1:" + std::to_string(kEchoPort));
+
+    auto start = Clock::now();
+    while (connected < 2 && Clock::now() - start < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    static const char kPing[] = "ping";
+    uint8_t buffer[65536];
+    size_t received = 0;
+    size_t echoed = 0;
+    bool pinging = false;
+    std::vector<double> round_trips;
+    start = Clock::now();
+    auto ping_at = start;
+    auto ping_sent = start;
+
+    while (received < kBulkBytes && Clock::now() - start < kTransferTimeout) {
+        size_t n = streams.read(bulk, buffer, sizeof(buffer));
+        received += n;
+
+        auto now = Clock::now();
+        if (!pinging && now >= ping_at) {
+            streams.write(echo, reinterpret_cast<const uint8_t*>(kPing), sizeof(kPing));
+            ping_sent = now;
+            echoed = 0;
+            pinging = true;
+        }
+        if (pinging) {
+            echoed += streams.read(echo, buffer, sizeof(buffer));
+            if (echoed >= sizeof(kPing)) {
+                now = Clock::now();
+                round_trips.push_back(std::chrono::duration<double, std::milli>(now - ping_sent).count());
+                ping_at = now + kPingInterval;
+                pinging = false;
+            }
+        }
+        if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.complete = received >= kBulkBytes;
+    double sum = 0.0;
+    for (double round_trip : round_trips) {
+        sum += round_trip;
+    }
+    result.echo_ms = round_trips.empty() ? 0.0 : sum / round_trips.size();
+    result.stats = streams.getStats();
+
+    streams.close(bulk);
+    streams.close(echo);
+    streams.setEventCallback(nullptr);
+    return result;
+}
+
+void report(const char* name, const Result& result) {
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::setw(6)
+              << kBulkBytes / 1048576.0 / result.seconds << " MiB/s   echo " << std::setw(7) << result.echo_ms
+              << " ms   legs " << result.stats.legs << "   out of order " << result.stats.reordered_cells
+              << (result.complete ? "" : "   (incomplete)") << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    long rate = (argc > 1 ? std::atol(argv[1]) : 2048) * 1024;
+    int delay_ms = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    LinkShape link_a;
+    LinkShape link_b;
+    auto reset = [&] {
+        link_a.delay_ms = delay_ms;
+        link_a.bytes_per_sec = rate;
+        link_b.delay_ms = delay_ms;
+        link_b.bytes_per_sec = rate;
+    };
+    reset();
+
+    startServer(kBulkPort, true);
+    startServer(kEchoPort, false);
+    std::vector<std::unique_ptr<Relay>> relays;
+    for (uint16_t i = 0; i < 5; ++i) {
+        relays.push_back(std::make_unique<Relay>(kRelayPort + i, i == 4));
+    }
+    for (auto& relay : relays) {
+        for (uint16_t i = 0; i < 5; ++i) {
+            relay->addPeer("127.0.0.1:" + std::to_string(kRelayPort + i), kRelayPort + i);
+        }
+    }
+    startLink(kLinkPortA, kRelayPort, &link_a);
+    startLink(kLinkPortB, kRelayPort + 2, &link_b);
+
+    kermit::NodeManager nodes;
+    nodes.initialize();
+    kermit::CircuitManager circuits(nodes);
+    nodes.getChannelPool()->setCellCallback(
+        [&circuits](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+            circuits.handleCell(channel, cell);
+        });
+    nodes.getChannelPool()->setCloseCallback([&circuits](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+        circuits.handleChannelClosed(channel);
+    });
+
+    auto relayId = [](uint16_t port) { return "127.0.0.1:" + std::to_string(port); };
+    for (uint16_t port : {kLinkPortA, kLinkPortB}) {
+        nodes.addRelayNode(relayId(port), "127.0.0.1", port, true);
+        nodes.connectToRelayNode(relayId(port));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    // Both paths end at the same exit
+    const std::vector<std::string> path_a = {relayId(kLinkPortA), relayId(kRelayPort + 1), relayId(kRelayPort + 4)};
+    const std::vector<std::string> path_b = {relayId(kLinkPortB), relayId(kRelayPort + 3), relayId(kRelayPort + 4)};
+
+    auto build = [&circuits](const std::vector<std::string>& path) {
+        auto circuit = circuits.build(kermit::CircuitPurpose::GENERAL, path, 5000);
+        if (!circuit) {
+            std::cerr << "Circuit build failed" << std::endl;
+            std::exit(1);
+        }
+        return circuit;
+    };
+    auto single = [&](const char* name, const std::vector<std::string>& path) {
+        auto circuit = build(path);
+        report(name, transfer(*circuit->getStreams()));
+        circuits.destroy(circuit);
+    };
+    auto linked = [&] {
+        auto a = build(path_a);
+        auto b = build(path_b);
+        if (!circuits.link({a, b})) {
+            std::cerr << "Linking failed" << std::endl;
+            std::exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        report("linked", transfer(*a->getStreams()));
+        circuits.destroy(a);
+        circuits.destroy(b);
+    };
+    auto stallLater = [&] {
+        std::thread([&link_b] {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            link_b.delay_ms = 400;
+            link_b.bytes_per_sec = link_b.bytes_per_sec / 2;
+        }).detach();
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "links A and B: " << rate / 1024 << " KiB/s, " << delay_ms << " ms" << std::endl;
+    single("single A", path_a);
+    linked();
+
+    link_b.delay_ms = delay_ms + 100;
+    std::cout << "link B " << link_b.delay_ms << " ms" << std::endl;
+    single("single B", path_b);
+    linked();
+
+    std::cout << "link B stalls after 1 s: 400 ms, half rate" << std::endl;
+    reset();
+    stallLater();
+    single("single B", path_b);
+    reset();
+    stallLater();
+    linked();
+
+    // Relays and link threads are not joined
+    std::cout.flush();
+    _exit(0);
+}
@@ -0,0 +1,141 @@
+// Circuit congestion control simulation
+//
+// Simulates a bulk sender on one circuit whose path has a bottleneck relay
+// link of a given rate and a given round-trip time; the receiver returns a
+// circuit-level SENDME for every increment cells that reach it. Compares
+// the fixed 1000-cell SENDME window (acknowledged 100 cells at a time)
+// with CongestionControl, reporting throughput as a share of the
+// bottleneck rate and the queue that builds at the bottleneck.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_congestion.cpp src/core/congestion_control.cpp
+//       -o bench_congestion
+//
+// Usage: ./bench_congestion [seconds]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include "src/include/kermit/congestion_control.h"
+
+namespace {
+
+// Legacy fixed circuit window
+constexpr uint32_t kFixedWindow = 1000;
+constexpr uint32_t kFixedIncrement = 100;
+
+struct Path {
+    const char* name;
+    uint64_t cells_per_sec;     // Bottleneck rate
+    uint64_t rtt_us;            // Propagation round trip, without queueing
+};
+
+struct Result {
+    double throughput_share = 0.0;
+    double mean_queue_ms = 0.0;
+    double max_queue_ms = 0.0;
+    uint32_t final_window = 0;
+};
+
+// Sends whenever the window allows; SENDMEs are the only events
+Result simulate(const Path& path, bool vegas, double seconds) {
+    std::unique_ptr<kermit::CongestionControl> cc;
+    uint32_t increment = kFixedIncrement;
+    if (vegas) {
+        cc = std::make_unique<kermit::CongestionControl>();
+        increment = kermit::CongestionControlConfig().sendme_increment;
+    }
+    uint32_t fixed_inflight = 0;
+
+    uint64_t service_us = 1000000 / path.cells_per_sec;
+    uint64_t one_way_us = path.rtt_us / 2;
+    uint64_t end_us = static_cast<uint64_t>(seconds * 1000000);
+    uint64_t warmup_us = end_us / 4;
+
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> sendmes;
+    uint64_t last_departure = 0;
+    uint64_t received = 0;
+    uint64_t delivered_after_warmup = 0;
+    double queue_sum_us = 0.0;
+    uint64_t queue_samples = 0;
+    uint64_t queue_max_us = 0;
+
+    uint64_t now = 0;
+    while (now < end_us) {
+        // Fill the window
+        while (vegas ? cc->canSend() : fixed_inflight < kFixedWindow) {
+            if (vegas) {
+                cc->onCellSent(now);
+            } else {
+                fixed_inflight++;
+            }
+
+            // Half the propagation delay to the bottleneck, the other half after it
+            uint64_t arrival = now + one_way_us / 2;
+            uint64_t start = std::max(arrival, last_departure);
+            last_departure = start + service_us;
+            uint64_t at_receiver = last_departure + one_way_us / 2;
+
+            if (arrival >= warmup_us) {
+                queue_sum_us += static_cast<double>(start - arrival);
+                queue_samples++;
+                queue_max_us = std::max(queue_max_us, start - arrival);
+            }
+            if (at_receiver >= warmup_us && at_receiver < end_us) {
+                delivered_after_warmup++;
+            }
+            if (++received % increment == 0) {
+                sendmes.push(at_receiver + one_way_us);
+            }
+        }
+
+        if (sendmes.empty()) break;
+        now = sendmes.top();
+        sendmes.pop();
+        if (vegas) {
+            cc->onSendme(now);
+        } else {
+            fixed_inflight -= kFixedIncrement;
+        }
+    }
+
+    Result result;
+    double capacity = path.cells_per_sec * (end_us - warmup_us) / 1000000.0;
+    result.throughput_share = 100.0 * delivered_after_warmup / capacity;
+    result.mean_queue_ms = queue_samples ? queue_sum_us / queue_samples / 1000.0 : 0.0;
+    result.max_queue_ms = queue_max_us / 1000.0;
+    result.final_window = vegas ? cc->getWindow() : kFixedWindow;
+    return result;
+}
+
+void report(const char* policy, const Result& result) {
+    std::cout << "  " << std::left << std::setw(10) << policy << std::right
+              << "throughput " << std::setw(6) << result.throughput_share << "%   queue mean "
+              << std::setw(7) << result.mean_queue_ms << " ms, max " << std::setw(7) << result.max_queue_ms
+              << " ms   window " << result.final_window << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? std::stod(argv[1]) : 60.0;
+
+    const Path paths[] = {
+        {"short path, 2000 cells/s, 30 ms RTT (BDP 60 cells)", 2000, 30000},
+        {"medium path, 5000 cells/s, 100 ms RTT (BDP 500 cells)", 5000, 100000},
+        {"long path, 10000 cells/s, 300 ms RTT (BDP 3000 cells)", 10000, 300000},
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (const Path& path : paths) {
+        std::cout << path.name << std::endl;
+        report("fixed", simulate(path, false, seconds));
+        report("vegas", simulate(path, true, seconds));
+    }
+    return 0;
+}
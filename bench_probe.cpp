@@ -0,0 +1,170 @@
+// Relay probing benchmark on loopback
+//
+// Starts a set of local echo relays, each adding its own artificial delay,
+// and compares the mean 3-hop path latency (sum of the true relay delays)
+// for paths picked before any measurement against paths picked after a few
+// RelayProber rounds have scored the relays.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_probe.cpp src/network/node_manager.cpp
+//       src/network/relay_node.cpp src/network/relay_directory.cpp src/network/relay_id.cpp
+//       src/network/alias_table.cpp src/network/relay_prober.cpp
+//       src/network/channel_pool.cpp src/network/cell.cpp src/network/event_loop.cpp
+//       src/network/backend_pool.cpp src/network/circuit_scheduler.cpp src/network/resolver.cpp
+//       src/core/slab.cpp src/core/log.cpp -pthread -o bench_probe
+//
+// Usage: ./bench_probe [relays] [paths] [rounds]
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <string>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "src/include/kermit/node_manager.h"
+#include "src/include/kermit/network.h"
+#include "src/include/kermit/relay_prober.h"
+
+// Echo relay that waits delay_ms before answering each read
+class DelayedEchoRelay {
+public:
+    explicit DelayedEchoRelay(int delay_ms) : delay_ms_(delay_ms), listen_fd_(-1), port_(0) {}
+
+    bool start() {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) return false;
+
+        int opt = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 128) < 0) {
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, (sockaddr*)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+
+        std::thread(&DelayedEchoRelay::acceptLoop, this).detach();
+        return true;
+    }
+
+    uint16_t port() const { return port_; }
+    int delay() const { return delay_ms_; }
+
+private:
+    void acceptLoop() {
+        while (true) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) return;
+            std::thread(&DelayedEchoRelay::serve, this, fd).detach();
+        }
+    }
+
+    void serve(int fd) {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms_));
+            if (send(fd, buffer, n, MSG_NOSIGNAL) != n) break;
+        }
+        close(fd);
+    }
+
+    int delay_ms_;
+    int listen_fd_;
+    uint16_t port_;
+};
+
+// Mean true latency of paths built from three distinct weighted picks
+static double meanPathLatency(kermit::NodeManager& node_manager, const std::map<std::string, int>& delays,
+                              size_t paths) {
+    uint64_t total = 0;
+    for (size_t p = 0; p < paths; ++p) {
+        std::vector<std::string> hops;
+        while (hops.size() < 3) {
+            auto node = node_manager.selectRelayNode(0);
+            if (!node) return 0;
+            bool repeated = false;
+            for (const auto& hop : hops) {
+                repeated = repeated || hop == node->getNodeId();
+            }
+            if (!repeated) hops.push_back(node->getNodeId());
+        }
+        for (const auto& hop : hops) {
+            total += delays.at(hop);
+        }
+    }
+    return static_cast<double>(total) / paths;
+}
+
+int main(int argc, char* argv[]) {
+    size_t relay_count = argc > 1 ? std::stoul(argv[1]) : 30;
+    size_t paths = argc > 2 ? std::stoul(argv[2]) : 100000;
+    size_t rounds = argc > 3 ? std::stoul(argv[3]) : 3;
+
+    if (relay_count < 3) {
+        std::cerr << "Need at least three relays" << std::endl;
+        return 1;
+    }
+
+    // Delays from 1 ms up to about 60 ms, all with the same advertised bandwidth
+    std::vector<std::unique_ptr<DelayedEchoRelay>> relays;
+    for (size_t i = 0; i < relay_count; ++i) {
+        int delay_ms = 1 + static_cast<int>((i * 59) / (relay_count - 1));
+        relays.push_back(std::make_unique<DelayedEchoRelay>(delay_ms));
+        if (!relays.back()->start()) {
+            std::cerr << "Failed to start echo relay" << std::endl;
+            return 1;
+        }
+    }
+
+    kermit::NodeManager node_manager;
+    std::map<std::string, int> delays;
+    for (const auto& relay : relays) {
+        std::string node_id = "127.0.0.1:" + std::to_string(relay->port());
+        node_manager.addRelayNode(node_id, "127.0.0.1", relay->port());
+        delays[node_id] = relay->delay();
+    }
+
+    double before = meanPathLatency(node_manager, delays, paths);
+
+    kermit::RelayProberConfig config;
+    config.echo_bytes = 512;
+    config.timeout_ms = 1000;
+    kermit::RelayProber prober(node_manager, config);
+
+    auto started = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        prober.probeOnce();
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+
+    double after = meanPathLatency(node_manager, delays, paths);
+    auto stats = prober.getStats();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "relays:                " << relay_count << std::endl;
+    std::cout << "probe rounds:          " << stats.rounds << " (" << stats.probes << " probes, "
+              << stats.failures << " failed, " << elapsed_ms << " ms)" << std::endl;
+    std::cout << "mean 3-hop latency:    " << before << " ms unmeasured, "
+              << after << " ms after probing" << std::endl;
+    std::cout << "improvement:           " << (before > 0 ? 100.0 * (before - after) / before : 0.0)
+              << "%" << std::endl;
+    return 0;
+}
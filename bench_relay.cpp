@@ -0,0 +1,251 @@
+// Relay switching throughput on a loopback testnet
+//
+// Starts three relays in-process (the last one an exit) and a bulk server
+// that sends 4 MiB per connection, then downloads over a number of
+// circuits at once, all on the same three-hop path, so every relay
+// switches the cells of all of them. Runs once with each relay's circuit
+// switch on one thread and once with it sharded over the given number of
+// threads. Reports the aggregate throughput and the slowest circuit.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_relay.cpp $(find src -name '*.cpp' ! -name main.cpp)
+//       -lssl -lcrypto -pthread -o bench_relay
+//
+// Usage: ./bench_relay [circuits] [threads] > /dev/null
+// (results go to stderr; relays log every read on stdout)
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "src/include/kermit/node_manager.h"
+#include "src/include/kermit/network.h"
+#include "src/include/kermit/cell.h"
+#include "src/include/kermit/core.h"
+#include "src/include/kermit/circuit_manager.h"
+#include "src/include/kermit/circuit_switch.h"
+#include "src/include/kermit/stream_mux.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr uint16_t kRelayPort = 19800;   // Relays of run r listen on kRelayPort + 10 * r + hop
+constexpr uint16_t kBulkPort = 19850;
+constexpr uint16_t kHops = 3;
+constexpr size_t kBulkBytes = 4 * 1024 * 1024;
+constexpr auto kTransferTimeout = std::chrono::seconds(60);
+
+// A relay answering on its listen port, as the router wires one up
+class Relay {
+public:
+    Relay(uint16_t port, bool exit, size_t threads) {
+        network_.initialize(port, "127.0.0.1");
+        nodes_.initialize();
+
+        switch_ = std::make_unique<kermit::CircuitSwitch>(nodes_, network_, threads);
+        switch_->setExitEnabled(exit);
+        switch_->setExitAllowPrivate(true);  // Targets are on loopback
+        kermit::CircuitSwitch* circuit_switch = switch_.get();
+        nodes_.getChannelPool()->setCellCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+                circuit_switch->handleChannelCell(channel, cell);
+            });
+        nodes_.getChannelPool()->setCloseCallback(
+            [circuit_switch](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+                circuit_switch->handleChannelClosed(channel);
+            });
+
+        network_.setConnectionCallback([this](kermit::ConnectionHandle id, bool connected) {
+            if (!connected) {
+                assemblers_.erase(id);
+                switch_->handleInboundClosed(id);
+            }
+        });
+        network_.setDataCallback([this](kermit::ConnectionHandle id, const std::vector<uint8_t>& data) {
+            std::vector<kermit::Cell> cells;
+            assemblers_[id].feed(data.data(), data.size(), cells);
+            std::vector<uint8_t> reply;
+            for (const auto& cell : cells) {
+                if (cell.command == kermit::CellCommand::PING) {
+                    kermit::Cell::make(cell.circuit_id, kermit::CellCommand::PONG).appendTo(reply);
+                } else if (cell.command != kermit::CellCommand::PONG &&
+                           cell.command != kermit::CellCommand::PADDING) {
+                    switch_->handleInboundCell(id, cell);
+                }
+            }
+            if (!reply.empty()) network_.sendData(id, reply);
+        });
+
+        network_.start();
+        switch_->start();
+    }
+
+    ~Relay() {
+        network_.stop();
+        switch_->stop();
+    }
+
+    // Relays this one may extend circuits to; EXTENDs naming others are refused
+    void addPeer(const std::string& id, uint16_t port) {
+        nodes_.addRelayNode(id, "127.0.0.1", port);
+    }
+
+private:
+    kermit::NetworkManager network_;
+    kermit::NodeManager nodes_;
+    std::unique_ptr<kermit::CircuitSwitch> switch_;
+    std::unordered_map<kermit::ConnectionHandle, kermit::CellAssembler> assemblers_;
+};
+
+int listenOn(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        std::cerr << "Cannot listen on port " << port << std::endl;
+        std::exit(1);
+    }
+    return fd;
+}
+
+void startBulkServer(uint16_t port) {
+    int listener = listenOn(port);
+    std::thread([listener] {
+        while (true) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) return;
+            std::thread([fd] {
+                char buffer[16384];
+                memset(buffer, 'B', sizeof(buffer));
+                for (size_t total = 0; total < kBulkBytes;) {
+                    ssize_t n = send(fd, buffer, sizeof(buffer), MSG_NOSIGNAL);
+                    if (n <= 0) break;
+                    total += n;
+                }
+                close(fd);
+            }).detach();
+        }
+    }).detach();
+}
+
+// Download kBulkBytes; returns the seconds it took, or 0 if it did not finish
+double download(kermit::StreamMux& streams) {
+    uint16_t bulk = streams.open("127.0.0.1:" + std::to_string(kBulkPort));
+    uint8_t buffer[65536];
+    size_t received = 0;
+    auto start = Clock::now();
+    while (received < kBulkBytes && Clock::now() - start < kTransferTimeout) {
+        size_t n = streams.read(bulk, buffer, sizeof(buffer));
+        received += n;
+        if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    streams.close(bulk);
+    return received >= kBulkBytes ? std::chrono::duration<double>(Clock::now() - start).count() : 0.0;
+}
+
+// Three relays and a client; left running until the process exits, since
+// the channel threads call back into them
+struct Testnet {
+    std::vector<std::unique_ptr<Relay>> relays;
+    kermit::NodeManager nodes;
+    kermit::CircuitManager circuits{nodes};
+};
+
+// Relays with the given switch threads, and circuits downloading through them at once
+void run(Testnet& net, int round, size_t circuit_count, size_t threads) {
+    uint16_t base = kRelayPort + 10 * round;
+    std::vector<std::string> path;
+    for (uint16_t hop = 0; hop < kHops; ++hop) {
+        net.relays.push_back(std::make_unique<Relay>(base + hop, hop == kHops - 1, threads));
+        path.push_back("127.0.0.1:" + std::to_string(base + hop));
+    }
+    for (size_t i = net.relays.size() - kHops; i < net.relays.size(); ++i) {
+        for (uint16_t hop = 0; hop < kHops; ++hop) {
+            net.relays[i]->addPeer(path[hop], base + hop);
+        }
+    }
+
+    kermit::NodeManager& nodes = net.nodes;
+    kermit::CircuitManager& circuits = net.circuits;
+    nodes.initialize();
+    nodes.getChannelPool()->setCellCallback(
+        [&circuits](kermit::ChannelPool::ChannelId channel, kermit::RelayId, const kermit::Cell& cell) {
+            circuits.handleCell(channel, cell);
+        });
+    nodes.getChannelPool()->setCloseCallback([&circuits](kermit::ChannelPool::ChannelId channel, kermit::RelayId) {
+        circuits.handleChannelClosed(channel);
+    });
+    nodes.addRelayNode(path[0], "127.0.0.1", base, true);
+    nodes.connectToRelayNode(path[0]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::vector<std::shared_ptr<kermit::Circuit>> built;
+    for (size_t i = 0; i < circuit_count; ++i) {
+        auto circuit = circuits.build(kermit::CircuitPurpose::GENERAL, path, 5000);
+        if (!circuit) {
+            std::cerr << "Circuit build failed" << std::endl;
+            std::exit(1);
+        }
+        built.push_back(circuit);
+    }
+
+    std::vector<double> seconds(circuit_count);
+    std::vector<std::thread> readers;
+    auto start = Clock::now();
+    for (size_t i = 0; i < circuit_count; ++i) {
+        readers.emplace_back([&, i] { seconds[i] = download(*built[i]->getStreams()); });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    double total = std::chrono::duration<double>(Clock::now() - start).count();
+
+    size_t failed = std::count(seconds.begin(), seconds.end(), 0.0);
+    double slowest = *std::max_element(seconds.begin(), seconds.end());
+    std::cerr << "  " << std::setw(2) << threads << " switch thread(s)   " << std::setw(7)
+              << (circuit_count - failed) * kBulkBytes / 1048576.0 / total << " MiB/s   slowest circuit "
+              << std::setw(6) << slowest << " s   failed " << failed << std::endl;
+
+    for (const auto& circuit : built) {
+        circuits.destroy(circuit);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t circuit_count = argc > 1 ? std::stoul(argv[1]) : 16;
+    size_t threads = argc > 2 ? std::stoul(argv[2]) : std::max(std::thread::hardware_concurrency(), 2u);
+
+    startBulkServer(kBulkPort);
+    std::cerr << std::fixed << std::setprecision(2);
+    std::cerr << circuit_count << " circuits, " << kHops << " hops, " << kBulkBytes / 1048576 << " MiB each, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    std::vector<std::unique_ptr<Testnet>> nets;
+    for (size_t round_threads : {size_t(1), threads}) {
+        nets.push_back(std::make_unique<Testnet>());
+        run(*nets.back(), static_cast<int>(nets.size() - 1), circuit_count, round_threads);
+    }
+
+    // Testnets and server threads are not torn down
+    std::cerr.flush();
+    _exit(0);
+}
@@ -0,0 +1,221 @@
+// Circuit scheduler simulation
+//
+// Simulates one channel whose link drains a fixed number of cells per
+// second, shared by bulk circuits that always have cells waiting and
+// interactive circuits that send a short burst now and then. Cells pass
+// through a modelled kernel send buffer (a FIFO) on their way to the link.
+// Each policy runs in real time so EWMA decay applies:
+//   FIFO        one queue, written into the socket buffer until it is full
+//               (how cells were written before the scheduler)
+//   EWMA        CircuitScheduler, written the same way
+//   EWMA+KIST   CircuitScheduler, written in rounds that only top the
+//               kernel queue up to what a congestion window sends soon
+// Reports the delay of interactive cells and the bulk share of the link.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_scheduler.cpp src/network/circuit_scheduler.cpp
+//       src/network/cell.cpp src/core/slab.cpp src/core/log.cpp -pthread -o bench_scheduler
+//
+// Usage: ./bench_scheduler [seconds] [bulk_circuits] [interactive_circuits] [cells_per_sec]
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include "src/include/kermit/cell.h"
+#include "src/include/kermit/circuit_scheduler.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Cells a bulk circuit keeps queued, like a full SENDME window
+constexpr size_t kBulkBacklog = 100;
+
+// Interactive circuits send 1-3 cells every 50-150 ms
+constexpr int kBurstMinMs = 50;
+constexpr int kBurstMaxMs = 150;
+
+// Kernel send buffer (256 KiB) and the KIST limit: a 10-cell congestion
+// window in flight plus one more window unsent
+constexpr size_t kSocketBufferCells = 512;
+constexpr size_t kKistLimitCells = 20;
+constexpr auto kKistInterval = std::chrono::milliseconds(2);
+
+enum class Policy { FIFO, EWMA, KIST };
+
+struct Result {
+    std::vector<double> interactive_delay_ms;
+    uint64_t bulk_cells = 0;
+    uint64_t total_cells = 0;
+};
+
+// Either a plain FIFO or the EWMA scheduler
+class Queue {
+public:
+    explicit Queue(bool ewma) : ewma_(ewma) {
+        kermit::CircuitSchedulerConfig config;
+        config.halflife_ms = 1000;
+        config.tick_ms = 100;
+        scheduler_ = std::make_unique<kermit::CircuitScheduler>(config);
+    }
+
+    void push(const kermit::Cell& cell) {
+        if (ewma_) {
+            scheduler_->enqueue(cell);
+        } else {
+            fifo_.push_back(cell);
+        }
+    }
+
+    bool pop(kermit::Cell& cell) {
+        if (ewma_) return scheduler_->next(cell);
+        if (fifo_.empty()) return false;
+        cell = fifo_.front();
+        fifo_.pop_front();
+        return true;
+    }
+
+private:
+    bool ewma_;
+    std::deque<kermit::Cell> fifo_;
+    std::unique_ptr<kermit::CircuitScheduler> scheduler_;
+};
+
+// Cells carry their enqueue time in the payload
+kermit::Cell makeCell(uint32_t circuit_id, Clock::time_point now) {
+    kermit::Cell cell = kermit::Cell::make(circuit_id, kermit::CellCommand::RELAY);
+    int64_t stamp = now.time_since_epoch().count();
+    memcpy(cell.payload, &stamp, sizeof(stamp));
+    return cell;
+}
+
+Result run(Policy policy, double seconds, uint32_t bulk, uint32_t interactive, uint32_t cells_per_sec) {
+    Queue queue(policy != Policy::FIFO);
+    std::deque<kermit::Cell> kernel;
+    Result result;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> gap(kBurstMinMs, kBurstMaxMs);
+    std::uniform_int_distribution<int> burst(1, 3);
+
+    // Circuits 1..bulk are bulk, the rest interactive
+    std::vector<size_t> bulk_queued(bulk + 1, 0);
+    std::vector<Clock::time_point> next_burst;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < interactive; ++i) {
+        next_burst.push_back(start + std::chrono::milliseconds(gap(rng)));
+    }
+
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    auto cell_time = std::chrono::nanoseconds(1000000000ull / cells_per_sec);
+    auto next_send = start;
+    auto next_round = start;
+
+    while (true) {
+        auto now = Clock::now();
+        if (now >= end) break;
+
+        for (uint32_t c = 1; c <= bulk; ++c) {
+            while (bulk_queued[c] < kBulkBacklog) {
+                queue.push(makeCell(c, now));
+                bulk_queued[c]++;
+            }
+        }
+        for (uint32_t i = 0; i < interactive; ++i) {
+            if (now < next_burst[i]) continue;
+            int cells = burst(rng);
+            for (int k = 0; k < cells; ++k) {
+                queue.push(makeCell(bulk + 1 + i, now));
+            }
+            next_burst[i] = now + std::chrono::milliseconds(gap(rng));
+        }
+
+        // Move cells from the scheduler into the socket buffer
+        size_t limit = kSocketBufferCells;
+        if (policy == Policy::KIST) {
+            limit = now >= next_round ? kKistLimitCells : 0;
+            if (now >= next_round) next_round = now + kKistInterval;
+        }
+        kermit::Cell cell;
+        while (kernel.size() < limit && queue.pop(cell)) {
+            kernel.push_back(cell);
+        }
+
+        // The link takes one cell per cell_time from the socket buffer
+        while (next_send <= now) {
+            if (kernel.empty()) {
+                next_send = now;
+                break;
+            }
+            cell = kernel.front();
+            kernel.pop_front();
+            next_send += cell_time;
+            result.total_cells++;
+
+            if (cell.circuit_id <= bulk) {
+                bulk_queued[cell.circuit_id]--;
+                result.bulk_cells++;
+            } else {
+                int64_t stamp;
+                memcpy(&stamp, cell.payload, sizeof(stamp));
+                auto queued = now - Clock::time_point(Clock::duration(stamp));
+                result.interactive_delay_ms.push_back(std::chrono::duration<double, std::milli>(queued).count());
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return result;
+}
+
+double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0.0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void report(const char* name, Result& result) {
+    double sum = 0.0;
+    for (double delay : result.interactive_delay_ms) {
+        sum += delay;
+    }
+    double mean = result.interactive_delay_ms.empty() ? 0.0 : sum / result.interactive_delay_ms.size();
+    double p50 = percentile(result.interactive_delay_ms, 0.5);
+    double p99 = percentile(result.interactive_delay_ms, 0.99);
+
+    std::cout << name << std::endl;
+    std::cout << "  interactive cells:     " << result.interactive_delay_ms.size() << std::endl;
+    std::cout << "  interactive delay:     mean " << mean << " ms, p50 " << p50 << " ms, p99 " << p99 << " ms"
+              << std::endl;
+    std::cout << "  bulk share of link:    "
+              << (result.total_cells ? 100.0 * result.bulk_cells / result.total_cells : 0.0) << "%" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? std::stod(argv[1]) : 5.0;
+    uint32_t bulk = argc > 2 ? std::stoul(argv[2]) : 4;
+    uint32_t interactive = argc > 3 ? std::stoul(argv[3]) : 8;
+    uint32_t cells_per_sec = argc > 4 ? std::stoul(argv[4]) : 5000;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "link:                    " << cells_per_sec << " cells/s, " << bulk << " bulk and " << interactive
+              << " interactive circuits, " << seconds << " s per policy" << std::endl;
+
+    Result fifo = run(Policy::FIFO, seconds, bulk, interactive, cells_per_sec);
+    report("FIFO", fifo);
+
+    Result ewma = run(Policy::EWMA, seconds, bulk, interactive, cells_per_sec);
+    report("EWMA", ewma);
+
+    Result kist = run(Policy::KIST, seconds, bulk, interactive, cells_per_sec);
+    report("EWMA+KIST", kist);
+    return 0;
+}
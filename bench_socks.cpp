@@ -0,0 +1,227 @@
+// SOCKS5 front end benchmark on loopback
+//
+// Runs a SocksServer on its own EventLoop in front of a local echo service
+// and measures connections/sec and time-to-first-byte (connect, SOCKS
+// handshake and one echoed byte) from several client threads.
+//
+// Build (one command):
+//   g++ -std=c++17 -O2 -Isrc/include bench_socks.cpp src/network/event_loop.cpp
+//       src/network/socks_server.cpp src/network/backend_pool.cpp src/network/resolver.cpp
+//       src/core/expose_service.cpp src/core/log.cpp -pthread -o bench_socks
+//
+// Usage: ./bench_socks [threads] [connections_per_thread] [--no-pool]
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "src/include/kermit/event_loop.h"
+#include "src/include/kermit/socks_server.h"
+#include "src/include/kermit/backend_pool.h"
+#include "src/include/kermit/expose_service.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Minimal echo service on its own loop
+class EchoServer {
+public:
+    explicit EchoServer(kermit::EventLoop& loop) : loop_(loop), listen_fd_(-1), port_(0) {}
+
+    bool start() {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int opt = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, SOMAXCONN) < 0) {
+            return false;
+        }
+
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, (sockaddr*)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+
+        return loop_.addFd(listen_fd_, kermit::EventLoop::READABLE, [this](uint32_t) { accept(); });
+    }
+
+    uint16_t getPort() const { return port_; }
+
+private:
+    void accept() {
+        int fd;
+        while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            loop_.addFd(fd, kermit::EventLoop::READABLE, [this, fd](uint32_t) { echo(fd); });
+        }
+    }
+
+    void echo(int fd) {
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            send(fd, buffer, n, MSG_NOSIGNAL);
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            loop_.removeFd(fd);
+            close(fd);
+        }
+    }
+
+    kermit::EventLoop& loop_;
+    int listen_fd_;
+    uint16_t port_;
+};
+
+bool readExactly(int fd, uint8_t* buffer, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buffer + got, len - got, 0);
+        if (n <= 0) return false;
+        got += n;
+    }
+    return true;
+}
+
+// One client session: connect, pipelined greeting + CONNECT + payload, read echo
+// Returns time to first echoed byte in microseconds, or -1 on failure
+double runClient(uint16_t socks_port, const std::string& service_hash) {
+    auto begin = Clock::now();
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(socks_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t request[64];
+    size_t len = 0;
+    request[len++] = 5; request[len++] = 1; request[len++] = 0;               // Greeting
+    request[len++] = 5; request[len++] = 1; request[len++] = 0; request[len++] = 3;
+    request[len++] = static_cast<uint8_t>(service_hash.size());
+    memcpy(request + len, service_hash.data(), service_hash.size());
+    len += service_hash.size();
+    request[len++] = 0; request[len++] = 80;                                  // Port
+    request[len++] = 'x';                                                     // Early data
+
+    uint8_t reply[13];
+    bool ok = send(fd, request, len, MSG_NOSIGNAL) == static_cast<ssize_t>(len) &&
+              readExactly(fd, reply, sizeof(reply)) &&
+              reply[1] == 0 && reply[3] == 0 && reply[12] == 'x';
+
+    auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - begin).count();
+    close(fd);
+    return ok ? elapsed : -1;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    int per_thread = argc > 2 ? std::atoi(argv[2]) : 2000;
+    bool use_pool = !(argc > 3 && std::string(argv[3]) == "--no-pool");
+
+    std::cout << "SOCKS5 loopback benchmark: " << threads << " threads x " << per_thread
+              << " connections, backend pool " << (use_pool ? "on" : "off") << std::endl;
+
+    kermit::EventLoop echo_loop;
+    echo_loop.initialize();
+    EchoServer echo(echo_loop);
+    if (!echo.start()) {
+        std::cerr << "Failed to start echo server" << std::endl;
+        return 1;
+    }
+    std::thread echo_thread([&] { echo_loop.run(); });
+
+    kermit::ServiceRegistry registry;
+    std::shared_ptr<kermit::BackendPool> pool;
+    if (use_pool) {
+        kermit::BackendPoolConfig pool_config;
+        pool_config.min_idle = 64;
+        pool_config.max_idle = 256;
+        pool = std::make_shared<kermit::BackendPool>(pool_config);
+        pool->start();
+        registry.setBackendPool(pool);
+    }
+    std::string service_hash = registry.exposeService("127.0.0.1:" + std::to_string(echo.getPort()));
+
+    kermit::EventLoop loop;
+    loop.initialize();
+    kermit::SocksServer socks(loop, registry);
+    if (!socks.start(0)) {
+        std::cerr << "Failed to start SOCKS server" << std::endl;
+        return 1;
+    }
+    std::thread loop_thread([&] { loop.run(); });
+
+    // Let the pool pre-warm
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<std::vector<double>> samples(threads);
+    std::atomic<int> failures(0);
+    auto begin = Clock::now();
+
+    std::vector<std::thread> clients;
+    for (int t = 0; t < threads; ++t) {
+        clients.emplace_back([&, t] {
+            samples[t].reserve(per_thread);
+            for (int i = 0; i < per_thread; ++i) {
+                double ttfb = runClient(socks.getPort(), service_hash);
+                if (ttfb < 0) {
+                    failures++;
+                } else {
+                    samples[t].push_back(ttfb);
+                }
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::vector<double> all;
+    for (const auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Connections:     " << all.size() << " ok, " << failures << " failed" << std::endl;
+    std::cout << "Throughput:      " << all.size() / seconds << " connections/sec" << std::endl;
+    std::cout << "TTFB p50:        " << percentile(0.50) << " us" << std::endl;
+    std::cout << "TTFB p90:        " << percentile(0.90) << " us" << std::endl;
+    std::cout << "TTFB p99:        " << percentile(0.99) << " us" << std::endl;
+
+    if (pool) {
+        auto stats = pool->getStats();
+        std::cout << "Pool hits/misses: " << stats.hits << "/" << stats.misses << std::endl;
+    }
+
+    loop.post([&] { socks.stop(); loop.stop(); });
+    loop_thread.join();
+    echo_loop.stop();
+    echo_thread.join();
+    return failures == 0 ? 0 : 1;
+}
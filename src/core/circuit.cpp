@@ -1,21 +1,34 @@
 #include "kermit/core.h"
-#include <iostream>
+#include "kermit/stream_mux.h"
+#include "kermit/slab.h"
+#include "kermit/log.h"
 #include <memory>
 #include <vector>
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <atomic>
+#include <chrono>
 
 namespace kermit {
 
 // Circuit implementation
-class Circuit::Impl {
+class Circuit::Impl : public SlabAllocated {
 public:
-    CircuitState state_;
+    std::atomic<CircuitState> state_;
     std::string circuit_id_;
     std::vector<std::string> nodes_;
+    CircuitPurpose purpose_;
+    uint64_t channel_;
+    uint32_t wire_id_;
+    uint32_t build_time_ms_;
+    std::atomic<bool> dirty_;
+    std::chrono::steady_clock::time_point created_;
+    std::shared_ptr<StreamMux> streams_;
+    uint32_t stream_leg_;
     
-    Impl() : state_(CircuitState::NEW) {
+    Impl() : state_(CircuitState::NEW), purpose_(CircuitPurpose::GENERAL), channel_(0), wire_id_(0),
+             build_time_ms_(0), dirty_(false), created_(std::chrono::steady_clock::now()), stream_leg_(0) {
         // Generate a random circuit ID
         std::random_device rd;
         std::mt19937 gen(rd());
@@ -34,30 +47,29 @@ public:
     
     bool extend(const std::string& node_id) {
         if (state_ == CircuitState::CLOSED || state_ == CircuitState::FAILED) {
-            std::cerr << "Cannot extend closed or failed circuit" << std::endl;
+            KERMIT_ERROR << "Cannot extend closed or failed circuit";
             return false;
         }
         
         nodes_.push_back(node_id);
         
-        if (state_ == CircuitState::NEW) {
-            state_ = CircuitState::BUILDING;
-        }
+        CircuitState expected = CircuitState::NEW;
+        state_.compare_exchange_strong(expected, CircuitState::BUILDING);
         
-        std::cout << "Extended circuit " << circuit_id_ << " with node " << node_id 
-                  << " (hop count: " << nodes_.size() << ")" << std::endl;
+        KERMIT_INFO << "Extended circuit " << circuit_id_ << " with node " << node_id 
+                    << " (hop count: " << nodes_.size() << ")";
         
         return true;
     }
     
     bool sendData(const std::vector<uint8_t>& data) {
         if (state_ != CircuitState::ESTABLISHED) {
-            std::cerr << "Cannot send data on non-established circuit" << std::endl;
+            KERMIT_ERROR << "Cannot send data on non-established circuit";
             return false;
         }
         
-        std::cout << "Sending " << data.size() << " bytes through circuit " << circuit_id_ 
-                  << " (" << nodes_.size() << " hops)" << std::endl;
+        KERMIT_DEBUG << "Sending " << data.size() << " bytes through circuit " << circuit_id_ 
+                     << " (" << nodes_.size() << " hops)";
         
         // TODO: Actual data sending through the circuit
         return true;
@@ -65,11 +77,11 @@ public:
     
     std::vector<uint8_t> receiveData() {
         if (state_ != CircuitState::ESTABLISHED) {
-            std::cerr << "Cannot receive data on non-established circuit" << std::endl;
+            KERMIT_ERROR << "Cannot receive data on non-established circuit";
             return {};
         }
         
-        std::cout << "Receiving data from circuit " << circuit_id_ << std::endl;
+        KERMIT_DEBUG << "Receiving data from circuit " << circuit_id_;
         
         // TODO: Actual data receiving
         return {};
@@ -121,4 +133,67 @@ const std::string& Circuit::getCircuitId() const {
     return impl_->getCircuitId();
 }
 
+void Circuit::setState(CircuitState state) {
+    impl_->setState(state);
+}
+
+CircuitPurpose Circuit::getPurpose() const {
+    return impl_->purpose_;
+}
+
+void Circuit::setPurpose(CircuitPurpose purpose) {
+    impl_->purpose_ = purpose;
+}
+
+const std::vector<std::string>& Circuit::getPath() const {
+    return impl_->nodes_;
+}
+
+uint64_t Circuit::getChannel() const {
+    return impl_->channel_;
+}
+
+uint32_t Circuit::getWireId() const {
+    return impl_->wire_id_;
+}
+
+void Circuit::attach(uint64_t channel, uint32_t wire_id) {
+    impl_->channel_ = channel;
+    impl_->wire_id_ = wire_id;
+}
+
+uint32_t Circuit::getBuildTimeMs() const {
+    return impl_->build_time_ms_;
+}
+
+void Circuit::setBuildTimeMs(uint32_t build_time_ms) {
+    impl_->build_time_ms_ = build_time_ms;
+}
+
+bool Circuit::isDirty() const {
+    return impl_->dirty_;
+}
+
+void Circuit::markDirty() {
+    impl_->dirty_ = true;
+}
+
+uint64_t Circuit::getAgeMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - impl_->created_).count();
+}
+
+std::shared_ptr<StreamMux> Circuit::getStreams() const {
+    return impl_->streams_;
+}
+
+uint32_t Circuit::getStreamLeg() const {
+    return impl_->stream_leg_;
+}
+
+void Circuit::attachStreams(std::shared_ptr<StreamMux> streams, uint32_t leg) {
+    impl_->streams_ = std::move(streams);
+    impl_->stream_leg_ = leg;
+}
+
 } // namespace kermit
\ No newline at end of file
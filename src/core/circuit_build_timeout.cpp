@@ -0,0 +1,159 @@
+#include "kermit/circuit_build_timeout.h"
+#include "kermit/log.h"
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <cmath>
+
+namespace kermit {
+
+namespace {
+
+// Ring entry for a build abandoned at max_timeout_ms
+constexpr uint32_t kAbandoned = 0;
+
+} // namespace
+
+CircuitBuildTimeoutConfig::CircuitBuildTimeoutConfig()
+    : quantile(0.8),
+      initial_timeout_ms(60000),
+      min_timeout_ms(1500),
+      max_timeout_ms(300000),
+      min_samples(50),
+      max_samples(1000),
+      bin_width_ms(10),
+      xm_modes(10),
+      recent_window(20),
+      recent_timeout_limit(9) {}
+
+CircuitBuildTimeout::CircuitBuildTimeout(const CircuitBuildTimeoutConfig& config)
+    : config_(config), next_sample_(0), next_recent_(0), timeout_ms_(0), xm_(0.0), alpha_(0.0) {
+    reset(std::min(config_.initial_timeout_ms, config_.max_timeout_ms));
+}
+
+void CircuitBuildTimeout::recordBuildTime(uint32_t build_ms) {
+    build_ms = std::max<uint32_t>(build_ms, 1);
+    if (samples_.size() < config_.max_samples) {
+        samples_.push_back(build_ms);
+    } else {
+        samples_[next_sample_] = build_ms;
+        next_sample_ = (next_sample_ + 1) % samples_.size();
+    }
+    recompute();
+}
+
+void CircuitBuildTimeout::recordAbandoned() {
+    if (samples_.size() < config_.max_samples) {
+        samples_.push_back(kAbandoned);
+    } else {
+        samples_[next_sample_] = kAbandoned;
+        next_sample_ = (next_sample_ + 1) % samples_.size();
+    }
+    recompute();
+}
+
+void CircuitBuildTimeout::recordOutcome(bool timed_out) {
+    if (recent_.empty()) return;
+
+    recent_[next_recent_] = timed_out;
+    next_recent_ = (next_recent_ + 1) % recent_.size();
+
+    size_t timeouts = std::count(recent_.begin(), recent_.end(), true);
+    if (timeouts > config_.recent_timeout_limit) {
+        uint32_t timeout_ms = std::min(std::max(timeout_ms_ * 2, config_.initial_timeout_ms), config_.max_timeout_ms);
+        KERMIT_WARN << timeouts << " of the last " << recent_.size() << " circuit builds timed out, "
+                    << "resetting the build timeout to " << timeout_ms << " ms";
+        reset(timeout_ms);
+    }
+}
+
+uint32_t CircuitBuildTimeout::getTimeoutMs() const {
+    return timeout_ms_;
+}
+
+size_t CircuitBuildTimeout::getSampleCount() const {
+    return samples_.size();
+}
+
+double CircuitBuildTimeout::getXm() const {
+    return xm_;
+}
+
+double CircuitBuildTimeout::getAlpha() const {
+    return alpha_;
+}
+
+void CircuitBuildTimeout::recompute() {
+    if (samples_.size() < config_.min_samples) return;
+
+    // Xm: weighted average of the most frequent bins
+    std::unordered_map<uint32_t, size_t> histogram;
+    uint32_t max_time = 0;
+    for (uint32_t sample : samples_) {
+        if (sample == kAbandoned) continue;
+        histogram[sample / config_.bin_width_ms]++;
+        max_time = std::max(max_time, sample);
+    }
+    if (histogram.empty()) return;
+
+    std::vector<std::pair<size_t, uint32_t>> bins;
+    bins.reserve(histogram.size());
+    for (const auto& entry : histogram) {
+        bins.emplace_back(entry.second, entry.first);
+    }
+    size_t modes = std::min(config_.xm_modes, bins.size());
+    std::partial_sort(bins.begin(), bins.begin() + modes, bins.end(),
+                      [](const std::pair<size_t, uint32_t>& a, const std::pair<size_t, uint32_t>& b) {
+                          return a.first > b.first;
+                      });
+
+    double weighted = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < modes; ++i) {
+        weighted += bins[i].first * (bins[i].second * static_cast<double>(config_.bin_width_ms) +
+                                     config_.bin_width_ms / 2.0);
+        count += bins[i].first;
+    }
+    double xm = weighted / count;
+
+    // Alpha: Pareto MLE, abandoned builds censored at the slowest completed one
+    double log_sum = 0.0;
+    size_t completed = 0;
+    size_t abandoned = 0;
+    for (uint32_t sample : samples_) {
+        if (sample == kAbandoned) {
+            abandoned++;
+        } else {
+            log_sum += std::log(std::max<double>(sample, xm));
+            completed++;
+        }
+    }
+    log_sum += abandoned * std::log(std::max<double>(max_time, xm));
+    log_sum -= (completed + abandoned) * std::log(xm);
+
+    double timeout;
+    if (log_sum <= 0.0) {
+        // Every build took about Xm
+        alpha_ = 0.0;
+        timeout = xm;
+    } else {
+        alpha_ = completed / log_sum;
+        timeout = xm / std::pow(1.0 - config_.quantile, 1.0 / alpha_);
+    }
+    xm_ = xm;
+
+    timeout = std::min<double>(std::max<double>(timeout, config_.min_timeout_ms), config_.max_timeout_ms);
+    timeout_ms_ = static_cast<uint32_t>(timeout);
+}
+
+void CircuitBuildTimeout::reset(uint32_t timeout_ms) {
+    samples_.clear();
+    next_sample_ = 0;
+    recent_.assign(config_.recent_window, false);
+    next_recent_ = 0;
+    timeout_ms_ = timeout_ms;
+    xm_ = 0.0;
+    alpha_ = 0.0;
+}
+
+} // namespace kermit
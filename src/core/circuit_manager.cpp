@@ -0,0 +1,826 @@
+#include "kermit/circuit_manager.h"
+#include "kermit/node_manager.h"
+#include "kermit/network.h"
+#include "kermit/cell.h"
+#include "kermit/stream_mux.h"
+#include "kermit/event_loop.h"
+#include "kermit/slab.h"
+#include "kermit/log.h"
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Attempts build(purpose) may have racing, counting the first
+constexpr size_t kMaxBuildAttempts = 3;
+
+// How often build deadlines are checked
+constexpr uint32_t kBuildTickMs = 50;
+
+bool isBuilding(const std::shared_ptr<Circuit>& circuit) {
+    auto state = circuit->getState();
+    return state == Circuit::CircuitState::NEW || state == Circuit::CircuitState::BUILDING;
+}
+
+} // namespace
+
+// CircuitManager implementation
+class CircuitManager::Impl {
+public:
+    // One build(purpose): attempts on different paths racing to finish
+    struct BuildJob {
+        CircuitPurpose purpose;
+        BuildCallback callback;
+        Clock::time_point hard_deadline;
+        Clock::time_point deadline;     // Adaptive timeout of the newest attempt
+        std::vector<std::shared_ptr<Circuit>> attempts;
+        std::shared_ptr<Circuit> latest;
+        size_t launched;
+        bool done;
+    };
+
+    // Build progress, advanced by handleCell
+    struct Entry {
+        std::shared_ptr<Circuit> circuit;
+        ChannelPool::ChannelId channel;
+        std::vector<std::string> path;
+        size_t hops_open;           // Hops that answered CREATED or EXTENDED
+        Clock::time_point started;
+        bool timed_out;             // Already counted as past the adaptive timeout
+        bool detached;              // Lost a relaunch race; kept only to measure it
+        bool pipelined;             // Every EXTEND went out with CREATE
+        BuildCallback callback;
+        std::shared_ptr<BuildJob> job;
+    };
+
+    // A finished build, reported once mutex_ is released
+    struct Completion {
+        std::shared_ptr<Circuit> circuit;
+        bool established;
+        BuildCallback callback;
+        std::shared_ptr<BuildJob> job;
+    };
+
+    // Job callbacks to run once jobs_mutex_ is released
+    using Finished = std::vector<std::pair<BuildCallback, std::shared_ptr<Circuit>>>;
+
+    NodeManager& node_manager_;
+    mutable std::mutex mutex_;
+    std::condition_variable progress_;
+    std::unordered_map<uint32_t, Entry> circuits_;
+    uint32_t next_wire_id_;
+    CircuitBuildTimeout build_timeout_;
+    uint32_t max_timeout_ms_;
+    std::atomic<bool> pipelining_;
+
+    // Taken before mutex_ when both are needed
+    std::mutex jobs_mutex_;
+    std::vector<std::shared_ptr<BuildJob>> jobs_;
+    EventLoop* loop_;
+    int timer_id_;
+
+    std::atomic<uint64_t> builds_started_;
+    std::atomic<uint64_t> builds_succeeded_;
+    std::atomic<uint64_t> builds_failed_;
+    std::atomic<uint64_t> builds_timed_out_;
+    std::atomic<uint64_t> builds_abandoned_;
+    std::atomic<uint64_t> relaunches_;
+    std::atomic<uint64_t> late_completions_;
+
+    Impl(NodeManager& node_manager, const CircuitBuildTimeoutConfig& timeout_config)
+        : node_manager_(node_manager), next_wire_id_(1), build_timeout_(timeout_config),
+          max_timeout_ms_(timeout_config.max_timeout_ms), pipelining_(true), loop_(nullptr), timer_id_(-1),
+          builds_started_(0), builds_succeeded_(0), builds_failed_(0), builds_timed_out_(0), builds_abandoned_(0),
+          relaunches_(0), late_completions_(0) {}
+
+    ~Impl() {
+        if (timer_id_ < 0) return;
+        loop_->cancelTimer(timer_id_);
+
+        // A tick may be running on the loop thread; none is once a task
+        // posted after the cancel has run
+        if (loop_->isRunning() && !loop_->isInLoopThread()) {
+            auto ran = std::make_shared<std::promise<void>>();
+            std::future<void> done = ran->get_future();
+            loop_->post([ran] { ran->set_value(); });
+            while (loop_->isRunning() && done.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+            }
+        }
+    }
+
+    std::vector<std::string> selectPath(CircuitPurpose purpose, size_t hops) const {
+        std::vector<std::string> path;
+        if (hops == 0) return path;
+
+        // The first hop must already have a channel, so prefer connected guards
+        std::shared_ptr<RelayNode> first =
+            node_manager_.selectRelayNode(RelayDirectory::CONNECTED | RelayDirectory::GUARD);
+        if (!first) first = node_manager_.selectRelayNode(RelayDirectory::CONNECTED);
+        if (!first) first = node_manager_.getRandomGuardNode();
+        if (!first) first = node_manager_.getRandomRelayNode();
+        if (!first) return path;
+        path.push_back(first->getNodeId());
+
+        uint8_t last_flags = purpose == CircuitPurpose::HIDDEN_SERVICE ? RelayDirectory::HIDDEN_SERVICES
+                                                                       : RelayDirectory::EXIT;
+        for (size_t hop = 1; hop < hops; ++hop) {
+            uint8_t required = hop + 1 == hops ? last_flags : 0;
+
+            // A few weighted draws usually find a relay not yet on the path
+            std::shared_ptr<RelayNode> node;
+            for (int attempt = 0; attempt < 16 && !node; ++attempt) {
+                auto candidate = node_manager_.selectRelayNode(attempt < 8 ? required : 0);
+                if (candidate && std::find(path.begin(), path.end(), candidate->getNodeId()) == path.end()) {
+                    node = candidate;
+                }
+            }
+            if (!node) break;
+            path.push_back(node->getNodeId());
+        }
+        return path;
+    }
+
+    std::shared_ptr<Circuit> launch(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                    BuildCallback callback, std::shared_ptr<BuildJob> job) {
+        builds_started_++;
+        ChannelPool* pool = node_manager_.getChannelPool();
+        if (path.empty() || !pool) {
+            builds_failed_++;
+            return nullptr;
+        }
+
+        ChannelPool::ChannelId channel = node_manager_.acquireChannel(path[0]);
+        if (channel == ChannelPool::kInvalidChannel) {
+            // Warm it for the next attempt rather than connecting on this one
+            node_manager_.connectToRelayNode(path[0]);
+            builds_failed_++;
+            return nullptr;
+        }
+
+        auto circuit = std::allocate_shared<Circuit>(SlabAllocator<Circuit>());
+        circuit->setPurpose(purpose);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        expireDetached();
+
+        uint32_t wire_id;
+        do {
+            wire_id = kOriginCircuitBit | (next_wire_id_++ & ~kOriginCircuitBit);
+        } while (wire_id == kOriginCircuitBit || circuits_.count(wire_id));
+        circuit->attach(channel, wire_id);
+
+        // Replies are handled under mutex_, so none can overtake the entry
+        bool pipelined = pipelining_;
+        bool sent = pool->send(channel, Cell::make(wire_id, CellCommand::CREATE));
+        for (size_t hop = 1; sent && pipelined && hop < path.size(); ++hop) {
+            sent = pool->send(channel, makeExtend(wire_id, path, hop));
+        }
+        if (!sent) {
+            if (pipelined) pool->send(channel, Cell::make(wire_id, CellCommand::DESTROY));
+            circuit->setState(Circuit::CircuitState::FAILED);
+            builds_failed_++;
+            return nullptr;
+        }
+        circuits_[wire_id] = Entry{circuit, channel, path, 0, Clock::now(), false, false, pipelined,
+                                   std::move(callback), std::move(job)};
+        return circuit;
+    }
+
+    // EXTEND to path[hop], addressed to the hop before it
+    static Cell makeExtend(uint32_t wire_id, const std::vector<std::string>& path, size_t hop) {
+        const std::string& next = path[hop];
+        return Cell::makeRelay(wire_id, static_cast<uint8_t>(hop - 1), RelayCommand::EXTEND, 0,
+                               reinterpret_cast<const uint8_t*>(next.data()), next.size());
+    }
+
+    // Wait until one of circuits is established or none is still building
+    // Returns the established circuit, nullptr on failure or at the deadline
+    std::shared_ptr<Circuit> waitForAny(const std::vector<std::shared_ptr<Circuit>>& circuits,
+                                        Clock::time_point deadline) {
+        std::shared_ptr<Circuit> established;
+        std::unique_lock<std::mutex> lock(mutex_);
+        progress_.wait_until(lock, deadline, [&circuits, &established] {
+            bool building = false;
+            for (const auto& circuit : circuits) {
+                if (circuit->getState() == Circuit::CircuitState::ESTABLISHED) {
+                    established = circuit;
+                    return true;
+                }
+                building = building || isBuilding(circuit);
+            }
+            return !building;
+        });
+        return established;
+    }
+
+    std::shared_ptr<Circuit> build(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                   uint32_t timeout_ms) {
+        auto circuit = launch(purpose, path, nullptr, nullptr);
+        if (!circuit) return nullptr;
+
+        auto established = waitForAny({circuit}, Clock::now() + std::chrono::milliseconds(timeout_ms));
+        if (!established) {
+            abandon(circuit, isBuilding(circuit));
+        }
+        return established;
+    }
+
+    std::shared_ptr<Circuit> build(CircuitPurpose purpose) {
+        struct Result {
+            std::mutex mutex;
+            std::condition_variable finished;
+            bool done = false;
+            std::shared_ptr<Circuit> circuit;
+        };
+        auto result = std::make_shared<Result>();
+        buildAsync(purpose, [result](const std::shared_ptr<Circuit>& circuit) {
+            std::lock_guard<std::mutex> lock(result->mutex);
+            result->circuit = circuit;
+            result->done = true;
+            result->finished.notify_all();
+        });
+
+        // The job gives up by itself at the hard timeout; the margin only
+        // covers a channel loop that stopped running
+        std::unique_lock<std::mutex> lock(result->mutex);
+        result->finished.wait_for(lock, std::chrono::milliseconds(max_timeout_ms_) + std::chrono::seconds(1),
+                                  [&result] { return result->done; });
+        return result->circuit;
+    }
+
+    void buildAsync(CircuitPurpose purpose, BuildCallback callback) {
+        auto job = std::make_shared<BuildJob>();
+        job->purpose = purpose;
+        job->callback = std::move(callback);
+        job->hard_deadline = Clock::now() + std::chrono::milliseconds(max_timeout_ms_);
+        job->launched = 0;
+        job->done = false;
+
+        Finished finished;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            if (!startTimer()) {
+                finished.emplace_back(job->callback, nullptr);
+            } else {
+                jobs_.push_back(job);
+                relaunch(job, finished);
+            }
+        }
+        runFinished(finished);
+    }
+
+    // Deadlines are checked on the channel loop, started with the first job
+    // Caller holds jobs_mutex_
+    bool startTimer() {
+        if (timer_id_ >= 0) return true;
+        loop_ = node_manager_.getEventLoop();
+        if (!loop_) return false;
+        timer_id_ = loop_->addTimer(kBuildTickMs, [this] { tick(); });
+        return timer_id_ >= 0;
+    }
+
+    // Launch the next attempt of a job with a full adaptive timeout; once
+    // none is left the others race until the hard timeout, or the job fails
+    // Caller holds jobs_mutex_
+    void relaunch(const std::shared_ptr<BuildJob>& job, Finished& finished) {
+        job->latest = nullptr;
+        while (job->launched < kMaxBuildAttempts) {
+            if (job->launched > 0) relaunches_++;
+            job->launched++;
+
+            auto circuit = launch(job->purpose, selectPath(job->purpose, 3), nullptr, job);
+            if (circuit) {
+                job->attempts.push_back(circuit);
+                job->latest = circuit;
+                job->deadline = std::min(job->hard_deadline,
+                                         Clock::now() + std::chrono::milliseconds(getBuildTimeoutMs()));
+                return;
+            }
+        }
+
+        if (job->attempts.empty()) {
+            finishJob(job, nullptr, finished);
+        } else {
+            job->deadline = job->hard_deadline;
+        }
+    }
+
+    // Caller holds jobs_mutex_
+    void finishJob(const std::shared_ptr<BuildJob>& job, const std::shared_ptr<Circuit>& circuit,
+                   Finished& finished) {
+        job->done = true;
+        jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+        finished.emplace_back(job->callback, circuit);
+    }
+
+    void runFinished(const Finished& finished) {
+        for (const auto& entry : finished) {
+            if (entry.first) entry.first(entry.second);
+        }
+    }
+
+    // One attempt of a job finished: the first established wins, and a job
+    // whose attempts all failed launches another
+    void onAttemptDone(const std::shared_ptr<BuildJob>& job, const std::shared_ptr<Circuit>& circuit,
+                       bool established) {
+        Finished finished;
+        std::vector<std::shared_ptr<Circuit>> others;
+        bool surplus = false;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            auto& attempts = job->attempts;
+            attempts.erase(std::remove(attempts.begin(), attempts.end(), circuit), attempts.end());
+            if (job->latest == circuit) job->latest = nullptr;
+
+            if (job->done) {
+                // Finished alongside the winner
+                surplus = established;
+            } else if (established) {
+                others.swap(attempts);
+                finishJob(job, circuit, finished);
+            } else if (attempts.empty()) {
+                relaunch(job, finished);
+            }
+        }
+
+        if (surplus) {
+            destroy(circuit);
+        }
+        if (!others.empty()) {
+            detachOthers(others, circuit);
+        }
+        runFinished(finished);
+    }
+
+    // Finish every job with nullptr and give up on its attempts
+    void cancelBuilds() {
+        Finished finished;
+        std::vector<std::shared_ptr<Circuit>> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            auto jobs = jobs_;
+            for (const auto& job : jobs) {
+                abandoned.insert(abandoned.end(), job->attempts.begin(), job->attempts.end());
+                job->attempts.clear();
+                job->latest = nullptr;
+                finishJob(job, nullptr, finished);
+            }
+        }
+
+        // Cut short rather than slow, so the timeout model is left alone
+        for (const auto& circuit : abandoned) {
+            abandon(circuit, false, false);
+        }
+        runFinished(finished);
+    }
+
+    // Runs on the channel loop every kBuildTickMs
+    void tick() {
+        Finished finished;
+        std::vector<std::shared_ptr<Circuit>> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            auto now = Clock::now();
+            auto jobs = jobs_;
+            for (const auto& job : jobs) {
+                if (now >= job->hard_deadline) {
+                    abandoned.insert(abandoned.end(), job->attempts.begin(), job->attempts.end());
+                    job->attempts.clear();
+                    finishJob(job, nullptr, finished);
+                } else if (job->latest && now >= job->deadline) {
+                    markTimedOut(job->latest);
+                    relaunch(job, finished);
+                }
+            }
+        }
+
+        for (const auto& circuit : abandoned) {
+            abandon(circuit, false);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            expireDetached();
+        }
+        runFinished(finished);
+    }
+
+    // Count a build that ran past the adaptive timeout but keep it going
+    void markTimedOut(const std::shared_ptr<Circuit>& circuit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = circuits_.find(circuit->getWireId());
+        if (it == circuits_.end() || it->second.circuit != circuit || it->second.timed_out) return;
+        it->second.timed_out = true;
+        builds_timed_out_++;
+        build_timeout_.recordOutcome(true);
+    }
+
+    // Leave the losers of a relaunch race building so their times are
+    // still measured; they close themselves when they finish
+    void detachOthers(const std::vector<std::shared_ptr<Circuit>>& attempts,
+                      const std::shared_ptr<Circuit>& winner) {
+        std::vector<std::shared_ptr<Circuit>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& circuit : attempts) {
+                if (circuit == winner) continue;
+                auto it = circuits_.find(circuit->getWireId());
+                if (it == circuits_.end() || it->second.circuit != circuit) continue;
+                if (isBuilding(circuit)) {
+                    it->second.detached = true;
+                } else {
+                    finished.push_back(circuit);
+                }
+            }
+        }
+
+        // Finished alongside the winner
+        for (const auto& circuit : finished) {
+            destroy(circuit);
+        }
+    }
+
+    // Give up on a build; timed_out counts it against the explicit timeout
+    // of build(purpose, path, timeout_ms), otherwise it hit the hard timeout.
+    // Unless measured, it was cancelled and is not counted at all
+    void abandon(const std::shared_ptr<Circuit>& circuit, bool timed_out, bool measured = true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = circuits_.find(circuit->getWireId());
+            if (it == circuits_.end() || it->second.circuit != circuit) {
+                return;
+            }
+
+            if (isBuilding(circuit) && measured) {
+                if (timed_out) {
+                    builds_timed_out_++;
+                } else {
+                    builds_abandoned_++;
+                    build_timeout_.recordAbandoned();
+                }
+            }
+            circuits_.erase(it);
+        }
+
+        if (ChannelPool* pool = node_manager_.getChannelPool()) {
+            pool->send(circuit->getChannel(), Cell::make(circuit->getWireId(), CellCommand::DESTROY));
+        }
+        circuit->setState(Circuit::CircuitState::FAILED);
+    }
+
+    // Drop detached builds that never finished
+    // Caller holds mutex_
+    void expireDetached() {
+        auto cutoff = Clock::now() - std::chrono::milliseconds(max_timeout_ms_);
+        ChannelPool* pool = node_manager_.getChannelPool();
+        for (auto it = circuits_.begin(); it != circuits_.end();) {
+            auto current = it++;
+            Entry& entry = current->second;
+            if (entry.detached && entry.started < cutoff) {
+                builds_abandoned_++;
+                build_timeout_.recordAbandoned();
+                if (pool) pool->send(entry.channel, Cell::make(current->first, CellCommand::DESTROY));
+                entry.circuit->setState(Circuit::CircuitState::FAILED);
+                circuits_.erase(current);
+            }
+        }
+    }
+
+    // Link established circuits to one relay so they carry the first one's
+    // streams as further legs
+    bool link(const std::vector<std::shared_ptr<Circuit>>& circuits) {
+        if (circuits.size() < 2) return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto streams = circuits[0]->getStreams();
+        if (!streams) return false;
+
+        std::string exit;
+        for (const auto& circuit : circuits) {
+            auto it = circuits_.find(circuit->getWireId());
+            if (it == circuits_.end() || it->second.circuit != circuit ||
+                circuit->getState() != Circuit::CircuitState::ESTABLISHED) {
+                return false;
+            }
+            if (exit.empty()) exit = it->second.path.back();
+            if (it->second.path.back() != exit) return false;
+
+            // Later circuits give up their own mux, which must be unused
+            auto own = circuit->getStreams();
+            if (circuit != circuits[0] && (!own || own == streams || own->getStreamCount() > 0)) return false;
+        }
+
+        for (size_t i = 1; i < circuits.size(); ++i) {
+            const auto& circuit = circuits[i];
+            const Entry& entry = circuits_[circuit->getWireId()];
+            StreamMux::LegId leg = streams->link(makeSender(entry.channel, circuit->getWireId(), entry.path.size()));
+            if (leg == StreamMux::kInvalidLeg) return false;
+            circuit->attachStreams(streams, leg);
+        }
+        return true;
+    }
+
+    // Stream cells to the last hop of a circuit
+    StreamMux::CellSender makeSender(ChannelPool::ChannelId channel, uint32_t wire_id, size_t hops) {
+        ChannelPool* pool = node_manager_.getChannelPool();
+        uint8_t last_hop = static_cast<uint8_t>(hops - 1);
+        return [pool, channel, wire_id, last_hop](RelayCommand command, uint16_t stream_id, const uint8_t* data,
+                                                  size_t len) {
+            return pool->send(channel, Cell::makeRelay(wire_id, last_hop, command, stream_id, data, len));
+        };
+    }
+
+    // A circuit carrying streams is gone; if they could not carry on over
+    // the circuits linked with it, those go too
+    void releaseStreams(const std::shared_ptr<Circuit>& circuit) {
+        auto streams = circuit->getStreams();
+        if (!streams || streams->removeLeg(circuit->getStreamLeg())) return;
+
+        std::vector<std::shared_ptr<Circuit>> linked;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : circuits_) {
+                if (entry.second.circuit->getStreams() == streams) {
+                    linked.push_back(entry.second.circuit);
+                }
+            }
+        }
+        for (const auto& other : linked) {
+            destroy(other);
+        }
+    }
+
+    void destroy(const std::shared_ptr<Circuit>& circuit) {
+        if (!circuit) return;
+
+        bool known;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = circuits_.find(circuit->getWireId());
+            known = it != circuits_.end() && it->second.circuit == circuit;
+            if (known) circuits_.erase(it);
+        }
+
+        if (known) {
+            if (ChannelPool* pool = node_manager_.getChannelPool()) {
+                pool->send(circuit->getChannel(), Cell::make(circuit->getWireId(), CellCommand::DESTROY));
+            }
+        }
+        circuit->setState(Circuit::CircuitState::CLOSED);
+        if (known) {
+            releaseStreams(circuit);
+        }
+    }
+
+    void handleCell(ChannelPool::ChannelId channel, const Cell& cell) {
+        std::shared_ptr<Circuit> stream_circuit;
+        std::shared_ptr<StreamMux> streams;
+        StreamMux::LegId leg = 0;
+        std::vector<std::shared_ptr<Circuit>> released;
+        std::vector<Completion> completions;
+        RelayHeader header{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = circuits_.find(cell.circuit_id);
+            if (it == circuits_.end() || it->second.channel != channel) {
+                return;
+            }
+            Entry& entry = it->second;
+
+            switch (cell.command) {
+                case CellCommand::CREATED:
+                    if (entry.hops_open == 0) {
+                        advance(it, completions);
+                    }
+                    break;
+                case CellCommand::RELAY:
+                    header = cell.relayHeader();
+                    if (header.command == RelayCommand::EXTENDED) {
+                        // Relay number header.hop opened the hop after it
+                        if (header.hop + 1u == entry.hops_open) {
+                            advance(it, completions);
+                        }
+                    } else if (header.hop + 1u == entry.path.size() && entry.circuit->getStreams()) {
+                        // Stream cells from the last hop go to the streams outside our lock
+                        stream_circuit = entry.circuit;
+                        streams = entry.circuit->getStreams();
+                        leg = entry.circuit->getStreamLeg();
+                    }
+                    break;
+                case CellCommand::DESTROY:
+                    markDestroyed(it, released, completions);
+                    break;
+                default:
+                    return;
+            }
+        }
+
+        for (const auto& circuit : released) {
+            releaseStreams(circuit);
+        }
+        runCompletions(completions);
+        if (streams && !streams->handleCell(leg, header, cell.relayData())) {
+            KERMIT_ERROR << "Flow control violation on circuit " << stream_circuit->getCircuitId();
+            destroy(stream_circuit);
+        }
+    }
+
+    void runCompletions(const std::vector<Completion>& completions) {
+        for (const auto& completion : completions) {
+            if (completion.job) {
+                onAttemptDone(completion.job, completion.circuit, completion.established);
+            } else if (completion.callback) {
+                completion.callback(completion.established ? completion.circuit : nullptr);
+            }
+        }
+    }
+
+    // Caller holds mutex_
+    static void complete(const Entry& entry, bool established, std::vector<Completion>& completions) {
+        if (entry.job || entry.callback) {
+            completions.push_back(Completion{entry.circuit, established, entry.callback, entry.job});
+        }
+    }
+
+    // One more hop answered: extend to the next, unless the EXTEND went out
+    // with CREATE, or finish the build
+    // Caller holds mutex_
+    void advance(std::unordered_map<uint32_t, Entry>::iterator it, std::vector<Completion>& completions) {
+        Entry& entry = it->second;
+        entry.circuit->extend(entry.path[entry.hops_open]);
+        entry.hops_open++;
+
+        if (entry.hops_open < entry.path.size()) {
+            if (entry.pipelined) return;
+            ChannelPool* pool = node_manager_.getChannelPool();
+            if (!pool || !pool->send(entry.channel, makeExtend(it->first, entry.path, entry.hops_open))) {
+                entry.circuit->setState(Circuit::CircuitState::FAILED);
+                builds_failed_++;
+                complete(entry, false, completions);
+                circuits_.erase(it);
+                progress_.notify_all();
+            }
+            return;
+        }
+
+        uint32_t build_ms = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - entry.started).count());
+        build_timeout_.recordBuildTime(build_ms);
+        if (!entry.timed_out) {
+            build_timeout_.recordOutcome(false);
+        }
+        entry.circuit->setBuildTimeMs(build_ms);
+        builds_succeeded_++;
+
+        if (entry.detached) {
+            // Measured; nobody is waiting for it
+            late_completions_++;
+            if (ChannelPool* pool = node_manager_.getChannelPool()) {
+                pool->send(entry.channel, Cell::make(it->first, CellCommand::DESTROY));
+            }
+            entry.circuit->setState(Circuit::CircuitState::CLOSED);
+            circuits_.erase(it);
+            return;
+        }
+
+        entry.circuit->attachStreams(std::allocate_shared<StreamMux>(
+            SlabAllocator<StreamMux>(), makeSender(entry.channel, it->first, entry.path.size())));
+
+        entry.circuit->setState(Circuit::CircuitState::ESTABLISHED);
+        complete(entry, true, completions);
+        progress_.notify_all();
+    }
+
+    void handleChannelClosed(ChannelPool::ChannelId channel) {
+        std::vector<std::shared_ptr<Circuit>> released;
+        std::vector<Completion> completions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = circuits_.begin(); it != circuits_.end();) {
+                auto current = it++;
+                if (current->second.channel == channel) {
+                    markDestroyed(current, released, completions);
+                }
+            }
+        }
+        for (const auto& circuit : released) {
+            releaseStreams(circuit);
+        }
+        runCompletions(completions);
+    }
+
+    // Circuits with streams are added to released for releaseStreams()
+    // once mutex_ is dropped, failed builds to completions
+    // Caller holds mutex_
+    void markDestroyed(std::unordered_map<uint32_t, Entry>::iterator it,
+                       std::vector<std::shared_ptr<Circuit>>& released, std::vector<Completion>& completions) {
+        Entry& entry = it->second;
+        if (isBuilding(entry.circuit)) {
+            entry.circuit->setState(Circuit::CircuitState::FAILED);
+            builds_failed_++;
+            complete(entry, false, completions);
+        } else {
+            entry.circuit->setState(Circuit::CircuitState::CLOSED);
+            if (entry.circuit->getStreams()) {
+                released.push_back(entry.circuit);
+            }
+        }
+        circuits_.erase(it);
+        progress_.notify_all();
+    }
+
+    uint32_t getBuildTimeoutMs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return build_timeout_.getTimeoutMs();
+    }
+
+    size_t getCircuitCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return circuits_.size();
+    }
+};
+
+// CircuitManager public interface
+CircuitManager::CircuitManager(NodeManager& node_manager, const CircuitBuildTimeoutConfig& timeout_config)
+    : impl_(std::make_unique<Impl>(node_manager, timeout_config)) {}
+
+CircuitManager::~CircuitManager() = default;
+
+std::vector<std::string> CircuitManager::selectPath(CircuitPurpose purpose, size_t hops) const {
+    return impl_->selectPath(purpose, hops);
+}
+
+std::shared_ptr<Circuit> CircuitManager::launch(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                                BuildCallback callback) {
+    return impl_->launch(purpose, path, std::move(callback), nullptr);
+}
+
+std::shared_ptr<Circuit> CircuitManager::build(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                               uint32_t timeout_ms) {
+    return impl_->build(purpose, path, timeout_ms);
+}
+
+std::shared_ptr<Circuit> CircuitManager::build(CircuitPurpose purpose) {
+    return impl_->build(purpose);
+}
+
+void CircuitManager::buildAsync(CircuitPurpose purpose, BuildCallback callback) {
+    impl_->buildAsync(purpose, std::move(callback));
+}
+
+void CircuitManager::cancelBuilds() {
+    impl_->cancelBuilds();
+}
+
+void CircuitManager::setPipelining(bool enabled) {
+    impl_->pipelining_ = enabled;
+}
+
+uint32_t CircuitManager::getBuildTimeoutMs() const {
+    return impl_->getBuildTimeoutMs();
+}
+
+bool CircuitManager::link(const std::vector<std::shared_ptr<Circuit>>& circuits) {
+    return impl_->link(circuits);
+}
+
+void CircuitManager::destroy(const std::shared_ptr<Circuit>& circuit) {
+    impl_->destroy(circuit);
+}
+
+void CircuitManager::handleCell(ChannelPool::ChannelId channel, const Cell& cell) {
+    impl_->handleCell(channel, cell);
+}
+
+void CircuitManager::handleChannelClosed(ChannelPool::ChannelId channel) {
+    impl_->handleChannelClosed(channel);
+}
+
+size_t CircuitManager::getCircuitCount() const {
+    return impl_->getCircuitCount();
+}
+
+CircuitManagerStats CircuitManager::getStats() const {
+    CircuitManagerStats stats{};
+    stats.builds_started = impl_->builds_started_;
+    stats.builds_succeeded = impl_->builds_succeeded_;
+    stats.builds_failed = impl_->builds_failed_;
+    stats.builds_timed_out = impl_->builds_timed_out_;
+    stats.builds_abandoned = impl_->builds_abandoned_;
+    stats.relaunches = impl_->relaunches_;
+    stats.late_completions = impl_->late_completions_;
+    stats.active = getCircuitCount();
+    stats.build_timeout_ms = getBuildTimeoutMs();
+    return stats;
+}
+
+} // namespace kermit
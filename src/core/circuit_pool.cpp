@@ -0,0 +1,333 @@
+#include "kermit/circuit_pool.h"
+#include "kermit/circuit_manager.h"
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Longest pause between builds while they keep failing
+constexpr uint32_t kMaxBuildBackoffMs = 30000;
+
+size_t slotIndex(CircuitPurpose purpose) {
+    return purpose == CircuitPurpose::HIDDEN_SERVICE ? 1 : 0;
+}
+
+} // namespace
+
+CircuitPoolConfig::CircuitPoolConfig()
+    : general_target(4),
+      hidden_service_target(2),
+      max_clean(32),
+      max_circuits(100),
+      max_pending_builds(4),
+      max_clean_age_ms(600000),
+      maintenance_interval_ms(1000),
+      demand_horizon_ms(5000),
+      demand_alpha(0.3) {}
+
+// CircuitPool implementation
+class CircuitPool::Impl {
+public:
+    // Clean circuits and demand for one purpose
+    struct Slot {
+        CircuitPurpose purpose;
+        size_t base_target;
+        size_t target;
+        std::deque<std::shared_ptr<Circuit>> clean;
+        size_t building;    // Builds under way
+        uint64_t demand;    // acquire() calls since the last rate update
+        double rate;        // Smoothed acquire() calls per second
+    };
+
+    CircuitManager& manager_;
+    CircuitPoolConfig config_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    Slot slots_[2];
+    bool running_;
+    std::thread builder_;
+    BuiltCallback built_callback_;
+    Clock::time_point last_rate_update_;
+    size_t building_;
+    uint32_t backoff_ms_;   // Pause between builds while they keep failing
+    Clock::time_point next_build_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> built_;
+    std::atomic<uint64_t> build_failures_;
+    std::atomic<uint64_t> expired_;
+
+    Impl(CircuitManager& manager, const CircuitPoolConfig& config)
+        : manager_(manager), config_(config), running_(false), building_(0), backoff_ms_(0), hits_(0), misses_(0),
+          built_(0), build_failures_(0), expired_(0) {
+        config_.max_pending_builds = std::max<size_t>(config_.max_pending_builds, 1);
+        slots_[0] = Slot{CircuitPurpose::GENERAL, config.general_target, config.general_target, {}, 0, 0, 0.0};
+        slots_[1] = Slot{CircuitPurpose::HIDDEN_SERVICE, config.hidden_service_target,
+                         config.hidden_service_target, {}, 0, 0, 0.0};
+    }
+
+    bool start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) return true;
+        running_ = true;
+        last_rate_update_ = Clock::now();
+        builder_ = std::thread(&Impl::builderLoop, this);
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (builder_.joinable()) {
+            builder_.join();
+        }
+
+        // Builds under way call back into us, with nullptr once cancelled
+        manager_.cancelBuilds();
+
+        std::vector<std::shared_ptr<Circuit>> leftover;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return building_ == 0; });
+            for (Slot& slot : slots_) {
+                leftover.insert(leftover.end(), slot.clean.begin(), slot.clean.end());
+                slot.clean.clear();
+            }
+        }
+        for (const auto& circuit : leftover) {
+            manager_.destroy(circuit);
+        }
+    }
+
+    std::shared_ptr<Circuit> acquire(CircuitPurpose purpose) {
+        std::shared_ptr<Circuit> circuit;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Slot& slot = slots_[slotIndex(purpose)];
+            slot.demand++;
+            while (!slot.clean.empty() && !circuit) {
+                auto candidate = slot.clean.front();
+                slot.clean.pop_front();
+                if (candidate->getState() == Circuit::CircuitState::ESTABLISHED) {
+                    circuit = candidate;
+                }
+            }
+        }
+
+        // Refill right away rather than at the next maintenance tick
+        wake_.notify_all();
+
+        if (!circuit) {
+            misses_++;
+            return nullptr;
+        }
+        circuit->markDirty();
+        hits_++;
+        return circuit;
+    }
+
+    void builderLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (running_) {
+            std::vector<std::shared_ptr<Circuit>> retired = maintain();
+            if (!retired.empty()) {
+                lock.unlock();
+                for (const auto& circuit : retired) {
+                    manager_.destroy(circuit);
+                }
+                lock.lock();
+                continue;
+            }
+
+            Slot* slot = neediestSlot();
+            if (!slot || building_ >= config_.max_pending_builds ||
+                manager_.getCircuitCount() >= config_.max_circuits) {
+                wake_.wait_for(lock, std::chrono::milliseconds(config_.maintenance_interval_ms));
+                continue;
+            }
+
+            if (Clock::now() < next_build_) {
+                // Cut short by stop() or a success; the slot may have filled meanwhile
+                auto until = next_build_;
+                wake_.wait_until(lock, until, [this] { return !running_ || Clock::now() >= next_build_; });
+                continue;
+            }
+
+            CircuitPurpose purpose = slot->purpose;
+            slot->building++;
+            building_++;
+            lock.unlock();
+            manager_.buildAsync(purpose, [this, purpose](const std::shared_ptr<Circuit>& circuit) {
+                onBuilt(purpose, circuit);
+            });
+            lock.lock();
+        }
+    }
+
+    // A build started by builderLoop() finished, usually on the channel loop
+    void onBuilt(CircuitPurpose purpose, const std::shared_ptr<Circuit>& circuit) {
+        bool keep = false;
+        BuiltCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!circuit) {
+                build_failures_++;
+                backoff_ms_ = backoff_ms_ == 0 ? config_.maintenance_interval_ms
+                                               : std::min(backoff_ms_ * 2, kMaxBuildBackoffMs);
+                next_build_ = Clock::now() + std::chrono::milliseconds(backoff_ms_);
+            } else {
+                backoff_ms_ = 0;
+                next_build_ = Clock::now();
+                built_++;
+                keep = running_;
+                if (keep) {
+                    slots_[slotIndex(purpose)].clean.push_back(circuit);
+                    callback = built_callback_;
+                }
+            }
+        }
+
+        if (circuit && !keep) {
+            manager_.destroy(circuit);
+        }
+        if (callback) {
+            callback(circuit);
+        }
+
+        // Last, since stop() may return and the pool go away once it is counted
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[slotIndex(purpose)].building--;
+        building_--;
+        wake_.notify_all();
+    }
+
+    // Drop dead circuits, retire stale ones and update demand-driven targets
+    // Caller holds mutex_; returns established circuits to destroy
+    std::vector<std::shared_ptr<Circuit>> maintain() {
+        std::vector<std::shared_ptr<Circuit>> retired;
+        for (Slot& slot : slots_) {
+            for (auto it = slot.clean.begin(); it != slot.clean.end();) {
+                if ((*it)->getState() != Circuit::CircuitState::ESTABLISHED) {
+                    it = slot.clean.erase(it);
+                } else if ((*it)->getAgeMs() > config_.max_clean_age_ms) {
+                    retired.push_back(*it);
+                    expired_++;
+                    it = slot.clean.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_rate_update_).count();
+        if (elapsed * 1000.0 >= config_.maintenance_interval_ms) {
+            last_rate_update_ = now;
+            for (Slot& slot : slots_) {
+                double sample = slot.demand / elapsed;
+                slot.rate = config_.demand_alpha * sample + (1.0 - config_.demand_alpha) * slot.rate;
+                slot.demand = 0;
+
+                // Enough spare circuits to cover the expected acquires over the horizon
+                size_t expected = static_cast<size_t>(std::ceil(slot.rate * config_.demand_horizon_ms / 1000.0));
+                slot.target = std::min(std::max(slot.base_target, slot.base_target + expected),
+                                       std::max(config_.max_clean, slot.base_target));
+
+                // Hand back the oldest spares once demand has dropped
+                while (slot.clean.size() > slot.target) {
+                    retired.push_back(slot.clean.front());
+                    slot.clean.pop_front();
+                    expired_++;
+                }
+            }
+        }
+        return retired;
+    }
+
+    // The purpose furthest below its target, nullptr if both are full
+    // Caller holds mutex_
+    Slot* neediestSlot() {
+        Slot* neediest = nullptr;
+        size_t deficit = 0;
+        for (Slot& slot : slots_) {
+            size_t have = slot.clean.size() + slot.building;
+            if (slot.target > have && slot.target - have > deficit) {
+                deficit = slot.target - have;
+                neediest = &slot;
+            }
+        }
+        return neediest;
+    }
+};
+
+// CircuitPool public interface
+CircuitPool::CircuitPool(CircuitManager& manager, const CircuitPoolConfig& config)
+    : impl_(std::make_unique<Impl>(manager, config)) {}
+
+CircuitPool::~CircuitPool() {
+    impl_->stop();
+}
+
+bool CircuitPool::start() {
+    return impl_->start();
+}
+
+void CircuitPool::stop() {
+    impl_->stop();
+}
+
+std::shared_ptr<Circuit> CircuitPool::acquire(CircuitPurpose purpose) {
+    return impl_->acquire(purpose);
+}
+
+size_t CircuitPool::getCleanCount(CircuitPurpose purpose) const {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->slots_[slotIndex(purpose)].clean.size();
+}
+
+size_t CircuitPool::getTarget(CircuitPurpose purpose) const {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->slots_[slotIndex(purpose)].target;
+}
+
+CircuitPoolStats CircuitPool::getStats() const {
+    CircuitPoolStats stats{};
+    stats.hits = impl_->hits_;
+    stats.misses = impl_->misses_;
+    stats.built = impl_->built_;
+    stats.build_failures = impl_->build_failures_;
+    stats.expired = impl_->expired_;
+
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    stats.clean_general = impl_->slots_[0].clean.size();
+    stats.clean_hidden_service = impl_->slots_[1].clean.size();
+    stats.target_general = impl_->slots_[0].target;
+    stats.target_hidden_service = impl_->slots_[1].target;
+    return stats;
+}
+
+void CircuitPool::setBuiltCallback(BuiltCallback callback) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->built_callback_ = std::move(callback);
+}
+
+} // namespace kermit
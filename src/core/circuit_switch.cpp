@@ -0,0 +1,1108 @@
+#include "kermit/circuit_switch.h"
+#include "kermit/node_manager.h"
+#include "kermit/network.h"
+#include "kermit/cell.h"
+#include "kermit/stream_mux.h"
+#include "kermit/event_loop.h"
+#include "kermit/backend_pool.h"
+#include "kermit/resolver.h"
+#include "kermit/mpsc_ring.h"
+#include "kermit/slab.h"
+#include "kermit/log.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// How long an EXTEND may wait for a channel to the next relay
+constexpr auto kExtendTimeout = std::chrono::seconds(5);
+
+// How often pending extends are retried
+constexpr uint32_t kTickMs = 100;
+
+// Cells for later hops a circuit may send before its extend completes; a
+// pipelined build sends one EXTEND per further hop
+constexpr size_t kMaxQueuedCells = 8;
+
+// Largest read from or write to an exit connection at a time
+constexpr size_t kExitChunk = 16 * 1024;
+
+// Messages waiting for a shard; a full ring makes the sender wait
+constexpr size_t kShardRingSize = 1024;
+
+// Messages a shard handles per wakeup before its timer gets a turn
+constexpr size_t kShardBatch = 256;
+
+// Shards used at most when the count follows the cores
+constexpr size_t kMaxShards = 16;
+
+// Relayed circuits one peer connection may hold, and all peers together;
+// CREATE beyond either is answered with DESTROY
+constexpr size_t kMaxCircuitsPerConnection = 1024;
+constexpr size_t kMaxCircuits = 65536;
+
+} // namespace
+
+// CircuitSwitch implementation
+class CircuitSwitch::Impl {
+public:
+    // Peer connection and the circuit id the peer chose on it
+    using InboundKey = std::pair<ConnectionHandle, uint32_t>;
+    using OutboundKey = std::pair<ChannelPool::ChannelId, uint32_t>;
+
+    struct Hop {
+        ChannelPool::ChannelId next_channel = ChannelPool::kInvalidChannel;
+        uint32_t next_id = 0;
+        bool extending = false;        // CREATE sent to the next relay, no CREATED yet
+        std::string pending_target;    // EXTEND waiting for a channel
+        Clock::time_point extend_started;
+        std::vector<Cell> queued;      // For later hops, held until the extend completes
+        std::shared_ptr<StreamMux> streams;  // We are the exit for this circuit
+        StreamMux::LegId leg = 0;            // Its leg of streams when linked
+        std::string link_nonce;
+    };
+
+    // Circuits whose LINK carried the same nonce
+    struct LinkedSet {
+        std::shared_ptr<StreamMux> streams;
+        size_t legs;
+    };
+
+    // TCP connection opened for a BEGIN; touched only on the loop thread.
+    // fd is -1 while the target's name is being looked up
+    struct ExitStream {
+        int fd;
+        uint64_t serial;            // Tells a lookup's answer whether it is still wanted
+        bool connected;
+        bool reading;               // Paused while the stream has no write space
+        bool peer_closed;           // END received; close once out is flushed
+        std::vector<uint8_t> out;   // Read from the stream, not yet sent to the target
+        size_t out_offset;
+        std::shared_ptr<StreamMux> streams;
+    };
+    using ExitKey = std::pair<const StreamMux*, uint16_t>;
+
+    // Lets resolver threads tell whether the switch still exists before posting
+    struct Liveness {
+        std::mutex mutex;
+        std::atomic<bool> alive{true};
+    };
+
+    // Stream leg of a circuit torn down
+    struct Released {
+        std::shared_ptr<StreamMux> streams;
+        StreamMux::LegId leg;
+        bool linked;
+    };
+
+    // Cells queued while a message is handled and sent once it is done,
+    // along with the legs to remove
+    struct Outbox {
+        std::vector<std::pair<ConnectionHandle, Cell>> inbound;
+        std::vector<std::pair<ChannelPool::ChannelId, Cell>> outbound;
+        std::vector<Released> released;
+
+        void clear() {
+            inbound.clear();
+            outbound.clear();
+            released.clear();
+        }
+    };
+
+    // Circuit tables take their nodes from the slab, since circuits come
+    // and go with every build
+    using Circuits = std::map<InboundKey, Hop, std::less<InboundKey>, SlabAllocator<std::pair<const InboundKey, Hop>>>;
+    using ByOutbound = std::map<OutboundKey, InboundKey, std::less<OutboundKey>,
+                                SlabAllocator<std::pair<const OutboundKey, InboundKey>>>;
+    using Pending = std::set<InboundKey, std::less<InboundKey>, SlabAllocator<InboundKey>>;
+
+    // Handed from the network and channel threads to a circuit's shard
+    struct Message {
+        enum class Kind : uint8_t { INBOUND_CELL, INBOUND_CLOSED, CHANNEL_CELL, CHANNEL_CLOSED };
+
+        Kind kind = Kind::INBOUND_CELL;
+        ConnectionHandle connection = kInvalidConnection;
+        ChannelPool::ChannelId channel = ChannelPool::kInvalidChannel;
+        Cell cell;
+    };
+
+    // Circuits owned by one thread, the only one to touch them. Inbound
+    // circuits are spread by peer connection and id; the ids we pick for
+    // the next hop are congruent to the shard index, so cells coming back
+    // on a channel find their shard without a shared table
+    struct alignas(64) Shard {
+        size_t index;
+        MpscRing<Message> ring;
+        std::atomic<size_t> queued;     // Pushed and not yet taken; 0 -> 1 wakes the shard
+        int wakeup_fd;
+        EventLoop loop;
+        std::thread thread;
+
+        Circuits circuits;
+        ByOutbound by_outbound;
+        Pending pending;
+        uint32_t next_id;
+        std::atomic<size_t> circuit_count;
+        Outbox outbox;                  // Reused for every cell, keeping its capacity
+
+        explicit Shard(size_t index)
+            : index(index), ring(kShardRingSize), queued(0), wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+              next_id(1), circuit_count(0) {}
+
+        ~Shard() {
+            if (wakeup_fd >= 0) close(wakeup_fd);
+        }
+    };
+
+    NodeManager& node_manager_;
+    NetworkManager& network_manager_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    // Circuits per peer connection and in total, counted across shards
+    std::mutex admitted_mutex_;
+    std::unordered_map<ConnectionHandle, size_t> admitted_;
+    size_t admitted_total_ = 0;
+
+    // Sets span shards
+    std::mutex linked_mutex_;
+    std::map<std::string, LinkedSet> linked_;
+
+    EventLoop loop_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> exit_enabled_;
+    std::atomic<bool> exit_allow_private_;
+    std::atomic<size_t> exit_count_;
+    std::map<ExitKey, ExitStream> exits_;
+    uint64_t next_exit_serial_;
+    std::vector<in_addr_t> local_addresses_;  // Ours, refused as exit targets
+    std::shared_ptr<Liveness> liveness_;
+
+    Impl(NodeManager& node_manager, NetworkManager& network_manager, size_t threads)
+        : node_manager_(node_manager), network_manager_(network_manager), running_(false), exit_enabled_(false),
+          exit_allow_private_(false), exit_count_(0), next_exit_serial_(0), liveness_(std::make_shared<Liveness>()) {
+        if (threads == 0) {
+            threads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), kMaxShards);
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            shards_.push_back(std::make_unique<Shard>(i));
+        }
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(liveness_->mutex);
+            liveness_->alive = false;
+        }
+        stop();
+    }
+
+    bool start() {
+        if (running_) return true;
+
+        local_addresses_.clear();
+        ifaddrs* interfaces = nullptr;
+        if (getifaddrs(&interfaces) == 0) {
+            for (ifaddrs* entry = interfaces; entry; entry = entry->ifa_next) {
+                if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET) {
+                    local_addresses_.push_back(reinterpret_cast<sockaddr_in*>(entry->ifa_addr)->sin_addr.s_addr);
+                }
+            }
+            freeifaddrs(interfaces);
+        }
+
+        if (!loop_.initialize()) {
+            KERMIT_ERROR << "Failed to initialize circuit switch event loop";
+            return false;
+        }
+        for (auto& shard : shards_) {
+            Shard* owner = shard.get();
+            if (shard->wakeup_fd < 0 || !shard->loop.initialize() ||
+                !shard->loop.addFd(shard->wakeup_fd, EventLoop::READABLE, [this, owner](uint32_t) { drain(*owner); }) ||
+                shard->loop.addTimer(kTickMs, [this, owner] { tick(*owner); }) < 0) {
+                KERMIT_ERROR << "Failed to start circuit switch shard " << shard->index;
+                return false;
+            }
+        }
+
+        running_ = true;
+        thread_ = std::thread([this] { loop_.run(); });
+        for (auto& shard : shards_) {
+            Shard* owner = shard.get();
+            shard->thread = std::thread([owner] { owner->loop.run(); });
+        }
+
+        // Cells may have arrived before the shards ran
+        for (auto& shard : shards_) {
+            wake(*shard);
+        }
+        return true;
+    }
+
+    void stop() {
+        if (!running_) return;
+        running_ = false;
+
+        for (auto& shard : shards_) {
+            shard->loop.stop();
+            if (shard->thread.joinable()) {
+                shard->thread.join();
+            }
+        }
+
+        loop_.stop();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        for (auto& entry : exits_) {
+            if (entry.second.fd < 0) continue;
+            loop_.removeFd(entry.second.fd);
+            close(entry.second.fd);
+        }
+        exits_.clear();
+        exit_count_ = 0;
+    }
+
+    size_t shardIndex(const InboundKey& key) const {
+        uint64_t hash = key.first * 0xff51afd7ed558ccdull ^ key.second * 0x9e3779b97f4a7c15ull;
+        return static_cast<size_t>(hash ^ (hash >> 32)) % shards_.size();
+    }
+
+    // Called from the network and channel threads; waits while the ring is full
+    void post(Shard& shard, Message&& message) {
+        while (!shard.ring.push(std::move(message))) {
+            if (!running_) return;
+            std::this_thread::yield();
+        }
+        if (shard.queued.fetch_add(1) == 0) {
+            wake(shard);
+        }
+    }
+
+    void wake(Shard& shard) {
+        uint64_t one = 1;
+        ssize_t result = write(shard.wakeup_fd, &one, sizeof(one));
+        (void)result;  // EAGAIN means a wakeup is already pending
+    }
+
+    void handleInboundCell(ConnectionHandle connection, const Cell& cell) {
+        Message message;
+        message.kind = Message::Kind::INBOUND_CELL;
+        message.connection = connection;
+        message.cell = cell;
+        post(*shards_[shardIndex(InboundKey(connection, cell.circuit_id))], std::move(message));
+    }
+
+    void handleInboundClosed(ConnectionHandle connection) {
+        for (auto& shard : shards_) {
+            Message message;
+            message.kind = Message::Kind::INBOUND_CLOSED;
+            message.connection = connection;
+            post(*shard, std::move(message));
+        }
+    }
+
+    void handleChannelCell(ChannelPool::ChannelId channel, const Cell& cell) {
+        Message message;
+        message.kind = Message::Kind::CHANNEL_CELL;
+        message.channel = channel;
+        message.cell = cell;
+        post(*shards_[cell.circuit_id % shards_.size()], std::move(message));
+    }
+
+    void handleChannelClosed(ChannelPool::ChannelId channel) {
+        for (auto& shard : shards_) {
+            Message message;
+            message.kind = Message::Kind::CHANNEL_CLOSED;
+            message.channel = channel;
+            post(*shard, std::move(message));
+        }
+    }
+
+    // Shard thread, when the wakeup eventfd fires
+    void drain(Shard& shard) {
+        uint64_t value;
+        ssize_t result = read(shard.wakeup_fd, &value, sizeof(value));
+        (void)result;
+
+        Message message;
+        size_t taken = 0;
+        while (taken < kShardBatch && shard.ring.pop(message)) {
+            taken++;
+            switch (message.kind) {
+                case Message::Kind::INBOUND_CELL:
+                    onInboundCell(shard, message.connection, message.cell);
+                    break;
+                case Message::Kind::INBOUND_CLOSED:
+                    onInboundClosed(shard, message.connection);
+                    break;
+                case Message::Kind::CHANNEL_CELL:
+                    onChannelCell(shard, message.channel, message.cell);
+                    break;
+                case Message::Kind::CHANNEL_CLOSED:
+                    onChannelClosed(shard, message.channel);
+                    break;
+            }
+        }
+        shard.circuit_count = shard.circuits.size();
+
+        // Producers only wake an idle shard, so keep going while any is left
+        if (shard.queued.fetch_sub(taken) != taken) {
+            wake(shard);
+        }
+    }
+
+    // Shard thread
+    void onInboundCell(Shard& shard, ConnectionHandle connection, const Cell& cell) {
+        Outbox& outbox = shard.outbox;
+        outbox.clear();
+        std::shared_ptr<StreamMux> streams;
+        StreamMux::LegId leg = 0;
+        InboundKey key(connection, cell.circuit_id);
+
+        switch (cell.command) {
+            case CellCommand::CREATE:
+                if (shard.circuits.count(key)) break;
+                if (!admit(connection)) {
+                    outbox.inbound.emplace_back(connection, Cell::make(cell.circuit_id, CellCommand::DESTROY));
+                    break;
+                }
+                shard.circuits.emplace(key, Hop());
+                outbox.inbound.emplace_back(connection, Cell::make(cell.circuit_id, CellCommand::CREATED));
+                break;
+
+            case CellCommand::RELAY: {
+                auto it = shard.circuits.find(key);
+                if (it == shard.circuits.end()) {
+                    outbox.inbound.emplace_back(connection, Cell::make(cell.circuit_id, CellCommand::DESTROY));
+                    break;
+                }
+
+                Hop& hop = it->second;
+                RelayHeader header = cell.relayHeader();
+                if (header.hop == 0) {
+                    streams = handleLocal(shard, it, header, cell, outbox, leg);
+                } else if (hop.next_channel != ChannelPool::kInvalidChannel && !hop.extending) {
+                    outbox.outbound.emplace_back(hop.next_channel, forward(hop, cell));
+                } else if ((hop.extending || !hop.pending_target.empty()) && hop.queued.size() < kMaxQueuedCells) {
+                    // A pipelined build sent them right behind its EXTEND
+                    hop.queued.push_back(cell);
+                } else {
+                    // Addressed past the end of the circuit
+                    teardown(shard, it, outbox, true, false);
+                }
+                break;
+            }
+
+            case CellCommand::DESTROY: {
+                auto it = shard.circuits.find(key);
+                if (it != shard.circuits.end()) {
+                    teardown(shard, it, outbox, false, true);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+        send(outbox);
+
+        if (streams && !streams->handleCell(leg, cell.relayHeader(), cell.relayData())) {
+            KERMIT_ERROR << "Flow control violation on circuit " << cell.circuit_id << " from "
+                         << network_manager_.getConnectionName(connection);
+            Outbox violation;
+            auto it = shard.circuits.find(key);
+            if (it != shard.circuits.end() && it->second.streams == streams) {
+                teardown(shard, it, violation, true, true);
+            }
+            send(violation);
+        }
+    }
+
+    // A cell for a later hop, addressed to the next relay
+    static Cell forward(const Hop& hop, const Cell& cell) {
+        Cell next = cell;
+        next.circuit_id = hop.next_id;
+        RelayHeader header = cell.relayHeader();
+        header.hop--;
+        header.write(next.payload);
+        return next;
+    }
+
+    // RELAY cells addressed to this relay
+    // Returns the mux a stream cell should be handed to and sets leg
+    // Shard thread
+    std::shared_ptr<StreamMux> handleLocal(Shard& shard, Circuits::iterator it,
+                                           const RelayHeader& header, const Cell& cell, Outbox& outbox,
+                                           StreamMux::LegId& leg) {
+        Hop& hop = it->second;
+        leg = hop.leg;
+
+        switch (header.command) {
+            case RelayCommand::EXTEND:
+                break;
+
+            case RelayCommand::BEGIN:
+                if (!hop.streams) {
+                    hop.streams = makeStreams(it->first);
+                }
+                return hop.streams;
+
+            case RelayCommand::DATA:
+            case RelayCommand::END:
+            case RelayCommand::SENDME:
+            case RelayCommand::SWITCH:
+                return hop.streams;
+
+            case RelayCommand::LINK:
+                link(shard, it, std::string(reinterpret_cast<const char*>(cell.relayData()), header.length), outbox);
+                return nullptr;
+
+            default:
+                return nullptr;
+        }
+
+        if (hop.next_channel != ChannelPool::kInvalidChannel || !hop.pending_target.empty() || header.length == 0) {
+            teardown(shard, it, outbox, true, true);
+            return nullptr;
+        }
+
+        hop.pending_target.assign(reinterpret_cast<const char*>(cell.relayData()), header.length);
+        hop.extend_started = Clock::now();
+        shard.pending.insert(it->first);
+        tryExtend(shard, it, outbox);
+        return nullptr;
+    }
+
+    // The first circuit to send a nonce becomes leg 0 of its set and is
+    // answered here; later ones join the set's mux, which answers them
+    // Shard thread
+    void link(Shard& shard, Circuits::iterator it, const std::string& nonce, Outbox& outbox) {
+        Hop& hop = it->second;
+        const InboundKey& key = it->first;
+        if (nonce.empty() || !hop.link_nonce.empty()) {
+            teardown(shard, it, outbox, true, true);
+            return;
+        }
+
+        std::shared_ptr<StreamMux> streams;
+        {
+            std::lock_guard<std::mutex> lock(linked_mutex_);
+            auto set = linked_.find(nonce);
+            if (set == linked_.end()) {
+                if (!hop.streams) {
+                    hop.streams = makeStreams(key);
+                }
+                linked_[nonce] = LinkedSet{hop.streams, 1};
+                hop.link_nonce = nonce;
+                outbox.inbound.emplace_back(key.first,
+                                            Cell::makeRelay(key.second, 0, RelayCommand::LINKED, 0, nullptr, 0));
+                return;
+            }
+            streams = set->second.streams;
+        }
+
+        // A joining circuit gives up its own mux, which must be unused
+        if (hop.streams && hop.streams->getStreamCount() > 0) {
+            teardown(shard, it, outbox, true, true);
+            return;
+        }
+
+        // join() sends LINKED itself, so it runs without linked_mutex_
+        StreamMux::LegId leg = streams->join(makeSender(key));
+        if (leg == StreamMux::kInvalidLeg) {
+            teardown(shard, it, outbox, true, true);
+            return;
+        }
+        hop.streams = streams;
+        hop.leg = leg;
+        hop.link_nonce = nonce;
+
+        std::lock_guard<std::mutex> lock(linked_mutex_);
+        auto set = linked_.emplace(nonce, LinkedSet{streams, 0}).first;
+        set->second.legs++;
+    }
+
+    // Stream cells back to the peer on one circuit, with hop 0
+    StreamMux::CellSender makeSender(const InboundKey& key) {
+        return [this, key](RelayCommand command, uint16_t stream_id, const uint8_t* data, size_t len) {
+            return network_manager_.sendCell(key.first, Cell::makeRelay(key.second, 0, command, stream_id, data, len));
+        };
+    }
+
+    // Streams for a circuit we are the exit of; the mux's events are
+    // handled on the loop thread
+    std::shared_ptr<StreamMux> makeStreams(const InboundKey& key) {
+        auto streams = std::allocate_shared<StreamMux>(SlabAllocator<StreamMux>(), makeSender(key));
+
+        std::weak_ptr<StreamMux> weak = streams;
+        streams->setEventCallback([this, weak](uint16_t stream_id, StreamEvent event) {
+            loop_.post([this, weak, stream_id, event] {
+                if (auto streams = weak.lock()) {
+                    onStreamEvent(streams, stream_id, event);
+                }
+            });
+        });
+        return streams;
+    }
+
+    // A circuit carrying streams is gone. If they could not carry on over
+    // the circuits linked with it, those are torn down too, on whichever
+    // shard owns them, and the exit connections closed
+    void releaseStreams(const Released& released) {
+        const std::shared_ptr<StreamMux>& streams = released.streams;
+        if (streams->removeLeg(released.leg)) return;
+
+        if (released.linked) {
+            for (auto& shard : shards_) {
+                Shard* owner = shard.get();
+                owner->loop.post([this, owner, streams] { teardownStreams(*owner, streams); });
+            }
+        }
+        loop_.post([this, streams] { closeExits(streams.get()); });
+    }
+
+    // Shard thread
+    void teardownStreams(Shard& shard, const std::shared_ptr<StreamMux>& streams) {
+        Outbox outbox;
+        for (auto it = shard.circuits.begin(); it != shard.circuits.end();) {
+            auto current = it++;
+            if (current->second.streams == streams) {
+                teardown(shard, current, outbox, true, true);
+            }
+        }
+        send(outbox);
+        shard.circuit_count = shard.circuits.size();
+    }
+
+    // Loop thread
+    void onStreamEvent(const std::shared_ptr<StreamMux>& streams, uint16_t stream_id, StreamEvent event) {
+        ExitKey exit_key(streams.get(), stream_id);
+
+        if (event == StreamEvent::BEGIN) {
+            if (!exit_enabled_ || !running_ || exits_.count(exit_key)) {
+                streams->close(stream_id);
+                return;
+            }
+            beginExit(exit_key, streams);
+            return;
+        }
+
+        auto it = exits_.find(exit_key);
+        if (it == exits_.end() || it->second.streams != streams) return;
+        ExitStream& exit = it->second;
+
+        if (!exit.connected) {
+            // Ended before the target answered
+            if (event == StreamEvent::CLOSED) {
+                closeExit(it, true);
+            }
+            return;
+        }
+
+        switch (event) {
+            case StreamEvent::READABLE:
+                writeToTarget(it);
+                break;
+
+            case StreamEvent::WRITABLE:
+                if (!exit.reading) {
+                    exit.reading = true;
+                    updateInterest(exit);
+                }
+                break;
+
+            case StreamEvent::CLOSED:
+                exit.peer_closed = true;
+                writeToTarget(it);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Loop thread. A name not in the resolver cache is looked up off the
+    // loop, the stream waiting in exits_ without a socket until it answers
+    void beginExit(const ExitKey& exit_key, const std::shared_ptr<StreamMux>& streams) {
+        std::string host;
+        uint16_t port;
+        if (!Resolver::splitAddress(streams->getTarget(exit_key.second), host, port)) {
+            streams->close(exit_key.second);
+            return;
+        }
+
+        auto it = exits_.emplace(exit_key, ExitStream{}).first;
+        ExitStream& exit = it->second;
+        exit.fd = -1;
+        exit.serial = next_exit_serial_++;
+        exit.streams = streams;
+        exit_count_ = exits_.size();
+
+        sockaddr_in address{};
+        if (Resolver::lookup(host, port, address)) {
+            connectExit(it, address);
+            return;
+        }
+
+        std::shared_ptr<Liveness> liveness = liveness_;
+        uint64_t serial = exit.serial;
+        Resolver::resolve(host, [this, liveness, exit_key, serial, host, port](bool) {
+            std::lock_guard<std::mutex> lock(liveness->mutex);
+            if (!liveness->alive) return;
+            loop_.post([this, liveness, exit_key, serial, host, port] {
+                if (liveness->alive) onExitResolved(exit_key, serial, host, port);
+            });
+        });
+    }
+
+    // Loop thread
+    void onExitResolved(const ExitKey& exit_key, uint64_t serial, const std::string& host, uint16_t port) {
+        auto it = exits_.find(exit_key);
+        if (it == exits_.end() || it->second.serial != serial) return;  // Ended while looking up
+
+        sockaddr_in address{};
+        if (!Resolver::lookup(host, port, address)) {
+            closeExit(it, true);
+            return;
+        }
+        connectExit(it, address);
+    }
+
+    // Loop thread
+    void connectExit(std::map<ExitKey, ExitStream>::iterator it, const sockaddr_in& address) {
+        int fd = exitAllowed(address) ? BackendPool::startConnect(address) : -1;
+        if (fd < 0) {
+            closeExit(it, true);
+            return;
+        }
+
+        ExitKey exit_key = it->first;
+        it->second.fd = fd;
+        loop_.addFd(fd, EventLoop::WRITABLE, [this, exit_key](uint32_t events) { onExitEvent(exit_key, events); });
+    }
+
+    // Unless private targets are allowed, exits may not reach this host or
+    // the networks around it: unspecified, loopback, RFC 1918, shared
+    // (100.64/10), link-local, multicast and reserved addresses, and any
+    // address of our own, which would expose the SOCKS and control ports
+    bool exitAllowed(const sockaddr_in& address) const {
+        if (exit_allow_private_) return true;
+
+        uint32_t ip = ntohl(address.sin_addr.s_addr);
+        uint32_t first = ip >> 24;
+        if (first == 0 || first == 10 || first == 127 || first >= 224 ||
+            (ip & 0xfff00000u) == 0xac100000u ||  // 172.16/12
+            (ip & 0xffff0000u) == 0xc0a80000u ||  // 192.168/16
+            (ip & 0xffc00000u) == 0x64400000u ||  // 100.64/10
+            (ip & 0xffff0000u) == 0xa9fe0000u) {  // 169.254/16
+            return false;
+        }
+        return std::find(local_addresses_.begin(), local_addresses_.end(), address.sin_addr.s_addr) ==
+               local_addresses_.end();
+    }
+
+    // Loop thread
+    void onExitEvent(const ExitKey& exit_key, uint32_t events) {
+        auto it = exits_.find(exit_key);
+        if (it == exits_.end()) return;
+        ExitStream& exit = it->second;
+
+        if (!exit.connected) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(exit.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                closeExit(it, true);
+                return;
+            }
+
+            exit.connected = true;
+            exit.reading = true;
+            updateInterest(exit);
+            exit.streams->accept(exit_key.second);
+            return;
+        }
+
+        if (events & EventLoop::READABLE) {
+            if (!readFromTarget(it)) return;
+        }
+        if (events & EventLoop::WRITABLE) {
+            if (!writeToTarget(it)) return;
+        }
+        if (events == EventLoop::ERROR) {
+            closeExit(it, true);
+        }
+    }
+
+    // Target to stream, no more than the stream will queue
+    // Returns false if the exit was closed
+    bool readFromTarget(std::map<ExitKey, ExitStream>::iterator it) {
+        ExitStream& exit = it->second;
+        uint16_t stream_id = it->first.second;
+
+        size_t space = exit.streams->writeSpace(stream_id);
+        if (space == 0) {
+            // Resumed by StreamEvent::WRITABLE
+            exit.reading = false;
+            updateInterest(exit);
+            return true;
+        }
+
+        uint8_t buffer[kExitChunk];
+        ssize_t n = recv(exit.fd, buffer, std::min(space, sizeof(buffer)), 0);
+        if (n > 0) {
+            exit.streams->write(stream_id, buffer, n);
+            return true;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return true;
+        }
+
+        // Target closed; queued data is still sent before END
+        closeExit(it, true);
+        return false;
+    }
+
+    // Stream to target; reading from the stream releases its SENDMEs
+    // Returns false if the exit was closed
+    bool writeToTarget(std::map<ExitKey, ExitStream>::iterator it) {
+        ExitStream& exit = it->second;
+        uint16_t stream_id = it->first.second;
+
+        while (true) {
+            if (exit.out_offset == exit.out.size()) {
+                exit.out.resize(kExitChunk);
+                exit.out.resize(exit.streams->read(stream_id, exit.out.data(), exit.out.size()));
+                exit.out_offset = 0;
+                if (exit.out.empty()) break;
+            }
+
+            ssize_t sent = ::send(exit.fd, exit.out.data() + exit.out_offset, exit.out.size() - exit.out_offset,
+                                  MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+                closeExit(it, true);
+                return false;
+            }
+            exit.out_offset += sent;
+        }
+
+        if (exit.peer_closed && exit.out_offset == exit.out.size()) {
+            closeExit(it, true);
+            return false;
+        }
+        updateInterest(exit);
+        return true;
+    }
+
+    void updateInterest(ExitStream& exit) {
+        uint32_t events = 0;
+        if (exit.reading) events |= EventLoop::READABLE;
+        if (exit.out_offset < exit.out.size()) events |= EventLoop::WRITABLE;
+        loop_.modifyFd(exit.fd, events);
+    }
+
+    // Loop thread
+    void closeExit(std::map<ExitKey, ExitStream>::iterator it, bool end_stream) {
+        if (it->second.fd >= 0) {
+            loop_.removeFd(it->second.fd);
+            close(it->second.fd);
+        }
+        if (end_stream) {
+            it->second.streams->close(it->first.second);
+        }
+        exits_.erase(it);
+        exit_count_ = exits_.size();
+    }
+
+    // Loop thread; the circuits are already gone, so nothing is sent
+    void closeExits(const StreamMux* streams) {
+        auto it = exits_.lower_bound(ExitKey(streams, 0));
+        while (it != exits_.end() && it->first.first == streams) {
+            closeExit(it++, false);
+        }
+    }
+
+
+    // Send CREATE to the next relay once a channel to it is open
+    // Shard thread
+    void tryExtend(Shard& shard, Circuits::iterator it, Outbox& outbox) {
+        Hop& hop = it->second;
+        const std::string& target = hop.pending_target;
+
+        // Peers may only extend to relays this node already knows; adding
+        // whatever address an EXTEND names would let them aim it anywhere
+        if (!node_manager_.getRelayNode(target)) {
+            teardown(shard, it, outbox, true, true);
+            return;
+        }
+
+        ChannelPool::ChannelId channel = node_manager_.acquireChannel(target);
+        if (channel == ChannelPool::kInvalidChannel) {
+            // Start warming channels; tick() retries
+            node_manager_.connectToRelayNode(target);
+            return;
+        }
+
+        // Congruent to the shard index, which is how replies find this shard
+        uint32_t count = static_cast<uint32_t>(shards_.size());
+        uint32_t next_id;
+        do {
+            next_id = (shard.next_id++ * count + static_cast<uint32_t>(shard.index)) & ~kOriginCircuitBit;
+        } while (next_id == 0 || next_id % count != shard.index ||
+                 shard.by_outbound.count(OutboundKey(channel, next_id)));
+
+        hop.next_channel = channel;
+        hop.next_id = next_id;
+        hop.extending = true;
+        hop.pending_target.clear();
+        shard.pending.erase(it->first);
+        shard.by_outbound[OutboundKey(channel, next_id)] = it->first;
+        outbox.outbound.emplace_back(channel, Cell::make(next_id, CellCommand::CREATE));
+    }
+
+    // Shard thread
+    void onChannelCell(Shard& shard, ChannelPool::ChannelId channel, const Cell& cell) {
+        auto out_it = shard.by_outbound.find(OutboundKey(channel, cell.circuit_id));
+        if (out_it == shard.by_outbound.end()) return;
+
+        Outbox& outbox = shard.outbox;
+        outbox.clear();
+        auto it = shard.circuits.find(out_it->second);
+        Hop& hop = it->second;
+        const InboundKey& key = it->first;
+
+        switch (cell.command) {
+            case CellCommand::CREATED:
+                if (hop.extending) {
+                    hop.extending = false;
+                    outbox.inbound.emplace_back(key.first, Cell::makeRelay(key.second, 0, RelayCommand::EXTENDED,
+                                                                           0, nullptr, 0));
+                    for (const Cell& queued : hop.queued) {
+                        outbox.outbound.emplace_back(hop.next_channel, forward(hop, queued));
+                    }
+                    hop.queued.clear();
+                }
+                break;
+
+            case CellCommand::RELAY: {
+                Cell back = cell;
+                back.circuit_id = key.second;
+                RelayHeader header = cell.relayHeader();
+                header.hop++;
+                header.write(back.payload);
+                outbox.inbound.emplace_back(key.first, back);
+                break;
+            }
+
+            case CellCommand::DESTROY:
+                teardown(shard, it, outbox, true, false);
+                break;
+
+            default:
+                break;
+        }
+        send(outbox);
+    }
+
+    // Shard thread
+    void onInboundClosed(Shard& shard, ConnectionHandle connection) {
+        Outbox outbox;
+        auto it = shard.circuits.lower_bound(InboundKey(connection, 0));
+        while (it != shard.circuits.end() && it->first.first == connection) {
+            auto current = it++;
+            teardown(shard, current, outbox, false, true);
+        }
+        send(outbox);
+    }
+
+    // Shard thread
+    void onChannelClosed(Shard& shard, ChannelPool::ChannelId channel) {
+        Outbox outbox;
+        auto out_it = shard.by_outbound.lower_bound(OutboundKey(channel, 0));
+        while (out_it != shard.by_outbound.end() && out_it->first.first == channel) {
+            auto it = shard.circuits.find(out_it->second);
+            ++out_it;
+            // The channel is gone, so only the peer is told
+            teardown(shard, it, outbox, true, false);
+        }
+        send(outbox);
+    }
+
+    // Count a new circuit from connection; false if it is over a limit
+    // Shard thread
+    bool admit(ConnectionHandle connection) {
+        std::lock_guard<std::mutex> lock(admitted_mutex_);
+        if (admitted_total_ >= kMaxCircuits) return false;
+        size_t& count = admitted_[connection];
+        if (count >= kMaxCircuitsPerConnection) return false;
+        count++;
+        admitted_total_++;
+        return true;
+    }
+
+    // Shard thread
+    void release(ConnectionHandle connection) {
+        std::lock_guard<std::mutex> lock(admitted_mutex_);
+        auto it = admitted_.find(connection);
+        if (it == admitted_.end()) return;
+        if (--it->second == 0) admitted_.erase(it);
+        admitted_total_--;
+    }
+
+    // Shard thread, every kTickMs
+    void tick(Shard& shard) {
+        Outbox outbox;
+        auto now = Clock::now();
+        for (auto key_it = shard.pending.begin(); key_it != shard.pending.end();) {
+            auto it = shard.circuits.find(*key_it++);
+            if (now - it->second.extend_started > kExtendTimeout) {
+                teardown(shard, it, outbox, true, false);
+            } else {
+                tryExtend(shard, it, outbox);
+            }
+        }
+        send(outbox);
+
+        // Retry cells refused while the peer's write queue was full
+        for (const auto& entry : shard.circuits) {
+            if (entry.second.streams) {
+                entry.second.streams->flush();
+            }
+        }
+        shard.circuit_count = shard.circuits.size();
+    }
+
+    // Forget a circuit, telling the peer and/or the next relay
+    // Shard thread
+    void teardown(Shard& shard, Circuits::iterator it, Outbox& outbox, bool notify_inbound,
+                  bool notify_outbound) {
+        const InboundKey& key = it->first;
+        Hop& hop = it->second;
+
+        if (hop.next_channel != ChannelPool::kInvalidChannel) {
+            if (notify_outbound) {
+                outbox.outbound.emplace_back(hop.next_channel, Cell::make(hop.next_id, CellCommand::DESTROY));
+            }
+            shard.by_outbound.erase(OutboundKey(hop.next_channel, hop.next_id));
+        }
+
+        if (notify_inbound) {
+            outbox.inbound.emplace_back(key.first, Cell::make(key.second, CellCommand::DESTROY));
+        }
+
+        if (hop.streams) {
+            outbox.released.push_back(Released{hop.streams, hop.leg, !hop.link_nonce.empty()});
+        }
+        if (!hop.link_nonce.empty()) {
+            std::lock_guard<std::mutex> lock(linked_mutex_);
+            auto set = linked_.find(hop.link_nonce);
+            if (set != linked_.end() && --set->second.legs == 0) {
+                linked_.erase(set);
+            }
+        }
+
+        shard.pending.erase(key);
+        release(key.first);
+        shard.circuits.erase(it);
+    }
+
+    void send(const Outbox& outbox) {
+        for (const auto& entry : outbox.inbound) {
+            network_manager_.sendCell(entry.first, entry.second);
+        }
+
+        if (!outbox.outbound.empty()) {
+            if (ChannelPool* pool = node_manager_.getChannelPool()) {
+                for (const auto& entry : outbox.outbound) {
+                    pool->send(entry.first, entry.second);
+                }
+            }
+        }
+
+        for (const auto& entry : outbox.released) {
+            releaseStreams(entry);
+        }
+    }
+
+    size_t getCircuitCount() const {
+        size_t count = 0;
+        for (const auto& shard : shards_) {
+            count += shard->circuit_count;
+        }
+        return count;
+    }
+};
+
+// CircuitSwitch public interface
+CircuitSwitch::CircuitSwitch(NodeManager& node_manager, NetworkManager& network_manager, size_t threads)
+    : impl_(std::make_unique<Impl>(node_manager, network_manager, threads)) {}
+
+CircuitSwitch::~CircuitSwitch() = default;
+
+bool CircuitSwitch::start() {
+    return impl_->start();
+}
+
+void CircuitSwitch::stop() {
+    impl_->stop();
+}
+
+void CircuitSwitch::setExitEnabled(bool enabled) {
+    impl_->exit_enabled_ = enabled;
+}
+
+void CircuitSwitch::setExitAllowPrivate(bool allow) {
+    impl_->exit_allow_private_ = allow;
+}
+
+void CircuitSwitch::handleInboundCell(ConnectionHandle connection, const Cell& cell) {
+    impl_->handleInboundCell(connection, cell);
+}
+
+void CircuitSwitch::handleInboundClosed(ConnectionHandle connection) {
+    impl_->handleInboundClosed(connection);
+}
+
+void CircuitSwitch::handleChannelCell(ChannelPool::ChannelId channel, const Cell& cell) {
+    impl_->handleChannelCell(channel, cell);
+}
+
+void CircuitSwitch::handleChannelClosed(ChannelPool::ChannelId channel) {
+    impl_->handleChannelClosed(channel);
+}
+
+size_t CircuitSwitch::getCircuitCount() const {
+    return impl_->getCircuitCount();
+}
+
+size_t CircuitSwitch::getExitStreamCount() const {
+    return impl_->exit_count_;
+}
+
+size_t CircuitSwitch::getThreadCount() const {
+    return impl_->shards_.size();
+}
+
+} // namespace kermit
@@ -1,8 +1,8 @@
 #include "kermit/config.h"
+#include "kermit/log.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <iostream>
 
 namespace kermit {
 
@@ -18,7 +18,23 @@ RouterConfig::RouterConfig()
       use_ipv6(false),
       enable_hidden_services(true),
       max_circuits(100),
-      circuit_timeout(300) {
+      circuit_timeout(300),
+      circuit_build_quantile(80),
+      preemptive_circuits(4),
+      preemptive_hs_circuits(2),
+      exit_relay(false),
+      exit_allow_private(false),
+      relay_threads(0),
+      directory_file(""),
+      relay_min_channels(1),
+      relay_keepalive_interval(30),
+      kist_interval_ms(2),
+      probe_interval(0),
+      state_save_interval(300),
+      slab_memory_mb(64),
+      backend_pool_min_idle(2),
+      backend_pool_max_idle(8),
+      backend_pool_idle_timeout(60) {
     // Default hidden service directories
     hidden_service_directories = {"./services/service1", "./services/service2"};
 }
@@ -41,12 +57,12 @@ ConfigManager& ConfigManager::getInstance() {
 void ConfigManager::loadConfig(const std::string& config_file) {
     std::ifstream file(config_file);
     if (!file.is_open()) {
-        std::cerr << "Warning: Could not open config file " << config_file 
-                  << ", using defaults" << std::endl;
+        KERMIT_WARN << "Could not open config file " << config_file 
+                    << ", using defaults";
         return;
     }
     
-    std::cout << "Loading configuration from " << config_file << std::endl;
+    KERMIT_INFO << "Loading configuration from " << config_file;
     
     std::string line;
     std::string current_key;
@@ -95,7 +111,7 @@ void ConfigManager::loadConfig(const std::string& config_file) {
                 current_value.erase(0, current_value.find_first_not_of(" \t"));
                 current_value.erase(current_value.find_last_not_of(" \t") + 1);
                 
-                std::cout << "Config: " << current_key << " = " << current_value << std::endl;
+                KERMIT_DEBUG << "Config: " << current_key << " = " << current_value;
                 parseConfigOption(current_key, current_value);
                 
                 current_key.clear();
@@ -121,15 +137,15 @@ void ConfigManager::loadConfig(const std::string& config_file) {
                 value = value.substr(1, value.size() - 2);
             }
             
-            std::cout << "Config: " << key << " = " << value << std::endl;
+            KERMIT_DEBUG << "Config: " << key << " = " << value;
             
             // Parse configuration
             parseConfigOption(key, value);
         }
     }
     
-    std::cout << "Configuration loaded: " << impl_->config.trusted_relays.size() 
-              << " trusted relays found" << std::endl;
+    KERMIT_INFO << "Configuration loaded: " << impl_->config.trusted_relays.size() 
+                << " trusted relays found";
 }
 
 void ConfigManager::parseConfigOption(const std::string& key, const std::string& value) {
@@ -155,6 +171,38 @@ void ConfigManager::parseConfigOption(const std::string& key, const std::string&
         impl_->config.max_circuits = static_cast<uint32_t>(std::stoi(value));
     } else if (key == "circuit_timeout") {
         impl_->config.circuit_timeout = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "circuit_build_quantile") {
+        impl_->config.circuit_build_quantile = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "preemptive_circuits") {
+        impl_->config.preemptive_circuits = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "preemptive_hs_circuits") {
+        impl_->config.preemptive_hs_circuits = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "exit_relay") {
+        impl_->config.exit_relay = (value == "true" || value == "True" || value == "1");
+    } else if (key == "exit_allow_private") {
+        impl_->config.exit_allow_private = (value == "true" || value == "True" || value == "1");
+    } else if (key == "relay_threads") {
+        impl_->config.relay_threads = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "directory_file") {
+        impl_->config.directory_file = value;
+    } else if (key == "relay_min_channels") {
+        impl_->config.relay_min_channels = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "relay_keepalive_interval") {
+        impl_->config.relay_keepalive_interval = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "kist_interval_ms") {
+        impl_->config.kist_interval_ms = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "probe_interval") {
+        impl_->config.probe_interval = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "state_save_interval") {
+        impl_->config.state_save_interval = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "slab_memory_mb") {
+        impl_->config.slab_memory_mb = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "backend_pool_min_idle") {
+        impl_->config.backend_pool_min_idle = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "backend_pool_max_idle") {
+        impl_->config.backend_pool_max_idle = static_cast<uint32_t>(std::stoi(value));
+    } else if (key == "backend_pool_idle_timeout") {
+        impl_->config.backend_pool_idle_timeout = static_cast<uint32_t>(std::stoi(value));
     } else if (key == "trusted_relays") {
         // Simple array parsing - expect format like ["host:port", "host:port"]
         parseArrayOption(value, impl_->config.trusted_relays);
@@ -240,7 +288,23 @@ void ConfigManager::saveConfig(const std::string& config_file) {
          << "use_ipv6 = " << (impl_->config.use_ipv6 ? "true" : "false") << "\n"
          << "enable_hidden_services = " << (impl_->config.enable_hidden_services ? "true" : "false") << "\n"
          << "max_circuits = " << impl_->config.max_circuits << "\n"
-         << "circuit_timeout = " << impl_->config.circuit_timeout << "\n";
+         << "circuit_timeout = " << impl_->config.circuit_timeout << "\n"
+         << "circuit_build_quantile = " << impl_->config.circuit_build_quantile << "\n"
+         << "preemptive_circuits = " << impl_->config.preemptive_circuits << "\n"
+         << "preemptive_hs_circuits = " << impl_->config.preemptive_hs_circuits << "\n"
+         << "exit_relay = " << (impl_->config.exit_relay ? "true" : "false") << "\n"
+         << "exit_allow_private = " << (impl_->config.exit_allow_private ? "true" : "false") << "\n"
+         << "relay_threads = " << impl_->config.relay_threads << "\n"
+         << "directory_file = \"" << impl_->config.directory_file << "\"\n"
+         << "relay_min_channels = " << impl_->config.relay_min_channels << "\n"
+         << "relay_keepalive_interval = " << impl_->config.relay_keepalive_interval << "\n"
+         << "kist_interval_ms = " << impl_->config.kist_interval_ms << "\n"
+         << "probe_interval = " << impl_->config.probe_interval << "\n"
+         << "state_save_interval = " << impl_->config.state_save_interval << "\n"
+         << "slab_memory_mb = " << impl_->config.slab_memory_mb << "\n"
+         << "backend_pool_min_idle = " << impl_->config.backend_pool_min_idle << "\n"
+         << "backend_pool_max_idle = " << impl_->config.backend_pool_max_idle << "\n"
+         << "backend_pool_idle_timeout = " << impl_->config.backend_pool_idle_timeout << "\n";
     
     // TODO: Save arrays
 }
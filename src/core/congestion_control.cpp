@@ -0,0 +1,150 @@
+#include "kermit/congestion_control.h"
+#include <memory>
+#include <deque>
+#include <algorithm>
+
+namespace kermit {
+
+// CongestionControlConfig implementation
+CongestionControlConfig::CongestionControlConfig()
+    : sendme_increment(31),
+      initial_window(124),
+      min_window(124),
+      max_window(10000),
+      window_step(31),
+      alpha(186),
+      beta(248),
+      gamma(186),
+      delta(310) {}
+
+// CongestionControl implementation
+class CongestionControl::Impl {
+public:
+    CongestionControlConfig config_;
+    uint32_t window_;
+    uint32_t inflight_;
+    uint64_t sent_;
+    std::deque<uint64_t> timestamps_;   // Send times of cells that will elicit a SENDME
+    uint64_t rtt_us_;
+    uint64_t min_rtt_us_;
+    bool slow_start_;
+    uint32_t acked_since_update_;
+
+    explicit Impl(const CongestionControlConfig& config)
+        : config_(config), inflight_(0), sent_(0), rtt_us_(0), min_rtt_us_(0), slow_start_(true),
+          acked_since_update_(0) {
+        if (config_.sendme_increment == 0) {
+            config_.sendme_increment = 1;
+        }
+        config_.min_window = std::max(config_.min_window, config_.sendme_increment);
+        config_.max_window = std::max(config_.max_window, config_.min_window);
+        window_ = std::min(std::max(config_.initial_window, config_.min_window), config_.max_window);
+    }
+
+    void onCellSent(uint64_t now_us) {
+        inflight_++;
+        if (++sent_ % config_.sendme_increment == 0) {
+            timestamps_.push_back(now_us);
+        }
+    }
+
+    bool onSendme(uint64_t now_us) {
+        if (timestamps_.empty() || inflight_ < config_.sendme_increment) {
+            return false;
+        }
+
+        uint64_t sample = now_us - timestamps_.front();
+        timestamps_.pop_front();
+        inflight_ -= config_.sendme_increment;
+
+        sample = std::max<uint64_t>(sample, 1);
+        min_rtt_us_ = min_rtt_us_ == 0 ? sample : std::min(min_rtt_us_, sample);
+        rtt_us_ = rtt_us_ == 0 ? sample : (rtt_us_ * 7 + sample) / 8;
+
+        update();
+        return true;
+    }
+
+    uint32_t bdp() const {
+        if (rtt_us_ == 0) return window_;
+        return static_cast<uint32_t>(static_cast<uint64_t>(window_) * min_rtt_us_ / rtt_us_);
+    }
+
+    void update() {
+        uint32_t bdp_cells = bdp();
+        uint32_t queued = window_ > bdp_cells ? window_ - bdp_cells : 0;
+
+        if (slow_start_) {
+            if (queued < config_.gamma) {
+                window_ += config_.sendme_increment;
+            } else {
+                slow_start_ = false;
+                window_ = bdp_cells + config_.gamma;
+            }
+        } else {
+            // Once per window of acknowledged cells, i.e. once per RTT
+            acked_since_update_ += config_.sendme_increment;
+            if (acked_since_update_ < window_) return;
+            acked_since_update_ = 0;
+
+            if (queued > config_.delta) {
+                window_ = bdp_cells + config_.delta - std::min(config_.window_step, bdp_cells + config_.delta);
+            } else if (queued > config_.beta) {
+                window_ -= std::min(config_.window_step, window_);
+            } else if (queued < config_.alpha) {
+                window_ += config_.window_step;
+            }
+        }
+
+        window_ = std::min(std::max(window_, config_.min_window), config_.max_window);
+    }
+};
+
+// CongestionControl public interface
+CongestionControl::CongestionControl(const CongestionControlConfig& config)
+    : impl_(std::make_unique<Impl>(config)) {}
+
+CongestionControl::~CongestionControl() = default;
+
+bool CongestionControl::canSend() const {
+    return impl_->inflight_ < impl_->window_;
+}
+
+void CongestionControl::onCellSent(uint64_t now_us) {
+    impl_->onCellSent(now_us);
+}
+
+bool CongestionControl::onSendme(uint64_t now_us) {
+    return impl_->onSendme(now_us);
+}
+
+uint32_t CongestionControl::getWindow() const {
+    return impl_->window_;
+}
+
+uint32_t CongestionControl::getInflight() const {
+    return impl_->inflight_;
+}
+
+uint32_t CongestionControl::getBdp() const {
+    return impl_->bdp();
+}
+
+uint64_t CongestionControl::getRttUs() const {
+    return impl_->rtt_us_;
+}
+
+uint64_t CongestionControl::getMinRttUs() const {
+    return impl_->min_rtt_us_;
+}
+
+uint64_t CongestionControl::getOutstandingUs(uint64_t now_us) const {
+    if (impl_->timestamps_.empty() || now_us < impl_->timestamps_.front()) return 0;
+    return now_us - impl_->timestamps_.front();
+}
+
+bool CongestionControl::inSlowStart() const {
+    return impl_->slow_start_;
+}
+
+} // namespace kermit
@@ -1,13 +1,80 @@
 #include "kermit/expose_service.h"
-#include <iostream>
+#include "kermit/backend_pool.h"
+#include "kermit/resolver.h"
+#include "kermit/log.h"
 #include <random>
 #include <sstream>
 #include <iomanip>
 #include <chrono>
 #include <regex>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
 
 namespace kermit {
 
+namespace {
+
+// Failed connects in a row before a backend is taken out of rotation
+constexpr uint32_t kMaxBackendFailures = 3;
+
+// How long a failing backend sits out, per failure beyond the limit
+constexpr uint64_t kBackendDownStepMs = 10000;
+constexpr uint64_t kBackendDownMaxMs = 300000;
+
+// Virtual points per unit of weight on the consistent hash ring, scaled
+// down once a service's ring would pass kMaxRingPoints
+constexpr uint32_t kRingPointsPerWeight = 64;
+constexpr uint64_t kMaxRingPoints = 65536;
+
+uint64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 32-bit FNV-1a
+uint32_t hashKey(const std::string& key, uint32_t seed = 0) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    // Final avalanche so nearby seeds spread over the ring
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+void validateWeight(uint32_t weight) {
+    if (weight < kMinBackendWeight || weight > kMaxBackendWeight) {
+        throw std::invalid_argument("Invalid weight " + std::to_string(weight) + ", expected " +
+                                    std::to_string(kMinBackendWeight) + ".." + std::to_string(kMaxBackendWeight));
+    }
+}
+
+}  // namespace
+
+const char* balancePolicyName(BalancePolicy policy) {
+    switch (policy) {
+        case BalancePolicy::LEAST_CONNECTIONS: return "least-conn";
+        case BalancePolicy::CONSISTENT_HASH: return "consistent-hash";
+    }
+    return "unknown";
+}
+
+bool parseBalancePolicy(const std::string& name, BalancePolicy& policy) {
+    if (name == "least-conn" || name == "least-connections") {
+        policy = BalancePolicy::LEAST_CONNECTIONS;
+        return true;
+    }
+    if (name == "consistent-hash" || name == "hash") {
+        policy = BalancePolicy::CONSISTENT_HASH;
+        return true;
+    }
+    return false;
+}
+
 ServiceRegistry::ServiceRegistry() {}
 
 ServiceRegistry::~ServiceRegistry() {
@@ -33,13 +100,25 @@ std::string ServiceRegistry::generateServiceHash() {
 
 bool ServiceRegistry::isValidServiceHash(const std::string& hash) {
     // Format: 12 hex characters followed by ".uwu"
-    std::regex pattern("^[0-9a-f]{12}\\.uwu$");
-    return std::regex_match(hash, pattern);
+    // Checked by hand: this runs on every lookup, and bulk operations
+    // validate thousands of hashes
+    if (hash.size() != 16 || hash.compare(12, 4, ".uwu") != 0) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < 12; ++i) {
+        char c = hash[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    
+    return true;
 }
 
 std::string ServiceRegistry::normalizeAddress(const std::string& address) {
     // Validate ip:port format
-    std::regex pattern("^([0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}|localhost|[a-zA-Z0-9.-]+):[0-9]{1,5}$");
+    static const std::regex pattern("^([0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}|localhost|[a-zA-Z0-9.-]+):[0-9]{1,5}$");
     
     if (!std::regex_match(address, pattern)) {
         throw std::invalid_argument("Invalid address format. Expected: ip:port or hostname:port");
@@ -48,12 +127,15 @@ std::string ServiceRegistry::normalizeAddress(const std::string& address) {
     return address;
 }
 
-std::string ServiceRegistry::exposeService(const std::string& target_address) {
-    // Validate address format
+std::string ServiceRegistry::exposeService(const std::string& target_address, uint32_t weight,
+                                           BalancePolicy policy) {
+    // Validate address format and weight
     std::string normalized_address = normalizeAddress(target_address);
+    validateWeight(weight);
     
     // Generate unique service hash
     std::string service_hash;
+    std::shared_ptr<BackendPool> pool;
     {
         std::lock_guard<std::mutex> lock(services_mutex_);
         
@@ -68,11 +150,20 @@ std::string ServiceRegistry::exposeService(const std::string& target_address) {
         handle->target_address = normalized_address;
         handle->created_timestamp = std::chrono::system_clock::now().time_since_epoch().count();
         handle->is_active = true;
+        handle->policy = policy;
+        handle->backends.push_back({normalized_address, weight, 0, 0, 0});
+        rebuildHashRing(*handle);
         
         services_[service_hash] = handle;
+        indexBackend(normalized_address, service_hash);
+        pool = backend_pool_;
+    }
+    
+    if (pool) {
+        pool->addTarget(normalized_address);
     }
     
-    std::cout << "Service exposed: " << service_hash << " -> " << normalized_address << std::endl;
+    KERMIT_INFO << "Service exposed: " << service_hash << " -> " << normalized_address;
     return service_hash;
 }
 
@@ -85,12 +176,235 @@ std::string ServiceRegistry::resolveService(const std::string& service_hash) {
     
     auto it = services_.find(service_hash);
     if (it != services_.end() && it->second->is_active) {
-        return it->second->target_address;
+        ServiceBackend* backend = pickBackend(*it->second, "");
+        return backend ? backend->address : "";
     }
     
     return "";
 }
 
+bool ServiceRegistry::addBackend(const std::string& service_hash, const std::string& address, uint32_t weight) {
+    if (!isValidServiceHash(service_hash)) {
+        return false;
+    }
+    
+    std::string normalized_address = normalizeAddress(address);
+    validateWeight(weight);
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        
+        auto it = services_.find(service_hash);
+        if (it == services_.end()) {
+            return false;
+        }
+        
+        auto& backends = it->second->backends;
+        auto existing = std::find_if(backends.begin(), backends.end(),
+                                     [&](const ServiceBackend& b) { return b.address == normalized_address; });
+        if (existing != backends.end()) {
+            // Re-adding a backend updates its weight
+            existing->weight = weight;
+            rebuildHashRing(*it->second);
+            return true;
+        }
+        
+        backends.push_back({normalized_address, weight, 0, 0, 0});
+        rebuildHashRing(*it->second);
+        indexBackend(normalized_address, service_hash);
+        pool = backend_pool_;
+    }
+    
+    if (pool) {
+        pool->addTarget(normalized_address);
+    }
+    
+    KERMIT_INFO << "Backend added: " << service_hash << " -> " << normalized_address
+                << " (weight " << weight << ")";
+    return true;
+}
+
+bool ServiceRegistry::removeBackend(const std::string& service_hash, const std::string& address) {
+    if (!isValidServiceHash(service_hash)) {
+        return false;
+    }
+    
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        
+        auto it = services_.find(service_hash);
+        if (it == services_.end()) {
+            return false;
+        }
+        
+        auto& backends = it->second->backends;
+        auto backend = std::find_if(backends.begin(), backends.end(),
+                                    [&](const ServiceBackend& b) { return b.address == address; });
+        // A service always keeps at least one backend; revoke it instead
+        if (backend == backends.end() || backends.size() == 1) {
+            return false;
+        }
+        
+        backends.erase(backend);
+        if (it->second->target_address == address) {
+            it->second->target_address = backends.front().address;
+        }
+        rebuildHashRing(*it->second);
+        unindexBackend(address, service_hash);
+        pool = backend_pool_;
+    }
+    
+    if (pool) {
+        pool->removeTarget(address);
+    }
+    
+    KERMIT_INFO << "Backend removed: " << service_hash << " -> " << address;
+    return true;
+}
+
+bool ServiceRegistry::setBalancePolicy(const std::string& service_hash, BalancePolicy policy) {
+    if (!isValidServiceHash(service_hash)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    
+    auto it = services_.find(service_hash);
+    if (it == services_.end()) {
+        return false;
+    }
+    
+    it->second->policy = policy;
+    return true;
+}
+
+std::string ServiceRegistry::selectBackend(const std::string& service_hash, const std::string& affinity_key) {
+    if (!isValidServiceHash(service_hash)) {
+        return "";
+    }
+    
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    
+    auto it = services_.find(service_hash);
+    if (it == services_.end() || !it->second->is_active) {
+        return "";
+    }
+    
+    ServiceBackend* backend = pickBackend(*it->second, affinity_key);
+    if (!backend) {
+        return "";
+    }
+    
+    backend->active_connections++;
+    return backend->address;
+}
+
+void ServiceRegistry::releaseBackend(const std::string& service_hash, const std::string& address, bool success) {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    releaseBackendLocked(service_hash, address, success);
+}
+
+void ServiceRegistry::releaseBackendLocked(const std::string& service_hash, const std::string& address, bool success) {
+    auto it = services_.find(service_hash);
+    if (it == services_.end()) {
+        return;
+    }
+    
+    for (auto& backend : it->second->backends) {
+        if (backend.address != address) continue;
+        
+        if (backend.active_connections > 0) {
+            backend.active_connections--;
+        }
+        
+        if (success) {
+            backend.consecutive_failures = 0;
+            backend.down_until_ms = 0;
+        } else if (++backend.consecutive_failures >= kMaxBackendFailures) {
+            uint64_t penalty = kBackendDownStepMs * (backend.consecutive_failures - kMaxBackendFailures + 1);
+            backend.down_until_ms = steadyNowMs() + std::min(penalty, kBackendDownMaxMs);
+            KERMIT_WARN << "Backend " << address << " of " << service_hash
+                        << " marked down after " << backend.consecutive_failures << " failures";
+        }
+        return;
+    }
+}
+
+ServiceBackend* ServiceRegistry::pickBackend(ServiceHandle& handle, const std::string& affinity_key,
+                                             const TriedBackends& exclude) {
+    if (handle.backends.empty()) {
+        return nullptr;
+    }
+    
+    if (handle.backends.size() == 1) {
+        return exclude.count == 0 ? &handle.backends.front() : nullptr;
+    }
+    
+    const uint64_t now = steadyNowMs();
+    auto is_excluded = [&exclude, &handle](const ServiceBackend& b) {
+        return exclude.contains(static_cast<size_t>(&b - handle.backends.data()));
+    };
+    auto is_up = [now, &is_excluded](const ServiceBackend& b) {
+        return b.down_until_ms <= now && !is_excluded(b);
+    };
+    
+    // If every backend is down, keep serving from all of them rather than failing
+    bool any_up = std::any_of(handle.backends.begin(), handle.backends.end(), is_up);
+    
+    if (handle.policy == BalancePolicy::CONSISTENT_HASH && !handle.hash_ring.empty()) {
+        const uint32_t point = hashKey(affinity_key);
+        auto ring_it = std::lower_bound(handle.hash_ring.begin(), handle.hash_ring.end(),
+                                        std::make_pair(point, size_t(0)));
+        
+        // Walk clockwise past backends that are down
+        for (size_t step = 0; step < handle.hash_ring.size(); ++step, ++ring_it) {
+            if (ring_it == handle.hash_ring.end()) {
+                ring_it = handle.hash_ring.begin();
+            }
+            ServiceBackend& candidate = handle.backends[ring_it->second];
+            if (is_excluded(candidate)) continue;
+            if (!any_up || is_up(candidate)) {
+                return &candidate;
+            }
+        }
+    }
+    
+    // Least connections relative to weight: minimise (active + 1) / weight
+    ServiceBackend* best = nullptr;
+    for (auto& backend : handle.backends) {
+        if (is_excluded(backend) || (any_up && !is_up(backend))) continue;
+        
+        if (!best ||
+            uint64_t(backend.active_connections + 1) * best->weight <
+            uint64_t(best->active_connections + 1) * backend.weight) {
+            best = &backend;
+        }
+    }
+    
+    return best;
+}
+
+void ServiceRegistry::rebuildHashRing(ServiceHandle& handle) {
+    handle.hash_ring.clear();
+    
+    uint64_t total_weight = 0;
+    for (const auto& backend : handle.backends) {
+        total_weight += backend.weight;
+    }
+    uint64_t ring_size = std::min(total_weight * kRingPointsPerWeight, kMaxRingPoints);
+    
+    for (size_t i = 0; i < handle.backends.size(); ++i) {
+        const auto& backend = handle.backends[i];
+        uint32_t points = static_cast<uint32_t>(std::max<uint64_t>(backend.weight * ring_size / total_weight, 1));
+        for (uint32_t p = 0; p < points; ++p) {
+            handle.hash_ring.emplace_back(hashKey(backend.address, p), i);
+        }
+    }
+    
+    std::sort(handle.hash_ring.begin(), handle.hash_ring.end());
+}
+
 std::shared_ptr<ServiceHandle> ServiceRegistry::getServiceHandle(const std::string& service_hash) {
     if (!isValidServiceHash(service_hash)) {
         return nullptr;
@@ -111,17 +425,33 @@ bool ServiceRegistry::revokeService(const std::string& service_hash) {
         return false;
     }
     
-    std::lock_guard<std::mutex> lock(services_mutex_);
-    
-    auto it = services_.find(service_hash);
-    if (it != services_.end()) {
+    std::vector<ServiceBackend> backends;
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        
+        auto it = services_.find(service_hash);
+        if (it == services_.end()) {
+            return false;
+        }
+        
         it->second->is_active = false;
+        backends = it->second->backends;
+        for (const auto& backend : backends) {
+            unindexBackend(backend.address, service_hash);
+        }
         services_.erase(it);
-        std::cout << "Service revoked: " << service_hash << std::endl;
-        return true;
+        pool = backend_pool_;
     }
     
-    return false;
+    if (pool) {
+        for (const auto& backend : backends) {
+            pool->removeTarget(backend.address);
+        }
+    }
+    
+    KERMIT_INFO << "Service revoked: " << service_hash;
+    return true;
 }
 
 std::vector<std::shared_ptr<ServiceHandle>> ServiceRegistry::listServices() {
@@ -136,4 +466,376 @@ std::vector<std::shared_ptr<ServiceHandle>> ServiceRegistry::listServices() {
     return result;
 }
 
+ServicePage ServiceRegistry::listServicesPage(const std::string& cursor, size_t limit) {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    
+    ServicePage page;
+    page.services.reserve(std::min(limit, services_.size()));
+    
+    // Resume strictly after the cursor so entries added or removed between
+    // calls never cause a service to be returned twice
+    auto it = cursor.empty() ? services_.begin() : services_.upper_bound(cursor);
+    for (; it != services_.end() && page.services.size() < limit; ++it) {
+        const ServiceHandle& service = *it->second;
+        if (service.is_active) {
+            page.services.push_back(
+                ServiceSummary{service.service_hash, service.target_address, service.policy, service.backends.size()});
+        }
+    }
+    
+    if (it != services_.end() && !page.services.empty()) {
+        page.next_cursor = page.services.back().service_hash;
+    }
+    
+    return page;
+}
+
+size_t ServiceRegistry::getServiceCount() const {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    return services_.size();
+}
+
+std::vector<std::string> ServiceRegistry::findServicesByTarget(const std::string& target_address) {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    
+    auto it = target_index_.find(target_address);
+    if (it == target_index_.end()) {
+        return {};
+    }
+    
+    return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+std::vector<std::string> ServiceRegistry::exposeServices(const std::vector<std::string>& target_addresses) {
+    // Validate outside the lock
+    std::vector<std::string> normalized(target_addresses.size());
+    for (size_t i = 0; i < target_addresses.size(); ++i) {
+        try {
+            normalized[i] = normalizeAddress(target_addresses[i]);
+        } catch (const std::invalid_argument&) {
+            // Leave empty, reported as an empty hash
+        }
+    }
+    
+    std::vector<std::string> hashes(target_addresses.size());
+    std::vector<std::string> exposed_targets;
+    exposed_targets.reserve(target_addresses.size());
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        const uint64_t now = std::chrono::system_clock::now().time_since_epoch().count();
+        
+        for (size_t i = 0; i < normalized.size(); ++i) {
+            if (normalized[i].empty()) continue;
+            
+            std::string service_hash;
+            do {
+                service_hash = generateServiceHash();
+            } while (services_.find(service_hash) != services_.end());
+            
+            auto handle = std::make_shared<ServiceHandle>();
+            handle->service_hash = service_hash;
+            handle->target_address = normalized[i];
+            handle->created_timestamp = now;
+            handle->is_active = true;
+            handle->policy = BalancePolicy::LEAST_CONNECTIONS;
+            handle->backends.push_back({normalized[i], 1, 0, 0, 0});
+            rebuildHashRing(*handle);
+            
+            services_.emplace(service_hash, handle);
+            indexBackend(normalized[i], service_hash);
+            exposed_targets.push_back(normalized[i]);
+            hashes[i] = service_hash;
+        }
+        
+        pool = backend_pool_;
+    }
+    
+    if (pool && !exposed_targets.empty()) {
+        pool->addTargets(exposed_targets);
+    }
+    
+    KERMIT_INFO << "Services exposed: " << exposed_targets.size() << " of "
+                << target_addresses.size() << " requested";
+    return hashes;
+}
+
+size_t ServiceRegistry::revokeServices(const std::vector<std::string>& service_hashes) {
+    std::vector<std::string> released_targets;
+    std::shared_ptr<BackendPool> pool;
+    size_t revoked = 0;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        
+        for (const auto& service_hash : service_hashes) {
+            if (!isValidServiceHash(service_hash)) continue;
+            
+            auto it = services_.find(service_hash);
+            if (it == services_.end()) continue;
+            
+            it->second->is_active = false;
+            for (const auto& backend : it->second->backends) {
+                unindexBackend(backend.address, service_hash);
+                released_targets.push_back(backend.address);
+            }
+            services_.erase(it);
+            revoked++;
+        }
+        
+        pool = backend_pool_;
+    }
+    
+    if (pool && !released_targets.empty()) {
+        pool->removeTargets(released_targets);
+    }
+    
+    KERMIT_INFO << "Services revoked: " << revoked << " of "
+                << service_hashes.size() << " requested";
+    return revoked;
+}
+
+void ServiceRegistry::indexBackend(const std::string& address, const std::string& service_hash) {
+    target_index_[address].insert(service_hash);
+}
+
+void ServiceRegistry::unindexBackend(const std::string& address, const std::string& service_hash) {
+    auto it = target_index_.find(address);
+    if (it == target_index_.end()) {
+        return;
+    }
+    
+    it->second.erase(service_hash);
+    if (it->second.empty()) {
+        target_index_.erase(it);
+    }
+}
+
+std::vector<ServiceHandle> ServiceRegistry::exportServices() const {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    
+    std::vector<ServiceHandle> result;
+    result.reserve(services_.size());
+    for (const auto& pair : services_) {
+        if (pair.second->is_active) {
+            result.push_back(*pair.second);
+        }
+    }
+    return result;
+}
+
+bool ServiceRegistry::restoreService(const ServiceHandle& saved) {
+    if (!isValidServiceHash(saved.service_hash)) {
+        return false;
+    }
+    
+    // Validate outside the lock; drop backends that no longer parse
+    std::vector<ServiceBackend> backends;
+    for (const auto& backend : saved.backends) {
+        try {
+            validateWeight(backend.weight);
+            backends.push_back({normalizeAddress(backend.address), backend.weight, 0, 0, 0});
+        } catch (const std::invalid_argument&) {
+            KERMIT_WARN << "Skipping invalid saved backend " << backend.address;
+        }
+    }
+    if (backends.empty()) {
+        return false;
+    }
+    
+    std::vector<std::string> targets;
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        
+        if (services_.find(saved.service_hash) != services_.end()) {
+            return false;
+        }
+        
+        auto handle = std::make_shared<ServiceHandle>();
+        handle->service_hash = saved.service_hash;
+        handle->target_address = saved.target_address.empty() ? backends.front().address : saved.target_address;
+        handle->created_timestamp = saved.created_timestamp;
+        handle->is_active = true;
+        handle->policy = saved.policy;
+        handle->backends = std::move(backends);
+        rebuildHashRing(*handle);
+        
+        for (const auto& backend : handle->backends) {
+            indexBackend(backend.address, handle->service_hash);
+            targets.push_back(backend.address);
+        }
+        services_.emplace(handle->service_hash, handle);
+        pool = backend_pool_;
+    }
+    
+    if (pool) {
+        pool->addTargets(targets);
+    }
+    return true;
+}
+
+void ServiceRegistry::setBackendPool(std::shared_ptr<BackendPool> pool) {
+    std::vector<std::string> targets;
+    std::shared_ptr<BackendPool> previous;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        previous = backend_pool_;
+        backend_pool_ = pool;
+        for (const auto& pair : services_) {
+            for (const auto& backend : pair.second->backends) {
+                targets.push_back(backend.address);
+            }
+        }
+    }
+    
+    // Move target registrations over to the new pool
+    if (previous) {
+        previous->removeTargets(targets);
+    }
+    if (pool) {
+        pool->addTargets(targets);
+    }
+}
+
+int ServiceRegistry::openServiceConnection(const std::string& service_hash, const std::string& affinity_key) {
+    return openConnection(service_hash, affinity_key, true);
+}
+
+int ServiceRegistry::openServiceConnectionAsync(const std::string& service_hash, const std::string& affinity_key) {
+    return openConnection(service_hash, affinity_key, false);
+}
+
+int ServiceRegistry::openConnection(const std::string& service_hash, const std::string& affinity_key, bool wait) {
+    std::shared_ptr<BackendPool> pool;
+    size_t attempts;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        auto it = services_.find(service_hash);
+        if (it == services_.end()) {
+            return -1;
+        }
+        pool = backend_pool_;
+        attempts = std::min(it->second->backends.size(), TriedBackends::kCapacity);
+    }
+    
+    // Fail over to other backends; each failure feeds passive health checking.
+    // Tried backends are kept by index: an edit to the backend list mid
+    // failover can at worst retry one of them
+    TriedBackends tried;
+    for (size_t attempt = 0; attempt < attempts; ++attempt) {
+        std::string address;
+        {
+            std::lock_guard<std::mutex> lock(services_mutex_);
+            auto it = services_.find(service_hash);
+            if (it == services_.end() || !it->second->is_active) {
+                return -1;
+            }
+            
+            ServiceBackend* backend = pickBackend(*it->second, affinity_key, tried);
+            if (!backend) {
+                return -1;
+            }
+            backend->active_connections++;
+            address = backend->address;
+            tried.index[tried.count++] = static_cast<size_t>(backend - it->second->backends.data());
+        }
+        
+        int fd = pool ? pool->acquire(address, wait) : -1;
+        if (fd == -1 && !wait) {
+            // Loop callers cannot wait for DNS; names not cached yet are left
+            // to resolveBackends and do not count against the backend
+            std::string host;
+            uint16_t port;
+            sockaddr_in target;
+            if (Resolver::splitAddress(address, host, port) && !Resolver::lookup(host, port, target)) {
+                std::lock_guard<std::mutex> lock(services_mutex_);
+                auto it = services_.find(service_hash);
+                if (it != services_.end()) {
+                    for (auto& backend : it->second->backends) {
+                        if (backend.address == address && backend.active_connections > 0) {
+                            backend.active_connections--;
+                        }
+                    }
+                }
+                continue;
+            }
+            fd = BackendPool::startConnect(target);
+        } else if (fd == -1 && !pool) {
+            BackendPoolConfig defaults;
+            fd = BackendPool::connectTarget(address, defaults.connect_timeout_ms);
+        }
+        
+        if (fd != -1) {
+            std::lock_guard<std::mutex> lock(services_mutex_);
+            if (static_cast<size_t>(fd) >= open_connections_.size()) {
+                open_connections_.resize(fd + 1);
+            }
+            open_connections_[fd].first.assign(service_hash);
+            open_connections_[fd].second.assign(address);
+            return fd;
+        }
+        
+        releaseBackend(service_hash, address, false);
+    }
+    
+    return -1;
+}
+
+bool ServiceRegistry::resolveBackends(const std::string& service_hash, std::function<void()> done) {
+    std::vector<std::string> hosts;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        auto it = services_.find(service_hash);
+        if (it == services_.end()) {
+            return false;
+        }
+        
+        for (const auto& backend : it->second->backends) {
+            std::string host;
+            uint16_t port;
+            sockaddr_in address;
+            if (Resolver::splitAddress(backend.address, host, port) && !Resolver::lookup(host, port, address)) {
+                hosts.push_back(host);
+            }
+        }
+    }
+    
+    if (hosts.empty()) {
+        return false;
+    }
+    
+    // done runs once, after the last lookup reports back
+    auto remaining = std::make_shared<std::atomic<size_t>>(hosts.size());
+    for (const auto& host : hosts) {
+        Resolver::resolve(host, [remaining, done](bool) {
+            if (--*remaining == 0) {
+                done();
+            }
+        });
+    }
+    return true;
+}
+
+void ServiceRegistry::closeServiceConnection(int fd, bool reusable, bool connect_failed) {
+    std::shared_ptr<BackendPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        pool = backend_pool_;
+        
+        if (fd >= 0 && static_cast<size_t>(fd) < open_connections_.size() &&
+            !open_connections_[fd].first.empty()) {
+            auto& owner = open_connections_[fd];
+            releaseBackendLocked(owner.first, owner.second, !connect_failed);
+            owner.first.clear();
+            owner.second.clear();
+        }
+    }
+    
+    if (pool) {
+        pool->release(fd, reusable);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+}
+
 }  // namespace kermit
@@ -0,0 +1,347 @@
+#include "kermit/log.h"
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+// Lines a thread may have queued before it starts dropping them
+constexpr size_t kRingLines = 1024;
+
+// How often the writer looks for lines when there were none last time
+constexpr auto kWriterIdle = std::chrono::milliseconds(5);
+
+struct Record {
+    uint64_t time_ns;       // System clock
+    LogLevel level;
+    uint8_t length;
+    char text[LogLine::kMaxLength];
+};
+
+// Lines from one thread; the thread pushes, the writer pops
+struct ThreadRing {
+    Record records[kRingLines];
+    alignas(64) std::atomic<size_t> head{0};    // Next record the thread fills
+    alignas(64) std::atomic<size_t> tail{0};    // Next record the writer reads
+    std::atomic<bool> retired{false};           // Thread has exited; freed once drained
+};
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::WARN: return "WARN";
+        default: return "ERROR";
+    }
+}
+
+void writeAll(int fd, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t n = ::write(fd, data.data() + offset, data.size() - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        offset += static_cast<size_t>(n);
+    }
+}
+
+class Logger {
+public:
+    std::atomic<uint8_t> level_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> lines_;
+    std::atomic<uint64_t> dropped_;
+
+    // Guards rings_ and the writer's lifetime; taken once per thread and by the writer
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+    std::thread writer_;
+    std::atomic<bool> stop_;
+    std::string path_;
+    int fd_;
+
+    // Writer-side buffers, reused every pass
+    std::vector<const Record*> batch_;
+    std::string file_out_;
+    std::string console_out_;
+    std::string error_out_;
+
+    Logger() : level_(static_cast<uint8_t>(LogLevel::INFO)), running_(false), lines_(0), dropped_(0),
+               stop_(false), fd_(-1) {}
+
+    bool start(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            std::cerr << "Logging is already started" << std::endl;
+            return false;
+        }
+
+        if (!path.empty()) {
+            fd_ = openFile(path);
+            if (fd_ < 0) {
+                return false;
+            }
+        }
+        path_ = path;
+
+        // Whatever went to the console so far comes before the writer's output
+        std::cout.flush();
+        stop_ = false;
+        writer_ = std::thread(&Logger::writerLoop, this);
+        running_ = true;
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            // New lines go to the console; the writer's last pass takes the queued ones
+            running_ = false;
+            stop_ = true;
+        }
+        writer_.join();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ != -1) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool reopen() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_ || path_.empty()) return true;
+
+        int fd = openFile(path_);
+        if (fd < 0) {
+            return false;
+        }
+        close(fd_);
+        fd_ = fd;
+        return true;
+    }
+
+    static int openFile(const std::string& path) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+        if (fd < 0) {
+            std::cerr << "Failed to open log file " << path << ": " << strerror(errno) << std::endl;
+        }
+        return fd;
+    }
+
+    ThreadRing* registerThread() {
+        auto ring = std::make_shared<ThreadRing>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(ring);
+        return ring.get();
+    }
+
+    void writerLoop() {
+        while (!stop_) {
+            if (drain() == 0) {
+                std::this_thread::sleep_for(kWriterIdle);
+            }
+        }
+        drain();
+    }
+
+    // Write every queued line, oldest first; returns how many
+    size_t drain() {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Snapshot each ring's head; records up to it are complete
+        batch_.clear();
+        std::vector<size_t> heads(rings_.size());
+        for (size_t i = 0; i < rings_.size(); ++i) {
+            ThreadRing& ring = *rings_[i];
+            heads[i] = ring.head.load(std::memory_order_acquire);
+            for (size_t position = ring.tail.load(std::memory_order_relaxed); position != heads[i]; ++position) {
+                batch_.push_back(&ring.records[position % kRingLines]);
+            }
+        }
+
+        std::stable_sort(batch_.begin(), batch_.end(),
+                         [](const Record* a, const Record* b) { return a->time_ns < b->time_ns; });
+
+        file_out_.clear();
+        console_out_.clear();
+        error_out_.clear();
+        for (const Record* record : batch_) {
+            format(*record);
+        }
+
+        // Hand the records back before the syscalls
+        for (size_t i = 0; i < rings_.size(); ++i) {
+            rings_[i]->tail.store(heads[i], std::memory_order_release);
+        }
+        rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                    [](const std::shared_ptr<ThreadRing>& ring) {
+                                        return ring->retired && ring->tail.load() == ring->head.load();
+                                    }),
+                     rings_.end());
+
+        if (!file_out_.empty()) writeAll(fd_, file_out_);
+        if (!console_out_.empty()) writeAll(STDOUT_FILENO, console_out_);
+        if (!error_out_.empty()) writeAll(STDERR_FILENO, error_out_);
+        lines_ += batch_.size();
+        return batch_.size();
+    }
+
+    // Caller holds mutex_
+    void format(const Record& record) {
+        bool error = record.level >= LogLevel::WARN;
+        if (fd_ == -1) {
+            std::string& out = error ? error_out_ : console_out_;
+            out.append(record.text, record.length).push_back('\n');
+            return;
+        }
+
+        time_t seconds = static_cast<time_t>(record.time_ns / 1000000000);
+        tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[48];
+        size_t n = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &utc);
+        snprintf(stamp + n, sizeof(stamp) - n, ".%03u %-5s ",
+                 static_cast<unsigned>(record.time_ns / 1000000 % 1000), levelName(record.level));
+
+        file_out_.append(stamp).append(record.text, record.length).push_back('\n');
+        if (error) {
+            error_out_.append(record.text, record.length).push_back('\n');
+        }
+    }
+};
+
+// Never destroyed, since threads may log during exit
+Logger& logger() {
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+// The calling thread's ring; retired when the thread exits, after which
+// its lines are written directly
+thread_local ThreadRing* t_ring = nullptr;
+thread_local bool t_exited = false;
+
+struct RingOwner {
+    ~RingOwner() {
+        if (t_ring) {
+            t_ring->retired = true;
+            t_ring = nullptr;
+        }
+        t_exited = true;
+    }
+};
+
+thread_local RingOwner t_owner;
+
+void writeDirect(LogLevel level, const char* text, size_t length) {
+    std::ostream& out = level >= LogLevel::WARN ? std::cerr : std::cout;
+    out.write(text, static_cast<std::streamsize>(length));
+    out << std::endl;
+}
+
+} // namespace
+
+bool Log::start(const std::string& path) {
+    return logger().start(path);
+}
+
+void Log::stop() {
+    logger().stop();
+}
+
+bool Log::reopen() {
+    return logger().reopen();
+}
+
+void Log::setLevel(LogLevel level) {
+    logger().level_ = static_cast<uint8_t>(level);
+}
+
+bool Log::enabled(LogLevel level) {
+    return static_cast<uint8_t>(level) >= logger().level_.load(std::memory_order_relaxed);
+}
+
+void Log::write(LogLevel level, const char* text, size_t length) {
+    Logger& instance = logger();
+    if (!instance.running_.load(std::memory_order_acquire) || t_exited) {
+        writeDirect(level, text, length);
+        return;
+    }
+
+    if (!t_ring) {
+        (void)&t_owner;     // Registers the exit hook
+        t_ring = instance.registerThread();
+    }
+
+    ThreadRing& ring = *t_ring;
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == kRingLines) {
+        instance.dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Record& record = ring.records[head % kRingLines];
+    record.time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    record.level = level;
+    record.length = static_cast<uint8_t>(length);
+    memcpy(record.text, text, length);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+LogStats Log::getStats() {
+    LogStats stats{};
+    stats.lines = logger().lines_;
+    stats.dropped = logger().dropped_;
+    return stats;
+}
+
+// LogLine formatting
+void LogLine::append(const char* text, size_t length) {
+    length = std::min(length, kMaxLength - length_);
+    memcpy(buffer_ + length_, text, length);
+    length_ += length;
+}
+
+LogLine& LogLine::operator<<(const char* text) {
+    append(text, strlen(text));
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& text) {
+    append(text.data(), text.size());
+    return *this;
+}
+
+LogLine& LogLine::operator<<(char c) {
+    append(&c, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(double value) {
+    char text[32];
+    int n = snprintf(text, sizeof(text), "%g", value);
+    if (n > 0) {
+        append(text, std::min(static_cast<size_t>(n), sizeof(text) - 1));
+    }
+    return *this;
+}
+
+} // namespace kermit
@@ -2,14 +2,54 @@
 #include "kermit/config.h"
 #include "kermit/network.h"
 #include "kermit/node_manager.h"
-#include <iostream>
+#include "kermit/directory_loader.h"
+#include "kermit/state_cache.h"
+#include "kermit/relay_directory.h"
+#include "kermit/relay_prober.h"
+#include "kermit/channel_pool.h"
+#include "kermit/circuit_manager.h"
+#include "kermit/circuit_switch.h"
+#include "kermit/circuit_pool.h"
+#include "kermit/cell.h"
+#include "kermit/event_loop.h"
+#include "kermit/socks_server.h"
+#include "kermit/control_server.h"
+#include "kermit/expose_service.h"
+#include "kermit/crypto.h"
+#include "kermit/slab.h"
+#include "kermit/log.h"
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace kermit {
 
+namespace {
+
+// Read by run() from a signalfd: SIGHUP reloads, the others shut down
+sigset_t controlSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    return signals;
+}
+
+} // namespace
+
 // Router implementation
 class Router::Impl {
 public:
@@ -18,13 +58,53 @@ public:
     std::unique_ptr<NodeManager> node_manager_;
     std::atomic<bool> should_stop_;
     
-    Impl() : running_(false), should_stop_(false) {
+    // Loop run() blocks in: signals through a signalfd, stop() through its
+    // eventfd and periodic state saves on a timerfd
+    EventLoop main_loop_;
+    
+    // Shared reactor for client-facing listeners
+    std::unique_ptr<EventLoop> event_loop_;
+    std::thread reactor_thread_;
+    std::unique_ptr<SocksServer> socks_server_;
+    std::unique_ptr<ControlServer> control_server_;
+    ServiceRegistry* service_registry_;
+    
+    // Measures relay latency and health for path selection
+    std::unique_ptr<RelayProber> prober_;
+    
+    // Circuits we originate, circuits we relay for peers, and clean
+    // circuits built ahead of demand
+    std::unique_ptr<CircuitManager> circuit_manager_;
+    std::unique_ptr<CircuitSwitch> circuit_switch_;
+    std::unique_ptr<CircuitPool> circuit_pool_;
+    
+    // Guards we held channels to in the previous run, reconnected first
+    std::vector<std::string> saved_guards_;
+    std::mutex save_mutex_;
+    
+    // Partial cells from peers' channels to our listen port, and buffers
+    // for each read; only touched from the network thread
+    std::unordered_map<ConnectionHandle, CellAssembler> inbound_channels_;
+    std::vector<Cell> inbound_cells_;
+    std::vector<uint8_t> inbound_reply_;
+    
+    Impl() : running_(false), should_stop_(false), service_registry_(nullptr) {
         network_manager_ = std::make_unique<NetworkManager>();
         node_manager_ = std::make_unique<NodeManager>();
     }
     
     ~Impl() {
         stop();
+        
+        // Join the channel thread before the circuit code it calls into goes
+        // away, and drop the circuit code before the node manager whose loop
+        // it runs on
+        circuit_pool_.reset();
+        circuit_manager_.reset();
+        circuit_switch_.reset();
+        node_manager_.reset();
+        
+        Log::stop();
     }
     
     bool initialize(const std::string& config_file) {
@@ -36,49 +116,201 @@ public:
             }
             
             const auto& config = config_manager.getConfig();
+            Slab::setLimit(static_cast<size_t>(config.slab_memory_mb) * 1024 * 1024);
+            
+            // From here lines go through the background writer; with logging
+            // disabled only warnings and errors reach the console
+            if (!config.enable_logging) {
+                Log::setLevel(LogLevel::WARN);
+            }
+            if (!Log::start(config.enable_logging ? config.log_file : std::string())) {
+                Log::start(std::string());
+            }
             
             // Initialize network manager
             if (!network_manager_->initialize(config.listen_port, config.listen_address)) {
-                std::cerr << "Failed to initialize network manager" << std::endl;
+                KERMIT_ERROR << "Failed to initialize network manager";
                 return false;
             }
+            network_manager_->setKistInterval(config.kist_interval_ms);
             
-            // Initialize node manager
-            if (!node_manager_->initialize()) {
-                std::cerr << "Failed to initialize node manager" << std::endl;
+            // Initialize node manager and its relay channel pool
+            ChannelPoolConfig channel_config;
+            channel_config.min_channels = config.relay_min_channels;
+            channel_config.keepalive_interval_ms = config.relay_keepalive_interval * 1000;
+            channel_config.kist_interval_ms = config.kist_interval_ms;
+            if (!node_manager_->initialize(channel_config)) {
+                KERMIT_ERROR << "Failed to initialize node manager";
                 return false;
             }
             
+            initializeCircuits(config);
+            
             // Load relay nodes from configuration
             node_manager_->loadFromConfig(config.trusted_relays);
             
-            std::cout << "Router initialized successfully" << std::endl;
-            std::cout << "Loaded " << node_manager_->getRelayNodeCount() 
-                      << " relay nodes (" << node_manager_->getTrustedRelayNodeCount() 
-                      << " trusted)" << std::endl;
+            // Warm start from the previous run's state
+            restoreState(config);
+            
+            // Bulk-load the relay directory, if one is configured
+            if (!config.directory_file.empty()) {
+                loadDirectory(config.directory_file);
+            }
+            
+            KERMIT_INFO << "Router initialized successfully";
+            KERMIT_INFO << "Loaded " << node_manager_->getRelayNodeCount() 
+                        << " relay nodes (" << node_manager_->getTrustedRelayNodeCount() 
+                        << " trusted)";
             
             return true;
             
         } catch (const std::exception& e) {
-            std::cerr << "Initialization error: " << e.what() << std::endl;
+            KERMIT_ERROR << "Initialization error: " << e.what();
             return false;
         }
     }
     
+    void initializeCircuits(const RouterConfig& config) {
+        // circuit_timeout is the hard limit; the build timeout itself is learned
+        CircuitBuildTimeoutConfig timeout_config;
+        timeout_config.max_timeout_ms = config.circuit_timeout * 1000;
+        timeout_config.initial_timeout_ms = std::min(timeout_config.initial_timeout_ms, timeout_config.max_timeout_ms);
+        timeout_config.min_timeout_ms = std::min(timeout_config.min_timeout_ms, timeout_config.max_timeout_ms);
+        timeout_config.quantile = std::min(std::max(config.circuit_build_quantile, 1u), 99u) / 100.0;
+        circuit_manager_ = std::make_unique<CircuitManager>(*node_manager_, timeout_config);
+        circuit_switch_ = std::make_unique<CircuitSwitch>(*node_manager_, *network_manager_, config.relay_threads);
+        circuit_switch_->setExitEnabled(config.exit_relay);
+        circuit_switch_->setExitAllowPrivate(config.exit_allow_private);
+        
+        CircuitPoolConfig pool_config;
+        pool_config.general_target = config.preemptive_circuits;
+        pool_config.hidden_service_target = config.enable_hidden_services ? config.preemptive_hs_circuits : 0;
+        pool_config.max_circuits = config.max_circuits;
+        circuit_pool_ = std::make_unique<CircuitPool>(*circuit_manager_, pool_config);
+        
+        // Origin circuit ids carry kOriginCircuitBit; everything else was
+        // opened by the switch towards the next hop of a peer's circuit
+        ChannelPool* channels = node_manager_->getChannelPool();
+        CircuitManager* manager = circuit_manager_.get();
+        CircuitSwitch* circuit_switch = circuit_switch_.get();
+        channels->setCellCallback([manager, circuit_switch](ChannelPool::ChannelId channel, RelayId,
+                                                            const Cell& cell) {
+            if (cell.circuit_id & kOriginCircuitBit) {
+                manager->handleCell(channel, cell);
+            } else {
+                circuit_switch->handleChannelCell(channel, cell);
+            }
+        });
+        channels->setCloseCallback([manager, circuit_switch](ChannelPool::ChannelId channel, RelayId) {
+            manager->handleChannelClosed(channel);
+            circuit_switch->handleChannelClosed(channel);
+        });
+    }
+    
+    void loadDirectory(const std::string& path) {
+        std::vector<RelayDescriptor> relays;
+        DirectoryLoadStats stats;
+        if (!DirectoryLoader::load(path, relays, &stats)) {
+            KERMIT_WARN << "Continuing without relay directory " << path;
+            return;
+        }
+        
+        size_t installed = node_manager_->bulkInstall(relays);
+        KERMIT_INFO << "Loaded " << installed << " relays from " << path
+                    << (stats.from_cache ? " (cache)" : "") << " in " << stats.elapsed_ms << " ms, skipped "
+                    << stats.malformed_lines << " malformed lines";
+    }
+    
+    void restoreState(const RouterConfig& config) {
+        StateCache cache(config.data_directory);
+        RouterState state;
+        if (!cache.load(state)) {
+            return;
+        }
+        
+        size_t relays = node_manager_->bulkInstall(state.relays);
+        
+        size_t services = 0;
+        if (service_registry_) {
+            for (const auto& service : state.services) {
+                if (service_registry_->restoreService(service)) {
+                    services++;
+                }
+            }
+        }
+        
+        saved_guards_ = std::move(state.guards);
+        
+        uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t age_s = now_ms > state.saved_at_ms ? (now_ms - state.saved_at_ms) / 1000 : 0;
+        KERMIT_INFO << "Warm start: restored " << relays << " relays, " << services << " services and "
+                    << saved_guards_.size() << " guards saved " << age_s << "s ago";
+    }
+    
+    bool saveState() {
+        // The save timer and stop() may both get here; StateCache writes
+        // through one temporary file
+        std::lock_guard<std::mutex> lock(save_mutex_);
+        const auto& config = ConfigManager::getInstance().getConfig();
+        RouterState state;
+        state.saved_at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        
+        // Only relays from the config or a directory are kept, and trust comes
+        // from those sources again, never from the cache
+        auto snapshot = node_manager_->getSnapshot();
+        const auto& directory = snapshot->directory;
+        const uint8_t runtime_flags = RelayDirectory::TRUSTED | RelayDirectory::CONNECTED | RelayDirectory::LISTED;
+        state.relays.reserve(directory.size());
+        for (size_t i = 0; i < directory.size(); ++i) {
+            uint8_t flags = directory.flags(i);
+            if (!(flags & RelayDirectory::LISTED)) continue;
+            
+            state.relays.push_back({std::string(directory.host(i)), directory.port(i), directory.bandwidth(i),
+                                    static_cast<uint8_t>(flags & ~runtime_flags), directory.latency(i)});
+            if ((flags & RelayDirectory::CONNECTED) && (flags & RelayDirectory::GUARD)) {
+                state.guards.emplace_back(directory.id(i));
+            }
+        }
+        
+        if (service_registry_) {
+            state.services = service_registry_->exportServices();
+        }
+        
+        return StateCache(config.data_directory).save(state);
+    }
+    
     bool start() {
         if (running_) {
-            std::cerr << "Router is already running" << std::endl;
+            KERMIT_ERROR << "Router is already running";
             return false;
         }
         
         try {
+            // Start the reactor and the listeners it serves
+            if (!startReactor()) {
+                stopReactor();
+                return false;
+            }
+            
+            // Callbacks are in place before the network thread can fire them
+            setNetworkCallbacks();
+            
             // Start network manager
             if (!network_manager_->start()) {
-                std::cerr << "Failed to start network manager" << std::endl;
+                KERMIT_ERROR << "Failed to start network manager";
+                stopReactor();
                 return false;
             }
             
-            // Connect to trusted relay nodes
+            // Reconnect to last run's guards first, then to trusted relay nodes
+            for (const auto& node_id : saved_guards_) {
+                if (node_manager_->getRelayNode(node_id)) {
+                    node_manager_->connectToRelayNode(node_id);
+                }
+            }
+            
             auto trusted_nodes = node_manager_->getTrustedRelayNodes();
             for (const auto& node : trusted_nodes) {
                 if (node) {
@@ -86,17 +318,35 @@ public:
                 }
             }
             
+            const auto& config = ConfigManager::getInstance().getConfig();
+            if (config.probe_interval > 0) {
+                RelayProberConfig prober_config;
+                prober_config.interval_ms = config.probe_interval * 1000;
+                prober_ = std::make_unique<RelayProber>(*node_manager_, prober_config);
+                prober_->start();
+            }
+            
+            if (circuit_pool_) {
+                ControlServer* control = control_server_.get();
+                circuit_pool_->setBuiltCallback([control](const std::shared_ptr<Circuit>& circuit) {
+                    if (control) {
+                        control->publishCircuitBuilt(circuit->getCircuitId(), circuit->getHopCount());
+                    }
+                });
+                circuit_pool_->start();
+            }
+            
             running_ = true;
             should_stop_ = false;
             
-            std::cout << "Router started successfully" << std::endl;
-            std::cout << "Connected to " << node_manager_->getTrustedRelayNodeCount() 
-                      << " trusted relay nodes" << std::endl;
+            KERMIT_INFO << "Router started successfully";
+            KERMIT_INFO << "Connected to " << node_manager_->getTrustedRelayNodeCount() 
+                        << " trusted relay nodes";
             
             return true;
             
         } catch (const std::exception& e) {
-            std::cerr << "Start error: " << e.what() << std::endl;
+            KERMIT_ERROR << "Start error: " << e.what();
             return false;
         }
     }
@@ -106,6 +356,20 @@ public:
         
         running_ = false;
         should_stop_ = true;
+        main_loop_.stop();
+        
+        // No builds may be in flight once channels start closing
+        if (circuit_pool_) {
+            circuit_pool_->stop();
+        }
+        
+        if (prober_) {
+            prober_->stop();
+            prober_.reset();
+        }
+        
+        // Save while channel state still shows which guards were in use
+        saveState();
         
         // Disconnect from all relay nodes
         auto trusted_nodes = node_manager_->getTrustedRelayNodes();
@@ -115,29 +379,253 @@ public:
             }
         }
         
-        // Stop network manager
+        // Stop network manager first so its callbacks no longer reach the reactor
         network_manager_->stop();
         
-        std::cout << "Router stopped" << std::endl;
+        if (circuit_switch_) {
+            circuit_switch_->stop();
+        }
+        
+        stopReactor();
+        
+        KERMIT_INFO << "Router stopped";
+    }
+    
+    bool startReactor() {
+        const auto& config = ConfigManager::getInstance().getConfig();
+        
+        event_loop_ = std::make_unique<EventLoop>();
+        if (!event_loop_->initialize()) {
+            KERMIT_ERROR << "Failed to initialize event loop";
+            return false;
+        }
+        
+        if (config.socks_port != 0) {
+            if (service_registry_) {
+                socks_server_ = std::make_unique<SocksServer>(*event_loop_, *service_registry_);
+                if (!socks_server_->start(config.socks_port)) {
+                    KERMIT_ERROR << "Failed to start SOCKS server";
+                    socks_server_.reset();
+                    return false;
+                }
+            } else {
+                KERMIT_WARN << "No service registry attached, SOCKS port disabled";
+            }
+        }
+        
+        if (config.control_port != 0) {
+            startControlServer(config);
+        }
+        
+        if (circuit_switch_ && !circuit_switch_->start()) {
+            return false;
+        }
+        
+        reactor_thread_ = std::thread([this] { event_loop_->run(); });
+        return true;
+    }
+    
+    // The control port is optional; failures disable it without stopping the router
+    void startControlServer(const RouterConfig& config) {
+        std::vector<uint8_t> cookie;
+        std::string cookie_path = config.data_directory + "/control_auth_cookie";
+        try {
+            cookie = CryptoManager().generateRandomBytes(32);
+        } catch (const std::exception& e) {
+            KERMIT_WARN << "Control port disabled: " << e.what();
+            return;
+        }
+        
+        if (!writeAuthCookie(cookie_path, cookie)) {
+            KERMIT_WARN << "Control port disabled: cannot write " << cookie_path;
+            return;
+        }
+        
+        control_server_ = std::make_unique<ControlServer>(*event_loop_, service_registry_);
+        control_server_->setAuthCookie(cookie);
+        
+        control_server_->setStatusProvider([this] {
+            ControlStatusInfo info{};
+            info.relays = node_manager_->getRelayNodeCount();
+            info.trusted_relays = node_manager_->getTrustedRelayNodeCount();
+            info.circuits = circuit_manager_ ? circuit_manager_->getCircuitCount() : 0;
+            if (socks_server_) {
+                auto socks = socks_server_->getStats();
+                info.socks_accepted = socks.accepted;
+                info.socks_active = socks.active;
+                info.bytes_relayed = socks.bytes_relayed;
+            }
+            SlabStats slab = Slab::getStats();
+            info.slab_bytes = slab.slab_bytes;
+            info.slab_fallbacks = slab.fallback_allocations;
+            return info;
+        });
+        
+        control_server_->setRelayProvider([this] {
+            std::vector<ControlRelayInfo> relays;
+            for (const auto& node : node_manager_->getAllRelayNodes()) {
+                if (!node) continue;
+                
+                uint8_t flags = 0;
+                if (node->isTrusted()) flags |= control::RELAY_TRUSTED;
+                if (node->isGuardNode()) flags |= control::RELAY_GUARD;
+                if (node->isExitNode()) flags |= control::RELAY_EXIT;
+                if (node->supportsHiddenServices()) flags |= control::RELAY_HIDDEN_SERVICES;
+                if (node_manager_->isConnectedToRelayNode(node->getNodeId())) flags |= control::RELAY_CONNECTED;
+                
+                relays.push_back({node->getNodeId(), node->getAddress(), node->getPort(), flags});
+            }
+            return relays;
+        });
+        
+        if (!control_server_->start(config.control_port)) {
+            KERMIT_ERROR << "Failed to start control port";
+            control_server_.reset();
+            return;
+        }
+    }
+    
+    void setNetworkCallbacks() {
+        ControlServer* control = control_server_.get();
+        network_manager_->setConnectionCallback([this, control](ConnectionHandle connection, bool connected) {
+            if (!connected) {
+                inbound_channels_.erase(connection);
+                if (circuit_switch_) {
+                    circuit_switch_->handleInboundClosed(connection);
+                }
+                if (control) {
+                    control->publishConnectionClosed(network_manager_->getConnectionName(connection));
+                }
+            }
+        });
+        
+        network_manager_->setDataCallback([this](ConnectionHandle connection, const std::vector<uint8_t>& data) {
+            handleInboundCells(connection, data);
+        });
+    }
+    
+    // Answer keepalive pings from peers' channel pools and hand circuit
+    // cells to the switch, reusing the cell and reply buffers
+    void handleInboundCells(ConnectionHandle connection, const std::vector<uint8_t>& data) {
+        std::vector<Cell>& cells = inbound_cells_;
+        std::vector<uint8_t>& reply = inbound_reply_;
+        cells.clear();
+        reply.clear();
+        inbound_channels_[connection].feed(data.data(), data.size(), cells);
+        
+        for (const auto& cell : cells) {
+            if (cell.command == CellCommand::PING) {
+                Cell::make(cell.circuit_id, CellCommand::PONG).appendTo(reply);
+            } else if (circuit_switch_ && cell.command != CellCommand::PADDING && cell.command != CellCommand::PONG) {
+                circuit_switch_->handleInboundCell(connection, cell);
+            }
+        }
+        
+        if (!reply.empty()) {
+            network_manager_->sendData(connection, reply);
+        }
+    }
+    
+    static bool writeAuthCookie(const std::string& path, const std::vector<uint8_t>& cookie) {
+        mkdir(path.substr(0, path.rfind('/')).c_str(), 0700);
+        
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        
+        // Tighten an existing file left with wider permissions
+        bool ok = fchmod(fd, 0600) == 0 &&
+                  write(fd, cookie.data(), cookie.size()) == static_cast<ssize_t>(cookie.size());
+        close(fd);
+        return ok;
+    }
+    
+    void stopReactor() {
+        if (!event_loop_) return;
+        
+        event_loop_->stop();
+        if (reactor_thread_.joinable()) {
+            reactor_thread_.join();
+        }
+        
+        // Listeners are torn down once the loop no longer dispatches to them
+        control_server_.reset();
+        socks_server_.reset();
+        event_loop_.reset();
     }
     
     void run() {
         if (!running_) {
-            std::cerr << "Router is not running" << std::endl;
+            KERMIT_ERROR << "Router is not running";
+            return;
+        }
+        
+        if (!main_loop_.initialize()) {
+            KERMIT_ERROR << "Failed to initialize router event loop";
             return;
         }
         
-        std::cout << "Router event loop started" << std::endl;
+        // Signals only arrive here if blocked in every thread; see Router::blockSignals()
+        sigset_t signals = controlSignals();
+        int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0) {
+            KERMIT_ERROR << "Failed to create signalfd: " << strerror(errno);
+        } else if (!main_loop_.addFd(signal_fd, EventLoop::READABLE,
+                                     [this, signal_fd](uint32_t) { onSignals(signal_fd); })) {
+            close(signal_fd);
+            signal_fd = -1;
+        }
+        
+        const auto& config = ConfigManager::getInstance().getConfig();
+        int save_timer = -1;
+        if (config.state_save_interval > 0) {
+            save_timer = main_loop_.addTimer(config.state_save_interval * 1000, [this] { saveState(); });
+        }
+        
+        KERMIT_INFO << "Router event loop started";
+        
+        // Returns at once if stop() already ran
+        main_loop_.run();
+        
+        if (save_timer != -1) {
+            main_loop_.cancelTimer(save_timer);
+        }
+        if (signal_fd != -1) {
+            main_loop_.removeFd(signal_fd);
+            close(signal_fd);
+        }
         
-        while (!should_stop_) {
-            // Main event loop
-            // TODO: Implement actual event processing
+        KERMIT_INFO << "Router event loop stopped";
+    }
+    
+    // Runs on the thread in run()
+    void onSignals(int signal_fd) {
+        signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+            if (info.ssi_signo == SIGHUP) {
+                reload();
+                continue;
+            }
             
-            // Sleep for a short time to prevent CPU overload
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            KERMIT_INFO << "Received signal " << info.ssi_signo << ", shutting down...";
+            main_loop_.stop();
+            return;
+        }
+    }
+    
+    // SIGHUP: reopen the log file after rotation and reload the relay
+    // directory; other settings still need a restart
+    void reload() {
+        KERMIT_INFO << "Reloading";
+        if (!Log::reopen()) {
+            KERMIT_ERROR << "Keeping the previous log file";
         }
         
-        std::cout << "Router event loop stopped" << std::endl;
+        const auto& config = ConfigManager::getInstance().getConfig();
+        if (!config.directory_file.empty()) {
+            loadDirectory(config.directory_file);
+        }
     }
 };
 
@@ -162,38 +650,73 @@ void Router::run() {
     impl_->run();
 }
 
+bool Router::blockSignals() {
+    sigset_t signals = controlSignals();
+    int result = pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    if (result != 0) {
+        KERMIT_ERROR << "Failed to block signals: " << strerror(result);
+        return false;
+    }
+    return true;
+}
+
 std::shared_ptr<Circuit> Router::createCircuit() {
-    // TODO: Implement circuit creation
-    std::cerr << "Circuit creation not yet implemented" << std::endl;
-    return nullptr;
+    if (!impl_->circuit_manager_) {
+        KERMIT_ERROR << "Router is not initialized";
+        return nullptr;
+    }
+    
+    // A pre-built circuit costs nothing; otherwise build one now
+    if (auto circuit = impl_->circuit_pool_->acquire(CircuitPurpose::GENERAL)) {
+        return circuit;
+    }
+    
+    const auto& config = ConfigManager::getInstance().getConfig();
+    if (impl_->circuit_manager_->getCircuitCount() >= config.max_circuits) {
+        KERMIT_WARN << "Circuit limit reached (" << config.max_circuits << ")";
+        return nullptr;
+    }
+    
+    auto circuit = impl_->circuit_manager_->build(CircuitPurpose::GENERAL);
+    if (!circuit) {
+        KERMIT_ERROR << "Circuit build failed";
+        return nullptr;
+    }
+    circuit->markDirty();
+    
+    if (impl_->control_server_) {
+        impl_->control_server_->publishCircuitBuilt(circuit->getCircuitId(), circuit->getHopCount());
+    }
+    return circuit;
 }
 
 void Router::destroyCircuit(std::shared_ptr<Circuit> circuit) {
-    // TODO: Implement circuit destruction
-    std::cerr << "Circuit destruction not yet implemented" << std::endl;
+    if (impl_->circuit_manager_) {
+        impl_->circuit_manager_->destroy(circuit);
+    }
 }
 
 bool Router::addHiddenService(const std::string& service_dir) {
     // TODO: Implement hidden service addition
-    std::cerr << "Hidden service addition not yet implemented" << std::endl;
+    KERMIT_ERROR << "Hidden service addition not yet implemented";
     return false;
 }
 
 bool Router::removeHiddenService(const std::string& service_dir) {
     // TODO: Implement hidden service removal
-    std::cerr << "Hidden service removal not yet implemented" << std::endl;
+    KERMIT_ERROR << "Hidden service removal not yet implemented";
     return false;
 }
 
 bool Router::connectToNetwork() {
     // TODO: Implement network connection
-    std::cerr << "Network connection not yet implemented" << std::endl;
+    KERMIT_ERROR << "Network connection not yet implemented";
     return false;
 }
 
 void Router::disconnectFromNetwork() {
     // TODO: Implement network disconnection
-    std::cerr << "Network disconnection not yet implemented" << std::endl;
+    KERMIT_ERROR << "Network disconnection not yet implemented";
 }
 
 bool Router::isRunning() const {
@@ -201,8 +724,7 @@ bool Router::isRunning() const {
 }
 
 size_t Router::getCircuitCount() const {
-    // TODO: Implement circuit count
-    return 0;
+    return impl_->circuit_manager_ ? impl_->circuit_manager_->getCircuitCount() : 0;
 }
 
 size_t Router::getHiddenServiceCount() const {
@@ -227,4 +749,8 @@ bool Router::connectToRelayNode(const std::string& node_id) {
     return impl_->node_manager_->connectToRelayNode(node_id);
 }
 
+void Router::setServiceRegistry(ServiceRegistry* registry) {
+    impl_->service_registry_ = registry;
+}
+
 } // namespace kermit
\ No newline at end of file
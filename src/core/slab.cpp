@@ -0,0 +1,227 @@
+#include "kermit/slab.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+
+namespace kermit {
+
+namespace {
+
+// Smallest block; classes double from here up to Slab::kMaxBlock
+constexpr size_t kMinBlock = 32;
+constexpr size_t kClasses = 6;
+
+constexpr size_t kSlabSize = 64 * 1024;
+constexpr size_t kDefaultLimit = 64 * 1024 * 1024;
+
+// Blocks a thread keeps per class before handing kBatch back to the depot
+constexpr size_t kCacheBlocks = 128;
+constexpr size_t kBatch = 64;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+size_t classOf(size_t bytes) {
+    size_t index = 0;
+    for (size_t size = kMinBlock; size < bytes; size <<= 1) {
+        index++;
+    }
+    return index;
+}
+
+size_t blockSize(size_t index) {
+    return kMinBlock << index;
+}
+
+// Blocks of one class shared by all threads
+struct Depot {
+    std::mutex mutex;
+    FreeBlock* free = nullptr;
+    size_t free_count = 0;
+    char* carve = nullptr;      // Rest of the slab being cut into blocks
+    char* carve_end = nullptr;
+};
+
+class Arena {
+public:
+    // Address range for slabs, reserved at the limit in force when the first
+    // slab is needed; only the pages touched take memory
+    std::atomic<char*> base_;
+    size_t reserved_;
+    std::once_flag reserve_once_;
+    std::atomic<size_t> used_;
+    std::atomic<size_t> limit_;
+    std::atomic<size_t> blocks_out_;
+    std::atomic<uint64_t> fallbacks_;
+    Depot depots_[kClasses];
+
+    Arena() : base_(nullptr), reserved_(0), used_(0), limit_(kDefaultLimit), blocks_out_(0), fallbacks_(0) {}
+
+    bool owns(const void* pointer) const {
+        const char* address = static_cast<const char*>(pointer);
+        const char* base = base_.load(std::memory_order_acquire);
+        return base && address >= base && address < base + reserved_;
+    }
+
+    void reserve() {
+        std::call_once(reserve_once_, [this] {
+            size_t bytes = (limit_.load() + kSlabSize - 1) / kSlabSize * kSlabSize;
+            if (bytes == 0) return;
+            void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+            if (base == MAP_FAILED) return;
+            reserved_ = bytes;
+            base_.store(static_cast<char*>(base), std::memory_order_release);
+        });
+    }
+
+    // Move up to count blocks into list; returns how many
+    size_t take(size_t index, FreeBlock*& list, size_t count) {
+        Depot& depot = depots_[index];
+        size_t size = blockSize(index);
+        size_t taken = 0;
+
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        while (taken < count) {
+            FreeBlock* block;
+            if (depot.free) {
+                block = depot.free;
+                depot.free = block->next;
+                depot.free_count--;
+            } else {
+                if (depot.carve == depot.carve_end && !newSlab(depot)) break;
+                block = reinterpret_cast<FreeBlock*>(depot.carve);
+                depot.carve += size;
+            }
+            block->next = list;
+            list = block;
+            taken++;
+        }
+        blocks_out_ += taken;
+        return taken;
+    }
+
+    // Return count blocks from the front of list
+    void give(size_t index, FreeBlock*& list, size_t count) {
+        Depot& depot = depots_[index];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        for (size_t i = 0; i < count && list; ++i) {
+            FreeBlock* block = list;
+            list = block->next;
+            block->next = depot.free;
+            depot.free = block;
+            depot.free_count++;
+        }
+        blocks_out_ -= count;
+    }
+
+    // Caller holds the depot's mutex
+    bool newSlab(Depot& depot) {
+        reserve();
+        char* base = base_.load(std::memory_order_acquire);
+        if (!base) return false;
+        size_t used = used_.load();
+        do {
+            if (used + kSlabSize > limit_.load() || used + kSlabSize > reserved_) return false;
+        } while (!used_.compare_exchange_weak(used, used + kSlabSize));
+
+        depot.carve = base + used;
+        depot.carve_end = depot.carve + kSlabSize;
+        return true;
+    }
+};
+
+// Never destroyed, since threads may free blocks during exit
+Arena& arena() {
+    static Arena* instance = new Arena();
+    return *instance;
+}
+
+// Free blocks held by one thread, returned when it exits
+struct ThreadCache {
+    FreeBlock* free[kClasses] = {};
+    size_t count[kClasses] = {};
+    bool exited = false;    // Blocks freed by later thread-exit destructors go straight back
+
+    ~ThreadCache() {
+        for (size_t index = 0; index < kClasses; ++index) {
+            if (count[index] > 0) {
+                arena().give(index, free[index], count[index]);
+                count[index] = 0;
+            }
+        }
+        exited = true;
+    }
+};
+
+thread_local ThreadCache cache;
+
+void* fallback(size_t bytes) {
+    arena().fallbacks_.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(bytes);
+}
+
+} // namespace
+
+void* Slab::allocate(size_t bytes) {
+    if (bytes == 0 || bytes > kMaxBlock || cache.exited) {
+        return fallback(bytes);
+    }
+
+    size_t index = classOf(bytes);
+    if (cache.count[index] == 0) {
+        cache.count[index] += arena().take(index, cache.free[index], kBatch);
+        if (cache.count[index] == 0) {
+            return fallback(bytes);
+        }
+    }
+
+    FreeBlock* block = cache.free[index];
+    cache.free[index] = block->next;
+    cache.count[index]--;
+    return block;
+}
+
+void Slab::deallocate(void* pointer, size_t bytes) {
+    if (!pointer) return;
+    if (!arena().owns(pointer)) {
+        ::operator delete(pointer);
+        return;
+    }
+
+    size_t index = classOf(bytes);
+    FreeBlock* block = static_cast<FreeBlock*>(pointer);
+    if (cache.exited) {
+        block->next = nullptr;
+        arena().give(index, block, 1);
+        return;
+    }
+    block->next = cache.free[index];
+    cache.free[index] = block;
+    if (++cache.count[index] > kCacheBlocks) {
+        arena().give(index, cache.free[index], kBatch);
+        cache.count[index] -= kBatch;
+    }
+}
+
+void Slab::setLimit(size_t bytes) {
+    arena().limit_ = bytes;
+}
+
+SlabStats Slab::getStats() {
+    Arena& instance = arena();
+    SlabStats stats{};
+    stats.limit_bytes = instance.limit_;
+    stats.slab_bytes = instance.used_;
+    stats.blocks_out = instance.blocks_out_;
+    stats.fallback_allocations = instance.fallbacks_;
+    for (Depot& depot : instance.depots_) {
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        stats.blocks_free += depot.free_count;
+    }
+    return stats;
+}
+
+} // namespace kermit
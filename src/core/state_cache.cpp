@@ -0,0 +1,222 @@
+#include "kermit/state_cache.h"
+#include "kermit/log.h"
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+constexpr char kStateMagic[4] = {'K', 'R', 'S', 'T'};
+// 2: only relays from the config or a directory are saved, so caches that
+// may hold relays added at runtime are dropped
+constexpr uint32_t kStateVersion = 2;
+
+// Host byte order throughout; the file never leaves this machine
+class StateWriter {
+public:
+    explicit StateWriter(std::string& out) : out_(out) {}
+
+    template <typename T>
+    void put(T value) {
+        out_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void putString(const std::string& value) {
+        uint16_t len = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+        put(len);
+        out_.append(value.data(), len);
+    }
+
+private:
+    std::string& out_;
+};
+
+// Bounds-checked reader; any overrun marks it failed
+class StateReader {
+public:
+    StateReader(const std::string& data) : data_(data), pos_(0), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (!need(sizeof(T))) return value;
+        memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    std::string getString() {
+        uint16_t len = get<uint16_t>();
+        if (!need(len)) return "";
+        std::string value = data_.substr(pos_, len);
+        pos_ += len;
+        return value;
+    }
+
+    // Reject absurd counts before reserving for them
+    bool plausible(uint32_t count, size_t min_record_size) const {
+        return ok_ && count <= (data_.size() - pos_) / min_record_size;
+    }
+
+private:
+    bool need(size_t count) {
+        if (!ok_ || data_.size() - pos_ < count) {
+            ok_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    const std::string& data_;
+    size_t pos_;
+    bool ok_;
+};
+
+} // namespace
+
+StateCache::StateCache(const std::string& data_directory)
+    : data_directory_(data_directory), path_(data_directory + "/state.bin") {}
+
+const std::string& StateCache::getPath() const {
+    return path_;
+}
+
+bool StateCache::load(RouterState& state) const {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    StateReader reader(data);
+
+    char magic[4];
+    for (char& c : magic) c = reader.get<char>();
+    if (!reader.ok() || memcmp(magic, kStateMagic, sizeof(magic)) != 0 ||
+        reader.get<uint32_t>() != kStateVersion) {
+        KERMIT_WARN << "Ignoring state cache with unknown format: " << path_;
+        return false;
+    }
+
+    RouterState loaded;
+    loaded.saved_at_ms = reader.get<uint64_t>();
+
+    uint32_t relay_count = reader.get<uint32_t>();
+    if (!reader.plausible(relay_count, 13)) return false;
+    loaded.relays.reserve(relay_count);
+    for (uint32_t i = 0; i < relay_count; ++i) {
+        RelayDescriptor relay{};
+        relay.flags = reader.get<uint8_t>();
+        relay.port = reader.get<uint16_t>();
+        relay.bandwidth = reader.get<uint32_t>();
+        relay.latency_us = reader.get<uint32_t>();
+        relay.host = reader.getString();
+        loaded.relays.push_back(std::move(relay));
+    }
+
+    uint32_t guard_count = reader.get<uint32_t>();
+    if (!reader.plausible(guard_count, 2)) return false;
+    for (uint32_t i = 0; i < guard_count; ++i) {
+        loaded.guards.push_back(reader.getString());
+    }
+
+    uint32_t service_count = reader.get<uint32_t>();
+    if (!reader.plausible(service_count, 13)) return false;
+    loaded.services.reserve(service_count);
+    for (uint32_t i = 0; i < service_count; ++i) {
+        ServiceHandle service{};
+        service.service_hash = reader.getString();
+        service.target_address = reader.getString();
+        service.created_timestamp = reader.get<uint64_t>();
+        uint8_t policy = reader.get<uint8_t>();
+        service.policy = policy == static_cast<uint8_t>(BalancePolicy::CONSISTENT_HASH)
+                             ? BalancePolicy::CONSISTENT_HASH : BalancePolicy::LEAST_CONNECTIONS;
+        service.is_active = true;
+
+        uint16_t backend_count = reader.get<uint16_t>();
+        for (uint16_t b = 0; b < backend_count && reader.ok(); ++b) {
+            ServiceBackend backend{};
+            backend.address = reader.getString();
+            backend.weight = reader.get<uint32_t>();
+            service.backends.push_back(std::move(backend));
+        }
+        loaded.services.push_back(std::move(service));
+    }
+
+    if (!reader.ok()) {
+        KERMIT_WARN << "Ignoring truncated state cache: " << path_;
+        return false;
+    }
+
+    state = std::move(loaded);
+    return true;
+}
+
+bool StateCache::save(const RouterState& state) const {
+    std::string buffer;
+    buffer.reserve(64 + state.relays.size() * 32 + state.services.size() * 64);
+    StateWriter writer(buffer);
+
+    buffer.append(kStateMagic, sizeof(kStateMagic));
+    writer.put(kStateVersion);
+    writer.put(state.saved_at_ms);
+
+    writer.put(static_cast<uint32_t>(state.relays.size()));
+    for (const auto& relay : state.relays) {
+        writer.put(relay.flags);
+        writer.put(relay.port);
+        writer.put(relay.bandwidth);
+        writer.put(relay.latency_us);
+        writer.putString(relay.host);
+    }
+
+    writer.put(static_cast<uint32_t>(state.guards.size()));
+    for (const auto& guard : state.guards) {
+        writer.putString(guard);
+    }
+
+    writer.put(static_cast<uint32_t>(state.services.size()));
+    for (const auto& service : state.services) {
+        writer.putString(service.service_hash);
+        writer.putString(service.target_address);
+        writer.put(service.created_timestamp);
+        writer.put(static_cast<uint8_t>(service.policy));
+
+        uint16_t backend_count = static_cast<uint16_t>(std::min<size_t>(service.backends.size(), 0xFFFF));
+        writer.put(backend_count);
+        for (uint16_t b = 0; b < backend_count; ++b) {
+            writer.putString(service.backends[b].address);
+            writer.put(service.backends[b].weight);
+        }
+    }
+
+    mkdir(data_directory_.c_str(), 0700);
+
+    std::string tmp_path = path_ + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        KERMIT_ERROR << "Failed to write state cache " << tmp_path << ": " << strerror(errno);
+        return false;
+    }
+
+    bool ok = write(fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size()) &&
+              fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        KERMIT_ERROR << "Failed to write state cache " << path_ << ": " << strerror(errno);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace kermit
@@ -0,0 +1,906 @@
+#include "kermit/stream_mux.h"
+#include "kermit/slab.h"
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstring>
+
+namespace kermit {
+
+StreamMuxConfig::StreamMuxConfig()
+    : congestion_control(true),
+      circuit_window(1000),
+      circuit_increment(100),
+      stream_window(500),
+      stream_increment(50),
+      max_streams(256),
+      max_stream_queued_bytes(64 * 1024),
+      max_queued_bytes(256 * 1024),
+      max_reorder_cells(4096) {}
+
+namespace {
+
+// Bytes of the nonce naming a linked set
+constexpr size_t kLinkNonceSize = 16;
+
+// DATA avoids legs slower than this many times the fastest, whose cells
+// would hold up the ones sent after them on faster legs
+constexpr uint64_t kMaxLegRttRatio = 2;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void writeU64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+    }
+}
+
+uint64_t readU64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// Cells that belong to a stream; these are numbered across legs, the rest
+// concern only the leg they arrive on
+bool isStreamCell(const RelayHeader& header) {
+    switch (header.command) {
+        case RelayCommand::BEGIN:
+        case RelayCommand::CONNECTED:
+        case RelayCommand::DATA:
+        case RelayCommand::END:
+            return true;
+        case RelayCommand::SENDME:
+            return header.stream_id != 0;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+// StreamMux implementation
+class StreamMux::Impl : public SlabAllocated {
+public:
+    struct Stream {
+        std::string target;
+        bool connected;             // CONNECTED seen (opener) or sent (acceptor)
+        bool remote_closed;         // END received
+        bool end_pending;           // close() called; END follows the queued data
+        bool write_blocked;         // A write() came up short; WRITABLE is owed
+        bool active;                // Queued in active_
+        std::vector<uint8_t> out;   // Unsent data from out_offset on
+        size_t out_offset;
+        std::vector<uint8_t> in;    // Unread data from in_offset on
+        size_t in_offset;
+        std::deque<size_t, SlabAllocator<size_t>> in_cells;  // Unread bytes left of each received cell
+        uint32_t package_window;
+        uint32_t deliver_window;
+        uint32_t unacked;           // Cells read but not yet acknowledged
+
+        size_t queued() const { return out.size() - out_offset; }
+        size_t buffered() const { return in.size() - in_offset; }
+    };
+
+    using Events = std::vector<std::pair<uint16_t, StreamEvent>, SlabAllocator<std::pair<uint16_t, StreamEvent>>>;
+
+    enum class LegState {
+        WAITING,    // LINK held back until leg 0 is linked
+        LINKING,    // LINK sent, no LINKED yet
+        ACTIVE,
+        CLOSED
+    };
+
+    // One circuit carrying the streams
+    struct Leg {
+        CellSender sender;
+        LegState state;
+        std::unique_ptr<CongestionControl> congestion;
+        uint32_t package_window;    // Fixed window only
+        uint32_t deliver_window;
+        uint32_t circuit_unacked;
+        uint32_t trailing;          // Stream cells other than DATA sent since its last DATA
+        uint64_t seq_sent;          // Stream cells sent on the set as of this leg's last one
+        uint64_t seq_received;      // Likewise for cells received
+        uint64_t link_sent_us;
+        uint64_t link_rtt_us;       // LINK to LINKED, until SENDMEs measure the leg
+
+        bool canSend() const {
+            if (state != LegState::ACTIVE) return false;
+            return congestion ? congestion->canSend() : package_window > 0;
+        }
+
+        uint64_t rttUs(uint64_t now_us) const {
+            if (!congestion) return link_rtt_us;
+            uint64_t rtt = congestion->getRttUs();
+            return std::max(rtt ? rtt : link_rtt_us, congestion->getOutstandingUs(now_us));
+        }
+    };
+
+    // A stream cell that arrived ahead of an earlier one; held in slab
+    // blocks, as a stalled leg can leave thousands waiting
+    struct Pending {
+        RelayHeader header;
+        std::vector<uint8_t, SlabAllocator<uint8_t>> data;
+    };
+    using Streams = std::unordered_map<uint16_t, Stream, std::hash<uint16_t>, std::equal_to<uint16_t>,
+                                       SlabAllocator<std::pair<const uint16_t, Stream>>>;
+
+    StreamMuxConfig config_;
+    mutable std::mutex mutex_;
+    EventCallback callback_;
+    Streams streams_;
+    std::deque<uint16_t> active_;
+    uint16_t next_stream_id_;
+    size_t blocked_writers_;
+
+    uint32_t circuit_increment_;
+    size_t queued_bytes_;
+
+    std::vector<Leg> legs_;
+    LegId current_leg_;
+    bool linking_;                  // LINK sent on leg 0
+    bool linked_;                   // Leg 0 answered it
+    std::string nonce_;
+    uint64_t seq_sent_;             // Stream cells sent over all legs
+    uint64_t seq_delivered_;        // Stream cells received and handled in order
+    std::map<uint64_t, Pending, std::less<uint64_t>, SlabAllocator<std::pair<const uint64_t, Pending>>> reorder_;
+
+    uint64_t cells_sent_;
+    uint64_t cells_received_;
+    uint64_t sendmes_sent_;
+    uint64_t reordered_cells_;
+    uint64_t leg_switches_;
+
+    Impl(CellSender sender, const StreamMuxConfig& config)
+        : config_(config), next_stream_id_(1), blocked_writers_(0), circuit_increment_(config.circuit_increment),
+          queued_bytes_(0), current_leg_(0), linking_(false), linked_(false), seq_sent_(0), seq_delivered_(0),
+          cells_sent_(0), cells_received_(0), sendmes_sent_(0), reordered_cells_(0), leg_switches_(0) {
+        if (config_.congestion_control) {
+            circuit_increment_ = std::max<uint32_t>(config_.congestion.sendme_increment, 1);
+        }
+        legs_.push_back(newLeg(std::move(sender), LegState::ACTIVE));
+    }
+
+    Leg newLeg(CellSender sender, LegState state) const {
+        Leg leg{};
+        leg.sender = std::move(sender);
+        leg.state = state;
+        leg.package_window = config_.circuit_window;
+        leg.deliver_window = config_.circuit_window;
+        if (config_.congestion_control) {
+            leg.congestion = std::make_unique<CongestionControl>(config_.congestion);
+            leg.deliver_window = config_.congestion.max_window;
+        }
+        return leg;
+    }
+
+    bool canPackage() const {
+        for (const Leg& leg : legs_) {
+            if (leg.canSend()) return true;
+        }
+        return false;
+    }
+
+    // Stream cells go on the lowest-RTT leg, staying on the current one on
+    // a tie; DATA only on legs with room, and never on one much slower than
+    // the fastest
+    LegId pickLeg(bool data) const {
+        // Legs not measured yet are tried rather than compared
+        uint64_t now = nowUs();
+        uint64_t fastest = UINT64_MAX;
+        for (const Leg& leg : legs_) {
+            uint64_t rtt = leg.rttUs(now);
+            if (leg.state == LegState::ACTIVE && rtt > 0) {
+                fastest = std::min(fastest, rtt);
+            }
+        }
+
+        LegId best = kInvalidLeg;
+        uint64_t best_rtt = 0;
+        for (LegId id = 0; id < legs_.size(); ++id) {
+            const Leg& leg = legs_[id];
+            if (data ? !leg.canSend() : leg.state != LegState::ACTIVE) continue;
+            uint64_t rtt = leg.rttUs(now);
+            if (data && fastest != UINT64_MAX && rtt > fastest * kMaxLegRttRatio) continue;
+            if (best == kInvalidLeg || rtt < best_rtt || (id == current_leg_ && rtt == best_rtt)) {
+                best = id;
+                best_rtt = rtt;
+            }
+        }
+        return best;
+    }
+
+    // Send a stream cell, first telling the receiver where the numbering
+    // stands if other legs carried cells since this one last did
+    bool sendStream(RelayCommand command, uint16_t id, const uint8_t* data, size_t len) {
+        bool is_data = command == RelayCommand::DATA;
+        LegId leg_id = pickLeg(is_data);
+        if (leg_id == kInvalidLeg) return false;
+        Leg& leg = legs_[leg_id];
+
+        if (leg.seq_sent != seq_sent_) {
+            uint8_t seq[8];
+            writeU64(seq, seq_sent_);
+            if (!leg.sender(RelayCommand::SWITCH, 0, seq, sizeof(seq))) return false;
+            leg.seq_sent = seq_sent_;
+            leg_switches_++;
+        }
+        current_leg_ = leg_id;
+
+        if (!leg.sender(command, id, data, len)) return false;
+        leg.seq_sent = ++seq_sent_;
+        if (!is_data) {
+            leg.trailing++;
+        } else {
+            leg.trailing = 0;
+            cells_sent_++;
+            if (leg.congestion) {
+                leg.congestion->onCellSent(nowUs());
+            } else {
+                leg.package_window--;
+            }
+        }
+        return true;
+    }
+
+    // Without congestion control the circuit is acknowledged as cells are
+    // read; there is only leg 0 then
+    void creditRead(size_t cells) {
+        if (!config_.congestion_control) {
+            legs_[0].circuit_unacked += cells;
+        }
+    }
+
+    Stream newStream(const std::string& target) const {
+        Stream stream{};
+        stream.target = target;
+        stream.package_window = config_.stream_window;
+        stream.deliver_window = config_.stream_window;
+        return stream;
+    }
+
+    uint16_t open(const std::string& target) {
+        if (streams_.size() >= config_.max_streams) return 0;
+
+        uint16_t id;
+        do {
+            id = next_stream_id_++;
+        } while (id == 0 || streams_.count(id));
+
+        if (!sendStream(RelayCommand::BEGIN, id, reinterpret_cast<const uint8_t*>(target.data()), target.size())) {
+            return 0;
+        }
+        streams_.emplace(id, newStream(target));
+        return id;
+    }
+
+    void accept(uint16_t id, Events& events) {
+        auto it = streams_.find(id);
+        if (it == streams_.end() || it->second.connected) return;
+
+        if (!sendStream(RelayCommand::CONNECTED, id, nullptr, 0)) {
+            return;
+        }
+        it->second.connected = true;
+        activate(id, it->second);
+        pump(events);
+    }
+
+    size_t writeSpace(const Stream& stream) const {
+        if (stream.end_pending || stream.remote_closed) return 0;
+        size_t stream_space = config_.max_stream_queued_bytes - std::min(config_.max_stream_queued_bytes, stream.queued());
+        size_t circuit_space = config_.max_queued_bytes - std::min(config_.max_queued_bytes, queued_bytes_);
+        return std::min(stream_space, circuit_space);
+    }
+
+    size_t write(uint16_t id, const uint8_t* data, size_t len, Events& events) {
+        auto it = streams_.find(id);
+        if (it == streams_.end()) return 0;
+        Stream& stream = it->second;
+
+        size_t accepted = std::min(len, writeSpace(stream));
+        if (accepted < len) {
+            block(stream);
+        }
+        if (accepted == 0) return 0;
+
+        stream.out.insert(stream.out.end(), data, data + accepted);
+        queued_bytes_ += accepted;
+        activate(id, stream);
+        pump(events);
+        return accepted;
+    }
+
+    // Owe the stream a WRITABLE event
+    void block(Stream& stream) {
+        if (!stream.write_blocked && !stream.end_pending && !stream.remote_closed) {
+            stream.write_blocked = true;
+            blocked_writers_++;
+        }
+    }
+
+    size_t read(uint16_t id, uint8_t* out, size_t len, Events& events) {
+        auto it = streams_.find(id);
+        if (it == streams_.end()) return 0;
+        Stream& stream = it->second;
+
+        size_t taken = std::min(len, stream.buffered());
+        memcpy(out, stream.in.data() + stream.in_offset, taken);
+        stream.in_offset += taken;
+        if (stream.in_offset == stream.in.size()) {
+            stream.in.clear();
+            stream.in_offset = 0;
+        } else if (stream.in_offset > stream.in.size() / 2) {
+            stream.in.erase(stream.in.begin(), stream.in.begin() + stream.in_offset);
+            stream.in_offset = 0;
+        }
+
+        // Whole cells read are what the peer gets credit for
+        size_t remaining = taken;
+        while (!stream.in_cells.empty() && remaining >= stream.in_cells.front()) {
+            remaining -= stream.in_cells.front();
+            stream.in_cells.pop_front();
+            stream.unacked++;
+            creditRead(1);
+        }
+        if (!stream.in_cells.empty()) {
+            stream.in_cells.front() -= remaining;
+        }
+
+        sendAcks();
+        pump(events);
+        return taken;
+    }
+
+    void close(uint16_t id, Events& events) {
+        auto it = streams_.find(id);
+        if (it == streams_.end()) return;
+        Stream& stream = it->second;
+
+        // Unread data will never be read, so credit the circuit for it now
+        creditRead(stream.in_cells.size());
+        stream.in_cells.clear();
+        stream.in.clear();
+        stream.in_offset = 0;
+
+        if (stream.remote_closed || stream.queued() == 0) {
+            if (!stream.remote_closed && !stream.end_pending) {
+                sendStream(RelayCommand::END, id, nullptr, 0);
+            }
+            erase(it);
+        } else {
+            stream.end_pending = true;
+            if (stream.write_blocked) {
+                stream.write_blocked = false;
+                blocked_writers_--;
+            }
+        }
+        sendAcks();
+        pump(events);
+    }
+
+    bool handleCell(LegId leg_id, const RelayHeader& header, const uint8_t* data, Events& events) {
+        if (leg_id >= legs_.size()) return false;
+        Leg& leg = legs_[leg_id];
+        if (leg.state == LegState::CLOSED) return true;
+
+        if (isStreamCell(header)) {
+            if (header.command == RelayCommand::DATA) {
+                if (leg.deliver_window == 0) return false;
+                leg.deliver_window--;
+                cells_received_++;
+
+                // With congestion control the circuit is acknowledged on arrival
+                if (leg.congestion) {
+                    leg.circuit_unacked++;
+                }
+            }
+
+            uint64_t seq = ++leg.seq_received;
+            if (seq <= seq_delivered_) return false;
+            if (seq > seq_delivered_ + 1) {
+                // An earlier cell is still on its way over another leg
+                if (reorder_.size() >= config_.max_reorder_cells) return false;
+                reorder_[seq] = Pending{header, {data, data + header.length}};
+                reordered_cells_++;
+            } else {
+                seq_delivered_++;
+                if (!handleStream(header, data, events)) return false;
+
+                while (!reorder_.empty() && reorder_.begin()->first == seq_delivered_ + 1) {
+                    Pending pending = std::move(reorder_.begin()->second);
+                    reorder_.erase(reorder_.begin());
+                    seq_delivered_++;
+                    if (!handleStream(pending.header, pending.data.data(), events)) return false;
+                }
+            }
+        } else {
+            switch (header.command) {
+                case RelayCommand::SENDME:
+                    if (leg.congestion) {
+                        if (!leg.congestion->onSendme(nowUs())) return false;
+                    } else {
+                        if (leg.package_window + circuit_increment_ > config_.circuit_window) return false;
+                        leg.package_window += circuit_increment_;
+                    }
+                    break;
+
+                case RelayCommand::LINKED:
+                    if (!onLinked(leg_id)) return false;
+                    break;
+
+                case RelayCommand::SWITCH: {
+                    if (header.length < 8) return false;
+                    uint64_t seq = readU64(data);
+                    if (seq < leg.seq_received) return false;
+                    leg.seq_received = seq;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        sendAcks();
+        pump(events);
+        return true;
+    }
+
+    // A stream cell, in order
+    bool handleStream(const RelayHeader& header, const uint8_t* data, Events& events) {
+        uint16_t id = header.stream_id;
+        auto it = streams_.find(id);
+
+        switch (header.command) {
+            case RelayCommand::BEGIN:
+                if (id == 0 || it != streams_.end() || streams_.size() >= config_.max_streams) {
+                    sendStream(RelayCommand::END, id, nullptr, 0);
+                    break;
+                }
+                streams_.emplace(id, newStream(std::string(reinterpret_cast<const char*>(data), header.length)));
+                events.emplace_back(id, StreamEvent::BEGIN);
+                break;
+
+            case RelayCommand::CONNECTED:
+                if (it != streams_.end() && !it->second.connected) {
+                    it->second.connected = true;
+                    events.emplace_back(id, StreamEvent::CONNECTED);
+                    activate(id, it->second);
+                }
+                break;
+
+            case RelayCommand::DATA: {
+                if (it == streams_.end() || it->second.end_pending || header.length == 0) {
+                    // Nobody will read it
+                    creditRead(1);
+                    break;
+                }
+                Stream& stream = it->second;
+                if (stream.deliver_window == 0) return false;
+                stream.deliver_window--;
+
+                stream.in.insert(stream.in.end(), data, data + header.length);
+                stream.in_cells.push_back(header.length);
+                events.emplace_back(id, StreamEvent::READABLE);
+                break;
+            }
+
+            case RelayCommand::END:
+                if (it == streams_.end()) break;
+                if (it->second.end_pending) {
+                    erase(it);
+                    break;
+                }
+                endLocally(it->first, it->second, events);
+                break;
+
+            case RelayCommand::SENDME:
+                if (it != streams_.end()) {
+                    Stream& stream = it->second;
+                    if (stream.package_window + config_.stream_increment > config_.stream_window) return false;
+                    stream.package_window += config_.stream_increment;
+                    activate(id, stream);
+                }
+                break;
+
+            default:
+                break;
+        }
+        return true;
+    }
+
+    // The peer ended the stream, or can no longer reach it
+    void endLocally(uint16_t id, Stream& stream, Events& events) {
+        stream.remote_closed = true;
+        queued_bytes_ -= stream.queued();
+        stream.out.clear();
+        stream.out_offset = 0;
+        if (stream.write_blocked) {
+            stream.write_blocked = false;
+            blocked_writers_--;
+        }
+        events.emplace_back(id, StreamEvent::CLOSED);
+    }
+
+    bool sendLink(LegId id) {
+        Leg& leg = legs_[id];
+        leg.link_sent_us = nowUs();
+        return leg.sender(RelayCommand::LINK, 0, reinterpret_cast<const uint8_t*>(nonce_.data()), nonce_.size());
+    }
+
+    LegId link(CellSender sender) {
+        if (!config_.congestion_control) return kInvalidLeg;
+
+        if (!linking_) {
+            std::random_device rd;
+            nonce_.clear();
+            for (size_t i = 0; i < kLinkNonceSize; ++i) {
+                nonce_.push_back(static_cast<char>(rd() & 0xff));
+            }
+            if (!sendLink(0)) return kInvalidLeg;
+            linking_ = true;
+        }
+
+        LegId id = static_cast<LegId>(legs_.size());
+        legs_.push_back(newLeg(std::move(sender), LegState::WAITING));
+        if (linked_) {
+            legs_[id].state = sendLink(id) ? LegState::LINKING : LegState::CLOSED;
+        }
+        return id;
+    }
+
+    // Leg 0's LINKED lets the others send theirs; theirs make them usable
+    bool onLinked(LegId id) {
+        Leg& leg = legs_[id];
+        if (id == 0) {
+            if (!linking_ || linked_) return false;
+            linked_ = true;
+            leg.link_rtt_us = nowUs() - leg.link_sent_us;
+            for (LegId other = 1; other < legs_.size(); ++other) {
+                if (legs_[other].state == LegState::WAITING) {
+                    legs_[other].state = sendLink(other) ? LegState::LINKING : LegState::CLOSED;
+                }
+            }
+            return true;
+        }
+
+        if (leg.state != LegState::LINKING) return false;
+        leg.state = LegState::ACTIVE;
+        leg.link_rtt_us = nowUs() - leg.link_sent_us;
+        return true;
+    }
+
+    LegId join(CellSender sender) {
+        if (!config_.congestion_control) return kInvalidLeg;
+
+        LegId id = static_cast<LegId>(legs_.size());
+        legs_.push_back(newLeg(std::move(sender), LegState::ACTIVE));
+        if (!legs_[id].sender(RelayCommand::LINKED, 0, nullptr, 0)) {
+            legs_[id].state = LegState::CLOSED;
+        }
+        return id;
+    }
+
+    bool removeLeg(LegId id, Events& events) {
+        if (id >= legs_.size()) return false;
+        Leg& leg = legs_[id];
+        if (leg.state == LegState::CLOSED) return true;
+
+        // Only SENDMEs prove delivery, and they cover DATA alone: the leg is
+        // clean if every DATA it sent was acknowledged and nothing followed
+        bool unacked = leg.trailing > 0 ||
+                       (leg.congestion ? leg.congestion->getInflight() > 0
+                                       : leg.package_window < config_.circuit_window);
+        leg.state = LegState::CLOSED;
+        if (id == 0 && linking_ && !linked_) {
+            // Nobody will answer for the legs waiting on it
+            for (Leg& other : legs_) {
+                other.state = LegState::CLOSED;
+            }
+        }
+
+        bool live = false;
+        for (const Leg& other : legs_) {
+            live = live || other.state != LegState::CLOSED;
+        }
+        if (live && !unacked && reorder_.empty()) {
+            pump(events);
+            return true;
+        }
+
+        // Cells were lost with the leg, so the numbering cannot be trusted
+        for (Leg& other : legs_) {
+            other.state = LegState::CLOSED;
+        }
+        reorder_.clear();
+        for (auto& entry : streams_) {
+            if (!entry.second.remote_closed) {
+                endLocally(entry.first, entry.second, events);
+            }
+        }
+        return false;
+    }
+
+    // Queue a stream for packaging if it has something it may send
+    void activate(uint16_t id, Stream& stream) {
+        if (!stream.active && stream.connected && stream.package_window > 0 && stream.queued() > 0) {
+            stream.active = true;
+            active_.push_back(id);
+        }
+    }
+
+    // Package queued data, one cell per stream per turn
+    void pump(Events& events) {
+        while (canPackage() && !active_.empty()) {
+            uint16_t id = active_.front();
+            active_.pop_front();
+
+            auto it = streams_.find(id);
+            if (it == streams_.end()) continue;
+            Stream& stream = it->second;
+            stream.active = false;
+            if (!stream.connected || stream.package_window == 0 || stream.queued() == 0) continue;
+
+            size_t len = std::min(stream.queued(), kRelayDataSize);
+            if (!sendStream(RelayCommand::DATA, id, stream.out.data() + stream.out_offset, len)) {
+                // Keep our turn for the next flush()
+                stream.active = true;
+                active_.push_front(id);
+                break;
+            }
+
+            stream.package_window--;
+            stream.out_offset += len;
+            queued_bytes_ -= len;
+            if (stream.out_offset == stream.out.size()) {
+                stream.out.clear();
+                stream.out_offset = 0;
+            } else if (stream.out_offset > stream.out.size() / 2) {
+                stream.out.erase(stream.out.begin(), stream.out.begin() + stream.out_offset);
+                stream.out_offset = 0;
+            }
+
+            if (stream.queued() > 0) {
+                activate(id, stream);
+            } else if (stream.end_pending) {
+                sendStream(RelayCommand::END, id, nullptr, 0);
+                erase(it);
+            }
+        }
+
+        if (blocked_writers_ > 0) {
+            for (auto& entry : streams_) {
+                Stream& stream = entry.second;
+                if (stream.write_blocked && writeSpace(stream) >= config_.max_stream_queued_bytes / 2) {
+                    stream.write_blocked = false;
+                    blocked_writers_--;
+                    events.emplace_back(entry.first, StreamEvent::WRITABLE);
+                }
+            }
+        }
+    }
+
+    // Send the SENDMEs that reads have earned
+    void sendAcks() {
+        for (auto& entry : streams_) {
+            Stream& stream = entry.second;
+            while (stream.unacked >= config_.stream_increment && !stream.remote_closed) {
+                if (!sendStream(RelayCommand::SENDME, entry.first, nullptr, 0)) return;
+                sendmes_sent_++;
+                stream.unacked -= config_.stream_increment;
+                stream.deliver_window += config_.stream_increment;
+            }
+        }
+
+        for (Leg& leg : legs_) {
+            while (leg.state != LegState::CLOSED && leg.circuit_unacked >= circuit_increment_) {
+                if (!leg.sender(RelayCommand::SENDME, 0, nullptr, 0)) return;
+                sendmes_sent_++;
+                leg.circuit_unacked -= circuit_increment_;
+                leg.deliver_window += circuit_increment_;
+            }
+        }
+    }
+
+    void erase(Streams::iterator it) {
+        queued_bytes_ -= it->second.queued();
+        if (it->second.write_blocked) {
+            blocked_writers_--;
+        }
+        streams_.erase(it);
+    }
+
+    void deliver(const Events& events) {
+        if (events.empty()) return;
+
+        EventCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            callback = callback_;
+        }
+        if (!callback) return;
+        for (const auto& event : events) {
+            callback(event.first, event.second);
+        }
+    }
+};
+
+// StreamMux public interface
+StreamMux::StreamMux(CellSender sender, const StreamMuxConfig& config)
+    : impl_(std::make_unique<Impl>(std::move(sender), config)) {}
+
+StreamMux::~StreamMux() = default;
+
+void StreamMux::setEventCallback(EventCallback callback) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->callback_ = std::move(callback);
+}
+
+uint16_t StreamMux::open(const std::string& target) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->open(target);
+}
+
+void StreamMux::accept(uint16_t stream_id) {
+    Impl::Events events;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        impl_->accept(stream_id, events);
+    }
+    impl_->deliver(events);
+}
+
+std::string StreamMux::getTarget(uint16_t stream_id) const {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    auto it = impl_->streams_.find(stream_id);
+    return it != impl_->streams_.end() ? it->second.target : std::string();
+}
+
+size_t StreamMux::write(uint16_t stream_id, const uint8_t* data, size_t len) {
+    Impl::Events events;
+    size_t accepted;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        accepted = impl_->write(stream_id, data, len, events);
+    }
+    impl_->deliver(events);
+    return accepted;
+}
+
+size_t StreamMux::writeSpace(uint16_t stream_id) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    auto it = impl_->streams_.find(stream_id);
+    if (it == impl_->streams_.end()) return 0;
+
+    size_t space = impl_->writeSpace(it->second);
+    if (space == 0) {
+        impl_->block(it->second);
+    }
+    return space;
+}
+
+size_t StreamMux::read(uint16_t stream_id, uint8_t* out, size_t len) {
+    Impl::Events events;
+    size_t taken;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        taken = impl_->read(stream_id, out, len, events);
+    }
+    impl_->deliver(events);
+    return taken;
+}
+
+void StreamMux::close(uint16_t stream_id) {
+    Impl::Events events;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        impl_->close(stream_id, events);
+    }
+    impl_->deliver(events);
+}
+
+void StreamMux::flush() {
+    Impl::Events events;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        impl_->sendAcks();
+        impl_->pump(events);
+    }
+    impl_->deliver(events);
+}
+
+bool StreamMux::handleCell(const RelayHeader& header, const uint8_t* data) {
+    return handleCell(0, header, data);
+}
+
+bool StreamMux::handleCell(LegId leg, const RelayHeader& header, const uint8_t* data) {
+    Impl::Events events;
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        ok = impl_->handleCell(leg, header, data, events);
+    }
+    impl_->deliver(events);
+    return ok;
+}
+
+StreamMux::LegId StreamMux::link(CellSender sender) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->link(std::move(sender));
+}
+
+StreamMux::LegId StreamMux::join(CellSender sender) {
+    Impl::Events events;
+    LegId leg;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        leg = impl_->join(std::move(sender));
+        impl_->pump(events);
+    }
+    impl_->deliver(events);
+    return leg;
+}
+
+bool StreamMux::removeLeg(LegId leg) {
+    Impl::Events events;
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        ok = impl_->removeLeg(leg, events);
+    }
+    impl_->deliver(events);
+    return ok;
+}
+
+size_t StreamMux::getStreamCount() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->streams_.size();
+}
+
+StreamMuxStats StreamMux::getStats() const {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    StreamMuxStats stats{};
+    stats.streams = impl_->streams_.size();
+    stats.queued_bytes = impl_->queued_bytes_;
+    for (const auto& entry : impl_->streams_) {
+        stats.buffered_bytes += entry.second.buffered();
+    }
+    for (const auto& leg : impl_->legs_) {
+        if (leg.state != Impl::LegState::ACTIVE) continue;
+        stats.legs++;
+        if (!leg.congestion) {
+            stats.package_window += leg.package_window;
+            continue;
+        }
+        const CongestionControl& congestion = *leg.congestion;
+        stats.package_window += congestion.getWindow() - std::min(congestion.getWindow(), congestion.getInflight());
+        stats.congestion_window += congestion.getWindow();
+        if (congestion.getRttUs() > 0 && (stats.rtt_us == 0 || congestion.getRttUs() < stats.rtt_us)) {
+            stats.rtt_us = congestion.getRttUs();
+            stats.min_rtt_us = congestion.getMinRttUs();
+        }
+    }
+    stats.reordered_cells = impl_->reordered_cells_;
+    stats.leg_switches = impl_->leg_switches_;
+    stats.cells_sent = impl_->cells_sent_;
+    stats.cells_received = impl_->cells_received_;
+    stats.sendmes_sent = impl_->sendmes_sent_;
+    return stats;
+}
+
+} // namespace kermit
@@ -1,5 +1,5 @@
 #include "kermit/crypto.h"
-#include <iostream>
+#include "kermit/log.h"
 #include <memory>
 #include <vector>
 #include <random>
@@ -68,7 +68,7 @@ public:
     
     std::string generateECDHKeyPair() {
         // TODO: Implement ECDH key pair generation
-        std::cerr << "ECDH key pair generation not yet implemented" << std::endl;
+        KERMIT_ERROR << "ECDH key pair generation not yet implemented";
         return "ECDH_KEY_PAIR_PLACEHOLDER";
     }
     
@@ -90,25 +90,25 @@ public:
     
     std::vector<uint8_t> encryptAES(const std::vector<uint8_t>& data, const std::string& key, const std::string& iv) {
         // TODO: Implement AES encryption
-        std::cerr << "AES encryption not yet implemented" << std::endl;
+        KERMIT_ERROR << "AES encryption not yet implemented";
         return {};
     }
     
     std::vector<uint8_t> decryptAES(const std::vector<uint8_t>& data, const std::string& key, const std::string& iv) {
         // TODO: Implement AES decryption
-        std::cerr << "AES decryption not yet implemented" << std::endl;
+        KERMIT_ERROR << "AES decryption not yet implemented";
         return {};
     }
     
     std::vector<uint8_t> encryptRSA(const std::vector<uint8_t>& data, const std::string& public_key) {
         // TODO: Implement RSA encryption
-        std::cerr << "RSA encryption not yet implemented" << std::endl;
+        KERMIT_ERROR << "RSA encryption not yet implemented";
         return {};
     }
     
     std::vector<uint8_t> decryptRSA(const std::vector<uint8_t>& data, const std::string& private_key) {
         // TODO: Implement RSA decryption
-        std::cerr << "RSA decryption not yet implemented" << std::endl;
+        KERMIT_ERROR << "RSA decryption not yet implemented";
         return {};
     }
     
@@ -134,25 +134,25 @@ public:
     
     std::string hashSHA3(const std::vector<uint8_t>& data) {
         // TODO: Implement SHA3 hashing
-        std::cerr << "SHA3 hashing not yet implemented" << std::endl;
+        KERMIT_ERROR << "SHA3 hashing not yet implemented";
         return "SHA3_PLACEHOLDER";
     }
     
     std::string signData(const std::vector<uint8_t>& data, const std::string& private_key) {
         // TODO: Implement data signing
-        std::cerr << "Data signing not yet implemented" << std::endl;
+        KERMIT_ERROR << "Data signing not yet implemented";
         return "SIGNATURE_PLACEHOLDER";
     }
     
     bool verifySignature(const std::vector<uint8_t>& data, const std::string& signature, const std::string& public_key) {
         // TODO: Implement signature verification
-        std::cerr << "Signature verification not yet implemented" << std::endl;
+        KERMIT_ERROR << "Signature verification not yet implemented";
         return false;
     }
     
     std::string deriveKey(const std::string& secret, const std::string& salt, size_t iterations) {
         // TODO: Implement key derivation
-        std::cerr << "Key derivation not yet implemented" << std::endl;
+        KERMIT_ERROR << "Key derivation not yet implemented";
         return "DERIVED_KEY_PLACEHOLDER";
     }
     
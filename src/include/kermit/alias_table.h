@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Walker/Vose alias table for O(1) weighted sampling
+//
+// Built once from a weight vector; sampling is two table reads and no
+// allocation. Zero or negative weights are never picked unless every
+// weight is zero, in which case sampling is uniform.
+class AliasTable {
+public:
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<double>& weights);
+
+    // Rebuild from weights; an empty vector yields an empty table
+    void build(const std::vector<double>& weights);
+
+    // Map 64 random bits to an index in [0, size())
+    // The high half picks a column, the low half flips the biased coin
+    size_t sample(uint64_t random_bits) const {
+        size_t column = static_cast<size_t>(((random_bits >> 32) * prob_.size()) >> 32);
+        return static_cast<uint32_t>(random_bits) < prob_[column] ? column : alias_[column];
+    }
+
+    size_t size() const { return prob_.size(); }
+    bool empty() const { return prob_.empty(); }
+
+private:
+    std::vector<uint32_t> prob_;   // Acceptance threshold scaled to 2^32
+    std::vector<uint32_t> alias_;  // Fallback index when the coin rejects
+};
+
+} // namespace kermit
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <netinet/in.h>
+
+namespace kermit {
+
+// Backend pool configuration
+struct BackendPoolConfig {
+    size_t min_idle;                   // Connections kept pre-warmed per target
+    size_t max_idle;                   // Upper bound on idle connections per target
+    uint32_t idle_timeout;             // Seconds an idle connection may sit unused
+    uint32_t connect_timeout_ms;       // Timeout for a single backend connect
+    uint32_t health_check_interval_ms; // Interval between maintenance rounds
+
+    // Default constructor with sensible defaults
+    BackendPoolConfig();
+};
+
+// Backend pool counters
+struct BackendPoolStats {
+    uint64_t hits;              // Checkouts served from the idle list
+    uint64_t misses;            // Checkouts that needed a fresh connect
+    uint64_t connects;          // Successful backend connects
+    uint64_t connect_failures;  // Failed backend connects
+    uint64_t evictions;         // Idle connections closed as dead or expired
+};
+
+// Keep-alive pool of pre-warmed TCP connections to exposed service targets
+//
+// Each registered target keeps between min_idle and max_idle connected,
+// unused sockets. A checkout hands out one of them so stream setup does not
+// pay a TCP handshake. Pooled sockets are never shared between streams: a
+// connection that carried data is closed on release unless the caller knows
+// the backend protocol allows reuse.
+class BackendPool {
+public:
+    explicit BackendPool(const BackendPoolConfig& config = BackendPoolConfig());
+    ~BackendPool();
+
+    // Start/stop the background maintenance thread
+    bool start();
+    void stop();
+
+    // Register a target and pre-warm connections to it
+    // Targets are reference counted, so several services may share one
+    void addTarget(const std::string& target_address);
+
+    // Drop one reference to a target, closing its idle connections on the last one
+    void removeTarget(const std::string& target_address);
+
+    // Bulk variants taking the pool lock once
+    void addTargets(const std::vector<std::string>& target_addresses);
+    void removeTargets(const std::vector<std::string>& target_addresses);
+
+    // Check out a connected, non-blocking socket to the target
+    // Returns -1 if no idle socket is available and connect_on_miss is false,
+    // or if connecting fails
+    int acquire(const std::string& target_address, bool connect_on_miss = true);
+
+    // Return a checked out socket to the pool
+    // Non-reusable sockets (or sockets beyond max_idle) are closed
+    void release(int fd, bool reusable);
+
+    // Pool information
+    size_t getIdleCount(const std::string& target_address) const;
+    size_t getTargetCount() const;
+    BackendPoolStats getStats() const;
+
+    // Open a new non-blocking TCP connection to host:port
+    // Returns -1 on failure
+    static int connectTarget(const std::string& target_address, uint32_t timeout_ms);
+
+    // Begin a non-blocking connect to host:port without waiting for it
+    // The socket becomes writable once connected; check SO_ERROR for the outcome
+    // Returns -1 on immediate failure. A host name is looked up on the calling
+    // thread; event loop code resolves through Resolver and passes the address
+    static int startConnect(const std::string& target_address);
+    static int startConnect(const sockaddr_in& address);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
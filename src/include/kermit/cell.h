@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Fixed-size cells exchanged on relay channels
+//
+// Wire layout, network byte order:
+//   u32 circuit_id | u8 command | payload (kCellPayloadSize bytes)
+// Channel-level cells (PADDING, PING, PONG) use circuit id 0. Circuit ids
+// are chosen by the side that sends CREATE; ids with kOriginCircuitBit set
+// belong to circuits this node originated, the rest to circuits it extends
+// on behalf of a peer, so the two never collide on one channel.
+constexpr size_t kCellSize = 512;
+constexpr size_t kCellHeaderSize = 5;
+constexpr size_t kCellPayloadSize = kCellSize - kCellHeaderSize;
+constexpr uint32_t kOriginCircuitBit = 0x80000000u;
+
+enum class CellCommand : uint8_t {
+    PADDING = 0,  // Ignored by the receiver
+    PING = 1,     // Keepalive; the peer answers with PONG
+    PONG = 2,
+    CREATE = 3,   // Open a circuit to the receiving relay
+    CREATED = 4,
+    RELAY = 5,    // Carries a RelayHeader and data along the circuit
+    DESTROY = 6   // Tear the circuit down, propagated hop by hop
+};
+
+// RELAY cell payload:
+//   u8 hop | u8 relay command | u16 stream_id | u16 length | data
+// Going forward, hop is the index of the target relay counted from the
+// first hop; each relay decrements it and handles the cell itself at 0.
+// Going back, the sending relay sets 0 and each relay increments it, so the
+// origin learns which hop answered.
+constexpr size_t kRelayHeaderSize = 6;
+constexpr size_t kRelayDataSize = kCellPayloadSize - kRelayHeaderSize;
+
+enum class RelayCommand : uint8_t {
+    EXTEND = 1,     // Data: "host:port" of the next relay
+    EXTENDED = 2,
+    BEGIN = 3,      // Open stream_id to the "host:port" in data
+    CONNECTED = 4,
+    DATA = 5,
+    END = 6,        // Close stream_id
+    SENDME = 7,     // Acknowledge delivered DATA; stream_id 0 for the circuit
+    LINK = 8,       // Join the exit's linked set named by the nonce in data
+    LINKED = 9,
+    SWITCH = 10     // Data: u64 stream cells sent on the set before the next one on this circuit
+};
+
+struct RelayHeader {
+    uint8_t hop;
+    RelayCommand command;
+    uint16_t stream_id;
+    uint16_t length;
+
+    static RelayHeader read(const uint8_t* payload);
+    void write(uint8_t* payload) const;
+};
+
+struct Cell {
+    uint32_t circuit_id;
+    CellCommand command;
+    uint8_t payload[kCellPayloadSize];
+
+    // Encode into exactly kCellSize bytes
+    void encode(uint8_t* out) const;
+    void appendTo(std::vector<uint8_t>& out) const;
+
+    // Decode from exactly kCellSize bytes
+    static Cell decode(const uint8_t* in);
+
+    // A zero-payload cell
+    static Cell make(uint32_t circuit_id, CellCommand command);
+
+    // A RELAY cell; len is clamped to kRelayDataSize
+    static Cell makeRelay(uint32_t circuit_id, uint8_t hop, RelayCommand command, uint16_t stream_id,
+                          const uint8_t* data, size_t len);
+
+    RelayHeader relayHeader() const { return RelayHeader::read(payload); }
+    const uint8_t* relayData() const { return payload + kRelayHeaderSize; }
+};
+
+// Reassembles cells from a byte stream that arrives in arbitrary chunks
+class CellAssembler {
+public:
+    CellAssembler() : pending_(0) {}
+
+    // Append bytes and collect every completed cell into out
+    // Returns the number of cells added
+    size_t feed(const uint8_t* data, size_t len, std::vector<Cell>& out);
+
+    // Bytes of a partial cell waiting for the rest
+    size_t pending() const { return pending_; }
+
+private:
+    uint8_t partial_[kCellSize];
+    size_t pending_;
+};
+
+} // namespace kermit
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "kermit/relay_id.h"
+
+namespace kermit {
+
+class EventLoop;
+struct Cell;
+
+// Relay channel pool configuration
+struct ChannelPoolConfig {
+    size_t min_channels;            // Open channels kept warm per relay
+    uint32_t keepalive_interval_ms; // Ping a channel that has been silent this long
+    uint32_t keepalive_timeout_ms;  // Close it if nothing arrives this long after the ping
+    uint32_t connect_timeout_ms;    // Abandon a connect that has not completed by then
+    uint32_t backoff_initial_ms;    // First reconnect delay after a failure
+    uint32_t backoff_max_ms;        // Cap for the doubling reconnect delay
+    uint32_t maintenance_interval_ms;
+    size_t max_queued_bytes;        // Per-channel write queue limit
+    uint32_t kist_interval_ms;      // Socket-aware write rounds; 0 writes cells as soon as they are queued
+
+    // Default constructor with sensible defaults
+    ChannelPoolConfig();
+};
+
+// Relay channel pool counters
+struct ChannelPoolStats {
+    uint64_t relays;            // Relays being kept warm
+    uint64_t open_channels;     // Channels ready for cells
+    uint64_t connecting;        // Connects in flight
+    uint64_t connects;          // Channels that completed their handshake
+    uint64_t connect_failures;  // Connects refused or timed out
+    uint64_t channel_failures;  // Open channels lost to errors or missed keepalives
+    uint64_t pings_sent;
+    uint64_t cells_sent;
+    uint64_t cells_received;
+};
+
+// Managed channels to relays
+//
+// Every relay added to the pool gets min_channels TCP channels opened in the
+// background and kept open. Idle channels are pinged, and a channel that
+// stays silent past the keepalive timeout or reports an error is closed and
+// replaced, with exponential backoff while the relay keeps failing. Circuit
+// code asks for an already open channel with acquire(), which never
+// connects inline, so no handshake lands on the circuit build path.
+//
+// Circuit cells are queued per channel in a CircuitScheduler. With
+// kist_interval_ms set, they are written in periodic rounds on the loop,
+// each channel getting only what its TCP socket can send soon (see
+// CircuitScheduler::socketWriteLimit), so congestion queues cells where
+// they can still be prioritized rather than in kernel buffers.
+//
+// All socket work runs on the given EventLoop; the public methods are safe
+// from any thread. Callbacks run on the loop thread.
+class ChannelPool {
+public:
+    using ChannelId = uint64_t;
+    static constexpr ChannelId kInvalidChannel = 0;
+
+    // Fired when a relay gains its first open channel (true) or loses its last (false)
+    using StateCallback = std::function<void(RelayId relay, bool up)>;
+
+    // Fired for every cell other than PADDING, PING and PONG
+    using CellCallback = std::function<void(ChannelId channel, RelayId relay, const Cell& cell)>;
+
+    // Fired when a channel that had opened is closed by failure; circuits on it are gone
+    using CloseCallback = std::function<void(ChannelId channel, RelayId relay)>;
+
+    explicit ChannelPool(EventLoop& loop, const ChannelPoolConfig& config = ChannelPoolConfig());
+    ~ChannelPool();
+
+    // Start the maintenance timer
+    bool start();
+
+    // Close every channel; must run on the loop thread or after the loop has stopped
+    void stop();
+
+    // Start keeping channels warm to a relay; adding a known relay is a no-op
+    void addRelay(RelayId relay, const std::string& host, uint16_t port);
+
+    // Close a relay's channels and stop reconnecting; no state callback fires
+    void removeRelay(RelayId relay);
+
+    // The open channel to the relay with the shortest write queue
+    // Returns kInvalidChannel if none is open; a replacement is already on its way
+    ChannelId acquire(RelayId relay) const;
+
+    // Queue a cell on a channel; fails if the channel is gone or its queue is full
+    bool send(ChannelId channel, const Cell& cell);
+
+    bool isOpen(ChannelId channel) const;
+
+    void setStateCallback(StateCallback callback);
+    void setCellCallback(CellCallback callback);
+    void setCloseCallback(CloseCallback callback);
+
+    // Pool information
+    size_t getOpenChannelCount(RelayId relay) const;
+    ChannelPoolStats getStats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Circuit build timeout estimator configuration
+struct CircuitBuildTimeoutConfig {
+    double quantile;                // Fraction of builds expected to finish within the timeout
+    uint32_t initial_timeout_ms;    // Used until min_samples builds have been seen
+    uint32_t min_timeout_ms;
+    uint32_t max_timeout_ms;        // Builds still running by then are abandoned
+    size_t min_samples;
+    size_t max_samples;             // Most recent build times kept for the fit
+    uint32_t bin_width_ms;          // Histogram bin used to find the modes
+    size_t xm_modes;                // Most frequent bins averaged into Xm
+    size_t recent_window;           // Recent builds checked for a network change
+    size_t recent_timeout_limit;    // More timeouts than this in the window resets the model
+
+    // Default constructor with sensible defaults
+    CircuitBuildTimeoutConfig();
+};
+
+// Adaptive circuit build timeout
+//
+// Build times are modelled as a Pareto distribution, as Tor does: Xm is the
+// weighted average of the most frequent histogram bins and alpha is the
+// maximum likelihood estimate over the recorded builds, with abandoned
+// builds treated as censored at the slowest observed time. The timeout is
+// the configured quantile of the fitted distribution, so most builds finish
+// inside it while the slow tail is cut off and relaunched.
+//
+// If most recent builds time out the network has probably changed (or the
+// timeout is far too low); the history is dropped and the timeout falls
+// back to at least twice its current value until enough builds are seen
+// again.
+//
+// Not thread-safe; the owner serializes access.
+class CircuitBuildTimeout {
+public:
+    explicit CircuitBuildTimeout(const CircuitBuildTimeoutConfig& config = CircuitBuildTimeoutConfig());
+
+    // A build that completed after build_ms, whether or not it had already
+    // exceeded the timeout
+    void recordBuildTime(uint32_t build_ms);
+
+    // A build still running at max_timeout_ms and given up on
+    void recordAbandoned();
+
+    // Whether a build finished inside the timeout in force when it ran
+    void recordOutcome(bool timed_out);
+
+    uint32_t getTimeoutMs() const;
+    size_t getSampleCount() const;
+
+    // Fitted Pareto parameters, 0 until min_samples builds have been seen
+    double getXm() const;
+    double getAlpha() const;
+
+private:
+    void recompute();
+    void reset(uint32_t timeout_ms);
+
+    CircuitBuildTimeoutConfig config_;
+
+    // Ring of recent build times; kAbandoned marks abandoned builds
+    std::vector<uint32_t> samples_;
+    size_t next_sample_;
+
+    std::vector<bool> recent_;
+    size_t next_recent_;
+
+    uint32_t timeout_ms_;
+    double xm_;
+    double alpha_;
+};
+
+} // namespace kermit
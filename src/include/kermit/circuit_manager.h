@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "kermit/core.h"
+#include "kermit/channel_pool.h"
+#include "kermit/circuit_build_timeout.h"
+
+namespace kermit {
+
+class NodeManager;
+struct Cell;
+
+// Origin circuit counters
+struct CircuitManagerStats {
+    uint64_t builds_started;
+    uint64_t builds_succeeded;
+    uint64_t builds_failed;     // Refused, destroyed or no channel to the first hop
+    uint64_t builds_timed_out;  // Ran past their timeout, whether or not they finished later
+    uint64_t builds_abandoned;  // Still building at the hard timeout
+    uint64_t relaunches;        // Parallel builds started because another timed out
+    uint64_t late_completions;  // Finished after losing to a relaunch; measured, then closed
+    uint64_t active;            // Circuits building or established
+    uint64_t build_timeout_ms;  // Current adaptive timeout
+};
+
+// Builds and tracks the circuits this node originates
+//
+// A build sends CREATE on an already open channel to the first hop followed
+// at once by one RELAY EXTEND per further hop; each relay holds the EXTEND
+// for the next one until its own hop is open, so a build takes one round
+// trip to the last hop rather than one per hop. Replies arrive through
+// handleCell from the channel pool's loop thread, so builds run without a
+// thread of their own and any number can be under way. Circuit ids carry
+// kOriginCircuitBit.
+//
+// Every completed build feeds a CircuitBuildTimeout model. build(purpose)
+// waits only as long as that model's timeout; a build that runs past it is
+// left running and a second one is launched on a fresh path, the first to
+// finish winning. Losers that still finish are measured and then closed, so
+// slow builds keep informing the model instead of being cut off unseen.
+// These deadlines are kept by a timer on the channel loop, and
+// buildAsync() reports the outcome from there instead of blocking.
+class CircuitManager {
+public:
+    // Called once a build finishes, with the established circuit or nullptr
+    using BuildCallback = std::function<void(const std::shared_ptr<Circuit>& circuit)>;
+
+    explicit CircuitManager(NodeManager& node_manager,
+                            const CircuitBuildTimeoutConfig& timeout_config = CircuitBuildTimeoutConfig());
+    ~CircuitManager();
+
+    // Pick distinct relays for a circuit: a connected guard first, then
+    // middles, then an exit (GENERAL) or a hidden service relay (HIDDEN_SERVICE)
+    // Returns fewer hops when the relay set is too small, empty if none
+    std::vector<std::string> selectPath(CircuitPurpose purpose, size_t hops = 3) const;
+
+    // Start building along path and return at once; the circuit leaves
+    // NEW/BUILDING for ESTABLISHED or FAILED as cells arrive. Never opens a
+    // TCP connection: without an open channel to the first hop the build
+    // fails at once. callback, if set, runs on the channel loop thread when
+    // the build finishes, unless destroy() ends it first
+    // Returns nullptr on immediate failure, without calling callback
+    std::shared_ptr<Circuit> launch(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                    BuildCallback callback = nullptr);
+
+    // Build a circuit along path; blocks until it is established, refused,
+    // or timeout_ms passes
+    // Returns nullptr on failure
+    std::shared_ptr<Circuit> build(CircuitPurpose purpose, const std::vector<std::string>& path,
+                                   uint32_t timeout_ms);
+
+    // Build a circuit on paths chosen by selectPath, relaunching in
+    // parallel whenever the newest attempt exceeds the adaptive timeout.
+    // Gives up after the model's max_timeout_ms
+    // Returns nullptr on failure
+    std::shared_ptr<Circuit> build(CircuitPurpose purpose);
+
+    // build(purpose) without waiting: returns at once and calls callback
+    // on the channel loop thread, or before returning if no attempt could
+    // be launched. Callbacks of builds still running when the manager is
+    // destroyed never run
+    void buildAsync(CircuitPurpose purpose, BuildCallback callback);
+
+    // End every build(purpose) and buildAsync() under way: their callbacks
+    // get nullptr now and their attempts are destroyed, e.g. at shutdown
+    void cancelBuilds();
+
+    // Send every EXTEND right behind CREATE (the default) rather than one
+    // per answered hop, which relays without pipelining support refuse
+    void setPipelining(bool enabled);
+
+    // Current adaptive build timeout
+    uint32_t getBuildTimeoutMs() const;
+
+    // Carry the first circuit's streams over all of them. The circuits must
+    // be established, end at the same relay, and the others must not have
+    // opened streams yet; each joins as a StreamMux leg once the relay
+    // answers its LINK. Losing a leg with cells in flight closes the streams
+    // and the remaining legs
+    // Returns false if the circuits cannot be linked
+    bool link(const std::vector<std::shared_ptr<Circuit>>& circuits);
+
+    // Send DESTROY and forget the circuit
+    void destroy(const std::shared_ptr<Circuit>& circuit);
+
+    // Channel pool events for circuits with kOriginCircuitBit set
+    void handleCell(ChannelPool::ChannelId channel, const Cell& cell);
+    void handleChannelClosed(ChannelPool::ChannelId channel);
+
+    size_t getCircuitCount() const;
+    CircuitManagerStats getStats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
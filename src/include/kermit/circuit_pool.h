@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "kermit/core.h"
+
+namespace kermit {
+
+class CircuitManager;
+
+// Preemptive circuit pool configuration
+struct CircuitPoolConfig {
+    size_t general_target;          // Clean GENERAL circuits kept when idle
+    size_t hidden_service_target;   // Clean HIDDEN_SERVICE circuits kept when idle
+    size_t max_clean;               // Per-purpose cap however high demand gets
+    size_t max_circuits;            // Stop building while this many origin circuits exist
+    size_t max_pending_builds;      // Builds under way at once
+    uint32_t max_clean_age_ms;      // Retire clean circuits nobody took by then
+    uint32_t maintenance_interval_ms;
+    uint32_t demand_horizon_ms;     // Keep enough spare circuits for this much expected demand
+    double demand_alpha;            // EWMA weight of each interval's demand rate
+
+    // Default constructor with sensible defaults
+    CircuitPoolConfig();
+};
+
+// Preemptive circuit pool counters
+struct CircuitPoolStats {
+    uint64_t hits;                  // acquire() served from the pool
+    uint64_t misses;                // acquire() found the pool empty
+    uint64_t built;
+    uint64_t build_failures;        // Including builds that found no path
+    uint64_t expired;               // Clean circuits retired unused (too old or surplus)
+    uint64_t clean_general;
+    uint64_t clean_hidden_service;
+    uint64_t target_general;
+    uint64_t target_hidden_service;
+};
+
+// Pre-built circuits ready for new streams
+//
+// A builder thread keeps a number of clean (never used) circuits per purpose
+// so that acquire() hands one out without waiting on any round trip,
+// starting up to max_pending_builds builds at once with buildAsync(). The
+// number kept grows above the configured target with the recent acquire
+// rate, capped by max_clean and by max_circuits across all origin circuits.
+// Circuits handed out are marked dirty and never return to the pool.
+class CircuitPool {
+public:
+    using BuiltCallback = std::function<void(const std::shared_ptr<Circuit>& circuit)>;
+
+    explicit CircuitPool(CircuitManager& manager, const CircuitPoolConfig& config = CircuitPoolConfig());
+    ~CircuitPool();
+
+    // Start the builder thread
+    bool start();
+
+    // Stop building and destroy the clean circuits still pooled; waits for
+    // builds under way to finish
+    void stop();
+
+    // Take a clean circuit; never blocks, nullptr if none is ready
+    std::shared_ptr<Circuit> acquire(CircuitPurpose purpose);
+
+    size_t getCleanCount(CircuitPurpose purpose) const;
+    size_t getTarget(CircuitPurpose purpose) const;
+    CircuitPoolStats getStats() const;
+
+    // Called on the channel loop thread for every circuit added to the pool
+    void setBuiltCallback(BuiltCallback callback);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
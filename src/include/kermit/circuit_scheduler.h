@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+struct Cell;
+
+// Circuit scheduler configuration
+struct CircuitSchedulerConfig {
+    uint32_t halflife_ms;   // Time for a circuit's activity count to decay by half
+    uint32_t tick_ms;       // Granularity of the decay
+
+    // Default constructor with sensible defaults
+    CircuitSchedulerConfig();
+};
+
+// Per-channel cell queue that picks the quietest circuit next
+//
+// Every circuit with cells queued on a channel keeps its own FIFO. Each
+// cell sent adds to the circuit's activity count, and counts decay with
+// halflife_ms, so next() favours circuits that have sent little recently:
+// a bulk circuit cannot hold back an interactive one queued behind it,
+// while cells within a circuit keep their order.
+//
+// Counts are decayed once per tick rather than per cell, so next() is
+// O(log n) in the circuits with cells queued.
+//
+// Not thread-safe; the owning channel's lock protects it.
+class CircuitScheduler {
+public:
+    explicit CircuitScheduler(const CircuitSchedulerConfig& config = CircuitSchedulerConfig());
+    ~CircuitScheduler();
+
+    // Queue a cell behind the others of its circuit
+    void enqueue(const Cell& cell);
+
+    // Take the next cell to write; false if nothing is queued
+    bool next(Cell& cell);
+
+    size_t getQueuedCells() const;
+    size_t getActiveCircuits() const;
+
+    // Decayed cells sent recently by a circuit
+    double getActivity(uint32_t circuit_id) const;
+
+    // KIST write limit for a TCP socket: the congestion window space not
+    // taken by unacknowledged data, plus room for one more window of unsent
+    // data in the send buffer. Writing no more than this keeps the queue in
+    // the scheduler, where circuits can still be prioritized, instead of in
+    // the kernel. SIZE_MAX if TCP_INFO is unavailable
+    static size_t socketWriteLimit(int fd);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
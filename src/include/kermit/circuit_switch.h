@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "kermit/channel_pool.h"
+#include "kermit/network.h"
+
+namespace kermit {
+
+class NodeManager;
+class NetworkManager;
+struct Cell;
+
+// Relay-side circuit switching
+//
+// Peers reach us on the NetworkManager listen port and open circuits with
+// CREATE. A RELAY EXTEND addressed to us opens the next hop over a pooled
+// channel; from then on RELAY cells for later hops are forwarded on with
+// their hop counter decremented, and cells coming back are returned to the
+// peer with it incremented. Cells for later hops that arrive while the
+// extend is still under way, as a pipelined build sends them, are held and
+// forwarded once the next relay answers. DESTROY and lost connections tear
+// the circuit down in both directions.
+//
+// Each peer connection may hold a bounded number of circuits, as may all
+// peers together; CREATE past either limit is answered with DESTROY.
+//
+// Circuits are split across a number of shards, each a thread owning its
+// circuits outright. The network and channel threads hand cells to the
+// owning shard through a lock-free ring and an eventfd wakeup, so circuits
+// on different shards are switched in parallel without a shared lock.
+//
+// When we are the last hop and exits are enabled, BEGIN opens a TCP
+// connection to the requested target, its name looked up off the exit
+// thread and private addresses refused, and the circuit's streams are
+// relayed through a StreamMux, reading from a target only while its
+// stream has window and queue space left.
+class CircuitSwitch {
+public:
+    // threads is the number of shards; 0 means one per core
+    CircuitSwitch(NodeManager& node_manager, NetworkManager& network_manager, size_t threads = 1);
+    ~CircuitSwitch();
+
+    // Start the shard threads and the thread running exit connections
+    bool start();
+
+    // Close exit connections and stop the threads
+    void stop();
+
+    // Accept BEGIN from peers; off by default
+    void setExitEnabled(bool enabled);
+
+    // Let exits reach loopback, private and link-local addresses and this
+    // host's own; off by default, for test networks only
+    void setExitAllowPrivate(bool allow);
+
+    // Cells from peers connected to our listen port
+    void handleInboundCell(ConnectionHandle connection, const Cell& cell);
+    void handleInboundClosed(ConnectionHandle connection);
+
+    // Channel pool events for circuits we extended (no kOriginCircuitBit)
+    void handleChannelCell(ChannelPool::ChannelId channel, const Cell& cell);
+    void handleChannelClosed(ChannelPool::ChannelId channel);
+
+    size_t getCircuitCount() const;
+    size_t getExitStreamCount() const;
+    size_t getThreadCount() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
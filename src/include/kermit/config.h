@@ -14,8 +14,8 @@ struct RouterConfig {
     uint16_t listen_port;
     uint16_t socks_port;
     uint16_t control_port;
-    bool enable_logging;
-    std::string log_file;
+    bool enable_logging;    // Off keeps only warnings and errors, on the console
+    std::string log_file;   // Written by a background thread; warnings and errors also go to stderr
     bool use_ipv6;
     
     // Hidden service configuration
@@ -25,7 +25,55 @@ struct RouterConfig {
     // Network configuration
     std::vector<std::string> trusted_relays;
     uint32_t max_circuits;
+    
+    // Circuit builds are given a timeout learned from past build times, set
+    // so circuit_build_quantile percent of builds finish inside it; builds
+    // running past it are raced by a relaunch. circuit_timeout (seconds) is
+    // the hard limit after which a build is abandoned
     uint32_t circuit_timeout;
+    uint32_t circuit_build_quantile;
+    
+    // Clean circuits kept pre-built for new streams; the pool grows above
+    // these with demand, up to max_circuits. 0 builds only on request
+    uint32_t preemptive_circuits;
+    uint32_t preemptive_hs_circuits;
+    
+    // Open TCP connections for streams that end at this relay
+    bool exit_relay;
+    
+    // Let exit streams reach loopback, private and link-local addresses and
+    // this host's own, SOCKS and control ports included; test networks only
+    bool exit_allow_private;
+    
+    // Threads switching relayed circuits, each owning a share of them; 0 uses one per core
+    uint32_t relay_threads;
+    
+    // Relay directory document; a binary cache is kept next to it
+    std::string directory_file;
+    
+    // Relay channels kept open per connected relay, and seconds of silence
+    // before a channel is pinged (an unanswered ping closes and replaces it)
+    uint32_t relay_min_channels;
+    uint32_t relay_keepalive_interval;
+    
+    // Milliseconds between KIST write rounds on relay links, which give each
+    // socket only what TCP can send soon; 0 writes cells as they are queued
+    uint32_t kist_interval_ms;
+    
+    // Seconds between relay latency probe rounds; 0 (the default) disables
+    // probing, since each round connects to every relay in the directory
+    uint32_t probe_interval;
+    
+    // Seconds between warm-start state saves to data_directory; 0 saves only on shutdown
+    uint32_t state_save_interval;
+    
+    // MiB of slab memory for cells, circuits and streams; past it they fall back to the heap
+    uint32_t slab_memory_mb;
+    
+    // Exposed service backend pool
+    uint32_t backend_pool_min_idle;
+    uint32_t backend_pool_max_idle;
+    uint32_t backend_pool_idle_timeout;
     
     // Default constructor with sensible defaults
     RouterConfig();
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Circuit congestion control configuration; windows and thresholds in cells
+struct CongestionControlConfig {
+    uint32_t sendme_increment;  // Cells acknowledged by one circuit-level SENDME
+    uint32_t initial_window;
+    uint32_t min_window;
+    uint32_t max_window;        // Also what a receiver accepts unacknowledged
+    uint32_t window_step;       // Change per adjustment outside slow start
+    uint32_t alpha;             // Grow while fewer cells than this are queued on the path
+    uint32_t beta;              // Shrink while more than this are queued
+    uint32_t gamma;             // Leave slow start once this many are queued
+    uint32_t delta;             // Cut back to the BDP once this many are queued
+
+    // Default constructor with sensible defaults
+    CongestionControlConfig();
+};
+
+// Vegas-style congestion window for one circuit's sender
+//
+// Every sendme_increment-th DATA cell is timestamped, and the circuit
+// SENDME it elicits gives an RTT sample. The bandwidth-delay product is
+// estimated as window * min_rtt / rtt; whatever the window holds beyond
+// that is queued somewhere on the path. Slow start doubles the window per
+// RTT until gamma cells are queued, after which the window moves by
+// window_step once per RTT to keep between alpha and beta cells queued, so
+// long paths fill their capacity while relay queues stay short.
+//
+// Times are in microseconds from any fixed origin. Not thread-safe.
+class CongestionControl {
+public:
+    explicit CongestionControl(const CongestionControlConfig& config = CongestionControlConfig());
+    ~CongestionControl();
+
+    // Whether the window has room for another DATA cell
+    bool canSend() const;
+
+    // A DATA cell was sent
+    void onCellSent(uint64_t now_us);
+
+    // A circuit-level SENDME arrived; false if nothing was outstanding
+    bool onSendme(uint64_t now_us);
+
+    uint32_t getWindow() const;
+    uint32_t getInflight() const;
+    uint32_t getBdp() const;
+    uint64_t getRttUs() const;     // Smoothed
+    uint64_t getMinRttUs() const;
+
+    // How long the oldest timestamped cell has waited for its SENDME; a
+    // stalled path shows here before any RTT sample does. 0 if none waits
+    uint64_t getOutstandingUs(uint64_t now_us) const;
+    bool inSlowStart() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace kermit {
+
+class EventLoop;
+class ServiceRegistry;
+
+// Binary control protocol
+//
+// Every message is a frame:
+//   u32 length     Bytes following this field (big-endian, at most 64 KiB)
+//   u8  type       Request opcode, opcode | 0x80 for its response, or EVENT
+//   u32 request_id Echoed in the response; 0 for events
+//   payload
+//
+// Integers are big-endian; strings are a u16 length followed by the bytes.
+// Every response payload starts with a u8 ControlStatus; on error it is
+// followed by a message string.
+//
+// When an auth cookie is configured, AUTHENTICATE must succeed before any
+// other request is accepted.
+namespace control {
+
+enum Opcode : uint8_t {
+    AUTHENTICATE = 0x01,  // bytes cookie (u16 length + bytes)
+    EXPOSE = 0x02,        // str target, u32 weight, u8 policy -> str hash
+    RESOLVE = 0x03,       // str hash -> str address
+    REVOKE = 0x04,        // str hash
+    LIST = 0x05,          // str cursor, u16 limit -> u16 n, n * (str hash, str target,
+                          //   u8 policy, u16 backends), str next_cursor
+    ADD_BACKEND = 0x06,   // str hash, str address, u32 weight
+    STATUS = 0x07,        // -> counters, see ControlStatusInfo
+    LIST_RELAYS = 0x08,   // -> u16 n, n * (str node_id, str address, u16 port, u8 flags)
+    SUBSCRIBE = 0x09,     // u32 event mask
+    UNSUBSCRIBE = 0x0A,   // u32 event mask
+
+    RESPONSE_FLAG = 0x80,
+    EVENT = 0xC0          // u8 event type, event body
+};
+
+enum Status : uint8_t {
+    OK = 0,
+    ERROR = 1,
+    NOT_FOUND = 2,
+    BAD_REQUEST = 3,
+    UNAUTHORIZED = 4
+};
+
+// Event types; subscribe with a mask of (1 << type)
+enum EventType : uint8_t {
+    CIRCUIT_BUILT = 1,      // str circuit_id, u8 hops
+    CONNECTION_CLOSED = 2,  // str connection_id
+    COUNTERS = 3            // Periodic ControlStatusInfo snapshot
+};
+
+// Relay flags in LIST_RELAYS
+enum RelayFlag : uint8_t {
+    RELAY_TRUSTED = 1 << 0,
+    RELAY_GUARD = 1 << 1,
+    RELAY_EXIT = 1 << 2,
+    RELAY_HIDDEN_SERVICES = 1 << 3,
+    RELAY_CONNECTED = 1 << 4
+};
+
+} // namespace control
+
+// Router counters served by STATUS and COUNTERS events
+// Encoded as u64 timestamp_ms followed by each field as u64 in order
+struct ControlStatusInfo {
+    uint64_t circuits;
+    uint64_t relays;
+    uint64_t trusted_relays;
+    uint64_t services;
+    uint64_t socks_accepted;
+    uint64_t socks_active;
+    uint64_t bytes_relayed;
+    uint64_t slab_bytes;              // Carved from the slab limit
+    uint64_t slab_fallbacks;          // Small allocations the slab could not serve
+};
+
+// Relay entry served by LIST_RELAYS
+struct ControlRelayInfo {
+    std::string node_id;
+    std::string address;
+    uint16_t port;
+    uint8_t flags;  // control::RelayFlag bits
+};
+
+// Control port listener
+//
+// Served from the shared EventLoop. Requests are answered in the order they
+// arrive, several frames per read are handled in one pass, and responses are
+// batched into one write. Event frames to subscribers are dropped rather
+// than buffered without bound when a subscriber stops reading.
+class ControlServer {
+public:
+    using StatusProvider = std::function<ControlStatusInfo()>;
+    using RelayProvider = std::function<std::vector<ControlRelayInfo>()>;
+
+    ControlServer(EventLoop& loop, ServiceRegistry* registry);
+    ~ControlServer();
+
+    // Router state sources, called on the loop thread
+    void setStatusProvider(StatusProvider provider);
+    void setRelayProvider(RelayProvider provider);
+
+    // Require AUTHENTICATE with this cookie before other requests
+    void setAuthCookie(const std::vector<uint8_t>& cookie);
+
+    // Start listening and emitting COUNTERS every counters_interval_ms
+    bool start(uint16_t port, const std::string& listen_address = "127.0.0.1",
+               uint32_t counters_interval_ms = 1000);
+
+    // Stop listening and drop all clients; must run on the loop thread
+    // or after the loop has stopped
+    void stop();
+
+    uint16_t getPort() const;
+
+    // Publish events to subscribers; safe from any thread
+    void publishCircuitBuilt(const std::string& circuit_id, size_t hops);
+    void publishConnectionClosed(const std::string& connection_id);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
@@ -12,6 +12,8 @@ class Circuit;
 class Router;
 class HiddenService;
 class RelayNode;
+class ServiceRegistry;
+class StreamMux;
 
 // Core router interface
 class Router {
@@ -28,9 +30,16 @@ public:
     // Stop the router
     void stop();
     
-    // Main event loop
+    // Block until shutdown, serving SIGINT and SIGTERM (return), SIGHUP
+    // (reopen the log file and reload the relay directory), stop() from
+    // another thread, and periodic state saves; call stop() afterwards
     void run();
     
+    // Block the signals run() reads in the calling thread and threads it
+    // starts later; call before creating any thread, or they may take the
+    // signals instead
+    static bool blockSignals();
+    
     // Circuit management
     std::shared_ptr<Circuit> createCircuit();
     void destroyCircuit(std::shared_ptr<Circuit> circuit);
@@ -54,12 +63,22 @@ public:
     bool addRelayNode(const std::string& node_address, bool trusted);
     bool connectToRelayNode(const std::string& node_id);
     
+    // Exposed services reachable through the SOCKS port
+    // The registry is not owned and must outlive the router
+    void setServiceRegistry(ServiceRegistry* registry);
+    
 private:
     // Private implementation details
     class Impl;
     std::unique_ptr<Impl> impl_;
 };
 
+// What a circuit will be used for; decides the last hop
+enum class CircuitPurpose {
+    GENERAL,
+    HIDDEN_SERVICE
+};
+
 // Circuit class for managing connections
 class Circuit {
 public:
@@ -84,6 +103,40 @@ public:
     size_t getHopCount() const;
     const std::string& getCircuitId() const;
     
+    // Updated by the circuit manager as cells arrive; safe from any thread
+    void setState(CircuitState state);
+    
+    CircuitPurpose getPurpose() const;
+    void setPurpose(CircuitPurpose purpose);
+    
+    // Node ids of the extended hops, first hop first
+    const std::vector<std::string>& getPath() const;
+    
+    // Wire identity: the ChannelPool channel to the first hop and the
+    // circuit id used on it
+    uint64_t getChannel() const;
+    uint32_t getWireId() const;
+    void attach(uint64_t channel, uint32_t wire_id);
+    
+    // Time from CREATE to the last EXTENDED, 0 until established
+    uint32_t getBuildTimeMs() const;
+    void setBuildTimeMs(uint32_t build_time_ms);
+    
+    // Clean circuits have never carried client traffic; handing one out
+    // marks it dirty
+    bool isDirty() const;
+    void markDirty();
+    
+    // Milliseconds since the circuit object was created
+    uint64_t getAgeMs() const;
+    
+    // Streams to the last hop, multiplexed on this circuit; nullptr until
+    // the circuit manager attaches them on establishment. Linked circuits
+    // share one mux, each as its own leg
+    std::shared_ptr<StreamMux> getStreams() const;
+    uint32_t getStreamLeg() const;
+    void attachStreams(std::shared_ptr<StreamMux> streams, uint32_t leg = 0);
+    
 private:
     class Impl;
     std::unique_ptr<Impl> impl_;
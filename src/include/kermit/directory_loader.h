@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "kermit/node_manager.h"
+
+namespace kermit {
+
+struct DirectoryLoadStats {
+    size_t relays;
+    size_t malformed_lines;
+    bool from_cache;
+    double elapsed_ms;
+};
+
+// Relay directory document loader
+//
+// The text format is one relay per line:
+//   relay <host:port> <bandwidth KB/s> [Guard] [Exit] [HSDir] [Trusted]
+// Blank lines and lines starting with '#' are ignored.
+//
+// The document is mmap'd and parsed in parallel chunks split on line
+// boundaries. A binary cache at <path>.cache is written after a text parse
+// and used instead of the text while the document's size and mtime match.
+class DirectoryLoader {
+public:
+    // Load relays from path, preferring a valid cache; false if unreadable
+    static bool load(const std::string& path, std::vector<RelayDescriptor>& relays,
+                     DirectoryLoadStats* stats = nullptr);
+
+    // Parse a text document; threads = 0 picks from hardware concurrency
+    // Returns the number of malformed lines skipped
+    static size_t parseText(const char* data, size_t len, std::vector<RelayDescriptor>& relays,
+                            size_t threads = 0);
+};
+
+} // namespace kermit
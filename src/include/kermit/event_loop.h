@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace kermit {
+
+// Shared epoll reactor
+//
+// File descriptors are watched level-triggered and their callbacks run on
+// the thread that calls run(). Registration and post() are safe from any
+// thread; post() wakes the loop through an eventfd.
+class EventLoop {
+public:
+    // Readiness flags passed to and from callbacks
+    static constexpr uint32_t READABLE = 1u << 0;
+    static constexpr uint32_t WRITABLE = 1u << 1;
+    static constexpr uint32_t ERROR = 1u << 2;  // Error or hangup, reported only
+
+    using IoCallback = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+
+    EventLoop();
+    ~EventLoop();
+
+    // Create the epoll and wakeup descriptors
+    bool initialize();
+
+    // Watch a file descriptor; the loop does not take ownership of it
+    bool addFd(int fd, uint32_t events, IoCallback callback);
+    bool modifyFd(int fd, uint32_t events);
+    void removeFd(int fd);
+
+    // Run a task on the loop thread
+    void post(Task task);
+
+    // Run a task on the loop thread every interval_ms, backed by a timerfd
+    // Returns a timer id for cancelTimer, or -1 on failure
+    int addTimer(uint32_t interval_ms, Task task);
+    void cancelTimer(int timer_id);
+
+    // Dispatch events until stop() is called
+    void run();
+    void stop();
+
+    bool isRunning() const;
+    bool isInLoopThread() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
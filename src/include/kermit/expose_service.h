@@ -1,20 +1,68 @@
 #pragma once
 
 #include <string>
+#include <array>
 #include <map>
+#include <set>
 #include <memory>
 #include <cstdint>
 #include <vector>
 #include <mutex>
+#include <functional>
 
 namespace kermit {
 
+class BackendPool;
+
+// Backend selection policy for services with several backends
+enum class BalancePolicy {
+    LEAST_CONNECTIONS,  // Fewest active connections relative to weight
+    CONSISTENT_HASH     // Stable mapping of an affinity key onto a weighted hash ring
+};
+
+// Policy name helpers ("least-conn", "consistent-hash")
+const char* balancePolicyName(BalancePolicy policy);
+bool parseBalancePolicy(const std::string& name, BalancePolicy& policy);
+
+// Backend weights accepted by the registry
+constexpr uint32_t kMinBackendWeight = 1;
+constexpr uint32_t kMaxBackendWeight = 1000;
+
+// A backend serving an exposed service
+struct ServiceBackend {
+    std::string address;            // ip:port
+    uint32_t weight;
+    uint32_t active_connections;
+    uint32_t consecutive_failures;  // Passive health: failed connects in a row
+    uint64_t down_until_ms;         // Skipped by selection until this steady-clock time
+};
+
 // Service handle for accessing exposed services
+// Backend state is updated under the registry lock; use the registry to read it
 struct ServiceHandle {
     std::string service_hash;  // Random hash like "a1b2c3d4e5f6.uwu"
     std::string target_address;  // Original ip:port
     uint64_t created_timestamp;
     bool is_active;
+    
+    // Load balancing
+    BalancePolicy policy;
+    std::vector<ServiceBackend> backends;
+    std::vector<std::pair<uint32_t, size_t>> hash_ring;  // Ring point -> backend index
+};
+
+// A service as listed, copied under the registry lock
+struct ServiceSummary {
+    std::string service_hash;
+    std::string target_address;
+    BalancePolicy policy;
+    size_t backend_count;
+};
+
+// One page of a cursor-based service listing
+struct ServicePage {
+    std::vector<ServiceSummary> services;
+    std::string next_cursor;  // Empty once the listing is exhausted
 };
 
 // Service registry for managing exposed hidden services
@@ -25,12 +73,30 @@ public:
 
     // Register a new exposed service
     // Returns the service hash (e.g., "a1b2c3d4e5f6.uwu")
-    std::string exposeService(const std::string& target_address);
+    // Throws std::invalid_argument for a bad address or a weight outside
+    // kMinBackendWeight..kMaxBackendWeight
+    std::string exposeService(const std::string& target_address, uint32_t weight = 1,
+                              BalancePolicy policy = BalancePolicy::LEAST_CONNECTIONS);
 
-    // Resolve a service hash to its target address
+    // Resolve a service hash to the address of one of its healthy backends
     // Returns empty string if service not found
     std::string resolveService(const std::string& service_hash);
 
+    // Backend management for load-balanced services
+    // addBackend throws std::invalid_argument like exposeService
+    bool addBackend(const std::string& service_hash, const std::string& address, uint32_t weight = 1);
+    bool removeBackend(const std::string& service_hash, const std::string& address);
+    bool setBalancePolicy(const std::string& service_hash, BalancePolicy policy);
+
+    // Pick a backend for a new connection and count it as active
+    // The affinity key (e.g. a client id) is used by CONSISTENT_HASH
+    // Returns empty string if service not found
+    std::string selectBackend(const std::string& service_hash, const std::string& affinity_key = "");
+
+    // Finish a connection picked by selectBackend
+    // A failed connect counts against the backend's passive health
+    void releaseBackend(const std::string& service_hash, const std::string& address, bool success);
+
     // Lookup service information
     std::shared_ptr<ServiceHandle> getServiceHandle(const std::string& service_hash);
 
@@ -40,6 +106,53 @@ public:
     // Get list of all exposed services
     std::vector<std::shared_ptr<ServiceHandle>> listServices();
 
+    // Iterate services in hash order, at most limit per call
+    // Pass an empty cursor to start and the returned next_cursor to continue
+    ServicePage listServicesPage(const std::string& cursor, size_t limit);
+
+    // Get number of exposed services
+    size_t getServiceCount() const;
+
+    // Find the services that have the given address as a backend
+    std::vector<std::string> findServicesByTarget(const std::string& target_address);
+
+    // Bulk expose/revoke under a single lock acquisition
+    // exposeServices returns one hash per input, empty for invalid addresses
+    // revokeServices returns the number of services revoked
+    std::vector<std::string> exposeServices(const std::vector<std::string>& target_addresses);
+    size_t revokeServices(const std::vector<std::string>& service_hashes);
+
+    // Copies of every service for persistence, taken under one lock
+    std::vector<ServiceHandle> exportServices() const;
+
+    // Re-register a service saved by an earlier run under its original hash
+    // Only hash, target, timestamp, policy and backend addresses/weights are used
+    // Returns false if the hash is invalid or taken or no backend is valid
+    bool restoreService(const ServiceHandle& saved);
+
+    // Attach a backend pool; targets of exposed services are pre-warmed in it
+    void setBackendPool(std::shared_ptr<BackendPool> pool);
+
+    // Open a connection to a backend of a service for a new incoming stream
+    // Served from the backend pool when one is attached
+    // Returns -1 if the service is unknown or no backend is reachable
+    int openServiceConnection(const std::string& service_hash, const std::string& affinity_key = "");
+
+    // Like openServiceConnection, but never blocks on a TCP handshake or a name lookup
+    // Returns a pooled socket, or one whose connect is still in progress: wait for
+    // it to become writable and check SO_ERROR, then report a failed connect
+    // through closeServiceConnection so the backend's health is updated.
+    // Backends whose host name is not resolved yet are skipped; see resolveBackends
+    int openServiceConnectionAsync(const std::string& service_hash, const std::string& affinity_key = "");
+
+    // Look up the host names of a service's backends off the calling thread;
+    // done runs on a resolver thread once they are cached. Returns false, and
+    // never calls done, when there is nothing to look up
+    bool resolveBackends(const std::string& service_hash, std::function<void()> done);
+
+    // Hand back a connection from openServiceConnection
+    void closeServiceConnection(int fd, bool reusable = false, bool connect_failed = false);
+
     // Generate random service hash
     static std::string generateServiceHash();
 
@@ -48,10 +161,42 @@ public:
 
 private:
     std::map<std::string, std::shared_ptr<ServiceHandle>> services_;
+    std::map<std::string, std::set<std::string>> target_index_;  // backend -> service hashes
     mutable std::mutex services_mutex_;
+    std::shared_ptr<BackendPool> backend_pool_;
+
+    // Connections handed out by openServiceConnection, indexed by fd:
+    // (hash, backend), empty when free. Slots keep their capacity so the
+    // SOCKS path does not allocate per connection
+    std::vector<std::pair<std::string, std::string>> open_connections_;
+
+    // Backends one openConnection call has tried, by index
+    struct TriedBackends {
+        static constexpr size_t kCapacity = 16;
+        std::array<size_t, kCapacity> index;
+        size_t count;
+
+        TriedBackends() : count(0) {}
+
+        bool contains(size_t i) const {
+            for (size_t n = 0; n < count; ++n) {
+                if (index[n] == i) return true;
+            }
+            return false;
+        }
+    };
 
     // Convert ip:port string to hash-friendly format
     std::string normalizeAddress(const std::string& address);
+
+    // Backend selection helpers; caller must hold services_mutex_
+    ServiceBackend* pickBackend(ServiceHandle& handle, const std::string& affinity_key,
+                                const TriedBackends& exclude = TriedBackends());
+    void releaseBackendLocked(const std::string& service_hash, const std::string& address, bool success);
+    void rebuildHashRing(ServiceHandle& handle);
+    void indexBackend(const std::string& address, const std::string& service_hash);
+    void unindexBackend(const std::string& address, const std::string& service_hash);
+    int openConnection(const std::string& service_hash, const std::string& affinity_key, bool wait);
 };
 
 }  // namespace kermit
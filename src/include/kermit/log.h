@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <charconv>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+// Lowest level compiled in: 0 debug, 1 info, 2 warn, 3 error. Statements
+// below it compile to nothing, their arguments included
+#ifndef KERMIT_LOG_LEVEL
+#define KERMIT_LOG_LEVEL 1
+#endif
+
+namespace kermit {
+
+enum class LogLevel : uint8_t {
+    DEBUG = 0,
+    INFO = 1,
+    WARN = 2,
+    ERROR = 3
+};
+
+// Logging counters
+struct LogStats {
+    uint64_t lines;     // Handed to the writer
+    uint64_t dropped;   // Lost to a full thread ring
+};
+
+// Asynchronous logging
+//
+// A log statement formats into a stack buffer and appends the finished
+// line to a ring owned by the calling thread, so it takes no lock, makes no
+// syscall and allocates nothing; when the ring is full the line is dropped
+// and counted rather than blocking. A background writer drains all rings
+// in timestamp order to the log file, copying warnings and errors to
+// stderr. Until start() and after stop() lines go straight to stdout (info
+// and debug) or stderr.
+class Log {
+public:
+    // Start the writer; an empty path writes to the console instead of a file
+    static bool start(const std::string& path);
+
+    // Write what is queued and stop the writer
+    static void stop();
+
+    // Open the log file again by name, e.g. after it was rotated; the old
+    // one stays in use if that fails
+    static bool reopen();
+
+    // Lines below the level are discarded at runtime; defaults to INFO
+    static void setLevel(LogLevel level);
+    static bool enabled(LogLevel level);
+
+    static void write(LogLevel level, const char* text, size_t length);
+
+    static LogStats getStats();
+};
+
+// One log line, written when it goes out of scope; longer lines are cut at kMaxLength
+class LogLine {
+public:
+    static constexpr size_t kMaxLength = 240;
+
+    explicit LogLine(LogLevel level) : level_(level), length_(0) {}
+    ~LogLine() { Log::write(level_, buffer_, length_); }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(const char* text);
+    LogLine& operator<<(const std::string& text);
+    LogLine& operator<<(char c);
+    LogLine& operator<<(double value);
+
+    template <typename T, typename = std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, char>::value &&
+                                                      !std::is_same<T, bool>::value>>
+    LogLine& operator<<(T value) {
+        auto result = std::to_chars(buffer_ + length_, buffer_ + kMaxLength, value);
+        if (result.ec == std::errc()) {
+            length_ = static_cast<size_t>(result.ptr - buffer_);
+        }
+        return *this;
+    }
+
+private:
+    void append(const char* text, size_t length);
+
+    LogLevel level_;
+    size_t length_;
+    char buffer_[kMaxLength];
+};
+
+} // namespace kermit
+
+#define KERMIT_LOG(level, floor) \
+    if ((floor) < KERMIT_LOG_LEVEL || !::kermit::Log::enabled(level)) {} else ::kermit::LogLine(level)
+
+#define KERMIT_DEBUG KERMIT_LOG(::kermit::LogLevel::DEBUG, 0)
+#define KERMIT_INFO KERMIT_LOG(::kermit::LogLevel::INFO, 1)
+#define KERMIT_WARN KERMIT_LOG(::kermit::LogLevel::WARN, 2)
+#define KERMIT_ERROR KERMIT_LOG(::kermit::LogLevel::ERROR, 3)
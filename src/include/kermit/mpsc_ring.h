@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Bounded lock-free queue for any number of producers and one consumer
+//
+// Each slot carries a sequence number telling producers and the consumer
+// whose turn it is, so a push claims a slot with one compare-and-swap and
+// a pop takes no atomic read-modify-write at all. The producer and
+// consumer positions sit on their own cache lines. Capacity is rounded up
+// to a power of two.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        slots_.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_ = 0;
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Any thread; false if the ring is full
+    bool push(T&& value) {
+        size_t position = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[position & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only; false if nothing is ready
+    bool pop(T& value) {
+        Slot& slot = slots_[tail_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+        tail_++;
+        return true;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(kCacheLine) std::atomic<size_t> head_;
+    alignas(kCacheLine) size_t tail_;
+    char padding_[kCacheLine - sizeof(size_t)];
+};
+
+} // namespace kermit
@@ -5,9 +5,22 @@
 #include <memory>
 #include <functional>
 #include <cstdint>
+#include "kermit/relay_id.h"
 
 namespace kermit {
 
+struct Cell;
+
+// Identifies one connection of a NetworkManager
+//
+// The low 32 bits index a slot in the connection table and the high 32 bits
+// are that slot's generation, bumped each time it is reused, so a handle
+// kept past its connection's close never reaches a later one. Handles are
+// compared and hashed as integers; getConnectionName() gives the "ip:port"
+// form for logging and the UI.
+using ConnectionHandle = uint64_t;
+constexpr ConnectionHandle kInvalidConnection = 0;
+
 // Network interface
 class NetworkManager {
 public:
@@ -21,24 +34,38 @@ public:
     bool start();
     void stop();
     
-    // Connection management
-    bool connect(const std::string& host, uint16_t port);
-    void disconnect(const std::string& connection_id);
+    // Connection management; connect() returns kInvalidConnection on failure
+    ConnectionHandle connect(const std::string& host, uint16_t port);
+    void disconnect(ConnectionHandle connection);
+    
+    // Data transmission; writes the socket does not take are queued per
+    // connection, and sends fail once the queue is full
+    bool sendData(ConnectionHandle connection, const std::vector<uint8_t>& data);
     
-    // Data transmission
-    bool sendData(const std::string& connection_id, const std::vector<uint8_t>& data);
-    std::vector<uint8_t> receiveData(const std::string& connection_id);
+    // Queue a cell; cells of different circuits are interleaved by a
+    // CircuitScheduler so busy circuits do not delay quiet ones
+    bool sendCell(ConnectionHandle connection, const Cell& cell);
     
-    // Callback registration
-    using ConnectionCallback = std::function<void(const std::string&, bool)>;
-    using DataCallback = std::function<void(const std::string&, const std::vector<uint8_t>&)>;
+    // Write cells in KIST rounds every interval_ms, each socket getting
+    // only what TCP_INFO says it can send soon; 0 (the default) writes
+    // them as they are queued. Set before start()
+    void setKistInterval(uint32_t interval_ms);
+    std::vector<uint8_t> receiveData(ConnectionHandle connection);
+    
+    // Callback registration; the name of a closing connection is still
+    // available while its callback runs
+    using ConnectionCallback = std::function<void(ConnectionHandle, bool)>;
+    using DataCallback = std::function<void(ConnectionHandle, const std::vector<uint8_t>&)>;
     
     void setConnectionCallback(ConnectionCallback callback);
     void setDataCallback(DataCallback callback);
     
     // Network information
-    std::vector<std::string> getActiveConnections() const;
-    bool isConnected(const std::string& connection_id) const;
+    std::vector<ConnectionHandle> getActiveConnections() const;
+    bool isConnected(ConnectionHandle connection) const;
+    
+    // "ip:port" of the peer, or empty for an unknown handle
+    std::string getConnectionName(ConnectionHandle connection) const;
     
 private:
     class Impl;
@@ -52,17 +79,43 @@ public:
     ~RelayNode();
     
     const std::string& getNodeId() const;
+    RelayId getRelayId() const;     // Interned getNodeId()
     const std::string& getAddress() const;
     uint16_t getPort() const;
     
     bool isTrusted() const;
     void setTrusted(bool trusted);
     
+    // Came from the config or a relay directory rather than being added at
+    // runtime; only listed relays are saved across restarts
+    bool isListed() const;
+    void setListed(bool listed);
+    
     // Node capabilities
     bool supportsHiddenServices() const;
     bool isExitNode() const;
     bool isGuardNode() const;
     
+    void setSupportsHiddenServices(bool supported);
+    void setExitNode(bool exit);
+    void setGuardNode(bool guard);
+    
+    // Advertised bandwidth in KB/s, used as the path selection weight
+    uint32_t getBandwidth() const;
+    void setBandwidth(uint32_t bandwidth);
+    
+    // Measured round-trip latency in microseconds (EWMA), 0 until measured
+    uint32_t getLatency() const;
+    void setLatency(uint32_t latency_us);
+    
+    // Probe failure rate (EWMA, 0.0 to 1.0)
+    double getFailureRate() const;
+    void setFailureRate(double failure_rate);
+    
+    // Measured echo throughput in KB/s (EWMA), 0 until measured
+    uint32_t getMeasuredThroughput() const;
+    void setMeasuredThroughput(uint32_t throughput);
+    
 private:
     class Impl;
     std::unique_ptr<Impl> impl_;
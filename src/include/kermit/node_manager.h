@@ -5,10 +5,76 @@
 #include <memory>
 #include <mutex>
 #include <map>
+#include <array>
+#include <cstdint>
+#include "kermit/alias_table.h"
+#include "kermit/relay_directory.h"
+#include "kermit/channel_pool.h"
 
 namespace kermit {
 
 class RelayNode;
+class EventLoop;
+
+// Relay entry for bulk installs, e.g. from a directory document
+struct RelayDescriptor {
+    std::string host;
+    uint16_t port;
+    uint32_t bandwidth;
+    uint8_t flags;        // RelayDirectory::Flag bits; CONNECTED is ignored
+    uint32_t latency_us;  // Measured latency, 0 keeps the current value
+};
+
+// One probe result for a relay
+struct RelayMeasurement {
+    std::string node_id;
+    bool success;
+    uint32_t rtt_us;      // Round trip of the probe, valid on success
+    uint32_t throughput;  // Echo throughput in KB/s, 0 if not measured
+};
+
+// Immutable view of the relay set
+//
+// NodeManager publishes a new snapshot on every change and readers load the
+// current one atomically, so queries never contend with writers and see one
+// consistent relay set. Nodes inside a snapshot are never modified; changes
+// replace them with fresh copies in the next snapshot.
+struct RelaySnapshot {
+    enum Selection {
+        SELECT_ANY,
+        SELECT_TRUSTED,
+        SELECT_GUARD,
+        SELECT_EXIT,
+        SELECT_HIDDEN_SERVICES,
+        SELECT_COUNT
+    };
+    
+    uint64_t version = 0;
+    
+    // All nodes sorted by node id, with connection state at the same index
+    std::vector<std::shared_ptr<RelayNode>> nodes;
+    std::vector<uint8_t> connected;
+    
+    // Precomputed filtered views
+    std::vector<std::shared_ptr<RelayNode>> trusted_nodes;
+    size_t connected_count = 0;
+    
+    // Packed columns for scans, same order as nodes
+    RelayDirectory directory;
+    
+    // Alias tables weighted by bandwidth and measured health; entries index into nodes
+    std::array<std::vector<uint32_t>, SELECT_COUNT> selection_nodes;
+    std::array<AliasTable, SELECT_COUNT> selection_tables;
+    
+    // Binary search by node id; returns nodes.size() if absent
+    size_t indexOf(const std::string& node_id) const;
+    
+    std::shared_ptr<RelayNode> find(const std::string& node_id) const;
+    bool isConnected(const std::string& node_id) const;
+    
+    // O(1) weighted pick from 64 random bits, nullptr if the class is empty
+    std::shared_ptr<RelayNode> pick(Selection selection, uint64_t random_bits) const;
+};
 
 // Node manager for handling relay nodes
 class NodeManager {
@@ -16,8 +82,8 @@ public:
     NodeManager();
     ~NodeManager();
     
-    // Initialize node manager
-    bool initialize();
+    // Initialize node manager and start the relay channel pool
+    bool initialize(const ChannelPoolConfig& channel_config = ChannelPoolConfig());
     
     // Add a relay node
     bool addRelayNode(const std::string& node_id, const std::string& address, uint16_t port, bool trusted = false);
@@ -25,6 +91,10 @@ public:
     // Add a relay node from address string (host:port)
     bool addRelayNodeFromString(const std::string& node_address, bool trusted = false);
     
+    // Add or update many relays under one lock and publish one snapshot
+    // Node ids are host:port; returns the number of relays installed
+    size_t bulkInstall(const std::vector<RelayDescriptor>& relays);
+    
     // Remove a relay node
     bool removeRelayNode(const std::string& node_id);
     
@@ -37,25 +107,56 @@ public:
     // Get trusted relay nodes
     std::vector<std::shared_ptr<RelayNode>> getTrustedRelayNodes() const;
     
-    // Get random relay node
+    // Weighted random picks, O(1) from precomputed alias tables
+    // Weights are bandwidth scaled down by probe failures and latency
     std::shared_ptr<RelayNode> getRandomRelayNode() const;
-    
-    // Get random trusted relay node
     std::shared_ptr<RelayNode> getRandomTrustedRelayNode() const;
+    std::shared_ptr<RelayNode> getRandomGuardNode() const;
+    std::shared_ptr<RelayNode> getRandomExitNode() const;
+    std::shared_ptr<RelayNode> getRandomHiddenServiceNode() const;
+    
+    // Weighted pick by arbitrary RelayDirectory::Flag constraints and latency
+    // cap, scanning the snapshot directory; for ad-hoc path restrictions
+    std::shared_ptr<RelayNode> selectRelayNode(uint8_t required_flags, uint8_t forbidden_flags = 0,
+                                               uint32_t max_latency_us = 0) const;
+    
+    // Fold probe results into each relay's EWMA latency, failure rate and
+    // throughput (new = alpha * sample + (1 - alpha) * old) and publish
+    // one snapshot; selection weights follow the updated scores
+    size_t recordMeasurements(const std::vector<RelayMeasurement>& measurements, double alpha);
+    
+    // Update a node's selection weight or flags and rebuild the tables
+    bool setRelayNodeBandwidth(const std::string& node_id, uint32_t bandwidth);
+    bool setRelayNodeCapabilities(const std::string& node_id, bool guard, bool exit, bool hidden_services);
     
     // Get number of relay nodes
     size_t getRelayNodeCount() const;
     size_t getTrustedRelayNodeCount() const;
     
-    // Connect to a relay node
+    // Keep warm channels to a relay node; they open in the background and
+    // are reconnected with backoff whenever they fail
     bool connectToRelayNode(const std::string& node_id);
     
-    // Disconnect from a relay node
+    // Close a relay node's channels and stop reconnecting
     void disconnectFromRelayNode(const std::string& node_id);
     
-    // Check if connected to a relay node
+    // Check if at least one channel to a relay node is open
     bool isConnectedToRelayNode(const std::string& node_id) const;
     
+    // An already open channel to the relay, or kInvalidChannel; never connects inline
+    ChannelPool::ChannelId acquireChannel(const std::string& node_id) const;
+    ChannelPool::ChannelId acquireChannel(RelayId relay) const;
+    
+    // Relay channels; nullptr until initialize() succeeds
+    ChannelPool* getChannelPool();
+    
+    // Loop the relay channels run on, for timers that drive circuit work
+    // Returns nullptr until initialize() succeeds
+    EventLoop* getEventLoop();
+    
+    // Current relay set; safe to hold and read from any thread
+    std::shared_ptr<const RelaySnapshot> getSnapshot() const;
+    
     // Load nodes from configuration
     void loadFromConfig(const std::vector<std::string>& trusted_relays);
     
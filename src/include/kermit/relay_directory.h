@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Compact structure-of-arrays relay directory
+//
+// Ids and hostnames are interned into one string pool and every other field
+// lives in its own contiguous array, so scans touch only the columns they
+// need. Filters walk the flags column 16 relays at a time with SSE2 where
+// available. Built once per RelaySnapshot, append-only and never modified
+// after publication; entries are expected in node id order.
+class RelayDirectory {
+public:
+    // Packed per-relay flags
+    enum Flag : uint8_t {
+        TRUSTED = 1 << 0,
+        GUARD = 1 << 1,
+        EXIT = 1 << 2,
+        HIDDEN_SERVICES = 1 << 3,
+        CONNECTED = 1 << 4,
+        LISTED = 1 << 5         // From the config or a relay directory, not added at runtime
+    };
+
+    void reserve(size_t count);
+
+    // Append a relay; ids must arrive in ascending order for find()
+    // weight is the selection weight: bandwidth adjusted by measured health
+    void append(std::string_view node_id, std::string_view host, uint16_t port,
+                uint32_t bandwidth, uint32_t weight, uint32_t latency_us, uint8_t flags);
+
+    size_t size() const { return ports_.size(); }
+    bool empty() const { return ports_.empty(); }
+
+    std::string_view id(size_t index) const { return view(ids_[index]); }
+    std::string_view host(size_t index) const { return view(hosts_[index]); }
+    uint32_t ipv4(size_t index) const { return ipv4_[index]; }  // Host order, 0 if not a literal
+    uint16_t port(size_t index) const { return ports_[index]; }
+    uint32_t bandwidth(size_t index) const { return bandwidth_[index]; }
+    uint32_t weight(size_t index) const { return weight_[index]; }
+    uint32_t latency(size_t index) const { return latency_[index]; }  // Microseconds, 0 if unmeasured
+    uint8_t flags(size_t index) const { return flags_[index]; }
+
+    // Binary search by id; returns size() if absent
+    size_t find(std::string_view node_id) const;
+
+    // Relays with all required flags set and no forbidden flag set
+    size_t countMatching(uint8_t required, uint8_t forbidden = 0) const;
+    void filter(uint8_t required, uint8_t forbidden, std::vector<uint32_t>& out) const;
+
+    // Weighted pick among matching relays whose measured latency is
+    // at most max_latency_us (0 disables the latency cut; unmeasured relays
+    // always pass). Returns size() if nothing matches.
+    size_t pickWeighted(uint8_t required, uint8_t forbidden, uint32_t max_latency_us,
+                        uint64_t random_bits) const;
+
+private:
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::string_view view(StringRef ref) const {
+        return std::string_view(pool_.data() + ref.offset, ref.length);
+    }
+
+    StringRef intern(std::string_view value);
+
+    // Calls visit(index) for every relay whose flags match
+    template <typename Visitor>
+    void scan(uint8_t required, uint8_t forbidden, Visitor&& visit) const;
+
+    std::string pool_;
+    std::vector<StringRef> ids_;
+    std::vector<StringRef> hosts_;
+    std::vector<uint32_t> ipv4_;
+    std::vector<uint16_t> ports_;
+    std::vector<uint32_t> bandwidth_;
+    std::vector<uint32_t> weight_;
+    std::vector<uint32_t> latency_;
+    std::vector<uint8_t> flags_;
+};
+
+} // namespace kermit
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace kermit {
+
+// Interned relay node id
+//
+// Relay ids ("host:port") are interned once into small integers that the
+// channel pool, node manager and their callbacks pass around instead of the
+// string, so per-cell and per-state work neither compares nor copies it.
+// Ids are process-wide and never reused; the string form is for logging
+// and the UI.
+using RelayId = uint32_t;
+constexpr RelayId kInvalidRelay = 0;
+
+class RelayIds {
+public:
+    // The id for a node id, assigning the next one if it is new
+    static RelayId intern(const std::string& node_id);
+
+    // The id for a node id, or kInvalidRelay if it was never interned
+    static RelayId find(const std::string& node_id);
+
+    // The node id an id was interned from; empty for unknown ids
+    static std::string name(RelayId id);
+};
+
+} // namespace kermit
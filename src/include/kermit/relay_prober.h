@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+class NodeManager;
+
+struct RelayProberConfig {
+    uint32_t interval_ms = 60000;  // Between probe rounds
+    uint32_t timeout_ms = 3000;    // A probe not done by then counts as a failure
+    size_t max_concurrent = 64;    // Probes in flight at once
+    double alpha = 0.3;            // EWMA weight of each new sample
+    size_t echo_bytes = 0;         // After connecting, send this many bytes and time
+                                   // the echo; only for relays that echo (testbeds)
+};
+
+struct RelayProberStats {
+    uint64_t rounds;
+    uint64_t probes;
+    uint64_t failures;
+};
+
+// Background relay prober
+//
+// Each round opens a TCP connection to every relay in the current snapshot,
+// many at once from a single poll loop, and times the handshake (one RTT).
+// With echo_bytes set it also times an echo for latency and throughput.
+// Results go to NodeManager::recordMeasurements, which keeps EWMA scores on
+// the relay and folds them into path selection weights.
+class RelayProber {
+public:
+    explicit RelayProber(NodeManager& node_manager, const RelayProberConfig& config = RelayProberConfig());
+    ~RelayProber();
+
+    // Run rounds every interval_ms on a background thread
+    bool start();
+    void stop();
+
+    // Probe every relay once and record the results; blocks for one round
+    // Returns the number of relays probed
+    size_t probeOnce();
+
+    RelayProberStats getStats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
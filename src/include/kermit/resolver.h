@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <netinet/in.h>
+
+namespace kermit {
+
+// Host name lookups that never block an event loop
+//
+// Numeric IPv4 hosts are parsed in place. Names are looked up by a few
+// process-wide worker threads and cached, so loop code asks lookup() first
+// and, on a miss, queues resolve() and retries once it reports back.
+class Resolver {
+public:
+    // Fill address without blocking; false if the host is a name that is not
+    // cached, or was cached as unresolvable
+    static bool lookup(const std::string& host, uint16_t port, sockaddr_in& address);
+
+    // Look the host up on a worker thread; done(resolved) runs there once the
+    // cache is updated. Concurrent requests for one host share a lookup
+    static void resolve(const std::string& host, std::function<void(bool)> done);
+
+    // Look the host up on the calling thread through the same cache, for
+    // threads that may wait
+    static bool resolveNow(const std::string& host, uint16_t port, sockaddr_in& address);
+
+    // Split "host:port"; false if the port is missing or out of range
+    static bool splitAddress(const std::string& address, std::string& host, uint16_t& port);
+};
+
+} // namespace kermit
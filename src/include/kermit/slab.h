@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace kermit {
+
+// Slab memory counters
+struct SlabStats {
+    size_t limit_bytes;             // Most memory slabs may take
+    size_t slab_bytes;              // Taken by slabs so far; never given back
+    size_t blocks_out;              // Handed to threads: in use or in their caches
+    size_t blocks_free;             // Back in the shared depot
+    uint64_t fallback_allocations;  // Served by operator new: too large, or slabs at the limit
+};
+
+// Small-object allocation from per-thread caches of fixed-size blocks
+//
+// Blocks come in power-of-two size classes up to kMaxBlock bytes. Each
+// thread keeps a short free list per class, so allocate() and deallocate()
+// take no lock and touch no shared cache line in the steady state; surplus
+// blocks move to a shared depot in batches and an empty cache refills from
+// it. Slabs are carved from one reserved address range up to the limit and
+// never returned, so memory under churn stays at its high-water mark
+// instead of fragmenting the heap. Larger requests, and any once the limit
+// is reached, go to operator new.
+//
+// Blocks may be freed on any thread. Alignment is that of operator new.
+class Slab {
+public:
+    static constexpr size_t kMaxBlock = 1024;
+
+    static void* allocate(size_t bytes);
+    static void deallocate(void* pointer, size_t bytes);
+
+    // Cap on slab memory; blocks already carved stay. Defaults to 64 MiB.
+    // Address space is reserved for the limit when the first slab is carved,
+    // so set it before then; a later raise cannot grow past that reservation
+    static void setLimit(size_t bytes);
+
+    static SlabStats getStats();
+};
+
+// Standard allocator drawing on the slab, for containers on hot paths
+template <typename T>
+class SlabAllocator {
+public:
+    using value_type = T;
+
+    SlabAllocator() noexcept = default;
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(Slab::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t n) noexcept {
+        Slab::deallocate(pointer, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const SlabAllocator<T>&, const SlabAllocator<U>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const SlabAllocator<T>&, const SlabAllocator<U>&) noexcept {
+    return false;
+}
+
+// Base for records created and destroyed with every circuit, stream or
+// connection, so that new and delete of them draw on the slab
+struct SlabAllocated {
+    static void* operator new(size_t bytes) {
+        return Slab::allocate(bytes);
+    }
+
+    static void operator delete(void* pointer, size_t bytes) {
+        Slab::deallocate(pointer, bytes);
+    }
+};
+
+} // namespace kermit
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace kermit {
+
+class EventLoop;
+class ServiceRegistry;
+
+// SOCKS front end counters
+struct SocksServerStats {
+    uint64_t accepted;          // Client connections accepted
+    uint64_t active;            // Sessions currently open
+    uint64_t connected;         // CONNECT requests that reached a backend
+    uint64_t rejected;          // Malformed, unsupported or unresolvable requests
+    uint64_t connect_failures;  // Backends that refused or timed out
+    uint64_t bytes_relayed;     // Payload bytes relayed in both directions
+};
+
+// SOCKS5 listener for .uwu services
+//
+// Runs entirely on a shared EventLoop. Only CONNECT with no authentication is
+// supported, and only to .uwu names, which are resolved through the service
+// registry. Each session parses the handshake in place in its fixed relay
+// buffers, so requests do not allocate; sessions are recycled between clients.
+// Backend host names are looked up off the loop, and a session that has not
+// finished its handshake and backend connect within a deadline is closed.
+class SocksServer {
+public:
+    SocksServer(EventLoop& loop, ServiceRegistry& registry);
+    ~SocksServer();
+
+    // Start listening; port 0 picks an ephemeral port (see getPort)
+    bool start(uint16_t port, const std::string& listen_address = "127.0.0.1");
+
+    // Stop listening and close all sessions; must run on the loop thread
+    // or after the loop has stopped
+    void stop();
+
+    uint16_t getPort() const;
+    SocksServerStats getStats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
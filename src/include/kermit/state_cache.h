@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "kermit/node_manager.h"
+#include "kermit/expose_service.h"
+
+namespace kermit {
+
+// Router state carried across restarts
+struct RouterState {
+    uint64_t saved_at_ms = 0;                // Wall clock at save time
+    std::vector<RelayDescriptor> relays;     // Relay set with measured latencies
+    std::vector<std::string> guards;         // Guard relays we held channels to, in order
+    std::vector<ServiceHandle> services;     // Exposed services and their backends
+};
+
+// Warm-start cache at <data_directory>/state.bin
+//
+// A compact binary file, written to a temporary name and renamed into place
+// so a crash mid-save leaves the previous state intact. An unreadable or
+// stale-format file is ignored and the router starts cold.
+class StateCache {
+public:
+    explicit StateCache(const std::string& data_directory);
+
+    bool load(RouterState& state) const;
+    bool save(const RouterState& state) const;
+
+    const std::string& getPath() const;
+
+private:
+    std::string data_directory_;
+    std::string path_;
+};
+
+} // namespace kermit
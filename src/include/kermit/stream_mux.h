@@ -0,0 +1,160 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "kermit/cell.h"
+#include "kermit/congestion_control.h"
+
+namespace kermit {
+
+// Stream multiplexer configuration
+struct StreamMuxConfig {
+    bool congestion_control;        // Size the circuit window from RTT; both ends must agree
+    CongestionControlConfig congestion;
+    uint32_t circuit_window;        // Fixed window when congestion control is off
+    uint32_t circuit_increment;     // Cells acknowledged by one circuit-level SENDME, without congestion control
+    uint32_t stream_window;         // DATA cells the peer may have unread per stream
+    uint32_t stream_increment;      // Cells acknowledged by one stream-level SENDME
+    size_t max_streams;
+    size_t max_stream_queued_bytes; // Unsent data accepted from the application per stream
+    size_t max_queued_bytes;        // Unsent data accepted across the circuit
+    size_t max_reorder_cells;       // Cells held waiting for an earlier one on another leg
+
+    // Default constructor with sensible defaults
+    StreamMuxConfig();
+};
+
+// What happened to a stream; delivered through StreamMux::EventCallback
+enum class StreamEvent {
+    BEGIN,      // The peer asked to open a stream; accept() or close() it
+    CONNECTED,  // The peer accepted a stream we opened
+    READABLE,   // Data arrived
+    WRITABLE,   // Queue space freed after a short write() or a zero writeSpace()
+    CLOSED      // The peer ended the stream; unread data can still be read
+};
+
+// Relay counters for one circuit end
+struct StreamMuxStats {
+    uint64_t streams;
+    uint64_t queued_bytes;      // Accepted from the application, not yet sent
+    uint64_t buffered_bytes;    // Received, not yet read by the application
+    uint64_t legs;              // Circuits carrying the streams
+    uint64_t package_window;    // Circuit-level cells we may still send, over all legs
+    uint64_t congestion_window; // Summed over legs; 0 without congestion control
+    uint64_t rtt_us;            // Smoothed SENDME round trip of the fastest leg, 0 until measured
+    uint64_t min_rtt_us;
+    uint64_t reordered_cells;   // Received ahead of an earlier cell on another leg
+    uint64_t leg_switches;
+    uint64_t cells_sent;
+    uint64_t cells_received;
+    uint64_t sendmes_sent;
+};
+
+// Streams multiplexed on one circuit, one instance at each end
+//
+// Both ends keep Tor-style SENDME windows. A sender may have at most
+// stream_window DATA cells per stream unacknowledged; the receiver
+// acknowledges every stream_increment cells with a SENDME once the
+// application has read them, so a slow reader stalls its sender instead of
+// growing buffers. Unsent data is capped per stream and per circuit, and
+// write() accepts only what fits.
+//
+// The circuit as a whole is limited by a CongestionControl window, with
+// circuit-level SENDMEs sent as cells arrive so they time the path rather
+// than the reader. With congestion control off, a fixed circuit_window is
+// acknowledged after reads like the stream windows.
+//
+// Queued data is packaged round robin, one cell per stream per turn, so a
+// bulk stream cannot starve an interactive one sharing the circuit.
+//
+// With congestion control, further circuits ending at the same relay can be
+// linked in as legs. Each leg keeps its own window, and every stream cell
+// goes on the leg with the lowest RTT that has room, so a bulk transfer
+// spills onto slower legs once the fastest is full and traffic moves off a
+// stalled one. Stream cells are numbered implicitly: each leg counts the
+// cells it carries, and a SWITCH cell tells the receiver where the count
+// stands whenever the sender moves to a leg. The receiver holds cells that
+// arrive ahead of an earlier one and handles them in order.
+//
+// Thread-safe. Cells are handed to the CellSender with the lock held;
+// events are delivered after it is released.
+class StreamMux {
+public:
+    // Send one RELAY cell to the other end; false if it could not be queued,
+    // in which case the data stays queued for the next flush()
+    using CellSender = std::function<bool(RelayCommand command, uint16_t stream_id, const uint8_t* data,
+                                          size_t len)>;
+    using EventCallback = std::function<void(uint16_t stream_id, StreamEvent event)>;
+
+    // Circuits carrying the streams; the constructor's sender is leg 0
+    using LegId = uint32_t;
+    static constexpr LegId kInvalidLeg = UINT32_MAX;
+
+    explicit StreamMux(CellSender sender, const StreamMuxConfig& config = StreamMuxConfig());
+    ~StreamMux();
+
+    void setEventCallback(EventCallback callback);
+
+    // Open a stream to target ("host:port"); 0 at the stream limit
+    uint16_t open(const std::string& target);
+
+    // Answer a BEGIN from the peer
+    void accept(uint16_t stream_id);
+
+    // The target a BEGIN asked for
+    std::string getTarget(uint16_t stream_id) const;
+
+    // Queue data for the peer; returns the bytes accepted
+    size_t write(uint16_t stream_id, const uint8_t* data, size_t len);
+
+    // Bytes write() would accept right now; at 0, WRITABLE follows once
+    // there is room again
+    size_t writeSpace(uint16_t stream_id);
+
+    // Take received data; reading releases SENDMEs to the peer
+    size_t read(uint16_t stream_id, uint8_t* out, size_t len);
+
+    // End the stream once its queued data is sent and forget it
+    void close(uint16_t stream_id);
+
+    // Retry packaging after the CellSender refused a cell
+    void flush();
+
+    // A RELAY cell from the other end: BEGIN, CONNECTED, DATA, END, SENDME,
+    // LINKED or SWITCH
+    // Returns false if the peer overran a window or broke the cell order; the
+    // circuit should be torn down
+    bool handleCell(const RelayHeader& header, const uint8_t* data);
+    bool handleCell(LegId leg, const RelayHeader& header, const uint8_t* data);
+
+    // Link another circuit to the same relay as a new leg. Sends LINK on leg
+    // 0 first and on the new leg once that is answered; the leg carries
+    // stream cells after its own LINKED
+    // Returns kInvalidLeg without congestion control
+    LegId link(CellSender sender);
+
+    // At the relay: add a circuit whose LINK named the same set as leg 0's
+    // and answer it with LINKED
+    // Returns kInvalidLeg without congestion control
+    LegId join(CellSender sender);
+
+    // A leg's circuit is gone. The streams carry on over the other legs
+    // only if a SENDME acknowledged every stream cell it carried and no cells
+    // are waiting for a gap; otherwise cells may have been lost with it
+    // Returns false if the streams were closed, including when no leg is
+    // left; the caller should then tear down the circuits of any other legs
+    // so the peer closes its streams too
+    bool removeLeg(LegId leg);
+
+    size_t getStreamCount() const;
+    StreamMuxStats getStats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace kermit
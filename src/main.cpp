@@ -1,11 +1,11 @@
 #include <iostream>
 #include <memory>
-#include <csignal>
 #include <cstdlib>
 
 #include "kermit/config.h"
 #include "kermit/core.h"
 #include "kermit/expose_service.h"
+#include "kermit/backend_pool.h"
 
 using namespace kermit;
 
@@ -15,22 +15,14 @@ std::unique_ptr<Router> g_router;
 // Global service registry
 std::unique_ptr<ServiceRegistry> g_service_registry;
 
-// Signal handler for graceful shutdown
-void signalHandler(int signal) {
-    std::cout << "\nReceived signal " << signal << ", shutting down..." << std::endl;
-    
-    if (g_router && g_router->isRunning()) {
-        g_router->stop();
-    }
-    
-    exit(0);
-}
-
 void printUsage(const std::string& program_name) {
     std::cout << "Usage: " << program_name << " [command] [options]" << std::endl;
     std::cout << std::endl;
     std::cout << "Commands:" << std::endl;
-    std::cout << "  expose <ip:port>      Expose a service and return .uwu address" << std::endl;
+    std::cout << "  expose <ip:port> [--weight <n>] [--policy least-conn|consistent-hash]" << std::endl;
+    std::cout << "                        Expose a service and return .uwu address" << std::endl;
+    std::cout << "  add-backend <hash> <ip:port> [weight]" << std::endl;
+    std::cout << "                        Add a load-balanced backend to a service" << std::endl;
     std::cout << "  revoke <hash>         Revoke an exposed service" << std::endl;
     std::cout << "  list                  List all exposed services" << std::endl;
     std::cout << "  resolve <hash>        Resolve a .uwu address to target" << std::endl;
@@ -44,13 +36,52 @@ void printUsage(const std::string& program_name) {
     std::cout << "Copyright (C) 2023 Kermit Developers" << std::endl;
 }
 
-int handleExposeCommand(const std::string& target_address) {
+// Parse a backend weight, reporting it if outside kMinBackendWeight..kMaxBackendWeight
+bool parseWeight(const std::string& text, uint32_t& weight) {
+    unsigned long value = 0;
+    try {
+        value = std::stoul(text);
+    } catch (const std::exception&) {
+        // Not a number; rejected with the range check below
+    }
+    if (value < kMinBackendWeight || value > kMaxBackendWeight) {
+        std::cerr << "Error: Invalid weight: " << text << " (expected " << kMinBackendWeight
+                  << ".." << kMaxBackendWeight << ")" << std::endl;
+        return false;
+    }
+    weight = static_cast<uint32_t>(value);
+    return true;
+}
+
+int handleExposeCommand(int argc, char* argv[]) {
+    std::string target_address = argv[2];
+    uint32_t weight = 1;
+    BalancePolicy policy = BalancePolicy::LEAST_CONNECTIONS;
+    
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--weight" && i + 1 < argc) {
+            if (!parseWeight(argv[++i], weight)) {
+                return 1;
+            }
+        } else if (arg == "--policy" && i + 1 < argc) {
+            if (!parseBalancePolicy(argv[++i], policy)) {
+                std::cerr << "Error: Unknown policy: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Error: Unknown expose option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
     if (!g_service_registry) {
         g_service_registry = std::make_unique<ServiceRegistry>();
     }
     
     try {
-        std::string service_hash = g_service_registry->exposeService(target_address);
+        std::string service_hash = g_service_registry->exposeService(target_address, weight, policy);
         std::cout << service_hash << std::endl;
         return 0;
     } catch (const std::exception& e) {
@@ -59,6 +90,29 @@ int handleExposeCommand(const std::string& target_address) {
     }
 }
 
+int handleAddBackendCommand(const std::string& service_hash, const std::string& address, const std::string& weight_str) {
+    uint32_t weight = 1;
+    if (!weight_str.empty() && !parseWeight(weight_str, weight)) {
+        return 1;
+    }
+    
+    if (!g_service_registry) {
+        std::cerr << "Error: No services exposed" << std::endl;
+        return 1;
+    }
+    
+    try {
+        if (g_service_registry->addBackend(service_hash, address, weight)) {
+            return 0;
+        }
+        std::cerr << "Error: Service not found" << std::endl;
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
 int handleRevokeCommand(const std::string& service_hash) {
     if (!g_service_registry) {
         std::cerr << "Error: No services exposed" << std::endl;
@@ -87,7 +141,15 @@ int handleListCommand() {
     
     std::cout << "Exposed Services:" << std::endl;
     for (const auto& service : services) {
-        std::cout << "  " << service->service_hash << " -> " << service->target_address << std::endl;
+        if (service->backends.size() <= 1) {
+            std::cout << "  " << service->service_hash << " -> " << service->target_address << std::endl;
+            continue;
+        }
+        
+        std::cout << "  " << service->service_hash << " (" << balancePolicyName(service->policy) << ")" << std::endl;
+        for (const auto& backend : service->backends) {
+            std::cout << "    -> " << backend.address << " weight " << backend.weight << std::endl;
+        }
     }
     return 0;
 }
@@ -116,7 +178,9 @@ int main(int argc, char* argv[]) {
         std::string command = argv[1];
         
         if (command == "expose" && argc > 2) {
-            return handleExposeCommand(argv[2]);
+            return handleExposeCommand(argc, argv);
+        } else if (command == "add-backend" && argc > 3) {
+            return handleAddBackendCommand(argv[2], argv[3], argc > 4 ? argv[4] : "");
         } else if (command == "revoke" && argc > 2) {
             return handleRevokeCommand(argv[2]);
         } else if (command == "list") {
@@ -159,9 +223,9 @@ int main(int argc, char* argv[]) {
     // Initialize service registry for daemon mode
     g_service_registry = std::make_unique<ServiceRegistry>();
 
-    // Set up signal handlers
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    // SIGINT, SIGTERM and SIGHUP are read by Router::run(); block them
+    // before any thread starts so none of them takes the default action
+    Router::blockSignals();
 
     std::cout << "Kermit - Hidden Service Router" << std::endl;
     std::cout << "Starting up..." << std::endl;
@@ -169,6 +233,7 @@ int main(int argc, char* argv[]) {
     try {
         // Create router instance
         g_router = std::make_unique<Router>();
+        g_router->setServiceRegistry(g_service_registry.get());
         
         // Initialize router
         if (!g_router->initialize(config_file)) {
@@ -176,6 +241,17 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
+        // Pre-warm connections to exposed service targets
+        const auto& config = ConfigManager::getInstance().getConfig();
+        BackendPoolConfig pool_config;
+        pool_config.min_idle = config.backend_pool_min_idle;
+        pool_config.max_idle = config.backend_pool_max_idle;
+        pool_config.idle_timeout = config.backend_pool_idle_timeout;
+        
+        auto backend_pool = std::make_shared<BackendPool>(pool_config);
+        backend_pool->start();
+        g_service_registry->setBackendPool(backend_pool);
+        
         // Start router
         if (!g_router->start()) {
             std::cerr << "Failed to start router" << std::endl;
@@ -185,8 +261,10 @@ int main(int argc, char* argv[]) {
         std::cout << "Router started successfully" << std::endl;
         std::cout << "Press Ctrl+C to shutdown..." << std::endl;
         
-        // Run main event loop
+        // Run main event loop until a shutdown signal
         g_router->run();
+        g_router->stop();
+        g_router.reset();
         
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
@@ -0,0 +1,64 @@
+#include "kermit/alias_table.h"
+#include <vector>
+#include <cstdint>
+
+namespace kermit {
+
+AliasTable::AliasTable(const std::vector<double>& weights) {
+    build(weights);
+}
+
+void AliasTable::build(const std::vector<double>& weights) {
+    const size_t n = weights.size();
+    prob_.assign(n, 0);
+    alias_.assign(n, 0);
+    if (n == 0) return;
+
+    double total = 0.0;
+    for (double w : weights) {
+        if (w > 0.0) total += w;
+    }
+
+    // Scale so the average column holds exactly 1.0
+    std::vector<double> scaled(n);
+    for (size_t i = 0; i < n; ++i) {
+        double w = weights[i] > 0.0 ? weights[i] : 0.0;
+        scaled[i] = total > 0.0 ? w * n / total : 1.0;
+    }
+
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    small.reserve(n);
+    large.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    while (!small.empty() && !large.empty()) {
+        uint32_t s = small.back();
+        small.pop_back();
+        uint32_t l = large.back();
+
+        prob_[s] = static_cast<uint32_t>(scaled[s] * 4294967296.0);
+        alias_[s] = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Leftovers are full columns, up to rounding error; aliasing a column to
+    // itself makes the coin irrelevant
+    for (uint32_t i : large) {
+        prob_[i] = UINT32_MAX;
+        alias_[i] = i;
+    }
+    for (uint32_t i : small) {
+        prob_[i] = UINT32_MAX;
+        alias_[i] = i;
+    }
+}
+
+} // namespace kermit
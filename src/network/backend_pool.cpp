@@ -0,0 +1,536 @@
+#include "kermit/backend_pool.h"
+#include "kermit/resolver.h"
+#include "kermit/log.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+namespace kermit {
+
+// BackendPoolConfig implementation
+BackendPoolConfig::BackendPoolConfig()
+    : min_idle(2),
+      max_idle(8),
+      idle_timeout(60),
+      connect_timeout_ms(2000),
+      health_check_interval_ms(1000) {}
+
+// BackendPool implementation
+class BackendPool::Impl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct IdleConnection {
+        int fd;
+        Clock::time_point idle_since;
+    };
+
+    struct Target {
+        size_t refs = 0;
+        size_t connecting = 0;
+        std::deque<IdleConnection> idle;
+    };
+
+    BackendPoolConfig config_;
+    std::map<std::string, Target> targets_;
+    std::map<int, std::string> checked_out_;
+    mutable std::mutex pool_mutex_;
+    std::condition_variable wake_;
+    bool wake_pending_;
+
+    std::thread maintenance_thread_;
+    std::atomic<bool> should_stop_;
+    bool running_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> connects_;
+    std::atomic<uint64_t> connect_failures_;
+    std::atomic<uint64_t> evictions_;
+
+    explicit Impl(const BackendPoolConfig& config)
+        : config_(config), wake_pending_(false), should_stop_(false), running_(false),
+          hits_(0), misses_(0), connects_(0), connect_failures_(0), evictions_(0) {
+        if (config_.max_idle < config_.min_idle) {
+            config_.max_idle = config_.min_idle;
+        }
+    }
+
+    ~Impl() {
+        stop();
+
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (auto& target : targets_) {
+            for (const auto& conn : target.second.idle) {
+                close(conn.fd);
+            }
+        }
+        targets_.clear();
+    }
+
+    bool start() {
+        if (running_) {
+            KERMIT_WARN << "Backend pool is already running";
+            return false;
+        }
+
+        should_stop_ = false;
+        maintenance_thread_ = std::thread(&Impl::maintenanceLoop, this);
+        running_ = true;
+        return true;
+    }
+
+    void stop() {
+        if (!running_) return;
+
+        running_ = false;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            should_stop_ = true;
+        }
+        wake_.notify_all();
+
+        if (maintenance_thread_.joinable()) {
+            maintenance_thread_.join();
+        }
+    }
+
+    void addTargets(const std::vector<std::string>& target_addresses) {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            for (const auto& target_address : target_addresses) {
+                targets_[target_address].refs++;
+            }
+            wake_pending_ = true;
+        }
+        wake_.notify_all();
+    }
+
+    void removeTargets(const std::vector<std::string>& target_addresses) {
+        std::vector<int> to_close;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            for (const auto& target_address : target_addresses) {
+                dropTargetLocked(target_address, to_close);
+            }
+        }
+
+        for (int fd : to_close) {
+            close(fd);
+        }
+    }
+
+    // Caller must hold pool_mutex_
+    void dropTargetLocked(const std::string& target_address, std::vector<int>& to_close) {
+        auto it = targets_.find(target_address);
+        if (it == targets_.end()) {
+            return;
+        }
+
+        if (--it->second.refs > 0) {
+            return;
+        }
+
+        for (const auto& conn : it->second.idle) {
+            to_close.push_back(conn.fd);
+        }
+        it->second.idle.clear();
+
+        // Keep the entry while a maintenance connect is in flight;
+        // the maintenance round erases it once that finishes
+        if (it->second.connecting == 0) {
+            targets_.erase(it);
+        }
+    }
+
+    int acquire(const std::string& target_address, bool connect_on_miss) {
+        int fd = -1;
+        while (true) {
+            int candidate = -1;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                auto it = targets_.find(target_address);
+                if (it != targets_.end() && !it->second.idle.empty()) {
+                    // Most recently returned first, it is the least likely to
+                    // have been dropped by the backend
+                    candidate = it->second.idle.back().fd;
+                    it->second.idle.pop_back();
+                }
+            }
+            if (candidate == -1) break;
+
+            // The socket is ours once popped, so probe it without the lock
+            if (isAlive(candidate)) {
+                fd = candidate;
+                break;
+            }
+            close(candidate);
+            evictions_++;
+        }
+
+        if (fd != -1) {
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                checked_out_[fd] = target_address;
+            }
+            hits_++;
+            // Refill the slot we just handed out
+            wakeMaintenance();
+            return fd;
+        }
+
+        misses_++;
+        if (!connect_on_miss) {
+            wakeMaintenance();
+            return -1;
+        }
+
+        fd = connectTarget(target_address, config_.connect_timeout_ms);
+        if (fd == -1) {
+            connect_failures_++;
+            return -1;
+        }
+
+        connects_++;
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        checked_out_[fd] = target_address;
+        return fd;
+    }
+
+    void release(int fd, bool reusable) {
+        if (fd < 0) return;
+
+        bool alive = reusable && isAlive(fd);
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            auto out_it = checked_out_.find(fd);
+            if (out_it != checked_out_.end()) {
+                std::string target_address = out_it->second;
+                checked_out_.erase(out_it);
+
+                auto it = targets_.find(target_address);
+                if (alive && it != targets_.end() && it->second.refs > 0 &&
+                    it->second.idle.size() < config_.max_idle) {
+                    it->second.idle.push_back({fd, Clock::now()});
+                    return;
+                }
+            }
+        }
+
+        close(fd);
+    }
+
+    size_t getIdleCount(const std::string& target_address) const {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        auto it = targets_.find(target_address);
+        return it == targets_.end() ? 0 : it->second.idle.size();
+    }
+
+    size_t getTargetCount() const {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        return targets_.size();
+    }
+
+    BackendPoolStats getStats() const {
+        BackendPoolStats stats;
+        stats.hits = hits_;
+        stats.misses = misses_;
+        stats.connects = connects_;
+        stats.connect_failures = connect_failures_;
+        stats.evictions = evictions_;
+        return stats;
+    }
+
+    // A pooled socket is healthy while the backend has neither closed it nor
+    // sent unsolicited data on it
+    static bool isAlive(int fd) {
+        char byte;
+        ssize_t result = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (result < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        return false;
+    }
+
+    void maintenanceLoop() {
+        while (!should_stop_) {
+            runMaintenance();
+
+            std::unique_lock<std::mutex> lock(pool_mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(config_.health_check_interval_ms),
+                           [this] { return should_stop_.load() || wake_pending_; });
+            wake_pending_ = false;
+        }
+    }
+
+    // Request an early maintenance round, e.g. to refill a target
+    void wakeMaintenance() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            wake_pending_ = true;
+        }
+        wake_.notify_all();
+    }
+
+    void runMaintenance() {
+        std::vector<int> to_close;
+        std::vector<std::pair<std::string, int>> to_check;
+        std::vector<std::string> to_warm;
+        const auto now = Clock::now();
+        const auto idle_timeout = std::chrono::seconds(config_.idle_timeout);
+
+        // Snapshot under the lock; the probes and connects below run without
+        // it so checkouts and releases are never held up by a syscall
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            for (auto& target : targets_) {
+                auto& idle = target.second.idle;
+
+                // Evict expired connections, collect the rest for a liveness probe
+                for (auto it = idle.begin(); it != idle.end();) {
+                    if (now - it->idle_since > idle_timeout) {
+                        to_close.push_back(it->fd);
+                        it = idle.erase(it);
+                    } else {
+                        to_check.emplace_back(target.first, it->fd);
+                        ++it;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::pair<std::string, int>> dead;
+        for (const auto& check : to_check) {
+            if (!isAlive(check.second)) {
+                dead.push_back(check);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+
+            // A probed socket may have been checked out meanwhile; only those
+            // still idle are ours to close
+            for (const auto& entry : dead) {
+                auto it = targets_.find(entry.first);
+                if (it == targets_.end()) continue;
+                auto& idle = it->second.idle;
+                for (auto conn = idle.begin(); conn != idle.end(); ++conn) {
+                    if (conn->fd == entry.second) {
+                        to_close.push_back(conn->fd);
+                        idle.erase(conn);
+                        break;
+                    }
+                }
+            }
+
+            for (auto& target : targets_) {
+                size_t have = target.second.idle.size() + target.second.connecting;
+                if (target.second.refs > 0 && have < config_.min_idle) {
+                    size_t deficit = config_.min_idle - have;
+                    target.second.connecting += deficit;
+                    to_warm.insert(to_warm.end(), deficit, target.first);
+                }
+            }
+        }
+
+        for (int fd : to_close) {
+            close(fd);
+            evictions_++;
+        }
+
+        if (to_warm.empty()) return;
+
+        // Start every connect at once and wait on them together, so a round
+        // takes one connect timeout rather than one per socket
+        std::vector<pollfd> pending(to_warm.size());
+        for (size_t i = 0; i < to_warm.size(); ++i) {
+            pending[i].fd = should_stop_ ? -1 : startConnect(to_warm[i]);
+            pending[i].events = POLLOUT;
+        }
+
+        std::vector<int> connected(to_warm.size(), -1);
+        const auto deadline = Clock::now() + std::chrono::milliseconds(config_.connect_timeout_ms);
+        size_t outstanding = 0;
+        for (const auto& pfd : pending) {
+            if (pfd.fd != -1) outstanding++;
+        }
+        while (outstanding > 0 && !should_stop_) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) break;
+
+            int poll_result = poll(pending.data(), pending.size(), static_cast<int>(remaining));
+            if (poll_result < 0 && errno != EINTR) break;
+            if (poll_result <= 0) continue;
+
+            for (size_t i = 0; i < pending.size(); ++i) {
+                if (pending[i].fd == -1 || pending[i].revents == 0) continue;
+
+                int so_error = 0;
+                socklen_t len = sizeof(so_error);
+                if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+                    connected[i] = pending[i].fd;
+                } else {
+                    close(pending[i].fd);
+                }
+                // poll() skips negative descriptors
+                pending[i].fd = -1;
+                outstanding--;
+            }
+        }
+        for (const auto& pfd : pending) {
+            if (pfd.fd != -1) close(pfd.fd);
+        }
+
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (size_t i = 0; i < to_warm.size(); ++i) {
+            int fd = connected[i];
+            if (fd == -1) {
+                connect_failures_++;
+            } else {
+                connects_++;
+            }
+
+            auto it = targets_.find(to_warm[i]);
+            if (it == targets_.end()) {
+                if (fd != -1) close(fd);
+                continue;
+            }
+
+            it->second.connecting--;
+            if (fd != -1) {
+                if (it->second.refs > 0 && it->second.idle.size() < config_.max_idle) {
+                    it->second.idle.push_back({fd, Clock::now()});
+                } else {
+                    close(fd);
+                }
+            }
+
+            if (it->second.refs == 0 && it->second.connecting == 0) {
+                targets_.erase(it);
+            }
+        }
+    }
+};
+
+// BackendPool public interface
+BackendPool::BackendPool(const BackendPoolConfig& config) : impl_(std::make_unique<Impl>(config)) {}
+
+BackendPool::~BackendPool() = default;
+
+bool BackendPool::start() {
+    return impl_->start();
+}
+
+void BackendPool::stop() {
+    impl_->stop();
+}
+
+void BackendPool::addTarget(const std::string& target_address) {
+    impl_->addTargets({target_address});
+}
+
+void BackendPool::removeTarget(const std::string& target_address) {
+    impl_->removeTargets({target_address});
+}
+
+void BackendPool::addTargets(const std::vector<std::string>& target_addresses) {
+    impl_->addTargets(target_addresses);
+}
+
+void BackendPool::removeTargets(const std::vector<std::string>& target_addresses) {
+    impl_->removeTargets(target_addresses);
+}
+
+int BackendPool::acquire(const std::string& target_address, bool connect_on_miss) {
+    return impl_->acquire(target_address, connect_on_miss);
+}
+
+void BackendPool::release(int fd, bool reusable) {
+    impl_->release(fd, reusable);
+}
+
+size_t BackendPool::getIdleCount(const std::string& target_address) const {
+    return impl_->getIdleCount(target_address);
+}
+
+size_t BackendPool::getTargetCount() const {
+    return impl_->getTargetCount();
+}
+
+BackendPoolStats BackendPool::getStats() const {
+    return impl_->getStats();
+}
+
+int BackendPool::connectTarget(const std::string& target_address, uint32_t timeout_ms) {
+    int sock_fd = startConnect(target_address);
+    if (sock_fd == -1) {
+        return -1;
+    }
+
+    // Wait for the handshake to complete
+    pollfd pfd{};
+    pfd.fd = sock_fd;
+    pfd.events = POLLOUT;
+
+    int poll_result;
+    do {
+        poll_result = poll(&pfd, 1, static_cast<int>(timeout_ms));
+    } while (poll_result < 0 && errno == EINTR);
+
+    int so_error = 0;
+    socklen_t len = sizeof(so_error);
+    if (poll_result <= 0 ||
+        getsockopt(sock_fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0 || so_error != 0) {
+        close(sock_fd);
+        return -1;
+    }
+
+    return sock_fd;
+}
+
+int BackendPool::startConnect(const std::string& target_address) {
+    std::string host;
+    uint16_t port;
+    sockaddr_in address;
+    if (!Resolver::splitAddress(target_address, host, port) || !Resolver::resolveNow(host, port, address)) {
+        return -1;
+    }
+    return startConnect(address);
+}
+
+int BackendPool::startConnect(const sockaddr_in& address) {
+    int sock_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock_fd < 0) {
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    setsockopt(sock_fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+
+    int connect_result = ::connect(sock_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    if (connect_result < 0 && errno != EINPROGRESS) {
+        close(sock_fd);
+        return -1;
+    }
+
+    return sock_fd;
+}
+
+} // namespace kermit
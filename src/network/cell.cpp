@@ -0,0 +1,104 @@
+#include "kermit/cell.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace kermit {
+
+void Cell::encode(uint8_t* out) const {
+    uint32_t id = htonl(circuit_id);
+    memcpy(out, &id, sizeof(id));
+    out[4] = static_cast<uint8_t>(command);
+    memcpy(out + kCellHeaderSize, payload, kCellPayloadSize);
+}
+
+void Cell::appendTo(std::vector<uint8_t>& out) const {
+    size_t offset = out.size();
+    out.resize(offset + kCellSize);
+    encode(out.data() + offset);
+}
+
+Cell Cell::decode(const uint8_t* in) {
+    Cell cell;
+    uint32_t id;
+    memcpy(&id, in, sizeof(id));
+    cell.circuit_id = ntohl(id);
+    cell.command = static_cast<CellCommand>(in[4]);
+    memcpy(cell.payload, in + kCellHeaderSize, kCellPayloadSize);
+    return cell;
+}
+
+Cell Cell::make(uint32_t circuit_id, CellCommand command) {
+    Cell cell;
+    cell.circuit_id = circuit_id;
+    cell.command = command;
+    memset(cell.payload, 0, sizeof(cell.payload));
+    return cell;
+}
+
+Cell Cell::makeRelay(uint32_t circuit_id, uint8_t hop, RelayCommand command, uint16_t stream_id,
+                     const uint8_t* data, size_t len) {
+    Cell cell = make(circuit_id, CellCommand::RELAY);
+    len = std::min(len, kRelayDataSize);
+    RelayHeader{hop, command, stream_id, static_cast<uint16_t>(len)}.write(cell.payload);
+    if (len > 0) {
+        memcpy(cell.payload + kRelayHeaderSize, data, len);
+    }
+    return cell;
+}
+
+RelayHeader RelayHeader::read(const uint8_t* payload) {
+    RelayHeader header;
+    header.hop = payload[0];
+    header.command = static_cast<RelayCommand>(payload[1]);
+    header.stream_id = static_cast<uint16_t>((payload[2] << 8) | payload[3]);
+    header.length = static_cast<uint16_t>((payload[4] << 8) | payload[5]);
+    if (header.length > kRelayDataSize) {
+        header.length = kRelayDataSize;
+    }
+    return header;
+}
+
+void RelayHeader::write(uint8_t* payload) const {
+    payload[0] = hop;
+    payload[1] = static_cast<uint8_t>(command);
+    payload[2] = static_cast<uint8_t>(stream_id >> 8);
+    payload[3] = static_cast<uint8_t>(stream_id);
+    payload[4] = static_cast<uint8_t>(length >> 8);
+    payload[5] = static_cast<uint8_t>(length);
+}
+
+size_t CellAssembler::feed(const uint8_t* data, size_t len, std::vector<Cell>& out) {
+    size_t added = 0;
+
+    // Finish a cell left over from the previous chunk
+    if (pending_ > 0) {
+        size_t take = std::min(len, kCellSize - pending_);
+        memcpy(partial_ + pending_, data, take);
+        pending_ += take;
+        data += take;
+        len -= take;
+
+        if (pending_ < kCellSize) {
+            return 0;
+        }
+        out.push_back(Cell::decode(partial_));
+        pending_ = 0;
+        added++;
+    }
+
+    // Whole cells straight from the input
+    while (len >= kCellSize) {
+        out.push_back(Cell::decode(data));
+        data += kCellSize;
+        len -= kCellSize;
+        added++;
+    }
+
+    memcpy(partial_, data, len);
+    pending_ = len;
+    return added;
+}
+
+} // namespace kermit
@@ -0,0 +1,730 @@
+#include "kermit/channel_pool.h"
+#include "kermit/cell.h"
+#include "kermit/event_loop.h"
+#include "kermit/backend_pool.h"
+#include "kermit/resolver.h"
+#include "kermit/circuit_scheduler.h"
+#include "kermit/log.h"
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Circuit cells moved from the scheduler to the write buffer at a time;
+// kept small so priority is decided as late as possible
+constexpr size_t kScheduleBatch = 4;
+
+} // namespace
+
+// ChannelPoolConfig implementation
+ChannelPoolConfig::ChannelPoolConfig()
+    : min_channels(1),
+      keepalive_interval_ms(30000),
+      keepalive_timeout_ms(10000),
+      connect_timeout_ms(5000),
+      backoff_initial_ms(1000),
+      backoff_max_ms(60000),
+      maintenance_interval_ms(250),
+      max_queued_bytes(1024 * 1024),
+      kist_interval_ms(2) {}
+
+// ChannelPool implementation
+class ChannelPool::Impl {
+public:
+    struct Channel {
+        ChannelId id;
+        RelayId relay_id;
+        int fd;
+        bool open;
+        uint32_t events;
+        Clock::time_point started;
+        Clock::time_point last_received;
+        Clock::time_point ping_sent;
+        bool ping_outstanding;
+        CellAssembler assembler;
+        std::vector<uint8_t> out;       // Control cells and the scheduled batch being written
+        size_t out_off;
+        CircuitScheduler scheduler;     // Circuit cells not yet in out
+
+        size_t queued() const { return out.size() - out_off + scheduler.getQueuedCells() * kCellSize; }
+    };
+
+    struct Relay {
+        std::string host;
+        uint16_t port;
+        std::vector<ChannelId> channels;  // Open and connecting
+        size_t open;
+        uint32_t failures;                // Consecutive, reset once a channel opens
+        Clock::time_point next_attempt;
+        bool resolving;                   // Host name lookup queued with the Resolver
+    };
+
+    // Lets resolver threads tell whether the pool still exists before posting
+    struct Liveness {
+        std::mutex mutex;
+        std::atomic<bool> alive{true};
+    };
+
+    // State changes and cells collected under the lock, delivered after it
+    struct Notices {
+        std::vector<std::pair<RelayId, bool>> states;
+        std::vector<std::pair<ChannelId, RelayId>> closed;
+        std::vector<std::tuple<ChannelId, RelayId, Cell>> cells;
+    };
+
+    EventLoop& loop_;
+    ChannelPoolConfig config_;
+    mutable std::mutex mutex_;
+    std::unordered_map<RelayId, Relay> relays_;
+    std::unordered_map<ChannelId, std::unique_ptr<Channel>> channels_;
+    std::unordered_set<ChannelId> scheduled_;  // Channels with cells waiting for a KIST round
+    ChannelId next_id_;
+    int timer_id_;
+    int round_timer_id_;
+    std::mt19937 jitter_;
+    std::shared_ptr<Liveness> liveness_;
+
+    // Reused for every read so their capacity stays; cells under mutex_,
+    // notices on the loop thread
+    std::vector<Cell> read_cells_;
+    Notices event_notices_;
+
+    StateCallback state_callback_;
+    CellCallback cell_callback_;
+    CloseCallback close_callback_;
+
+    std::atomic<uint64_t> connects_;
+    std::atomic<uint64_t> connect_failures_;
+    std::atomic<uint64_t> channel_failures_;
+    std::atomic<uint64_t> pings_sent_;
+    std::atomic<uint64_t> cells_sent_;
+    std::atomic<uint64_t> cells_received_;
+
+    Impl(EventLoop& loop, const ChannelPoolConfig& config)
+        : loop_(loop), config_(config), next_id_(kInvalidChannel + 1), timer_id_(-1), round_timer_id_(-1),
+          jitter_(std::random_device{}()), liveness_(std::make_shared<Liveness>()), connects_(0), connect_failures_(0),
+          channel_failures_(0), pings_sent_(0), cells_sent_(0), cells_received_(0) {
+        if (config_.backoff_initial_ms == 0) {
+            config_.backoff_initial_ms = 1;
+        }
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(liveness_->mutex);
+            liveness_->alive = false;
+        }
+        stop();
+    }
+
+    bool start() {
+        if (timer_id_ != -1) {
+            KERMIT_ERROR << "Channel pool is already running";
+            return false;
+        }
+
+        timer_id_ = loop_.addTimer(config_.maintenance_interval_ms, [this] { maintain(); });
+        if (timer_id_ == -1) {
+            KERMIT_ERROR << "Failed to start channel pool maintenance";
+            return false;
+        }
+        return true;
+    }
+
+    void stop() {
+        if (timer_id_ != -1) {
+            loop_.cancelTimer(timer_id_);
+            timer_id_ = -1;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (round_timer_id_ != -1) {
+            loop_.cancelTimer(round_timer_id_);
+            round_timer_id_ = -1;
+        }
+        for (auto& entry : channels_) {
+            loop_.removeFd(entry.second->fd);
+            close(entry.second->fd);
+        }
+        channels_.clear();
+        scheduled_.clear();
+        relays_.clear();
+    }
+
+    void addRelay(RelayId relay_id, const std::string& host, uint16_t port) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (relays_.count(relay_id)) return;
+            relays_[relay_id] = Relay{host, port, {}, 0, 0, Clock::now(), false};
+        }
+
+        // Warm up now rather than on the next maintenance tick
+        loop_.post([this] { maintain(); });
+    }
+
+    void removeRelay(RelayId relay_id) {
+        auto notices = std::make_shared<Notices>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = relays_.find(relay_id);
+            if (it == relays_.end()) return;
+
+            for (ChannelId id : it->second.channels) {
+                auto ch_it = channels_.find(id);
+                if (ch_it == channels_.end()) continue;
+                if (ch_it->second->open) {
+                    notices->closed.emplace_back(id, relay_id);
+                }
+                loop_.removeFd(ch_it->second->fd);
+                close(ch_it->second->fd);
+                channels_.erase(ch_it);
+                scheduled_.erase(id);
+            }
+            relays_.erase(it);
+        }
+        if (notices->closed.empty()) return;
+
+        // Circuits on the channels learn of the close from the loop thread,
+        // since callers hold the node manager's lock
+        std::shared_ptr<Liveness> liveness = liveness_;
+        loop_.post([this, liveness, notices] {
+            if (liveness->alive) deliver(*notices);
+        });
+    }
+
+    ChannelId acquire(RelayId relay_id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = relays_.find(relay_id);
+        if (it == relays_.end()) return kInvalidChannel;
+
+        ChannelId best = kInvalidChannel;
+        size_t best_queued = 0;
+        for (ChannelId id : it->second.channels) {
+            const Channel& channel = *channels_.at(id);
+            if (!channel.open) continue;
+            if (best == kInvalidChannel || channel.queued() < best_queued) {
+                best = id;
+                best_queued = channel.queued();
+            }
+        }
+        return best;
+    }
+
+    bool send(ChannelId id, const Cell& cell) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_.find(id);
+        if (it == channels_.end() || !it->second->open) return false;
+
+        Channel& channel = *it->second;
+        if (channel.queued() + kCellSize > config_.max_queued_bytes) {
+            return false;
+        }
+
+        channel.scheduler.enqueue(cell);
+        cells_sent_++;
+
+        if (config_.kist_interval_ms > 0) {
+            if (schedule(id)) return true;
+
+            // No rounds to wait for; write what is queued directly
+            Cell queued;
+            while (channel.scheduler.next(queued)) {
+                queued.appendTo(channel.out);
+            }
+        }
+
+        // Write errors surface on the loop thread as an ERROR event
+        flush(channel);
+        return true;
+    }
+
+    // Leave a channel's cells for the next KIST round, starting rounds if
+    // none are running; false if they could not be started
+    // Caller holds mutex_
+    bool schedule(ChannelId id) {
+        if (round_timer_id_ == -1) {
+            round_timer_id_ = loop_.addTimer(config_.kist_interval_ms, [this] { runRound(); });
+            if (round_timer_id_ == -1) return false;
+        }
+        scheduled_.insert(id);
+        return true;
+    }
+
+    // Called on the loop thread every kist_interval_ms while cells are waiting
+    void runRound() {
+        Notices notices;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<ChannelId> failed;
+
+            for (auto it = scheduled_.begin(); it != scheduled_.end();) {
+                auto ch_it = channels_.find(*it);
+                if (ch_it == channels_.end() || !ch_it->second->open) {
+                    it = scheduled_.erase(it);
+                    continue;
+                }
+                Channel& channel = *ch_it->second;
+
+                // Cells beyond the limit stay in the scheduler for the next round
+                size_t limit = CircuitScheduler::socketWriteLimit(channel.fd);
+                size_t unwritten = channel.out.size() - channel.out_off;
+                Cell cell;
+                while (unwritten + kCellSize <= limit && channel.scheduler.next(cell)) {
+                    cell.appendTo(channel.out);
+                    unwritten += kCellSize;
+                }
+
+                if (!flush(channel)) {
+                    failed.push_back(channel.id);
+                }
+                if (channel.scheduler.getQueuedCells() == 0) {
+                    it = scheduled_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            for (ChannelId id : failed) {
+                failChannel(id, notices);
+            }
+
+            if (scheduled_.empty() && round_timer_id_ != -1) {
+                loop_.cancelTimer(round_timer_id_);
+                round_timer_id_ = -1;
+            }
+        }
+        deliver(notices);
+    }
+
+    // Called on the loop thread by the maintenance timer and after addRelay
+    void maintain() {
+        Notices notices;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = Clock::now();
+            std::vector<ChannelId> dead;
+
+            for (auto& entry : relays_) {
+                Relay& relay = entry.second;
+
+                dead.clear();
+                for (ChannelId id : relay.channels) {
+                    Channel& channel = *channels_.at(id);
+                    if (!channel.open) {
+                        if (now - channel.started > std::chrono::milliseconds(config_.connect_timeout_ms)) {
+                            dead.push_back(id);
+                        }
+                    } else if (channel.ping_outstanding) {
+                        if (now - channel.ping_sent > std::chrono::milliseconds(config_.keepalive_timeout_ms)) {
+                            dead.push_back(id);
+                        }
+                    } else if (now - channel.last_received > std::chrono::milliseconds(config_.keepalive_interval_ms)) {
+                        Cell::make(0, CellCommand::PING).appendTo(channel.out);
+                        channel.ping_outstanding = true;
+                        channel.ping_sent = now;
+                        pings_sent_++;
+                        flush(channel);
+                    }
+                }
+
+                for (ChannelId id : dead) {
+                    failChannel(id, notices);
+                }
+
+                while (relay.channels.size() < config_.min_channels && now >= relay.next_attempt) {
+                    if (!openChannel(entry.first, relay)) break;
+                }
+            }
+        }
+        deliver(notices);
+    }
+
+    // Caller holds mutex_. Host names not yet cached are looked up off the
+    // loop and the connect is retried once the lookup reports back
+    bool openChannel(RelayId relay_id, Relay& relay) {
+        sockaddr_in address{};
+        if (!Resolver::lookup(relay.host, relay.port, address)) {
+            if (!relay.resolving) {
+                relay.resolving = true;
+                resolve(relay_id, relay.host);
+            }
+            return false;
+        }
+
+        int fd = BackendPool::startConnect(address);
+        if (fd == -1) {
+            connect_failures_++;
+            backoff(relay);
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        ChannelId id = next_id_++;
+        auto channel = std::make_unique<Channel>();
+        channel->id = id;
+        channel->relay_id = relay_id;
+        channel->fd = fd;
+        channel->open = false;
+        channel->events = EventLoop::WRITABLE;
+        channel->started = Clock::now();
+        channel->ping_outstanding = false;
+        channel->out_off = 0;
+
+        if (!loop_.addFd(fd, channel->events, [this, id](uint32_t events) { onEvent(id, events); })) {
+            close(fd);
+            connect_failures_++;
+            backoff(relay);
+            return false;
+        }
+
+        channels_[id] = std::move(channel);
+        relay.channels.push_back(id);
+        return true;
+    }
+
+    void resolve(RelayId relay_id, const std::string& host) {
+        std::shared_ptr<Liveness> liveness = liveness_;
+        Resolver::resolve(host, [this, liveness, relay_id](bool resolved) {
+            std::lock_guard<std::mutex> lock(liveness->mutex);
+            if (!liveness->alive) return;
+            loop_.post([this, liveness, relay_id, resolved] {
+                if (liveness->alive) onResolved(relay_id, resolved);
+            });
+        });
+    }
+
+    // Called on the loop thread once a relay's host name lookup finishes
+    void onResolved(RelayId relay_id, bool resolved) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = relays_.find(relay_id);
+            if (it == relays_.end()) return;
+            it->second.resolving = false;
+            if (!resolved) {
+                connect_failures_++;
+                backoff(it->second);
+                return;
+            }
+        }
+        maintain();
+    }
+
+    void onEvent(ChannelId id, uint32_t events) {
+        Notices& notices = event_notices_;
+        notices.states.clear();
+        notices.closed.clear();
+        notices.cells.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = channels_.find(id);
+            if (it == channels_.end()) return;  // Closed after the event was collected
+            Channel& channel = *it->second;
+
+            if (!channel.open) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if ((events & EventLoop::ERROR) ||
+                    getsockopt(channel.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                    failChannel(id, notices);
+                } else {
+                    onOpen(channel, notices);
+                }
+            } else {
+                if ((events & EventLoop::READABLE) && !readCells(channel, notices)) {
+                    failChannel(id, notices);
+                } else if (events & EventLoop::ERROR) {
+                    failChannel(id, notices);
+                } else if ((events & EventLoop::WRITABLE) && !flush(channel)) {
+                    failChannel(id, notices);
+                }
+            }
+        }
+        deliver(notices);
+    }
+
+    // Caller holds mutex_
+    void onOpen(Channel& channel, Notices& notices) {
+        Relay& relay = relays_.at(channel.relay_id);
+        channel.open = true;
+        channel.last_received = Clock::now();
+        relay.open++;
+        relay.failures = 0;
+        connects_++;
+
+        if (relay.open == 1) {
+            notices.states.emplace_back(channel.relay_id, true);
+        }
+        setInterest(channel, EventLoop::READABLE);
+    }
+
+    // Returns false once the channel is closed by the peer or broken
+    // Caller holds mutex_
+    bool readCells(Channel& channel, Notices& notices) {
+        uint8_t buffer[16384];
+        std::vector<Cell>& cells = read_cells_;
+        cells.clear();
+
+        while (true) {
+            ssize_t n = recv(channel.fd, buffer, sizeof(buffer), 0);
+            if (n == 0) return false;
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            // Any traffic proves the peer is alive
+            channel.last_received = Clock::now();
+            channel.ping_outstanding = false;
+            channel.assembler.feed(buffer, static_cast<size_t>(n), cells);
+        }
+
+        for (const Cell& cell : cells) {
+            cells_received_++;
+            switch (cell.command) {
+                case CellCommand::PADDING:
+                case CellCommand::PONG:
+                    break;
+                case CellCommand::PING:
+                    Cell::make(cell.circuit_id, CellCommand::PONG).appendTo(channel.out);
+                    break;
+                default:
+                    notices.cells.emplace_back(channel.id, channel.relay_id, cell);
+                    break;
+            }
+        }
+        return flush(channel);
+    }
+
+    // Write as much of the queue as the socket takes; returns false on a write error
+    // With KIST rounds only the write buffer is written; the rounds fill it
+    // Caller holds mutex_
+    bool flush(Channel& channel) {
+        while (true) {
+            if (channel.out_off == channel.out.size()) {
+                channel.out.clear();
+                channel.out_off = 0;
+                if (config_.kist_interval_ms > 0) break;
+                Cell cell;
+                for (size_t i = 0; i < kScheduleBatch && channel.scheduler.next(cell); ++i) {
+                    cell.appendTo(channel.out);
+                }
+                if (channel.out.empty()) break;
+            }
+
+            ssize_t n = ::send(channel.fd, channel.out.data() + channel.out_off, channel.out.size() - channel.out_off,
+                               MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                setInterest(channel, EventLoop::READABLE | EventLoop::WRITABLE);
+                return false;
+            }
+            channel.out_off += static_cast<size_t>(n);
+        }
+
+        if (channel.out_off == channel.out.size()) {
+            channel.out.clear();
+            channel.out_off = 0;
+            setInterest(channel, EventLoop::READABLE);
+        } else {
+            // Drop the written prefix once it dominates the buffer
+            if (channel.out_off > channel.out.size() / 2) {
+                channel.out.erase(channel.out.begin(), channel.out.begin() + channel.out_off);
+                channel.out_off = 0;
+            }
+            setInterest(channel, EventLoop::READABLE | EventLoop::WRITABLE);
+        }
+        return true;
+    }
+
+    void setInterest(Channel& channel, uint32_t events) {
+        if (!channel.open || channel.events == events) return;
+        channel.events = events;
+        loop_.modifyFd(channel.fd, events);
+    }
+
+    // Close a connecting or open channel and schedule its replacement
+    // Caller holds mutex_
+    void failChannel(ChannelId id, Notices& notices) {
+        auto it = channels_.find(id);
+        if (it == channels_.end()) return;
+        Channel& channel = *it->second;
+        Relay& relay = relays_.at(channel.relay_id);
+
+        loop_.removeFd(channel.fd);
+        close(channel.fd);
+        relay.channels.erase(std::find(relay.channels.begin(), relay.channels.end(), id));
+
+        if (channel.open) {
+            channel_failures_++;
+            notices.closed.emplace_back(id, channel.relay_id);
+            relay.open--;
+            if (relay.open == 0) {
+                notices.states.emplace_back(channel.relay_id, false);
+            }
+        } else {
+            connect_failures_++;
+        }
+
+        backoff(relay);
+        scheduled_.erase(id);
+        channels_.erase(it);
+    }
+
+    // Delay the next connect by initial * 2^(failures - 1), capped, with
+    // jitter in [delay / 2, delay] so relays that failed together do not
+    // reconnect together
+    // Caller holds mutex_
+    void backoff(Relay& relay) {
+        relay.failures++;
+        uint64_t delay = config_.backoff_initial_ms;
+        for (uint32_t i = 1; i < relay.failures && delay < config_.backoff_max_ms; ++i) {
+            delay *= 2;
+        }
+        delay = std::min<uint64_t>(delay, config_.backoff_max_ms);
+        delay = delay / 2 + jitter_() % (delay / 2 + 1);
+        relay.next_attempt = Clock::now() + std::chrono::milliseconds(delay);
+    }
+
+    void deliver(const Notices& notices) {
+        StateCallback state_callback;
+        CellCallback cell_callback;
+        CloseCallback close_callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            state_callback = state_callback_;
+            cell_callback = cell_callback_;
+            close_callback = close_callback_;
+        }
+
+        // Cells that arrived before a close are delivered first
+        if (cell_callback) {
+            for (const auto& entry : notices.cells) {
+                cell_callback(std::get<0>(entry), std::get<1>(entry), std::get<2>(entry));
+            }
+        }
+
+        if (close_callback) {
+            for (const auto& closed : notices.closed) {
+                close_callback(closed.first, closed.second);
+            }
+        }
+
+        if (state_callback) {
+            for (const auto& state : notices.states) {
+                state_callback(state.first, state.second);
+            }
+        }
+    }
+
+    bool isOpen(ChannelId id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_.find(id);
+        return it != channels_.end() && it->second->open;
+    }
+
+    size_t getOpenChannelCount(RelayId relay_id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = relays_.find(relay_id);
+        return it == relays_.end() ? 0 : it->second.open;
+    }
+
+    ChannelPoolStats getStats() const {
+        ChannelPoolStats stats{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats.relays = relays_.size();
+            for (const auto& entry : relays_) {
+                stats.open_channels += entry.second.open;
+                stats.connecting += entry.second.channels.size() - entry.second.open;
+            }
+        }
+        stats.connects = connects_;
+        stats.connect_failures = connect_failures_;
+        stats.channel_failures = channel_failures_;
+        stats.pings_sent = pings_sent_;
+        stats.cells_sent = cells_sent_;
+        stats.cells_received = cells_received_;
+        return stats;
+    }
+};
+
+// ChannelPool public interface
+ChannelPool::ChannelPool(EventLoop& loop, const ChannelPoolConfig& config)
+    : impl_(std::make_unique<Impl>(loop, config)) {}
+
+ChannelPool::~ChannelPool() = default;
+
+bool ChannelPool::start() {
+    return impl_->start();
+}
+
+void ChannelPool::stop() {
+    impl_->stop();
+}
+
+void ChannelPool::addRelay(RelayId relay_id, const std::string& host, uint16_t port) {
+    impl_->addRelay(relay_id, host, port);
+}
+
+void ChannelPool::removeRelay(RelayId relay_id) {
+    impl_->removeRelay(relay_id);
+}
+
+ChannelPool::ChannelId ChannelPool::acquire(RelayId relay_id) const {
+    return impl_->acquire(relay_id);
+}
+
+bool ChannelPool::send(ChannelId channel, const Cell& cell) {
+    return impl_->send(channel, cell);
+}
+
+void ChannelPool::setStateCallback(StateCallback callback) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->state_callback_ = std::move(callback);
+}
+
+void ChannelPool::setCellCallback(CellCallback callback) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->cell_callback_ = std::move(callback);
+}
+
+void ChannelPool::setCloseCallback(CloseCallback callback) {
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->close_callback_ = std::move(callback);
+}
+
+bool ChannelPool::isOpen(ChannelId channel) const {
+    return impl_->isOpen(channel);
+}
+
+size_t ChannelPool::getOpenChannelCount(RelayId relay_id) const {
+    return impl_->getOpenChannelCount(relay_id);
+}
+
+ChannelPoolStats ChannelPool::getStats() const {
+    return impl_->getStats();
+}
+
+} // namespace kermit
@@ -0,0 +1,164 @@
+#include "kermit/circuit_scheduler.h"
+#include "kermit/cell.h"
+#include "kermit/slab.h"
+#include <memory>
+#include <chrono>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Idle circuits whose count has decayed below this are forgotten
+constexpr double kForgetBelow = 0.01;
+
+} // namespace
+
+// CircuitSchedulerConfig implementation
+CircuitSchedulerConfig::CircuitSchedulerConfig()
+    : halflife_ms(30000),
+      tick_ms(1000) {}
+
+// CircuitScheduler implementation
+class CircuitScheduler::Impl {
+public:
+    // Every queued cell and scheduling entry comes from the slab
+    struct Circuit {
+        std::deque<Cell, SlabAllocator<Cell>> cells;
+        double activity = 0.0;
+    };
+    using Entry = std::pair<double, uint32_t>;
+
+    CircuitSchedulerConfig config_;
+    std::unordered_map<uint32_t, Circuit, std::hash<uint32_t>, std::equal_to<uint32_t>,
+                       SlabAllocator<std::pair<const uint32_t, Circuit>>> circuits_;
+    std::set<Entry, std::less<Entry>, SlabAllocator<Entry>> active_;  // (activity, circuit) with cells queued
+    Clock::time_point start_;
+    uint64_t tick_;
+    size_t queued_;
+
+    explicit Impl(const CircuitSchedulerConfig& config)
+        : config_(config), start_(Clock::now()), tick_(0), queued_(0) {
+        if (config_.tick_ms == 0) {
+            config_.tick_ms = 1;
+        }
+    }
+
+    // Decay every count by the ticks elapsed since the last call
+    void decay() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count();
+        uint64_t tick = static_cast<uint64_t>(elapsed) / config_.tick_ms;
+        if (tick == tick_) return;
+
+        double factor = 0.0;
+        if (config_.halflife_ms > 0) {
+            factor = std::pow(0.5, static_cast<double>(tick - tick_) * config_.tick_ms / config_.halflife_ms);
+        }
+        tick_ = tick;
+
+        active_.clear();
+        for (auto it = circuits_.begin(); it != circuits_.end();) {
+            Circuit& circuit = it->second;
+            circuit.activity *= factor;
+            if (!circuit.cells.empty()) {
+                active_.emplace(circuit.activity, it->first);
+            } else if (circuit.activity < kForgetBelow) {
+                it = circuits_.erase(it);
+                continue;
+            }
+            ++it;
+        }
+    }
+
+    void enqueue(const Cell& cell) {
+        decay();
+
+        Circuit& circuit = circuits_[cell.circuit_id];
+        if (circuit.cells.empty()) {
+            active_.emplace(circuit.activity, cell.circuit_id);
+        }
+        circuit.cells.push_back(cell);
+        queued_++;
+    }
+
+    bool next(Cell& cell) {
+        if (active_.empty()) return false;
+        decay();
+
+        auto it = active_.begin();
+        uint32_t circuit_id = it->second;
+        active_.erase(it);
+
+        Circuit& circuit = circuits_.at(circuit_id);
+        cell = circuit.cells.front();
+        circuit.cells.pop_front();
+        queued_--;
+
+        circuit.activity += 1.0;
+        if (!circuit.cells.empty()) {
+            active_.emplace(circuit.activity, circuit_id);
+        }
+        return true;
+    }
+};
+
+// CircuitScheduler public interface
+CircuitScheduler::CircuitScheduler(const CircuitSchedulerConfig& config)
+    : impl_(std::make_unique<Impl>(config)) {}
+
+CircuitScheduler::~CircuitScheduler() = default;
+
+void CircuitScheduler::enqueue(const Cell& cell) {
+    impl_->enqueue(cell);
+}
+
+bool CircuitScheduler::next(Cell& cell) {
+    return impl_->next(cell);
+}
+
+size_t CircuitScheduler::getQueuedCells() const {
+    return impl_->queued_;
+}
+
+size_t CircuitScheduler::getActiveCircuits() const {
+    return impl_->active_.size();
+}
+
+size_t CircuitScheduler::socketWriteLimit(int fd) {
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0 || info.tcpi_snd_mss == 0) {
+        return SIZE_MAX;
+    }
+
+    int notsent = 0;
+    if (ioctl(fd, SIOCOUTQNSD, &notsent) < 0) {
+        notsent = 0;
+    }
+
+    int64_t window = static_cast<int64_t>(info.tcpi_snd_cwnd) * info.tcpi_snd_mss;
+    int64_t tcp_space = (static_cast<int64_t>(info.tcpi_snd_cwnd) - info.tcpi_unacked) * info.tcpi_snd_mss;
+    int64_t extra_space = window - notsent;
+    return static_cast<size_t>(std::max<int64_t>(tcp_space, 0) + std::max<int64_t>(extra_space, 0));
+}
+
+double CircuitScheduler::getActivity(uint32_t circuit_id) const {
+    auto it = impl_->circuits_.find(circuit_id);
+    return it != impl_->circuits_.end() ? it->second.activity : 0.0;
+}
+
+} // namespace kermit
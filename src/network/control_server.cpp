@@ -0,0 +1,708 @@
+#include "kermit/control_server.h"
+#include "kermit/event_loop.h"
+#include "kermit/expose_service.h"
+#include "kermit/log.h"
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+constexpr size_t kFrameHeaderSize = 4 + 1 + 4;
+constexpr size_t kMaxFrameSize = 64 * 1024;
+constexpr size_t kReadChunkSize = 16384;
+constexpr size_t kMaxListLimit = 1000;
+
+// A client with this much unsent output is not read from until it catches
+// up, and loses events instead of growing its buffer further
+constexpr size_t kMaxClientBacklog = 1024 * 1024;
+
+// Big-endian frame encoder
+class FrameWriter {
+public:
+    explicit FrameWriter(std::vector<uint8_t>& out) : out_(out), start_(out.size()) {}
+
+    void begin(uint8_t type, uint32_t request_id) {
+        putU32(0);  // Patched in finish()
+        putU8(type);
+        putU32(request_id);
+    }
+
+    void finish() {
+        uint32_t length = static_cast<uint32_t>(out_.size() - start_ - 4);
+        out_[start_] = static_cast<uint8_t>(length >> 24);
+        out_[start_ + 1] = static_cast<uint8_t>(length >> 16);
+        out_[start_ + 2] = static_cast<uint8_t>(length >> 8);
+        out_[start_ + 3] = static_cast<uint8_t>(length);
+    }
+
+    void putU8(uint8_t value) {
+        out_.push_back(value);
+    }
+
+    void putU16(uint16_t value) {
+        out_.push_back(static_cast<uint8_t>(value >> 8));
+        out_.push_back(static_cast<uint8_t>(value));
+    }
+
+    void putU32(uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out_.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void putU64(uint64_t value) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out_.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void putString(const std::string& value) {
+        size_t len = std::min(value.size(), size_t(0xFFFF));
+        putU16(static_cast<uint16_t>(len));
+        out_.insert(out_.end(), value.begin(), value.begin() + len);
+    }
+
+    // Bytes the length field will count so far
+    size_t length() const {
+        return out_.size() - start_ - 4;
+    }
+
+    // Where the next field goes, for patchU16
+    size_t position() const {
+        return out_.size();
+    }
+
+    void patchU16(size_t position, uint16_t value) {
+        out_[position] = static_cast<uint8_t>(value >> 8);
+        out_[position + 1] = static_cast<uint8_t>(value);
+    }
+
+    static size_t stringSize(const std::string& value) {
+        return 2 + std::min(value.size(), size_t(0xFFFF));
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    size_t start_;
+};
+
+// Big-endian payload decoder; any overrun marks the reader as failed
+class FrameReader {
+public:
+    FrameReader(const uint8_t* data, size_t len) : data_(data), len_(len), pos_(0), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    uint8_t getU8() {
+        if (!need(1)) return 0;
+        return data_[pos_++];
+    }
+
+    uint16_t getU16() {
+        if (!need(2)) return 0;
+        uint16_t value = static_cast<uint16_t>((data_[pos_] << 8) | data_[pos_ + 1]);
+        pos_ += 2;
+        return value;
+    }
+
+    uint32_t getU32() {
+        if (!need(4)) return 0;
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value = (value << 8) | data_[pos_++];
+        }
+        return value;
+    }
+
+    std::string getString() {
+        uint16_t len = getU16();
+        if (!need(len)) return "";
+        std::string value(reinterpret_cast<const char*>(data_ + pos_), len);
+        pos_ += len;
+        return value;
+    }
+
+private:
+    bool need(size_t count) {
+        if (!ok_ || len_ - pos_ < count) {
+            ok_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    const uint8_t* data_;
+    size_t len_;
+    size_t pos_;
+    bool ok_;
+};
+
+uint64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+// ControlServer implementation
+class ControlServer::Impl {
+public:
+    struct Client {
+        int fd;
+        bool authenticated;
+        uint32_t event_mask;
+        uint32_t events;    // Interest registered with the loop
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+        size_t out_off;
+    };
+
+    EventLoop& loop_;
+    ServiceRegistry* registry_;
+    int listen_fd_;
+    uint16_t port_;
+    int counters_timer_;
+
+    StatusProvider status_provider_;
+    RelayProvider relay_provider_;
+    std::vector<uint8_t> auth_cookie_;
+
+    std::unordered_map<int, std::unique_ptr<Client>> clients_;
+    uint32_t subscribed_mask_;  // Union of all client masks
+
+    Impl(EventLoop& loop, ServiceRegistry* registry)
+        : loop_(loop), registry_(registry), listen_fd_(-1), port_(0),
+          counters_timer_(-1), subscribed_mask_(0) {}
+
+    ~Impl() {
+        stop();
+    }
+
+    bool start(uint16_t port, const std::string& listen_address, uint32_t counters_interval_ms) {
+        if (listen_fd_ != -1) {
+            KERMIT_WARN << "Control server is already running";
+            return false;
+        }
+
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            KERMIT_ERROR << "Failed to create control socket: " << strerror(errno);
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, listen_address.c_str(), &addr.sin_addr) != 1) {
+            KERMIT_ERROR << "Invalid control listen address: " << listen_address;
+            closeListener();
+            return false;
+        }
+
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, SOMAXCONN) < 0) {
+            KERMIT_ERROR << "Failed to listen on control port: " << strerror(errno);
+            closeListener();
+            return false;
+        }
+
+        socklen_t addr_len = sizeof(addr);
+        getsockname(listen_fd_, (sockaddr*)&addr, &addr_len);
+        port_ = ntohs(addr.sin_port);
+
+        if (!loop_.addFd(listen_fd_, EventLoop::READABLE, [this](uint32_t) { acceptClients(); })) {
+            closeListener();
+            return false;
+        }
+
+        if (counters_interval_ms > 0) {
+            counters_timer_ = loop_.addTimer(counters_interval_ms, [this] { publishCounters(); });
+        }
+
+        KERMIT_INFO << "Control port listening on " << listen_address << ":" << port_;
+        return true;
+    }
+
+    void stop() {
+        if (counters_timer_ != -1) {
+            loop_.cancelTimer(counters_timer_);
+            counters_timer_ = -1;
+        }
+
+        if (listen_fd_ != -1) {
+            loop_.removeFd(listen_fd_);
+            closeListener();
+        }
+
+        while (!clients_.empty()) {
+            closeClient(clients_.begin()->first);
+        }
+    }
+
+    void closeListener() {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    void acceptClients() {
+        int fd;
+        while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+            auto client = std::make_unique<Client>();
+            client->fd = fd;
+            client->authenticated = auth_cookie_.empty();
+            client->event_mask = 0;
+            client->events = EventLoop::READABLE;
+            client->out_off = 0;
+
+            if (!loop_.addFd(fd, EventLoop::READABLE, [this, fd](uint32_t events) { onClientEvent(fd, events); })) {
+                close(fd);
+                continue;
+            }
+            clients_[fd] = std::move(client);
+        }
+    }
+
+    void closeClient(int fd) {
+        auto it = clients_.find(fd);
+        if (it == clients_.end()) return;
+
+        loop_.removeFd(fd);
+        close(fd);
+        bool had_events = it->second->event_mask != 0;
+        clients_.erase(it);
+
+        if (had_events) {
+            recomputeSubscriptions();
+        }
+    }
+
+    void onClientEvent(int fd, uint32_t events) {
+        auto it = clients_.find(fd);
+        if (it == clients_.end()) return;
+        Client& client = *it->second;
+
+        // Requests left waiting on a full backlog are answered as it drains
+        if (events & EventLoop::WRITABLE) {
+            if (!flush(client) || !answerRequests(client)) {
+                closeClient(fd);
+                return;
+            }
+        }
+
+        if (events & (EventLoop::READABLE | EventLoop::ERROR)) {
+            // The socket is not read while over the cap, so a hangup would repeat
+            if (!readRequests(client) || ((events & EventLoop::ERROR) && backlog(client) > kMaxClientBacklog)) {
+                closeClient(fd);
+                return;
+            }
+        }
+    }
+
+    static size_t backlog(const Client& client) {
+        return client.out.size() - client.out_off;
+    }
+
+    bool readRequests(Client& client) {
+        // Drain the socket, then answer every complete frame in one pass
+        while (backlog(client) <= kMaxClientBacklog && client.in.size() <= kMaxClientBacklog) {
+            size_t old_size = client.in.size();
+            client.in.resize(old_size + kReadChunkSize);
+            ssize_t n = recv(client.fd, client.in.data() + old_size, kReadChunkSize, 0);
+
+            if (n <= 0) {
+                client.in.resize(old_size);
+                if (n == 0) return false;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            client.in.resize(old_size + static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < kReadChunkSize) break;
+        }
+
+        return answerRequests(client);
+    }
+
+    // Answer buffered frames until the backlog passes the cap
+    bool answerRequests(Client& client) {
+        size_t pos = 0;
+        while (client.in.size() - pos >= 4 && backlog(client) <= kMaxClientBacklog) {
+            const uint8_t* p = client.in.data() + pos;
+            uint32_t length = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+
+            if (length < kFrameHeaderSize - 4 || length > kMaxFrameSize) {
+                return false;
+            }
+            if (client.in.size() - pos < 4 + length) {
+                break;
+            }
+
+            uint8_t type = p[4];
+            uint32_t request_id = (uint32_t(p[5]) << 24) | (uint32_t(p[6]) << 16) | (uint32_t(p[7]) << 8) | p[8];
+            handleRequest(client, type, request_id, p + kFrameHeaderSize, length - (kFrameHeaderSize - 4));
+
+            pos += 4 + length;
+        }
+
+        client.in.erase(client.in.begin(), client.in.begin() + pos);
+        return flush(client);
+    }
+
+    void handleRequest(Client& client, uint8_t type, uint32_t request_id, const uint8_t* payload, size_t len) {
+        FrameReader reader(payload, len);
+        FrameWriter writer(client.out);
+        writer.begin(type | control::RESPONSE_FLAG, request_id);
+
+        if (!client.authenticated && type != control::AUTHENTICATE) {
+            writeError(writer, control::UNAUTHORIZED, "Authentication required");
+            writer.finish();
+            return;
+        }
+
+        switch (type) {
+            case control::AUTHENTICATE: {
+                std::string cookie = reader.getString();
+                bool match = reader.ok() && cookie.size() == auth_cookie_.size() &&
+                             constantTimeEquals(cookie, auth_cookie_);
+                if (auth_cookie_.empty() || match) {
+                    client.authenticated = true;
+                    writer.putU8(control::OK);
+                } else {
+                    writeError(writer, control::UNAUTHORIZED, "Bad cookie");
+                }
+                break;
+            }
+
+            case control::EXPOSE: {
+                std::string target = reader.getString();
+                uint32_t weight = reader.getU32();
+                uint8_t policy = reader.getU8();
+                if (!reader.ok() || policy > static_cast<uint8_t>(BalancePolicy::CONSISTENT_HASH)) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed EXPOSE");
+                    break;
+                }
+                if (!registry_) {
+                    writeError(writer, control::ERROR, "No service registry");
+                    break;
+                }
+                try {
+                    std::string hash = registry_->exposeService(target, weight, static_cast<BalancePolicy>(policy));
+                    writer.putU8(control::OK);
+                    writer.putString(hash);
+                } catch (const std::exception& e) {
+                    writeError(writer, control::BAD_REQUEST, e.what());
+                }
+                break;
+            }
+
+            case control::RESOLVE: {
+                std::string hash = reader.getString();
+                std::string target = (reader.ok() && registry_) ? registry_->resolveService(hash) : "";
+                if (!reader.ok()) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed RESOLVE");
+                } else if (target.empty()) {
+                    writeError(writer, control::NOT_FOUND, "Service not found");
+                } else {
+                    writer.putU8(control::OK);
+                    writer.putString(target);
+                }
+                break;
+            }
+
+            case control::REVOKE: {
+                std::string hash = reader.getString();
+                if (!reader.ok()) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed REVOKE");
+                } else if (!registry_ || !registry_->revokeService(hash)) {
+                    writeError(writer, control::NOT_FOUND, "Service not found");
+                } else {
+                    writer.putU8(control::OK);
+                }
+                break;
+            }
+
+            case control::LIST: {
+                std::string cursor = reader.getString();
+                size_t limit = std::min<size_t>(reader.getU16(), kMaxListLimit);
+                if (!reader.ok()) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed LIST");
+                    break;
+                }
+
+                ServicePage page;
+                if (registry_) {
+                    page = registry_->listServicesPage(cursor, limit);
+                }
+
+                // Keep the response inside one frame; a page cut short
+                // resumes after the last service sent
+                writer.putU8(control::OK);
+                size_t count_at = writer.position();
+                writer.putU16(0);
+                size_t count = 0;
+                for (const auto& service : page.services) {
+                    size_t entry = FrameWriter::stringSize(service.service_hash) +
+                                   FrameWriter::stringSize(service.target_address) + 1 + 2;
+                    size_t cursor_size = 2 + std::max(service.service_hash.size(), page.next_cursor.size());
+                    if (writer.length() + entry + cursor_size > kMaxFrameSize) break;
+
+                    writer.putString(service.service_hash);
+                    writer.putString(service.target_address);
+                    writer.putU8(static_cast<uint8_t>(service.policy));
+                    writer.putU16(static_cast<uint16_t>(std::min<size_t>(service.backend_count, 0xFFFF)));
+                    count++;
+                }
+                writer.patchU16(count_at, static_cast<uint16_t>(count));
+                writer.putString(count < page.services.size() && count > 0 ? page.services[count - 1].service_hash
+                                                                           : page.next_cursor);
+                break;
+            }
+
+            case control::ADD_BACKEND: {
+                std::string hash = reader.getString();
+                std::string address = reader.getString();
+                uint32_t weight = reader.getU32();
+                if (!reader.ok()) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed ADD_BACKEND");
+                    break;
+                }
+                try {
+                    if (registry_ && registry_->addBackend(hash, address, weight)) {
+                        writer.putU8(control::OK);
+                    } else {
+                        writeError(writer, control::NOT_FOUND, "Service not found");
+                    }
+                } catch (const std::exception& e) {
+                    writeError(writer, control::BAD_REQUEST, e.what());
+                }
+                break;
+            }
+
+            case control::STATUS: {
+                writer.putU8(control::OK);
+                writeStatus(writer);
+                break;
+            }
+
+            case control::LIST_RELAYS: {
+                std::vector<ControlRelayInfo> relays;
+                if (relay_provider_) {
+                    relays = relay_provider_();
+                }
+
+                // Keep the response inside one frame
+                writer.putU8(control::OK);
+                size_t count_at = writer.position();
+                writer.putU16(0);
+                size_t count = 0;
+                for (const auto& relay : relays) {
+                    size_t entry = FrameWriter::stringSize(relay.node_id) + FrameWriter::stringSize(relay.address) + 2 + 1;
+                    if (count == 0xFFFF || writer.length() + entry > kMaxFrameSize) break;
+
+                    writer.putString(relay.node_id);
+                    writer.putString(relay.address);
+                    writer.putU16(relay.port);
+                    writer.putU8(relay.flags);
+                    count++;
+                }
+                writer.patchU16(count_at, static_cast<uint16_t>(count));
+                break;
+            }
+
+            case control::SUBSCRIBE:
+            case control::UNSUBSCRIBE: {
+                uint32_t mask = reader.getU32();
+                if (!reader.ok()) {
+                    writeError(writer, control::BAD_REQUEST, "Malformed subscription");
+                    break;
+                }
+                if (type == control::SUBSCRIBE) {
+                    client.event_mask |= mask;
+                } else {
+                    client.event_mask &= ~mask;
+                }
+                recomputeSubscriptions();
+                writer.putU8(control::OK);
+                break;
+            }
+
+            default:
+                writeError(writer, control::BAD_REQUEST, "Unknown opcode");
+                break;
+        }
+
+        writer.finish();
+    }
+
+    static void writeError(FrameWriter& writer, control::Status status, const std::string& message) {
+        writer.putU8(status);
+        writer.putString(message);
+    }
+
+    static bool constantTimeEquals(const std::string& a, const std::vector<uint8_t>& b) {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < b.size(); ++i) {
+            diff |= static_cast<uint8_t>(a[i]) ^ b[i];
+        }
+        return diff == 0;
+    }
+
+    void writeStatus(FrameWriter& writer) {
+        ControlStatusInfo info{};
+        if (status_provider_) {
+            info = status_provider_();
+        }
+        if (registry_) {
+            info.services = registry_->getServiceCount();
+        }
+
+        writer.putU64(nowMs());
+        writer.putU64(info.circuits);
+        writer.putU64(info.relays);
+        writer.putU64(info.trusted_relays);
+        writer.putU64(info.services);
+        writer.putU64(info.socks_accepted);
+        writer.putU64(info.socks_active);
+        writer.putU64(info.bytes_relayed);
+        writer.putU64(info.slab_bytes);
+        writer.putU64(info.slab_fallbacks);
+    }
+
+    bool flush(Client& client) {
+        while (client.out_off < client.out.size()) {
+            ssize_t n = send(client.fd, client.out.data() + client.out_off,
+                             client.out.size() - client.out_off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            client.out_off += static_cast<size_t>(n);
+        }
+
+        if (client.out_off == client.out.size()) {
+            client.out.clear();
+            client.out_off = 0;
+        }
+
+        // Stop reading while over the cap, so a client that pipelines
+        // requests without reading the answers cannot grow our buffers
+        uint32_t events = 0;
+        if (backlog(client) <= kMaxClientBacklog) events |= EventLoop::READABLE;
+        if (!client.out.empty()) events |= EventLoop::WRITABLE;
+        if (events != client.events) {
+            client.events = events;
+            loop_.modifyFd(client.fd, events);
+        }
+        return true;
+    }
+
+    void recomputeSubscriptions() {
+        subscribed_mask_ = 0;
+        for (const auto& client : clients_) {
+            subscribed_mask_ |= client.second->event_mask;
+        }
+    }
+
+    // Encode an event once per subscriber and flush; caller is on the loop thread
+    template <typename Body>
+    void broadcast(control::EventType event, Body&& body) {
+        const uint32_t bit = 1u << event;
+        if (!(subscribed_mask_ & bit)) {
+            return;
+        }
+
+        std::vector<int> failed;
+        for (auto& entry : clients_) {
+            Client& client = *entry.second;
+            if (!(client.event_mask & bit) || !client.authenticated) continue;
+            if (backlog(client) > kMaxClientBacklog) continue;
+
+            FrameWriter writer(client.out);
+            writer.begin(control::EVENT, 0);
+            writer.putU8(event);
+            body(writer);
+            writer.finish();
+
+            if (!flush(client)) {
+                failed.push_back(entry.first);
+            }
+        }
+
+        for (int fd : failed) {
+            closeClient(fd);
+        }
+    }
+
+    void publishCounters() {
+        broadcast(control::COUNTERS, [this](FrameWriter& writer) { writeStatus(writer); });
+    }
+};
+
+// ControlServer public interface
+ControlServer::ControlServer(EventLoop& loop, ServiceRegistry* registry)
+    : impl_(std::make_unique<Impl>(loop, registry)) {}
+
+ControlServer::~ControlServer() = default;
+
+void ControlServer::setStatusProvider(StatusProvider provider) {
+    impl_->status_provider_ = std::move(provider);
+}
+
+void ControlServer::setRelayProvider(RelayProvider provider) {
+    impl_->relay_provider_ = std::move(provider);
+}
+
+void ControlServer::setAuthCookie(const std::vector<uint8_t>& cookie) {
+    impl_->auth_cookie_ = cookie;
+}
+
+bool ControlServer::start(uint16_t port, const std::string& listen_address, uint32_t counters_interval_ms) {
+    return impl_->start(port, listen_address, counters_interval_ms);
+}
+
+void ControlServer::stop() {
+    impl_->stop();
+}
+
+uint16_t ControlServer::getPort() const {
+    return impl_->port_;
+}
+
+void ControlServer::publishCircuitBuilt(const std::string& circuit_id, size_t hops) {
+    Impl* impl = impl_.get();
+    impl->loop_.post([impl, circuit_id, hops] {
+        impl->broadcast(control::CIRCUIT_BUILT, [&](FrameWriter& writer) {
+            writer.putString(circuit_id);
+            writer.putU8(static_cast<uint8_t>(std::min<size_t>(hops, 255)));
+        });
+    });
+}
+
+void ControlServer::publishConnectionClosed(const std::string& connection_id) {
+    Impl* impl = impl_.get();
+    impl->loop_.post([impl, connection_id] {
+        impl->broadcast(control::CONNECTION_CLOSED, [&](FrameWriter& writer) {
+            writer.putString(connection_id);
+        });
+    });
+}
+
+} // namespace kermit
@@ -0,0 +1,327 @@
+#include "kermit/directory_loader.h"
+#include "kermit/relay_directory.h"
+#include "kermit/log.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+constexpr char kCacheMagic[4] = {'K', 'R', 'D', 'C'};
+constexpr uint32_t kCacheVersion = 1;
+constexpr size_t kMinChunkSize = 64 * 1024;
+constexpr size_t kMaxParseThreads = 8;
+
+// Fixed cache header; records follow as
+//   u8 flags, u16 port, u32 bandwidth, u16 host length, host bytes
+// in host byte order, since the cache never leaves this machine
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint32_t count;
+};
+
+// Fixed part of each cache record, before the host bytes
+constexpr size_t kRecordHeaderSize = 1 + 2 + 4 + 2;
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapped);
+                size_ = static_cast<size_t>(st.st_size);
+                madvise(mapped, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool valid() const { return data_ != nullptr; }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+int64_t mtimeNs(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Split off the next whitespace-delimited token
+std::string_view nextToken(std::string_view& line) {
+    size_t start = 0;
+    while (start < line.size() && isSpace(line[start])) ++start;
+    size_t end = start;
+    while (end < line.size() && !isSpace(line[end])) ++end;
+
+    std::string_view token = line.substr(start, end - start);
+    line.remove_prefix(end);
+    return token;
+}
+
+// Parse one line; returns false for malformed relay lines
+// Comments and blank lines succeed without producing a relay
+bool parseLine(std::string_view line, std::vector<RelayDescriptor>& relays) {
+    std::string_view keyword = nextToken(line);
+    if (keyword.empty() || keyword[0] == '#') {
+        return true;
+    }
+    if (keyword != "relay") {
+        return false;
+    }
+
+    std::string_view address = nextToken(line);
+    size_t colon = address.rfind(':');
+    if (colon == std::string_view::npos || colon == 0) {
+        return false;
+    }
+
+    std::string_view port_str = address.substr(colon + 1);
+    unsigned port = 0;
+    auto port_result = std::from_chars(port_str.data(), port_str.data() + port_str.size(), port);
+    if (port_result.ec != std::errc() || port_result.ptr != port_str.data() + port_str.size() ||
+        port == 0 || port > 65535) {
+        return false;
+    }
+
+    std::string_view bandwidth_str = nextToken(line);
+    uint32_t bandwidth = 0;
+    auto bw_result = std::from_chars(bandwidth_str.data(), bandwidth_str.data() + bandwidth_str.size(), bandwidth);
+    if (bw_result.ec != std::errc() || bw_result.ptr != bandwidth_str.data() + bandwidth_str.size()) {
+        return false;
+    }
+
+    uint8_t flags = 0;
+    for (std::string_view flag = nextToken(line); !flag.empty(); flag = nextToken(line)) {
+        if (flag == "Guard") flags |= RelayDirectory::GUARD;
+        else if (flag == "Exit") flags |= RelayDirectory::EXIT;
+        else if (flag == "HSDir") flags |= RelayDirectory::HIDDEN_SERVICES;
+        else if (flag == "Trusted") flags |= RelayDirectory::TRUSTED;
+        // Unknown flags are ignored so newer documents still load
+    }
+
+    relays.push_back({std::string(address.substr(0, colon)), static_cast<uint16_t>(port), bandwidth, flags, 0});
+    return true;
+}
+
+size_t parseChunk(const char* begin, const char* end, std::vector<RelayDescriptor>& relays) {
+    size_t malformed = 0;
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        const char* line_end = newline ? newline : end;
+
+        if (!parseLine(std::string_view(begin, line_end - begin), relays)) {
+            ++malformed;
+        }
+        begin = line_end + 1;
+    }
+    return malformed;
+}
+
+bool readCache(const std::string& cache_path, const struct stat& source, std::vector<RelayDescriptor>& relays) {
+    MappedFile cache(cache_path);
+    if (!cache.valid() || cache.size() < sizeof(CacheHeader)) {
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, cache.data(), sizeof(header));
+    if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion ||
+        header.source_size != static_cast<uint64_t>(source.st_size) ||
+        header.source_mtime_ns != mtimeNs(source)) {
+        return false;
+    }
+
+    const char* p = cache.data() + sizeof(header);
+    const char* end = cache.data() + cache.size();
+    // Records are at least kRecordHeaderSize bytes; a count the rest of
+    // the file cannot hold is corrupt and must not size the reserve
+    if (header.count > static_cast<size_t>(end - p) / kRecordHeaderSize) {
+        return false;
+    }
+    std::vector<RelayDescriptor> loaded;
+    loaded.reserve(header.count);
+
+    for (uint32_t i = 0; i < header.count; ++i) {
+        RelayDescriptor relay{};
+        uint16_t host_len;
+        if (end - p < static_cast<ptrdiff_t>(kRecordHeaderSize)) return false;
+
+        memcpy(&relay.flags, p, 1);
+        memcpy(&relay.port, p + 1, 2);
+        memcpy(&relay.bandwidth, p + 3, 4);
+        memcpy(&host_len, p + 7, 2);
+        p += kRecordHeaderSize;
+
+        if (end - p < host_len) return false;
+        relay.host.assign(p, host_len);
+        p += host_len;
+        loaded.push_back(std::move(relay));
+    }
+
+    relays = std::move(loaded);
+    return true;
+}
+
+bool writeCache(const std::string& cache_path, const struct stat& source, const std::vector<RelayDescriptor>& relays) {
+    std::string buffer;
+    buffer.reserve(sizeof(CacheHeader) + relays.size() * 24);
+
+    CacheHeader header;
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.source_size = static_cast<uint64_t>(source.st_size);
+    header.source_mtime_ns = mtimeNs(source);
+    header.count = static_cast<uint32_t>(relays.size());
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const auto& relay : relays) {
+        uint16_t host_len = static_cast<uint16_t>(std::min<size_t>(relay.host.size(), 0xFFFF));
+        buffer.append(reinterpret_cast<const char*>(&relay.flags), 1);
+        buffer.append(reinterpret_cast<const char*>(&relay.port), 2);
+        buffer.append(reinterpret_cast<const char*>(&relay.bandwidth), 4);
+        buffer.append(reinterpret_cast<const char*>(&host_len), 2);
+        buffer.append(relay.host.data(), host_len);
+    }
+
+    // Write beside the target and rename so readers never see a partial cache
+    std::string tmp_path = cache_path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = write(fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size());
+    close(fd);
+
+    if (!ok || rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+size_t DirectoryLoader::parseText(const char* data, size_t len, std::vector<RelayDescriptor>& relays,
+                                  size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), kMaxParseThreads));
+    }
+    threads = std::max<size_t>(1, std::min(threads, len / kMinChunkSize));
+
+    if (threads == 1) {
+        return parseChunk(data, data + len, relays);
+    }
+
+    // Cut the document at line boundaries; each chunk gets its own output
+    std::vector<const char*> bounds(threads + 1);
+    bounds[0] = data;
+    bounds[threads] = data + len;
+    for (size_t i = 1; i < threads; ++i) {
+        const char* cut = std::max(bounds[i - 1], data + len * i / threads);
+        const char* newline = static_cast<const char*>(memchr(cut, '\n', data + len - cut));
+        bounds[i] = newline ? newline + 1 : data + len;
+    }
+
+    std::vector<std::vector<RelayDescriptor>> parts(threads);
+    std::vector<size_t> malformed(threads, 0);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            malformed[i] = parseChunk(bounds[i], bounds[i + 1], parts[i]);
+        });
+    }
+    malformed[0] = parseChunk(bounds[0], bounds[1], parts[0]);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    size_t total = relays.size();
+    size_t malformed_total = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        total += parts[i].size();
+        malformed_total += malformed[i];
+    }
+
+    relays.reserve(total);
+    for (auto& part : parts) {
+        relays.insert(relays.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
+    return malformed_total;
+}
+
+bool DirectoryLoader::load(const std::string& path, std::vector<RelayDescriptor>& relays,
+                           DirectoryLoadStats* stats) {
+    auto begin = std::chrono::steady_clock::now();
+    DirectoryLoadStats result{0, 0, false, 0.0};
+
+    struct stat source;
+    if (stat(path.c_str(), &source) != 0) {
+        KERMIT_ERROR << "Cannot read relay directory " << path << ": " << strerror(errno);
+        return false;
+    }
+
+    std::string cache_path = path + ".cache";
+    relays.clear();
+
+    if (readCache(cache_path, source, relays)) {
+        result.from_cache = true;
+    } else {
+        MappedFile document(path);
+        if (!document.valid() && source.st_size > 0) {
+            KERMIT_ERROR << "Cannot map relay directory " << path;
+            return false;
+        }
+
+        if (document.valid()) {
+            result.malformed_lines = parseText(document.data(), document.size(), relays);
+        }
+
+        if (!writeCache(cache_path, source, relays)) {
+            KERMIT_WARN << "Could not write relay directory cache " << cache_path;
+        }
+    }
+
+    result.relays = relays.size();
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    if (stats) {
+        *stats = result;
+    }
+    return true;
+}
+
+} // namespace kermit
@@ -0,0 +1,320 @@
+#include "kermit/event_loop.h"
+#include "kermit/log.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+uint32_t toEpollEvents(uint32_t events) {
+    uint32_t result = 0;
+    if (events & EventLoop::READABLE) result |= EPOLLIN | EPOLLRDHUP;
+    if (events & EventLoop::WRITABLE) result |= EPOLLOUT;
+    return result;
+}
+
+uint32_t fromEpollEvents(uint32_t events) {
+    uint32_t result = 0;
+    if (events & (EPOLLIN | EPOLLRDHUP)) result |= EventLoop::READABLE;
+    if (events & EPOLLOUT) result |= EventLoop::WRITABLE;
+    if (events & (EPOLLERR | EPOLLHUP)) result |= EventLoop::ERROR;
+    return result;
+}
+
+// Registration id reserved for the wakeup eventfd
+constexpr uint64_t kWakeupId = 0;
+
+} // namespace
+
+// EventLoop implementation
+class EventLoop::Impl {
+public:
+    struct Handler {
+        int fd;
+        IoCallback callback;
+    };
+
+    int epoll_fd_;
+    int wakeup_fd_;
+    std::atomic<bool> running_;
+    std::atomic<bool> should_stop_;
+    std::atomic<std::thread::id> loop_thread_;
+
+    // Events carry a registration id rather than the fd, so an event that
+    // was already collected for a removed fd can never reach a new handler
+    // that reused the same descriptor number
+    std::unordered_map<uint64_t, std::shared_ptr<Handler>> handlers_;
+    std::unordered_map<int, uint64_t> fd_ids_;
+    uint64_t next_id_;
+    std::mutex handlers_mutex_;
+
+    std::vector<Task> pending_tasks_;
+    std::mutex tasks_mutex_;
+
+    Impl() : epoll_fd_(-1), wakeup_fd_(-1), running_(false), should_stop_(false), next_id_(kWakeupId + 1) {}
+
+    ~Impl() {
+        if (wakeup_fd_ != -1) close(wakeup_fd_);
+        if (epoll_fd_ != -1) close(epoll_fd_);
+    }
+
+    bool initialize() {
+        if (epoll_fd_ != -1) {
+            return true;
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            KERMIT_ERROR << "Failed to create epoll instance: " << strerror(errno);
+            return false;
+        }
+
+        wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd_ < 0) {
+            KERMIT_ERROR << "Failed to create wakeup eventfd: " << strerror(errno);
+            close(epoll_fd_);
+            epoll_fd_ = -1;
+            return false;
+        }
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = kWakeupId;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) < 0) {
+            KERMIT_ERROR << "Failed to watch wakeup eventfd: " << strerror(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool addFd(int fd, uint32_t events, IoCallback callback) {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+
+        if (fd_ids_.count(fd)) {
+            KERMIT_WARN << "File descriptor " << fd << " is already registered";
+            return false;
+        }
+
+        uint64_t id = next_id_++;
+
+        epoll_event ev{};
+        ev.events = toEpollEvents(events);
+        ev.data.u64 = id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            KERMIT_ERROR << "Failed to watch fd " << fd << ": " << strerror(errno);
+            return false;
+        }
+
+        handlers_[id] = std::make_shared<Handler>(Handler{fd, std::move(callback)});
+        fd_ids_[fd] = id;
+        return true;
+    }
+
+    bool modifyFd(int fd, uint32_t events) {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+
+        auto it = fd_ids_.find(fd);
+        if (it == fd_ids_.end()) {
+            return false;
+        }
+
+        epoll_event ev{};
+        ev.events = toEpollEvents(events);
+        ev.data.u64 = it->second;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    void removeFd(int fd) {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+
+        auto it = fd_ids_.find(fd);
+        if (it == fd_ids_.end()) {
+            return;
+        }
+
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        handlers_.erase(it->second);
+        fd_ids_.erase(it);
+    }
+
+    void post(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(tasks_mutex_);
+            pending_tasks_.push_back(std::move(task));
+        }
+        wakeup();
+    }
+
+    int addTimer(uint32_t interval_ms, Task task) {
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0) {
+            KERMIT_ERROR << "Failed to create timerfd: " << strerror(errno);
+            return -1;
+        }
+
+        itimerspec spec{};
+        spec.it_interval.tv_sec = interval_ms / 1000;
+        spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+        if (timerfd_settime(timer_fd, 0, &spec, nullptr) < 0) {
+            KERMIT_ERROR << "Failed to arm timerfd: " << strerror(errno);
+            close(timer_fd);
+            return -1;
+        }
+
+        auto callback = [timer_fd, task = std::move(task)](uint32_t) {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                task();
+            }
+        };
+
+        if (!addFd(timer_fd, READABLE, std::move(callback))) {
+            close(timer_fd);
+            return -1;
+        }
+
+        return timer_fd;
+    }
+
+    void cancelTimer(int timer_id) {
+        if (timer_id < 0) return;
+        removeFd(timer_id);
+        close(timer_id);
+    }
+
+    void wakeup() {
+        uint64_t one = 1;
+        ssize_t result = write(wakeup_fd_, &one, sizeof(one));
+        (void)result;  // EAGAIN means a wakeup is already pending
+    }
+
+    void run() {
+        if (epoll_fd_ == -1 && !initialize()) {
+            return;
+        }
+
+        loop_thread_ = std::this_thread::get_id();
+        running_ = true;
+
+        std::vector<epoll_event> events(256);
+        std::vector<Task> tasks;
+
+        while (!should_stop_) {
+            int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                KERMIT_ERROR << "epoll_wait error: " << strerror(errno);
+                break;
+            }
+
+            for (int i = 0; i < count; ++i) {
+                uint64_t id = events[i].data.u64;
+
+                if (id == kWakeupId) {
+                    uint64_t value;
+                    while (read(wakeup_fd_, &value, sizeof(value)) > 0) {}
+                    continue;
+                }
+
+                std::shared_ptr<Handler> handler;
+                {
+                    std::lock_guard<std::mutex> lock(handlers_mutex_);
+                    auto it = handlers_.find(id);
+                    if (it == handlers_.end()) continue;
+                    handler = it->second;
+                }
+
+                handler->callback(fromEpollEvents(events[i].events));
+            }
+
+            // Run posted tasks
+            {
+                std::lock_guard<std::mutex> lock(tasks_mutex_);
+                tasks.swap(pending_tasks_);
+            }
+            for (auto& task : tasks) {
+                task();
+            }
+            tasks.clear();
+
+            // Grow the event buffer under load
+            if (count == static_cast<int>(events.size())) {
+                events.resize(events.size() * 2);
+            }
+        }
+
+        running_ = false;
+        loop_thread_ = std::thread::id();
+    }
+
+    void stop() {
+        should_stop_ = true;
+        if (wakeup_fd_ != -1) {
+            wakeup();
+        }
+    }
+};
+
+// EventLoop public interface
+EventLoop::EventLoop() : impl_(std::make_unique<Impl>()) {}
+
+EventLoop::~EventLoop() = default;
+
+bool EventLoop::initialize() {
+    return impl_->initialize();
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, IoCallback callback) {
+    return impl_->addFd(fd, events, std::move(callback));
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events) {
+    return impl_->modifyFd(fd, events);
+}
+
+void EventLoop::removeFd(int fd) {
+    impl_->removeFd(fd);
+}
+
+void EventLoop::post(Task task) {
+    impl_->post(std::move(task));
+}
+
+int EventLoop::addTimer(uint32_t interval_ms, Task task) {
+    return impl_->addTimer(interval_ms, std::move(task));
+}
+
+void EventLoop::cancelTimer(int timer_id) {
+    impl_->cancelTimer(timer_id);
+}
+
+void EventLoop::run() {
+    impl_->run();
+}
+
+void EventLoop::stop() {
+    impl_->stop();
+}
+
+bool EventLoop::isRunning() const {
+    return impl_->running_;
+}
+
+bool EventLoop::isInLoopThread() const {
+    return impl_->loop_thread_.load() == std::this_thread::get_id();
+}
+
+} // namespace kermit
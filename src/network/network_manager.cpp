@@ -1,10 +1,13 @@
 #include "kermit/network.h"
-#include <iostream>
+#include "kermit/cell.h"
+#include "kermit/circuit_scheduler.h"
+#include "kermit/log.h"
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <chrono>
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 #include <vector>
 #include <string>
@@ -16,9 +19,20 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
+#include <sys/eventfd.h>
 
 namespace kermit {
 
+namespace {
+
+// Per-connection write queue limit
+constexpr size_t kMaxQueuedBytes = 1024 * 1024;
+
+// Circuit cells moved from the scheduler to the write buffer at a time
+constexpr size_t kScheduleBatch = 4;
+
+} // namespace
+
 // NetworkManager implementation
 class NetworkManager::Impl {
 public:
@@ -29,9 +43,44 @@ public:
     
     // Socket management
     int listen_socket_;
-    std::map<std::string, int> connections_;
     std::mutex connections_mutex_;
     
+    // Connection table, indexed by the low half of a ConnectionHandle, under
+    // connections_mutex_; a slot stays claimed with its name until the
+    // close callback has run
+    struct Slot {
+        int fd = -1;                // -1 while free or closing
+        uint32_t generation = 1;
+        bool claimed = false;
+        std::string name;           // "ip:port", for logging
+    };
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_slots_;
+    std::unordered_map<int, uint32_t> slot_of_fd_;
+    
+    // Unwritten data per socket, under connections_mutex_
+    struct WriteQueue {
+        std::vector<uint8_t> out;       // Raw data and the scheduled batch being written
+        size_t out_off = 0;
+        CircuitScheduler scheduler;     // Cells from sendCell() not yet in out
+        bool polling = false;           // POLLOUT is or will be in the poll set
+
+        size_t queued() const { return out.size() - out_off + scheduler.getQueuedCells() * kCellSize; }
+        size_t unwritten() const { return out.size() - out_off; }
+    };
+    std::unordered_map<int, std::unique_ptr<WriteQueue>> write_queues_;
+    
+    // KIST rounds: sockets with cells waiting, and how often they run
+    std::unordered_set<int> scheduled_;
+    uint32_t kist_interval_ms_;
+    std::chrono::steady_clock::time_point last_round_;
+    
+    // Wakes poll() when a send leaves data queued
+    int wake_fd_;
+    
+    // Handed to the data callback, reusing its capacity on every read
+    std::vector<uint8_t> received_;
+    
     // Thread for network operations
     std::thread network_thread_;
     
@@ -39,7 +88,8 @@ public:
     ConnectionCallback connection_callback_;
     DataCallback data_callback_;
     
-    Impl() : running_(false), listen_port_(0), should_stop_(false), listen_socket_(-1) {}
+    Impl() : running_(false), listen_port_(0), should_stop_(false), listen_socket_(-1), kist_interval_ms_(0),
+             wake_fd_(-1) {}
     
     ~Impl() {
         stop();
@@ -49,20 +99,28 @@ public:
         listen_port_ = listen_port;
         listen_address_ = listen_address;
         
-        std::cout << "Network manager initialized on " 
-                  << listen_address << ":" << listen_port << std::endl;
+        KERMIT_INFO << "Network manager initialized on " 
+                    << listen_address << ":" << listen_port;
         return true;
     }
     
     bool start() {
         if (running_) {
-            std::cerr << "Network manager is already running" << std::endl;
+            KERMIT_ERROR << "Network manager is already running";
             return false;
         }
         
         // Create listen socket
         if (!createListenSocket()) {
-            std::cerr << "Failed to create listen socket" << std::endl;
+            KERMIT_ERROR << "Failed to create listen socket";
+            return false;
+        }
+        
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) {
+            KERMIT_ERROR << "Failed to create wakeup eventfd: " << strerror(errno);
+            close(listen_socket_);
+            listen_socket_ = -1;
             return false;
         }
         
@@ -71,7 +129,7 @@ public:
         network_thread_ = std::thread(&Impl::networkLoop, this);
         
         running_ = true;
-        std::cout << "Network manager started" << std::endl;
+        KERMIT_INFO << "Network manager started";
         return true;
     }
     
@@ -81,38 +139,46 @@ public:
         running_ = false;
         should_stop_ = true;
         
-        // Close listen socket to break accept()
+        // Join network thread before closing the sockets it polls
+        if (network_thread_.joinable()) {
+            network_thread_.join();
+        }
+        
         if (listen_socket_ != -1) {
             close(listen_socket_);
             listen_socket_ = -1;
         }
         
-        // Close all connections
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        for (auto& conn : connections_) {
-            close(conn.second);
+        if (wake_fd_ != -1) {
+            close(wake_fd_);
+            wake_fd_ = -1;
         }
-        connections_.clear();
         
-        // Join network thread
-        if (network_thread_.joinable()) {
-            network_thread_.join();
+        // Close all connections
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto& entry : slot_of_fd_) {
+            close(entry.first);
         }
+        slots_.clear();
+        free_slots_.clear();
+        slot_of_fd_.clear();
+        write_queues_.clear();
+        scheduled_.clear();
         
-        std::cout << "Network manager stopped" << std::endl;
+        KERMIT_INFO << "Network manager stopped";
     }
     
     bool createListenSocket() {
         listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
         if (listen_socket_ < 0) {
-            std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to create socket: " << strerror(errno);
             return false;
         }
         
         // Set socket options
         int opt = 1;
         if (setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-            std::cerr << "Failed to set socket options: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to set socket options: " << strerror(errno);
             close(listen_socket_);
             listen_socket_ = -1;
             return false;
@@ -120,7 +186,7 @@ public:
         
         // Set non-blocking
         if (fcntl(listen_socket_, F_SETFL, O_NONBLOCK) < 0) {
-            std::cerr << "Failed to set non-blocking: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to set non-blocking: " << strerror(errno);
             close(listen_socket_);
             listen_socket_ = -1;
             return false;
@@ -135,7 +201,7 @@ public:
             addr.sin_addr.s_addr = INADDR_ANY;
         } else {
             if (inet_pton(AF_INET, listen_address_.c_str(), &addr.sin_addr) != 1) {
-                std::cerr << "Invalid listen address: " << listen_address_ << std::endl;
+                KERMIT_ERROR << "Invalid listen address: " << listen_address_;
                 close(listen_socket_);
                 listen_socket_ = -1;
                 return false;
@@ -143,7 +209,7 @@ public:
         }
         
         if (bind(listen_socket_, (sockaddr*)&addr, sizeof(addr)) < 0) {
-            std::cerr << "Failed to bind socket: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to bind socket: " << strerror(errno);
             close(listen_socket_);
             listen_socket_ = -1;
             return false;
@@ -151,13 +217,13 @@ public:
         
         // Listen
         if (listen(listen_socket_, SOMAXCONN) < 0) {
-            std::cerr << "Failed to listen: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to listen: " << strerror(errno);
             close(listen_socket_);
             listen_socket_ = -1;
             return false;
         }
         
-        std::cout << "Listening on " << listen_address_ << ":" << listen_port_ << std::endl;
+        KERMIT_INFO << "Listening on " << listen_address_ << ":" << listen_port_;
         return true;
     }
     
@@ -175,25 +241,51 @@ public:
             listen_pfd.revents = 0;
             poll_fds.push_back(listen_pfd);
             
-            // Add connected sockets
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            for (const auto& conn : connections_) {
-                pollfd conn_pfd{};
-                conn_pfd.fd = conn.second;
-                conn_pfd.events = POLLIN | POLLHUP | POLLERR;
-                conn_pfd.revents = 0;
-                poll_fds.push_back(conn_pfd);
+            pollfd wake_pfd{};
+            wake_pfd.fd = wake_fd_;
+            wake_pfd.events = POLLIN;
+            wake_pfd.revents = 0;
+            poll_fds.push_back(wake_pfd);
+            
+            // Add connected sockets, watching for writability while data is
+            // queued; the lock is released before dispatch because the
+            // handlers below take it again
+            int timeout_ms = 100;
+            {
+                std::lock_guard<std::mutex> lock(connections_mutex_);
+                for (const auto& entry : slot_of_fd_) {
+                    pollfd conn_pfd{};
+                    conn_pfd.fd = entry.first;
+                    conn_pfd.events = POLLIN | POLLHUP | POLLERR;
+                    auto queue_it = write_queues_.find(entry.first);
+                    if (queue_it != write_queues_.end()) {
+                        WriteQueue& queue = *queue_it->second;
+                        queue.polling = queue.unwritten() > 0;
+                        if (queue.polling) {
+                            conn_pfd.events |= POLLOUT;
+                        }
+                    }
+                    conn_pfd.revents = 0;
+                    poll_fds.push_back(conn_pfd);
+                }
+                if (!scheduled_.empty()) {
+                    timeout_ms = static_cast<int>(kist_interval_ms_);
+                }
             }
             
             // Wait for events
-            int poll_result = poll(poll_fds.data(), poll_fds.size(), 100);
+            int poll_result = poll(poll_fds.data(), poll_fds.size(), timeout_ms);
             
             if (poll_result < 0) {
                 if (errno == EINTR) continue;
-                std::cerr << "Poll error: " << strerror(errno) << std::endl;
+                KERMIT_ERROR << "Poll error: " << strerror(errno);
                 break;
             }
             
+            if (kist_interval_ms_ > 0) {
+                runRound();
+            }
+            
             if (poll_result == 0) {
                 // Timeout, continue loop
                 continue;
@@ -208,13 +300,27 @@ public:
                     if (poll_fds[i].revents & POLLIN) {
                         acceptNewConnection();
                     }
+                } else if (i == 1) {
+                    // A send left data queued; the next pass watches for POLLOUT
+                    // or runs a KIST round
+                    uint64_t value;
+                    while (read(wake_fd_, &value, sizeof(value)) > 0) {}
                 } else {
                     // Connection socket event
                     int sock_fd = poll_fds[i].fd;
                     if (poll_fds[i].revents & (POLLHUP | POLLERR)) {
                         // Connection closed or error
                         handleConnectionClosed(sock_fd);
-                    } else if (poll_fds[i].revents & POLLIN) {
+                        continue;
+                    }
+                    if (poll_fds[i].revents & POLLOUT) {
+                        std::lock_guard<std::mutex> lock(connections_mutex_);
+                        auto queue_it = write_queues_.find(sock_fd);
+                        if (queue_it != write_queues_.end()) {
+                            flush(sock_fd, *queue_it->second);
+                        }
+                    }
+                    if (poll_fds[i].revents & POLLIN) {
                         // Data available
                         handleIncomingData(sock_fd);
                     }
@@ -230,14 +336,14 @@ public:
         int client_fd = accept(listen_socket_, (sockaddr*)&client_addr, &client_len);
         if (client_fd < 0) {
             if (errno != EWOULDBLOCK && errno != EAGAIN) {
-                std::cerr << "Accept error: " << strerror(errno) << std::endl;
+                KERMIT_ERROR << "Accept error: " << strerror(errno);
             }
             return;
         }
         
         // Set non-blocking
         if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
-            std::cerr << "Failed to set client socket non-blocking: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to set client socket non-blocking: " << strerror(errno);
             close(client_fd);
             return;
         }
@@ -246,16 +352,16 @@ public:
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
         uint16_t client_port = ntohs(client_addr.sin_port);
         
-        std::string connection_id = std::string(client_ip) + ":" + std::to_string(client_port);
+        std::string name = std::string(client_ip) + ":" + std::to_string(client_port);
         
         std::lock_guard<std::mutex> lock(connections_mutex_);
-        connections_[connection_id] = client_fd;
+        ConnectionHandle connection = claimSlot(client_fd, name);
         
-        std::cout << "New connection from " << connection_id << std::endl;
+        KERMIT_INFO << "New connection from " << name;
         
         // Call connection callback if set
         if (connection_callback_) {
-            connection_callback_(connection_id, true);
+            connection_callback_(connection, true);
         }
     }
     
@@ -265,7 +371,7 @@ public:
         
         if (bytes_read < 0) {
             if (errno != EWOULDBLOCK && errno != EAGAIN) {
-                std::cerr << "Recv error: " << strerror(errno) << std::endl;
+                KERMIT_ERROR << "Recv error: " << strerror(errno);
                 handleConnectionClosed(sock_fd);
             }
             return;
@@ -277,68 +383,128 @@ public:
             return;
         }
         
-        // Find connection ID
-        std::string connection_id;
+        // Find the connection
+        ConnectionHandle connection = kInvalidConnection;
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
-            for (const auto& conn : connections_) {
-                if (conn.second == sock_fd) {
-                    connection_id = conn.first;
-                    break;
-                }
+            auto it = slot_of_fd_.find(sock_fd);
+            if (it != slot_of_fd_.end()) {
+                connection = handleOf(it->second);
+                KERMIT_DEBUG << "Received " << bytes_read << " bytes from " << slots_[it->second].name;
             }
         }
         
-        if (!connection_id.empty()) {
-            std::vector<uint8_t> data(buffer, buffer + bytes_read);
-            
-            std::cout << "Received " << bytes_read << " bytes from " << connection_id << std::endl;
+        if (connection != kInvalidConnection) {
+            received_.assign(buffer, buffer + bytes_read);
             
             // Call data callback if set
             if (data_callback_) {
-                data_callback_(connection_id, data);
+                data_callback_(connection, received_);
             }
         }
     }
     
     void handleConnectionClosed(int sock_fd) {
-        std::string connection_id;
-        
+        ConnectionHandle connection = kInvalidConnection;
+        std::string name;
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
-            for (auto it = connections_.begin(); it != connections_.end(); ++it) {
-                if (it->second == sock_fd) {
-                    connection_id = it->first;
-                    close(sock_fd);
-                    connections_.erase(it);
-                    break;
-                }
+            auto it = slot_of_fd_.find(sock_fd);
+            if (it != slot_of_fd_.end()) {
+                connection = handleOf(it->second);
+                name = slots_[it->second].name;
+                detach(it->second);
             }
         }
         
-        if (!connection_id.empty()) {
-            std::cout << "Connection closed: " << connection_id << std::endl;
+        if (connection != kInvalidConnection) {
+            KERMIT_INFO << "Connection closed: " << name;
             
             // Call connection callback if set
             if (connection_callback_) {
-                connection_callback_(connection_id, false);
+                connection_callback_(connection, false);
             }
+            release(connection);
+        }
+    }
+    
+    ConnectionHandle handleOf(uint32_t index) const {
+        return (static_cast<uint64_t>(slots_[index].generation) << 32) | index;
+    }
+    
+    // Caller holds connections_mutex_
+    ConnectionHandle claimSlot(int sock_fd, const std::string& name) {
+        uint32_t index;
+        if (!free_slots_.empty()) {
+            index = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        }
+        
+        Slot& slot = slots_[index];
+        slot.fd = sock_fd;
+        slot.claimed = true;
+        slot.name = name;
+        slot_of_fd_[sock_fd] = index;
+        return handleOf(index);
+    }
+    
+    // The claimed slot a handle names, or nullptr if it is stale or unknown
+    // Caller holds connections_mutex_
+    Slot* findSlot(ConnectionHandle connection) {
+        uint32_t index = static_cast<uint32_t>(connection);
+        if (index >= slots_.size()) return nullptr;
+        Slot& slot = slots_[index];
+        if (!slot.claimed || slot.generation != static_cast<uint32_t>(connection >> 32)) return nullptr;
+        return &slot;
+    }
+    
+    const Slot* findSlot(ConnectionHandle connection) const {
+        return const_cast<Impl*>(this)->findSlot(connection);
+    }
+    
+    // Close the socket and drop its queues; the slot stays claimed
+    // Caller holds connections_mutex_
+    void detach(uint32_t index) {
+        Slot& slot = slots_[index];
+        close(slot.fd);
+        slot_of_fd_.erase(slot.fd);
+        write_queues_.erase(slot.fd);
+        scheduled_.erase(slot.fd);
+        slot.fd = -1;
+    }
+    
+    // Free a detached slot once its close callback has run
+    void release(ConnectionHandle connection) {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        Slot* slot = findSlot(connection);
+        if (!slot || slot->fd != -1) return;
+        
+        slot->claimed = false;
+        slot->name.clear();
+        if (++slot->generation == 0) {
+            slot->generation = 1;
         }
+        free_slots_.push_back(static_cast<uint32_t>(connection));
     }
     
-    bool connect(const std::string& host, uint16_t port) {
-        std::string connection_id = host + ":" + std::to_string(port);
+    ConnectionHandle connect(const std::string& host, uint16_t port) {
+        std::string name = host + ":" + std::to_string(port);
         
         // Check if already connected
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
-            if (connections_.find(connection_id) != connections_.end()) {
-                std::cerr << "Already connected to " << connection_id << std::endl;
-                return false;
+            for (const Slot& slot : slots_) {
+                if (slot.fd != -1 && slot.name == name) {
+                    KERMIT_ERROR << "Already connected to " << name;
+                    return kInvalidConnection;
+                }
             }
         }
         
-        std::cout << "Connecting to " << connection_id << "..." << std::endl;
+        KERMIT_INFO << "Connecting to " << name << "...";
         
         // Resolve hostname
         addrinfo hints{};
@@ -349,24 +515,24 @@ public:
         int resolve_result = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
         
         if (resolve_result != 0) {
-            std::cerr << "Failed to resolve hostname: " << gai_strerror(resolve_result) << std::endl;
-            return false;
+            KERMIT_ERROR << "Failed to resolve hostname: " << gai_strerror(resolve_result);
+            return kInvalidConnection;
         }
         
         // Create socket
         int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
         if (sock_fd < 0) {
-            std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to create socket: " << strerror(errno);
             freeaddrinfo(result);
-            return false;
+            return kInvalidConnection;
         }
         
         // Set non-blocking
         if (fcntl(sock_fd, F_SETFL, O_NONBLOCK) < 0) {
-            std::cerr << "Failed to set non-blocking: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to set non-blocking: " << strerror(errno);
             close(sock_fd);
             freeaddrinfo(result);
-            return false;
+            return kInvalidConnection;
         }
         
         // Connect
@@ -376,95 +542,198 @@ public:
         freeaddrinfo(result);
         
         if (connect_result < 0 && errno != EINPROGRESS) {
-            std::cerr << "Failed to connect: " << strerror(errno) << std::endl;
+            KERMIT_ERROR << "Failed to connect: " << strerror(errno);
             close(sock_fd);
-            return false;
+            return kInvalidConnection;
         }
         
         // Add to connections
+        ConnectionHandle connection;
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
-            connections_[connection_id] = sock_fd;
+            connection = claimSlot(sock_fd, name);
         }
         
-        std::cout << "Connected to " << connection_id << std::endl;
+        KERMIT_INFO << "Connected to " << name;
         
         // Call connection callback if set
         if (connection_callback_) {
-            connection_callback_(connection_id, true);
+            connection_callback_(connection, true);
         }
         
-        return true;
+        return connection;
     }
     
-    void disconnect(const std::string& connection_id) {
-        int sock_fd = -1;
-        
+    void disconnect(ConnectionHandle connection) {
+        std::string name;
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
-            auto it = connections_.find(connection_id);
-            if (it != connections_.end()) {
-                sock_fd = it->second;
-                connections_.erase(it);
-            }
+            Slot* slot = findSlot(connection);
+            if (!slot || slot->fd == -1) return;
+            name = slot->name;
+            detach(static_cast<uint32_t>(connection));
         }
         
-        if (sock_fd != -1) {
-            close(sock_fd);
-            
-            // Call connection callback if set
-            if (connection_callback_) {
-                connection_callback_(connection_id, false);
-            }
-            
-            std::cout << "Disconnected from " << connection_id << std::endl;
+        // Call connection callback if set
+        if (connection_callback_) {
+            connection_callback_(connection, false);
         }
+        release(connection);
+        
+        KERMIT_INFO << "Disconnected from " << name;
     }
     
-    bool sendData(const std::string& connection_id, const std::vector<uint8_t>& data) {
-        int sock_fd = -1;
+    bool sendData(ConnectionHandle connection, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        int sock_fd;
+        WriteQueue* queue = findQueue(connection, sock_fd);
+        if (!queue) {
+            return false;
+        }
+        const std::string& name = slots_[static_cast<uint32_t>(connection)].name;
+        if (queue->queued() + data.size() > kMaxQueuedBytes) {
+            KERMIT_WARN << "Write queue full for " << name;
+            return false;
+        }
         
-        {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            auto it = connections_.find(connection_id);
-            if (it == connections_.end()) {
-                std::cerr << "Connection " << connection_id << " not found" << std::endl;
-                return false;
-            }
-            sock_fd = it->second;
+        queue->out.insert(queue->out.end(), data.begin(), data.end());
+        if (!flush(sock_fd, *queue)) {
+            return false;
         }
         
-        if (sock_fd == -1) {
+        KERMIT_DEBUG << "Sent " << data.size() << " bytes to " << name;
+        return true;
+    }
+    
+    bool sendCell(ConnectionHandle connection, const Cell& cell) {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        int sock_fd;
+        WriteQueue* queue = findQueue(connection, sock_fd);
+        if (!queue || queue->queued() + kCellSize > kMaxQueuedBytes) {
             return false;
         }
         
-        ssize_t bytes_sent = send(sock_fd, data.data(), data.size(), 0);
+        queue->scheduler.enqueue(cell);
+        if (kist_interval_ms_ > 0) {
+            // Written by the next round; wake the loop if it is not running rounds yet
+            if (scheduled_.insert(sock_fd).second && scheduled_.size() == 1) {
+                wake();
+            }
+            return true;
+        }
+        return flush(sock_fd, *queue);
+    }
+    
+    // Give each scheduled socket what TCP_INFO says it can send soon
+    // Runs on the network thread
+    void runRound() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_round_ < std::chrono::milliseconds(kist_interval_ms_)) return;
+        last_round_ = now;
         
-        if (bytes_sent < 0) {
-            if (errno != EWOULDBLOCK && errno != EAGAIN) {
-                std::cerr << "Send error: " << strerror(errno) << std::endl;
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto it = scheduled_.begin(); it != scheduled_.end();) {
+            auto queue_it = write_queues_.find(*it);
+            if (queue_it == write_queues_.end()) {
+                it = scheduled_.erase(it);
+                continue;
+            }
+            WriteQueue& queue = *queue_it->second;
+            
+            size_t limit = CircuitScheduler::socketWriteLimit(*it);
+            size_t unwritten = queue.unwritten();
+            Cell cell;
+            while (unwritten + kCellSize <= limit && queue.scheduler.next(cell)) {
+                cell.appendTo(queue.out);
+                unwritten += kCellSize;
+            }
+            
+            // Errors surface as POLLERR or POLLHUP on the next poll
+            flush(*it, queue);
+            if (queue.scheduler.getQueuedCells() == 0) {
+                it = scheduled_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    void wake() {
+        if (wake_fd_ == -1) return;
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd_, &one, sizeof(one));
+        (void)written;
+    }
+    
+    // Caller holds connections_mutex_
+    WriteQueue* findQueue(ConnectionHandle connection, int& sock_fd) {
+        Slot* slot = findSlot(connection);
+        if (!slot || slot->fd == -1) {
+            KERMIT_ERROR << "Connection " << connection << " not found";
+            return nullptr;
+        }
+        
+        sock_fd = slot->fd;
+        std::unique_ptr<WriteQueue>& queue = write_queues_[sock_fd];
+        if (!queue) {
+            queue = std::make_unique<WriteQueue>();
+        }
+        return queue.get();
+    }
+    
+    // Write as much of the queue as the socket takes, refilling from the
+    // scheduler a few cells at a time unless KIST rounds do that; returns
+    // false on a write error
+    // Caller holds connections_mutex_
+    bool flush(int sock_fd, WriteQueue& queue) {
+        while (true) {
+            if (queue.out_off == queue.out.size()) {
+                queue.out.clear();
+                queue.out_off = 0;
+                if (kist_interval_ms_ > 0) break;
+                Cell cell;
+                for (size_t i = 0; i < kScheduleBatch && queue.scheduler.next(cell); ++i) {
+                    cell.appendTo(queue.out);
+                }
+                if (queue.out.empty()) break;
+            }
+            
+            ssize_t n = send(sock_fd, queue.out.data() + queue.out_off, queue.out.size() - queue.out_off,
+                             MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EWOULDBLOCK || errno == EAGAIN) break;
+                // The poll loop reports the connection as closed
+                KERMIT_ERROR << "Send error: " << strerror(errno);
                 return false;
             }
-            // Would be blocked, but we'll try again later
-            return true;
+            queue.out_off += static_cast<size_t>(n);
         }
         
-        if (bytes_sent < static_cast<ssize_t>(data.size())) {
-            std::cout << "Partial send: " << bytes_sent << "/" << data.size() << " bytes" << std::endl;
-            // TODO: Handle partial sends
+        if (queue.out_off > queue.out.size() / 2) {
+            queue.out.erase(queue.out.begin(), queue.out.begin() + queue.out_off);
+            queue.out_off = 0;
         }
         
-        std::cout << "Sent " << bytes_sent << " bytes to " << connection_id << std::endl;
+        // The poll loop only adds POLLOUT when it rebuilds its set
+        if (queue.unwritten() > 0 && !queue.polling) {
+            queue.polling = true;
+            wake();
+        }
         return true;
     }
     
-    std::vector<uint8_t> receiveData(const std::string& connection_id) {
+    std::vector<uint8_t> receiveData(ConnectionHandle connection) {
         // In our implementation, data is handled via callbacks in the network loop
         // This method could be used for synchronous reads if needed
-        std::cerr << "receiveData not implemented - use callbacks instead" << std::endl;
+        KERMIT_ERROR << "receiveData not implemented - use callbacks instead";
         return {};
     }
     
+    void setKistInterval(uint32_t interval_ms) {
+        kist_interval_ms_ = interval_ms;
+    }
+    
     void setConnectionCallback(ConnectionCallback callback) {
         connection_callback_ = callback;
     }
@@ -473,20 +742,27 @@ public:
         data_callback_ = callback;
     }
     
-    std::vector<std::string> getActiveConnections() const {
+    std::vector<ConnectionHandle> getActiveConnections() const {
         std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(connections_mutex_));
         
-        std::vector<std::string> active_connections;
-        for (const auto& conn : connections_) {
-            active_connections.push_back(conn.first);
+        std::vector<ConnectionHandle> active_connections;
+        for (const auto& entry : slot_of_fd_) {
+            active_connections.push_back(handleOf(entry.second));
         }
         
         return active_connections;
     }
     
-    bool isConnected(const std::string& connection_id) const {
+    bool isConnected(ConnectionHandle connection) const {
+        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(connections_mutex_));
+        const Slot* slot = findSlot(connection);
+        return slot && slot->fd != -1;
+    }
+    
+    std::string getConnectionName(ConnectionHandle connection) const {
         std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(connections_mutex_));
-        return connections_.find(connection_id) != connections_.end();
+        const Slot* slot = findSlot(connection);
+        return slot ? slot->name : std::string();
     }
 };
 
@@ -507,20 +783,28 @@ void NetworkManager::stop() {
     impl_->stop();
 }
 
-bool NetworkManager::connect(const std::string& host, uint16_t port) {
+ConnectionHandle NetworkManager::connect(const std::string& host, uint16_t port) {
     return impl_->connect(host, port);
 }
 
-void NetworkManager::disconnect(const std::string& connection_id) {
-    impl_->disconnect(connection_id);
+void NetworkManager::disconnect(ConnectionHandle connection) {
+    impl_->disconnect(connection);
+}
+
+bool NetworkManager::sendData(ConnectionHandle connection, const std::vector<uint8_t>& data) {
+    return impl_->sendData(connection, data);
 }
 
-bool NetworkManager::sendData(const std::string& connection_id, const std::vector<uint8_t>& data) {
-    return impl_->sendData(connection_id, data);
+bool NetworkManager::sendCell(ConnectionHandle connection, const Cell& cell) {
+    return impl_->sendCell(connection, cell);
 }
 
-std::vector<uint8_t> NetworkManager::receiveData(const std::string& connection_id) {
-    return impl_->receiveData(connection_id);
+std::vector<uint8_t> NetworkManager::receiveData(ConnectionHandle connection) {
+    return impl_->receiveData(connection);
+}
+
+void NetworkManager::setKistInterval(uint32_t interval_ms) {
+    impl_->setKistInterval(interval_ms);
 }
 
 void NetworkManager::setConnectionCallback(ConnectionCallback callback) {
@@ -531,12 +815,16 @@ void NetworkManager::setDataCallback(DataCallback callback) {
     impl_->setDataCallback(callback);
 }
 
-std::vector<std::string> NetworkManager::getActiveConnections() const {
+std::vector<ConnectionHandle> NetworkManager::getActiveConnections() const {
     return impl_->getActiveConnections();
 }
 
-bool NetworkManager::isConnected(const std::string& connection_id) const {
-    return impl_->isConnected(connection_id);
+bool NetworkManager::isConnected(ConnectionHandle connection) const {
+    return impl_->isConnected(connection);
+}
+
+std::string NetworkManager::getConnectionName(ConnectionHandle connection) const {
+    return impl_->getConnectionName(connection);
 }
 
 } // namespace kermit
\ No newline at end of file
@@ -1,61 +1,135 @@
 #include "kermit/node_manager.h"
 #include "kermit/network.h"
-#include <iostream>
+#include "kermit/alias_table.h"
+#include "kermit/channel_pool.h"
+#include "kermit/event_loop.h"
+#include "kermit/log.h"
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <mutex>
 #include <random>
 #include <sstream>
+#include <thread>
 #include <algorithm>
+#include <array>
 
 namespace kermit {
 
+// RelaySnapshot lookups
+size_t RelaySnapshot::indexOf(const std::string& node_id) const {
+    // The directory keeps ids contiguous, so the search stays out of the nodes
+    return directory.find(node_id);
+}
+
+std::shared_ptr<RelayNode> RelaySnapshot::find(const std::string& node_id) const {
+    size_t index = indexOf(node_id);
+    return index < nodes.size() ? nodes[index] : nullptr;
+}
+
+bool RelaySnapshot::isConnected(const std::string& node_id) const {
+    size_t index = indexOf(node_id);
+    return index < nodes.size() && connected[index];
+}
+
+std::shared_ptr<RelayNode> RelaySnapshot::pick(Selection selection, uint64_t random_bits) const {
+    const auto& table = selection_tables[selection];
+    if (table.empty()) {
+        return nullptr;
+    }
+    return nodes[selection_nodes[selection][table.sample(random_bits)]];
+}
+
 // NodeManager implementation
 class NodeManager::Impl {
 public:
+    // Writer-side state, guarded by nodes_mutex_
     std::map<std::string, std::shared_ptr<RelayNode>> nodes_;
-    std::map<std::string, bool> connected_nodes_;
+    std::unordered_map<RelayId, bool> connected_nodes_;
     std::mutex nodes_mutex_;
-    std::shared_ptr<NetworkManager> network_manager_;
     
-    Impl() {
-        network_manager_ = std::make_unique<NetworkManager>();
-    }
+    // Published view for readers, swapped with atomic_store on every change
+    std::shared_ptr<const RelaySnapshot> snapshot_;
+    
+    // Relay channels live on their own loop; connected_nodes_ follows the
+    // pool's state callbacks, so a dead channel clears the flag
+    EventLoop channel_loop_;
+    std::thread channel_thread_;
+    std::unique_ptr<ChannelPool> channel_pool_;
+    
+    Impl() : snapshot_(std::make_shared<RelaySnapshot>()) {}
     
     ~Impl() {
-        // Disconnect from all nodes
-        std::lock_guard<std::mutex> lock(nodes_mutex_);
-        for (auto& conn : connected_nodes_) {
-            if (conn.second) {
-                network_manager_->disconnect(conn.first);
-            }
+        // Stop dispatching before closing channels; state callbacks take nodes_mutex_
+        if (channel_thread_.joinable()) {
+            channel_loop_.stop();
+            channel_thread_.join();
         }
-        connected_nodes_.clear();
+        channel_pool_.reset();
     }
     
-    bool initialize() {
-        // Initialize network manager
-        if (!network_manager_->initialize(0, "0.0.0.0")) {
-            std::cerr << "Failed to initialize network manager" << std::endl;
+    bool initialize(const ChannelPoolConfig& channel_config) {
+        if (channel_pool_) {
+            KERMIT_ERROR << "Node manager is already initialized";
+            return false;
+        }
+        
+        if (!channel_loop_.initialize()) {
+            KERMIT_ERROR << "Failed to initialize channel event loop";
             return false;
         }
         
-        if (!network_manager_->start()) {
-            std::cerr << "Failed to start network manager" << std::endl;
+        auto pool = std::make_unique<ChannelPool>(channel_loop_, channel_config);
+        pool->setStateCallback([this](RelayId relay, bool up) {
+            onChannelState(relay, up);
+        });
+        if (!pool->start()) {
+            KERMIT_ERROR << "Failed to start relay channel pool";
             return false;
         }
         
-        std::cout << "Node manager initialized" << std::endl;
+        channel_pool_ = std::move(pool);
+        channel_thread_ = std::thread([this] { channel_loop_.run(); });
+        
+        KERMIT_INFO << "Node manager initialized";
         return true;
     }
     
+    // Runs on the channel loop thread
+    void onChannelState(RelayId relay, bool up) {
+        std::lock_guard<std::mutex> lock(nodes_mutex_);
+        
+        auto it = connected_nodes_.find(relay);
+        if (it == connected_nodes_.end() || it->second == up) {
+            return;
+        }
+        
+        it->second = up;
+        publishSnapshot();
+        
+        if (up) {
+            KERMIT_INFO << "Connected to relay node " << RelayIds::name(relay);
+        } else {
+            KERMIT_WARN << "Lost all channels to relay node " << RelayIds::name(relay) << ", reconnecting";
+        }
+    }
+    
     bool addRelayNode(const std::string& node_id, const std::string& address, uint16_t port, bool trusted) {
         std::lock_guard<std::mutex> lock(nodes_mutex_);
         
+        if (!addRelayNodeLocked(node_id, address, port, trusted)) {
+            return false;
+        }
+        
+        publishSnapshot();
+        return true;
+    }
+    
+    bool addRelayNodeLocked(const std::string& node_id, const std::string& address, uint16_t port, bool trusted) {
         // Check if node already exists
         if (nodes_.find(node_id) != nodes_.end()) {
-            std::cerr << "Node " << node_id << " already exists" << std::endl;
+            KERMIT_ERROR << "Node " << node_id << " already exists";
             return false;
         }
         
@@ -64,36 +138,78 @@ public:
         node->setTrusted(trusted);
         
         nodes_[node_id] = node;
-        connected_nodes_[node_id] = false;
+        connected_nodes_[node->getRelayId()] = false;
         
-        std::cout << "Added relay node " << node_id << " at " 
-                  << address << ":" << port 
-                  << (trusted ? " (trusted)" : "") << std::endl;
+        KERMIT_INFO << "Added relay node " << node_id << " at " 
+                    << address << ":" << port 
+                    << (trusted ? " (trusted)" : "");
         
         return true;
     }
     
+    size_t bulkInstall(const std::vector<RelayDescriptor>& relays) {
+        std::lock_guard<std::mutex> lock(nodes_mutex_);
+        
+        size_t installed = 0;
+        std::string node_id;
+        for (const auto& relay : relays) {
+            if (relay.host.empty() || relay.port == 0) continue;
+            
+            node_id.assign(relay.host).append(":").append(std::to_string(relay.port));
+            auto& slot = nodes_[node_id];
+            
+            // Published nodes are immutable; an update gets a fresh node that
+            // keeps trust granted by the config
+            bool trusted = (relay.flags & RelayDirectory::TRUSTED) || (slot && slot->isTrusted());
+            auto node = std::make_shared<RelayNode>(node_id, relay.host, relay.port);
+            node->setTrusted(trusted);
+            node->setListed(true);
+            node->setGuardNode(relay.flags & RelayDirectory::GUARD);
+            node->setExitNode(relay.flags & RelayDirectory::EXIT);
+            node->setSupportsHiddenServices(relay.flags & RelayDirectory::HIDDEN_SERVICES);
+            node->setBandwidth(relay.bandwidth);
+            node->setLatency(relay.latency_us ? relay.latency_us : (slot ? slot->getLatency() : 0));
+            if (slot) {
+                node->setFailureRate(slot->getFailureRate());
+                node->setMeasuredThroughput(slot->getMeasuredThroughput());
+            }
+            
+            slot = node;
+            connected_nodes_.emplace(node->getRelayId(), false);
+            installed++;
+        }
+        
+        publishSnapshot();
+        return installed;
+    }
+    
     bool addRelayNodeFromString(const std::string& node_address, bool trusted) {
+        std::string host;
+        uint16_t port;
+        if (!parseNodeAddress(node_address, host, port)) {
+            return false;
+        }
+        
+        // Use host:port as node ID for simplicity
+        return addRelayNode(node_address, host, port, trusted);
+    }
+    
+    static bool parseNodeAddress(const std::string& node_address, std::string& host, uint16_t& port) {
         size_t colon_pos = node_address.find(':');
         if (colon_pos == std::string::npos) {
-            std::cerr << "Invalid node address format: " << node_address 
-                      << " (expected host:port)" << std::endl;
+            KERMIT_ERROR << "Invalid node address format: " << node_address 
+                         << " (expected host:port)";
             return false;
         }
         
-        std::string host = node_address.substr(0, colon_pos);
+        host = node_address.substr(0, colon_pos);
         std::string port_str = node_address.substr(colon_pos + 1);
         
         try {
-            uint16_t port = static_cast<uint16_t>(std::stoi(port_str));
-            
-            // Use host:port as node ID for simplicity
-            std::string node_id = host + ":" + port_str;
-            
-            return addRelayNode(node_id, host, port, trusted);
-            
+            port = static_cast<uint16_t>(std::stoi(port_str));
+            return true;
         } catch (const std::exception& e) {
-            std::cerr << "Invalid port number: " << port_str << std::endl;
+            KERMIT_ERROR << "Invalid port number: " << port_str;
             return false;
         }
     }
@@ -103,100 +219,201 @@ public:
         
         auto node_it = nodes_.find(node_id);
         if (node_it == nodes_.end()) {
-            std::cerr << "Node " << node_id << " not found" << std::endl;
+            KERMIT_ERROR << "Node " << node_id << " not found";
             return false;
         }
         
-        // Disconnect if connected
-        auto conn_it = connected_nodes_.find(node_id);
-        if (conn_it != connected_nodes_.end() && conn_it->second) {
-            network_manager_->disconnect(node_id);
+        // Close its channels, open or still connecting
+        RelayId relay = node_it->second->getRelayId();
+        if (channel_pool_) {
+            channel_pool_->removeRelay(relay);
         }
         
         nodes_.erase(node_it);
-        connected_nodes_.erase(conn_it);
+        connected_nodes_.erase(relay);
+        publishSnapshot();
         
-        std::cout << "Removed relay node " << node_id << std::endl;
+        KERMIT_INFO << "Removed relay node " << node_id;
         return true;
     }
     
-    std::shared_ptr<RelayNode> getRelayNode(const std::string& node_id) {
+    std::shared_ptr<const RelaySnapshot> getSnapshot() const {
+        return std::atomic_load(&snapshot_);
+    }
+    
+    std::shared_ptr<RelayNode> getRandomRelayNode(RelaySnapshot::Selection selection) const {
+        return getSnapshot()->pick(selection, nextRandom());
+    }
+    
+    bool setRelayNodeBandwidth(const std::string& node_id, uint32_t bandwidth) {
         std::lock_guard<std::mutex> lock(nodes_mutex_);
         
         auto it = nodes_.find(node_id);
         if (it == nodes_.end()) {
-            return nullptr;
+            return false;
         }
         
-        return it->second;
+        // Published nodes are immutable; replace rather than modify
+        auto node = cloneNode(*it->second);
+        node->setBandwidth(bandwidth);
+        it->second = node;
+        publishSnapshot();
+        return true;
     }
     
-    std::vector<std::shared_ptr<RelayNode>> getAllRelayNodes() const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(nodes_mutex_));
+    bool setRelayNodeCapabilities(const std::string& node_id, bool guard, bool exit, bool hidden_services) {
+        std::lock_guard<std::mutex> lock(nodes_mutex_);
         
-        std::vector<std::shared_ptr<RelayNode>> all_nodes;
-        for (const auto& node : nodes_) {
-            all_nodes.push_back(node.second);
+        auto it = nodes_.find(node_id);
+        if (it == nodes_.end()) {
+            return false;
         }
         
-        return all_nodes;
+        auto node = cloneNode(*it->second);
+        node->setGuardNode(guard);
+        node->setExitNode(exit);
+        node->setSupportsHiddenServices(hidden_services);
+        it->second = node;
+        publishSnapshot();
+        return true;
+    }
+    
+    static std::shared_ptr<RelayNode> cloneNode(const RelayNode& source) {
+        auto node = std::make_shared<RelayNode>(source.getNodeId(), source.getAddress(), source.getPort());
+        node->setTrusted(source.isTrusted());
+        node->setListed(source.isListed());
+        node->setGuardNode(source.isGuardNode());
+        node->setExitNode(source.isExitNode());
+        node->setSupportsHiddenServices(source.supportsHiddenServices());
+        node->setBandwidth(source.getBandwidth());
+        node->setLatency(source.getLatency());
+        node->setFailureRate(source.getFailureRate());
+        node->setMeasuredThroughput(source.getMeasuredThroughput());
+        return node;
     }
     
-    std::vector<std::shared_ptr<RelayNode>> getTrustedRelayNodes() const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(nodes_mutex_));
+    // Build a snapshot from the writer-side state and swap it in
+    // Caller holds nodes_mutex_
+    void publishSnapshot() {
+        auto snapshot = std::make_shared<RelaySnapshot>();
+        snapshot->version = std::atomic_load(&snapshot_)->version + 1;
+        snapshot->nodes.reserve(nodes_.size());
+        snapshot->connected.reserve(nodes_.size());
+        snapshot->directory.reserve(nodes_.size());
+        
+        // std::map iteration is already sorted by node id
+        for (const auto& entry : nodes_) {
+            const auto& node = entry.second;
+            auto conn_it = connected_nodes_.find(node->getRelayId());
+            bool connected = conn_it != connected_nodes_.end() && conn_it->second;
+            
+            snapshot->nodes.push_back(node);
+            snapshot->connected.push_back(connected ? 1 : 0);
+            if (connected) snapshot->connected_count++;
+            if (node->isTrusted()) snapshot->trusted_nodes.push_back(node);
+            
+            snapshot->directory.append(node->getNodeId(), node->getAddress(), node->getPort(),
+                                       node->getBandwidth(), selectionWeight(*node), node->getLatency(),
+                                       directoryFlags(*node, connected));
+        }
         
-        std::vector<std::shared_ptr<RelayNode>> trusted_nodes;
-        for (const auto& node : nodes_) {
-            if (node.second->isTrusted()) {
-                trusted_nodes.push_back(node.second);
+        std::vector<double> weights;
+        weights.reserve(nodes_.size());
+        for (int selection = 0; selection < RelaySnapshot::SELECT_COUNT; ++selection) {
+            auto& indices = snapshot->selection_nodes[selection];
+            weights.clear();
+            
+            for (size_t i = 0; i < snapshot->nodes.size(); ++i) {
+                const auto& node = *snapshot->nodes[i];
+                if (!matchesSelection(node, static_cast<RelaySnapshot::Selection>(selection))) continue;
+                
+                indices.push_back(static_cast<uint32_t>(i));
+                weights.push_back(static_cast<double>(snapshot->directory.weight(i)));
             }
+            
+            snapshot->selection_tables[selection].build(weights);
         }
         
-        return trusted_nodes;
+        std::atomic_store(&snapshot_, std::shared_ptr<const RelaySnapshot>(std::move(snapshot)));
     }
     
-    std::shared_ptr<RelayNode> getRandomRelayNode() const {
-        auto all_nodes = getAllRelayNodes();
-        if (all_nodes.empty()) {
-            return nullptr;
+    // Bandwidth in milli-units, scaled by the probe success rate and by
+    // kLatencyReferenceUs / (kLatencyReferenceUs + latency); unmeasured
+    // relays keep their full bandwidth so they still get picked and probed
+    static uint32_t selectionWeight(const RelayNode& node) {
+        static constexpr double kLatencyReferenceUs = 20000.0;
+        
+        double weight = node.getBandwidth() * 1000.0 * (1.0 - node.getFailureRate());
+        if (node.getLatency() > 0) {
+            weight *= kLatencyReferenceUs / (kLatencyReferenceUs + node.getLatency());
         }
-        
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, all_nodes.size() - 1);
-        
-        return all_nodes[dis(gen)];
+        return static_cast<uint32_t>(std::min(weight, 4294967295.0));
     }
     
-    std::shared_ptr<RelayNode> getRandomTrustedRelayNode() const {
-        auto trusted_nodes = getTrustedRelayNodes();
-        if (trusted_nodes.empty()) {
-            return nullptr;
-        }
+    size_t recordMeasurements(const std::vector<RelayMeasurement>& measurements, double alpha) {
+        std::lock_guard<std::mutex> lock(nodes_mutex_);
         
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, trusted_nodes.size() - 1);
+        size_t updated = 0;
+        for (const auto& m : measurements) {
+            auto it = nodes_.find(m.node_id);
+            if (it == nodes_.end()) continue;
+            
+            auto node = cloneNode(*it->second);
+            node->setFailureRate(alpha * (m.success ? 0.0 : 1.0) + (1.0 - alpha) * node->getFailureRate());
+            
+            if (m.success) {
+                // The first sample seeds the average; 0 stays reserved for unmeasured
+                double rtt = node->getLatency() == 0 ? m.rtt_us
+                             : alpha * m.rtt_us + (1.0 - alpha) * node->getLatency();
+                node->setLatency(std::max<uint32_t>(static_cast<uint32_t>(rtt), 1));
+                
+                if (m.throughput > 0) {
+                    double throughput = node->getMeasuredThroughput() == 0 ? m.throughput
+                                        : alpha * m.throughput + (1.0 - alpha) * node->getMeasuredThroughput();
+                    node->setMeasuredThroughput(static_cast<uint32_t>(throughput));
+                }
+            }
+            
+            it->second = node;
+            updated++;
+        }
         
-        return trusted_nodes[dis(gen)];
+        if (updated > 0) {
+            publishSnapshot();
+        }
+        return updated;
     }
     
-    size_t getRelayNodeCount() const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(nodes_mutex_));
-        return nodes_.size();
+    static uint8_t directoryFlags(const RelayNode& node, bool connected) {
+        uint8_t flags = 0;
+        if (node.isTrusted()) flags |= RelayDirectory::TRUSTED;
+        if (node.isListed()) flags |= RelayDirectory::LISTED;
+        if (node.isGuardNode()) flags |= RelayDirectory::GUARD;
+        if (node.isExitNode()) flags |= RelayDirectory::EXIT;
+        if (node.supportsHiddenServices()) flags |= RelayDirectory::HIDDEN_SERVICES;
+        if (connected) flags |= RelayDirectory::CONNECTED;
+        return flags;
     }
     
-    size_t getTrustedRelayNodeCount() const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(nodes_mutex_));
-        
-        size_t count = 0;
-        for (const auto& node : nodes_) {
-            if (node.second->isTrusted()) {
-                count++;
-            }
+    std::shared_ptr<RelayNode> selectRelayNode(uint8_t required, uint8_t forbidden, uint32_t max_latency_us) const {
+        auto snapshot = getSnapshot();
+        size_t index = snapshot->directory.pickWeighted(required, forbidden, max_latency_us, nextRandom());
+        return index < snapshot->nodes.size() ? snapshot->nodes[index] : nullptr;
+    }
+    
+    static bool matchesSelection(const RelayNode& node, RelaySnapshot::Selection selection) {
+        switch (selection) {
+            case RelaySnapshot::SELECT_TRUSTED: return node.isTrusted();
+            case RelaySnapshot::SELECT_GUARD: return node.isGuardNode();
+            case RelaySnapshot::SELECT_EXIT: return node.isExitNode();
+            case RelaySnapshot::SELECT_HIDDEN_SERVICES: return node.supportsHiddenServices();
+            default: return true;
         }
-        
-        return count;
+    }
+    
+    static uint64_t nextRandom() {
+        thread_local std::mt19937_64 gen(std::random_device{}());
+        return gen();
     }
     
     bool connectToRelayNode(const std::string& node_id) {
@@ -204,63 +421,57 @@ public:
         
         auto node_it = nodes_.find(node_id);
         if (node_it == nodes_.end()) {
-            std::cerr << "Node " << node_id << " not found" << std::endl;
+            KERMIT_ERROR << "Node " << node_id << " not found";
             return false;
         }
         
-        auto conn_it = connected_nodes_.find(node_id);
-        if (conn_it != connected_nodes_.end() && conn_it->second) {
-            std::cout << "Already connected to " << node_id << std::endl;
-            return true;
+        if (!channel_pool_) {
+            KERMIT_ERROR << "Cannot connect to " << node_id << ": node manager is not initialized";
+            return false;
         }
         
-        // Connect to the node
+        // Channels open in the background; the connected flag flips when
+        // the first one completes its handshake
         auto node = node_it->second;
-        bool success = network_manager_->connect(node->getAddress(), node->getPort());
-        
-        if (success) {
-            connected_nodes_[node_id] = true;
-            std::cout << "Connected to relay node " << node_id << std::endl;
-        } else {
-            std::cerr << "Failed to connect to " << node_id << std::endl;
-        }
-        
-        return success;
+        channel_pool_->addRelay(node->getRelayId(), node->getAddress(), node->getPort());
+        return true;
     }
     
     void disconnectFromRelayNode(const std::string& node_id) {
         std::lock_guard<std::mutex> lock(nodes_mutex_);
         
-        auto conn_it = connected_nodes_.find(node_id);
+        RelayId relay = RelayIds::find(node_id);
+        if (channel_pool_) {
+            channel_pool_->removeRelay(relay);
+        }
+        
+        auto conn_it = connected_nodes_.find(relay);
         if (conn_it == connected_nodes_.end() || !conn_it->second) {
             return;
         }
         
-        network_manager_->disconnect(node_id);
-        connected_nodes_[node_id] = false;
-        
-        std::cout << "Disconnected from relay node " << node_id << std::endl;
-    }
-    
-    bool isConnectedToRelayNode(const std::string& node_id) const {
-        std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(nodes_mutex_));
+        conn_it->second = false;
+        publishSnapshot();
         
-        auto it = connected_nodes_.find(node_id);
-        return it != connected_nodes_.end() && it->second;
+        KERMIT_INFO << "Disconnected from relay node " << node_id;
     }
     
     void loadFromConfig(const std::vector<std::string>& trusted_relays) {
         std::lock_guard<std::mutex> lock(nodes_mutex_);
         
-        std::cout << "Loading " << trusted_relays.size() << " trusted relay nodes from config..." << std::endl;
+        KERMIT_INFO << "Loading " << trusted_relays.size() << " trusted relay nodes from config...";
         
         for (const auto& relay_addr : trusted_relays) {
-            if (!relay_addr.empty() && relay_addr.find(':') != std::string::npos) {
-                addRelayNodeFromString(relay_addr, true);
+            std::string host;
+            uint16_t port;
+            if (!relay_addr.empty() && parseNodeAddress(relay_addr, host, port) &&
+                addRelayNodeLocked(relay_addr, host, port, true)) {
+                nodes_[relay_addr]->setListed(true);
             }
         }
+        publishSnapshot();
         
-        std::cout << "Loaded " << nodes_.size() << " relay nodes" << std::endl;
+        KERMIT_INFO << "Loaded " << nodes_.size() << " relay nodes";
     }
 };
 
@@ -269,8 +480,8 @@ NodeManager::NodeManager() : impl_(std::make_unique<Impl>()) {}
 
 NodeManager::~NodeManager() = default;
 
-bool NodeManager::initialize() {
-    return impl_->initialize();
+bool NodeManager::initialize(const ChannelPoolConfig& channel_config) {
+    return impl_->initialize(channel_config);
 }
 
 bool NodeManager::addRelayNode(const std::string& node_id, const std::string& address, uint16_t port, bool trusted) {
@@ -281,36 +492,69 @@ bool NodeManager::addRelayNodeFromString(const std::string& node_address, bool t
     return impl_->addRelayNodeFromString(node_address, trusted);
 }
 
+size_t NodeManager::bulkInstall(const std::vector<RelayDescriptor>& relays) {
+    return impl_->bulkInstall(relays);
+}
+
 bool NodeManager::removeRelayNode(const std::string& node_id) {
     return impl_->removeRelayNode(node_id);
 }
 
 std::shared_ptr<RelayNode> NodeManager::getRelayNode(const std::string& node_id) {
-    return impl_->getRelayNode(node_id);
+    return impl_->getSnapshot()->find(node_id);
 }
 
 std::vector<std::shared_ptr<RelayNode>> NodeManager::getAllRelayNodes() const {
-    return impl_->getAllRelayNodes();
+    return impl_->getSnapshot()->nodes;
 }
 
 std::vector<std::shared_ptr<RelayNode>> NodeManager::getTrustedRelayNodes() const {
-    return impl_->getTrustedRelayNodes();
+    return impl_->getSnapshot()->trusted_nodes;
 }
 
 std::shared_ptr<RelayNode> NodeManager::getRandomRelayNode() const {
-    return impl_->getRandomRelayNode();
+    return impl_->getRandomRelayNode(RelaySnapshot::SELECT_ANY);
 }
 
 std::shared_ptr<RelayNode> NodeManager::getRandomTrustedRelayNode() const {
-    return impl_->getRandomTrustedRelayNode();
+    return impl_->getRandomRelayNode(RelaySnapshot::SELECT_TRUSTED);
+}
+
+std::shared_ptr<RelayNode> NodeManager::getRandomGuardNode() const {
+    return impl_->getRandomRelayNode(RelaySnapshot::SELECT_GUARD);
+}
+
+std::shared_ptr<RelayNode> NodeManager::getRandomExitNode() const {
+    return impl_->getRandomRelayNode(RelaySnapshot::SELECT_EXIT);
+}
+
+std::shared_ptr<RelayNode> NodeManager::getRandomHiddenServiceNode() const {
+    return impl_->getRandomRelayNode(RelaySnapshot::SELECT_HIDDEN_SERVICES);
+}
+
+std::shared_ptr<RelayNode> NodeManager::selectRelayNode(uint8_t required_flags, uint8_t forbidden_flags,
+                                                        uint32_t max_latency_us) const {
+    return impl_->selectRelayNode(required_flags, forbidden_flags, max_latency_us);
+}
+
+size_t NodeManager::recordMeasurements(const std::vector<RelayMeasurement>& measurements, double alpha) {
+    return impl_->recordMeasurements(measurements, alpha);
+}
+
+bool NodeManager::setRelayNodeBandwidth(const std::string& node_id, uint32_t bandwidth) {
+    return impl_->setRelayNodeBandwidth(node_id, bandwidth);
+}
+
+bool NodeManager::setRelayNodeCapabilities(const std::string& node_id, bool guard, bool exit, bool hidden_services) {
+    return impl_->setRelayNodeCapabilities(node_id, guard, exit, hidden_services);
 }
 
 size_t NodeManager::getRelayNodeCount() const {
-    return impl_->getRelayNodeCount();
+    return impl_->getSnapshot()->nodes.size();
 }
 
 size_t NodeManager::getTrustedRelayNodeCount() const {
-    return impl_->getTrustedRelayNodeCount();
+    return impl_->getSnapshot()->trusted_nodes.size();
 }
 
 bool NodeManager::connectToRelayNode(const std::string& node_id) {
@@ -322,7 +566,27 @@ void NodeManager::disconnectFromRelayNode(const std::string& node_id) {
 }
 
 bool NodeManager::isConnectedToRelayNode(const std::string& node_id) const {
-    return impl_->isConnectedToRelayNode(node_id);
+    return impl_->getSnapshot()->isConnected(node_id);
+}
+
+ChannelPool::ChannelId NodeManager::acquireChannel(const std::string& node_id) const {
+    return acquireChannel(RelayIds::find(node_id));
+}
+
+ChannelPool::ChannelId NodeManager::acquireChannel(RelayId relay) const {
+    return impl_->channel_pool_ ? impl_->channel_pool_->acquire(relay) : ChannelPool::kInvalidChannel;
+}
+
+ChannelPool* NodeManager::getChannelPool() {
+    return impl_->channel_pool_.get();
+}
+
+EventLoop* NodeManager::getEventLoop() {
+    return impl_->channel_pool_ ? &impl_->channel_loop_ : nullptr;
+}
+
+std::shared_ptr<const RelaySnapshot> NodeManager::getSnapshot() const {
+    return impl_->getSnapshot();
 }
 
 void NodeManager::loadFromConfig(const std::vector<std::string>& trusted_relays) {
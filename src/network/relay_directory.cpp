@@ -0,0 +1,140 @@
+#include "kermit/relay_directory.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <arpa/inet.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace kermit {
+
+void RelayDirectory::reserve(size_t count) {
+    ids_.reserve(count);
+    hosts_.reserve(count);
+    ipv4_.reserve(count);
+    ports_.reserve(count);
+    bandwidth_.reserve(count);
+    weight_.reserve(count);
+    latency_.reserve(count);
+    flags_.reserve(count);
+    pool_.reserve(count * 32);
+}
+
+RelayDirectory::StringRef RelayDirectory::intern(std::string_view value) {
+    StringRef ref{static_cast<uint32_t>(pool_.size()), static_cast<uint32_t>(value.size())};
+    pool_.append(value.data(), value.size());
+    return ref;
+}
+
+void RelayDirectory::append(std::string_view node_id, std::string_view host, uint16_t port,
+                            uint32_t bandwidth, uint32_t weight, uint32_t latency_us, uint8_t flags) {
+    ids_.push_back(intern(node_id));
+    hosts_.push_back(intern(host));
+
+    in_addr addr{};
+    std::string host_str(host);
+    ipv4_.push_back(inet_pton(AF_INET, host_str.c_str(), &addr) == 1 ? ntohl(addr.s_addr) : 0);
+
+    ports_.push_back(port);
+    bandwidth_.push_back(bandwidth);
+    weight_.push_back(weight);
+    latency_.push_back(latency_us);
+    flags_.push_back(flags);
+}
+
+size_t RelayDirectory::find(std::string_view node_id) const {
+    size_t lo = 0;
+    size_t hi = ids_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (view(ids_[mid]) < node_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < ids_.size() && view(ids_[lo]) == node_id) ? lo : ids_.size();
+}
+
+template <typename Visitor>
+void RelayDirectory::scan(uint8_t required, uint8_t forbidden, Visitor&& visit) const {
+    const uint8_t mask = required | forbidden;
+    const size_t n = flags_.size();
+    const uint8_t* flags = flags_.data();
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // (flags & mask) == required, sixteen relays per compare
+    const __m128i mask_v = _mm_set1_epi8(static_cast<char>(mask));
+    const __m128i want_v = _mm_set1_epi8(static_cast<char>(required));
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i));
+        __m128i hit = _mm_cmpeq_epi8(_mm_and_si128(block, mask_v), want_v);
+        uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        while (bits) {
+            visit(i + __builtin_ctz(bits));
+            bits &= bits - 1;
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        if ((flags[i] & mask) == required) {
+            visit(i);
+        }
+    }
+}
+
+size_t RelayDirectory::countMatching(uint8_t required, uint8_t forbidden) const {
+    size_t count = 0;
+    scan(required, forbidden, [&count](size_t) { ++count; });
+    return count;
+}
+
+void RelayDirectory::filter(uint8_t required, uint8_t forbidden, std::vector<uint32_t>& out) const {
+    out.clear();
+    scan(required, forbidden, [&out](size_t index) { out.push_back(static_cast<uint32_t>(index)); });
+}
+
+size_t RelayDirectory::pickWeighted(uint8_t required, uint8_t forbidden, uint32_t max_latency_us,
+                                    uint64_t random_bits) const {
+    auto eligible = [this, max_latency_us](size_t index) {
+        return max_latency_us == 0 || latency_[index] == 0 || latency_[index] <= max_latency_us;
+    };
+
+    uint64_t total = 0;
+    size_t matches = 0;
+    scan(required, forbidden, [&](size_t index) {
+        if (eligible(index)) {
+            total += weight_[index];
+            ++matches;
+        }
+    });
+
+    if (matches == 0) {
+        return size();
+    }
+
+    // Fall back to a uniform pick when every candidate has zero weight
+    const bool uniform = total == 0;
+    uint64_t target = random_bits % (uniform ? matches : total);
+
+    size_t chosen = size();
+    scan(required, forbidden, [&](size_t index) {
+        if (chosen != size() || !eligible(index)) return;
+
+        uint64_t weight = uniform ? 1 : weight_[index];
+        if (target < weight) {
+            chosen = index;
+        } else {
+            target -= weight;
+        }
+    });
+
+    return chosen;
+}
+
+} // namespace kermit
@@ -0,0 +1,47 @@
+#include "kermit/relay_id.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace kermit {
+
+namespace {
+
+struct Table {
+    std::mutex mutex;
+    std::unordered_map<std::string, RelayId> ids;
+    std::vector<std::string> names{std::string()};  // Indexed by id; 0 is kInvalidRelay
+};
+
+// Never destroyed, since relays may be looked up during exit
+Table& table() {
+    static Table* instance = new Table();
+    return *instance;
+}
+
+} // namespace
+
+RelayId RelayIds::intern(const std::string& node_id) {
+    Table& instance = table();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    auto inserted = instance.ids.emplace(node_id, static_cast<RelayId>(instance.names.size()));
+    if (inserted.second) {
+        instance.names.push_back(node_id);
+    }
+    return inserted.first->second;
+}
+
+RelayId RelayIds::find(const std::string& node_id) {
+    Table& instance = table();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    auto it = instance.ids.find(node_id);
+    return it == instance.ids.end() ? kInvalidRelay : it->second;
+}
+
+std::string RelayIds::name(RelayId id) {
+    Table& instance = table();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    return id < instance.names.size() ? instance.names[id] : std::string();
+}
+
+} // namespace kermit
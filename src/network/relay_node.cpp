@@ -1,4 +1,5 @@
 #include "kermit/network.h"
+#include "kermit/slab.h"
 #include <iostream>
 #include <memory>
 #include <cstdint>
@@ -6,20 +7,28 @@
 namespace kermit {
 
 // RelayNode implementation
-class RelayNode::Impl {
+class RelayNode::Impl : public SlabAllocated {
 public:
     std::string node_id_;
+    RelayId relay_id_;
     std::string address_;
     uint16_t port_;
     bool trusted_;
+    bool listed_;
     bool supports_hidden_services_;
     bool is_exit_node_;
     bool is_guard_node_;
+    uint32_t bandwidth_;
+    uint32_t latency_us_;
+    double failure_rate_;
+    uint32_t measured_throughput_;
     
     Impl(const std::string& node_id, const std::string& address, uint16_t port)
-        : node_id_(node_id), address_(address), port_(port), 
-          trusted_(false), supports_hidden_services_(true), 
-          is_exit_node_(false), is_guard_node_(false) {}
+        : node_id_(node_id), relay_id_(RelayIds::intern(node_id)), address_(address), port_(port), 
+          trusted_(false), listed_(false), supports_hidden_services_(true), 
+          is_exit_node_(false), is_guard_node_(false),
+          bandwidth_(1), latency_us_(0), failure_rate_(0.0),
+          measured_throughput_(0) {}
     
     ~Impl() = default;
 };
@@ -34,6 +43,10 @@ const std::string& RelayNode::getNodeId() const {
     return impl_->node_id_;
 }
 
+RelayId RelayNode::getRelayId() const {
+    return impl_->relay_id_;
+}
+
 const std::string& RelayNode::getAddress() const {
     return impl_->address_;
 }
@@ -50,6 +63,14 @@ void RelayNode::setTrusted(bool trusted) {
     impl_->trusted_ = trusted;
 }
 
+bool RelayNode::isListed() const {
+    return impl_->listed_;
+}
+
+void RelayNode::setListed(bool listed) {
+    impl_->listed_ = listed;
+}
+
 bool RelayNode::supportsHiddenServices() const {
     return impl_->supports_hidden_services_;
 }
@@ -62,4 +83,48 @@ bool RelayNode::isGuardNode() const {
     return impl_->is_guard_node_;
 }
 
+void RelayNode::setSupportsHiddenServices(bool supported) {
+    impl_->supports_hidden_services_ = supported;
+}
+
+void RelayNode::setExitNode(bool exit) {
+    impl_->is_exit_node_ = exit;
+}
+
+void RelayNode::setGuardNode(bool guard) {
+    impl_->is_guard_node_ = guard;
+}
+
+uint32_t RelayNode::getBandwidth() const {
+    return impl_->bandwidth_;
+}
+
+void RelayNode::setBandwidth(uint32_t bandwidth) {
+    impl_->bandwidth_ = bandwidth;
+}
+
+uint32_t RelayNode::getLatency() const {
+    return impl_->latency_us_;
+}
+
+void RelayNode::setLatency(uint32_t latency_us) {
+    impl_->latency_us_ = latency_us;
+}
+
+double RelayNode::getFailureRate() const {
+    return impl_->failure_rate_;
+}
+
+void RelayNode::setFailureRate(double failure_rate) {
+    impl_->failure_rate_ = failure_rate;
+}
+
+uint32_t RelayNode::getMeasuredThroughput() const {
+    return impl_->measured_throughput_;
+}
+
+void RelayNode::setMeasuredThroughput(uint32_t throughput) {
+    impl_->measured_throughput_ = throughput;
+}
+
 } // namespace kermit
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "kermit/relay_prober.h"
+#include "kermit/node_manager.h"
+#include "kermit/relay_directory.h"
+#include "kermit/log.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+
+namespace kermit {
+
+using Clock = std::chrono::steady_clock;
+
+// RelayProber implementation
+class RelayProber::Impl {
+public:
+    struct Probe {
+        enum class Phase { CONNECTING, SENDING, RECEIVING, DONE };
+
+        std::string node_id;
+        int fd = -1;
+        Phase phase = Phase::CONNECTING;
+        Clock::time_point started;
+        Clock::time_point echo_started;
+        size_t sent = 0;
+        size_t received = 0;
+        RelayMeasurement result{};
+    };
+
+    NodeManager& node_manager_;
+    RelayProberConfig config_;
+    std::vector<uint8_t> echo_payload_;
+    std::vector<uint8_t> echo_buffer_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread prober_thread_;
+    std::atomic<bool> should_stop_;
+    bool running_;
+
+    std::atomic<uint64_t> rounds_;
+    std::atomic<uint64_t> probes_;
+    std::atomic<uint64_t> failures_;
+
+    Impl(NodeManager& node_manager, const RelayProberConfig& config)
+        : node_manager_(node_manager), config_(config), should_stop_(false), running_(false),
+          rounds_(0), probes_(0), failures_(0) {
+        if (config_.max_concurrent == 0) {
+            config_.max_concurrent = 1;
+        }
+        echo_payload_.assign(config_.echo_bytes, 0x5A);
+        echo_buffer_.resize(std::max<size_t>(config_.echo_bytes, 1));
+    }
+
+    ~Impl() {
+        stop();
+    }
+
+    bool start() {
+        if (running_) {
+            KERMIT_WARN << "Relay prober is already running";
+            return false;
+        }
+
+        should_stop_ = false;
+        prober_thread_ = std::thread(&Impl::proberLoop, this);
+        running_ = true;
+        return true;
+    }
+
+    void stop() {
+        if (!running_) return;
+
+        running_ = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            should_stop_ = true;
+        }
+        wake_.notify_all();
+
+        if (prober_thread_.joinable()) {
+            prober_thread_.join();
+        }
+    }
+
+    void proberLoop() {
+        while (!should_stop_) {
+            probeOnce();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(config_.interval_ms),
+                           [this] { return should_stop_.load(); });
+        }
+    }
+
+    size_t probeOnce() {
+        auto snapshot = node_manager_.getSnapshot();
+        const auto& directory = snapshot->directory;
+
+        std::vector<RelayMeasurement> results;
+        results.reserve(directory.size());
+
+        for (size_t begin = 0; begin < directory.size() && !should_stop_; begin += config_.max_concurrent) {
+            size_t end = std::min(directory.size(), begin + config_.max_concurrent);
+            runBatch(directory, begin, end, results);
+        }
+
+        node_manager_.recordMeasurements(results, config_.alpha);
+
+        rounds_++;
+        probes_ += results.size();
+        for (const auto& result : results) {
+            if (!result.success) failures_++;
+        }
+        return results.size();
+    }
+
+    // Probe relays [begin, end) concurrently from one poll loop
+    void runBatch(const RelayDirectory& directory, size_t begin, size_t end,
+                  std::vector<RelayMeasurement>& results) {
+        std::vector<Probe> probes(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            Probe& probe = probes[i - begin];
+            probe.node_id = std::string(directory.id(i));
+            probe.result.node_id = probe.node_id;
+            probe.started = Clock::now();
+            if (!startConnect(probe, directory, i)) {
+                finish(probe, false);
+            }
+        }
+
+        const auto deadline = Clock::now() + std::chrono::milliseconds(config_.timeout_ms);
+        std::vector<pollfd> poll_fds;
+        std::vector<size_t> owners;
+
+        while (!should_stop_) {
+            poll_fds.clear();
+            owners.clear();
+            for (size_t i = 0; i < probes.size(); ++i) {
+                const Probe& probe = probes[i];
+                if (probe.phase == Probe::Phase::DONE) continue;
+
+                short events = probe.phase == Probe::Phase::RECEIVING ? POLLIN : POLLOUT;
+                poll_fds.push_back({probe.fd, events, 0});
+                owners.push_back(i);
+            }
+            if (poll_fds.empty()) break;
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) break;
+
+            int ready = poll(poll_fds.data(), poll_fds.size(), static_cast<int>(std::min<long long>(remaining, 100)));
+            if (ready < 0 && errno != EINTR) break;
+
+            for (size_t k = 0; k < poll_fds.size(); ++k) {
+                if (poll_fds[k].revents != 0) {
+                    advance(probes[owners[k]], poll_fds[k].revents);
+                }
+            }
+        }
+
+        // Probes cut short by stop() say nothing about the relay, so only
+        // the ones that finished or timed out are recorded
+        bool stopped = should_stop_;
+        for (auto& probe : probes) {
+            if (probe.phase != Probe::Phase::DONE) {
+                finish(probe, false);  // Timed out
+                if (stopped) continue;
+            }
+            results.push_back(probe.result);
+        }
+    }
+
+    bool startConnect(Probe& probe, const RelayDirectory& directory, size_t index) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(directory.port(index));
+
+        if (directory.ipv4(index) != 0) {
+            addr.sin_addr.s_addr = htonl(directory.ipv4(index));
+        } else {
+            // Hostnames are rare in directories; resolve inline
+            addrinfo hints{};
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* result = nullptr;
+            std::string host(directory.host(index));
+            if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+                return false;
+            }
+            addr.sin_addr = reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr;
+            freeaddrinfo(result);
+        }
+
+        probe.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (probe.fd < 0) {
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(probe.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        probe.started = Clock::now();
+        if (::connect(probe.fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            return false;
+        }
+        return true;
+    }
+
+    void advance(Probe& probe, short revents) {
+        if (probe.phase == Probe::Phase::CONNECTING) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(probe.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0 ||
+                (revents & (POLLERR | POLLHUP))) {
+                finish(probe, false);
+                return;
+            }
+
+            // Handshake completion is one round trip
+            probe.result.rtt_us = elapsedUs(probe.started);
+            if (echo_payload_.empty()) {
+                finish(probe, true);
+                return;
+            }
+
+            probe.phase = Probe::Phase::SENDING;
+            probe.echo_started = Clock::now();
+        }
+
+        if (probe.phase == Probe::Phase::SENDING) {
+            ssize_t n = send(probe.fd, echo_payload_.data() + probe.sent, echo_payload_.size() - probe.sent, MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                finish(probe, false);
+                return;
+            }
+            if (n > 0) probe.sent += static_cast<size_t>(n);
+            if (probe.sent == echo_payload_.size()) {
+                probe.phase = Probe::Phase::RECEIVING;
+            }
+            return;
+        }
+
+        if (probe.phase == Probe::Phase::RECEIVING) {
+            ssize_t n = recv(probe.fd, echo_buffer_.data(), echo_buffer_.size(), 0);
+            if (n <= 0) {
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                finish(probe, false);
+                return;
+            }
+
+            if (probe.received == 0) {
+                // Time to the first echoed byte includes the relay's own delay
+                probe.result.rtt_us = elapsedUs(probe.echo_started);
+            }
+            probe.received += static_cast<size_t>(n);
+
+            if (probe.received >= echo_payload_.size()) {
+                uint64_t elapsed_us = std::max<uint64_t>(elapsedUs(probe.echo_started), 1);
+                // Bytes moved both ways, in KB/s
+                probe.result.throughput = static_cast<uint32_t>(
+                    (2 * echo_payload_.size() * 1000000ull / elapsed_us) / 1024);
+                finish(probe, true);
+            }
+        }
+    }
+
+    void finish(Probe& probe, bool success) {
+        if (probe.fd >= 0) {
+            close(probe.fd);
+            probe.fd = -1;
+        }
+        probe.result.success = success;
+        probe.phase = Probe::Phase::DONE;
+    }
+
+    static uint32_t elapsedUs(Clock::time_point since) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count();
+        return static_cast<uint32_t>(std::max<long long>(us, 1));
+    }
+};
+
+// RelayProber public interface
+RelayProber::RelayProber(NodeManager& node_manager, const RelayProberConfig& config)
+    : impl_(std::make_unique<Impl>(node_manager, config)) {}
+
+RelayProber::~RelayProber() = default;
+
+bool RelayProber::start() {
+    return impl_->start();
+}
+
+void RelayProber::stop() {
+    impl_->stop();
+}
+
+size_t RelayProber::probeOnce() {
+    return impl_->probeOnce();
+}
+
+RelayProberStats RelayProber::getStats() const {
+    return {impl_->rounds_.load(), impl_->probes_.load(), impl_->failures_.load()};
+}
+
+} // namespace kermit
@@ -0,0 +1,190 @@
+#include "kermit/resolver.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+namespace kermit {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Lookups that may run at once; a slow one only holds up its own thread
+constexpr size_t kWorkers = 2;
+
+// How long answers are trusted; failures are retried sooner
+constexpr auto kResolvedTtl = std::chrono::seconds(60);
+constexpr auto kFailedTtl = std::chrono::seconds(5);
+
+struct Entry {
+    bool resolved;
+    in_addr address;
+    Clock::time_point expires;
+};
+
+struct State {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::unordered_map<std::string, Entry> cache;
+    // Hosts queued or being looked up, with who to tell
+    std::unordered_map<std::string, std::vector<std::function<void(bool)>>> waiting;
+    std::deque<std::string> queue;
+    size_t workers = 0;
+};
+
+// Never destroyed, since workers may still be in a lookup during exit
+State& state() {
+    static State* instance = new State();
+    return *instance;
+}
+
+bool query(const std::string& host, in_addr& address) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        return false;
+    }
+    address = reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return true;
+}
+
+// Caller holds the state mutex
+bool cached(State& s, const std::string& host, Entry& entry) {
+    auto it = s.cache.find(host);
+    if (it == s.cache.end() || Clock::now() >= it->second.expires) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+// Caller holds the state mutex
+void store(State& s, const std::string& host, bool resolved, const in_addr& address) {
+    s.cache[host] = {resolved, address, Clock::now() + (resolved ? kResolvedTtl : kFailedTtl)};
+}
+
+void workerLoop() {
+    State& s = state();
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while (true) {
+        s.wake.wait(lock, [&s] { return !s.queue.empty(); });
+        std::string host = std::move(s.queue.front());
+        s.queue.pop_front();
+
+        // Another request may have filled the cache since this one was queued
+        Entry entry{};
+        bool resolved;
+        if (cached(s, host, entry)) {
+            resolved = entry.resolved;
+        } else {
+            lock.unlock();
+            resolved = query(host, entry.address);
+            lock.lock();
+            store(s, host, resolved, entry.address);
+        }
+
+        auto callbacks = std::move(s.waiting[host]);
+        s.waiting.erase(host);
+        lock.unlock();
+        for (auto& done : callbacks) {
+            if (done) done(resolved);
+        }
+        lock.lock();
+    }
+}
+
+void fill(sockaddr_in& address, const in_addr& host, uint16_t port) {
+    address = sockaddr_in{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr = host;
+}
+
+} // namespace
+
+bool Resolver::lookup(const std::string& host, uint16_t port, sockaddr_in& address) {
+    in_addr numeric{};
+    if (inet_pton(AF_INET, host.c_str(), &numeric) == 1) {
+        fill(address, numeric, port);
+        return true;
+    }
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    Entry entry{};
+    if (!cached(s, host, entry) || !entry.resolved) {
+        return false;
+    }
+    fill(address, entry.address, port);
+    return true;
+}
+
+void Resolver::resolve(const std::string& host, std::function<void(bool)> done) {
+    State& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto inserted = s.waiting.emplace(host, std::vector<std::function<void(bool)>>());
+        inserted.first->second.push_back(std::move(done));
+        if (!inserted.second) {
+            return;
+        }
+        s.queue.push_back(host);
+
+        // Workers start with the first name to look up and then stay
+        while (s.workers < kWorkers) {
+            std::thread(workerLoop).detach();
+            s.workers++;
+        }
+    }
+    s.wake.notify_one();
+}
+
+bool Resolver::resolveNow(const std::string& host, uint16_t port, sockaddr_in& address) {
+    if (lookup(host, port, address)) {
+        return true;
+    }
+
+    in_addr resolved{};
+    bool ok = query(host, resolved);
+    {
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        store(s, host, ok, resolved);
+    }
+    if (ok) {
+        fill(address, resolved, port);
+    }
+    return ok;
+}
+
+bool Resolver::splitAddress(const std::string& address, std::string& host, uint16_t& port) {
+    size_t colon_pos = address.rfind(':');
+    if (colon_pos == std::string::npos || colon_pos == 0 || address[colon_pos + 1] < '0' ||
+        address[colon_pos + 1] > '9') {
+        return false;
+    }
+
+    char* end = nullptr;
+    unsigned long value = strtoul(address.c_str() + colon_pos + 1, &end, 10);
+    if (*end != '\0' || value == 0 || value > 65535) {
+        return false;
+    }
+
+    host = address.substr(0, colon_pos);
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+} // namespace kermit
@@ -0,0 +1,667 @@
+#include "kermit/socks_server.h"
+#include "kermit/event_loop.h"
+#include "kermit/expose_service.h"
+#include "kermit/log.h"
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace kermit {
+
+namespace {
+
+constexpr size_t kRelayBufferSize = 16384;
+constexpr size_t kMaxFreeSessions = 1024;
+
+// Sessions that have not reached the relay state by then are closed, so a
+// client cannot hold one open by never finishing its greeting
+constexpr auto kHandshakeTimeout = std::chrono::seconds(10);
+constexpr uint32_t kHandshakeCheckMs = 1000;
+
+// RFC 1928 constants
+constexpr uint8_t kSocksVersion = 5;
+constexpr uint8_t kMethodNoAuth = 0x00;
+constexpr uint8_t kMethodNoAcceptable = 0xFF;
+constexpr uint8_t kCmdConnect = 1;
+constexpr uint8_t kAtypIPv4 = 1;
+constexpr uint8_t kAtypDomain = 3;
+constexpr uint8_t kAtypIPv6 = 4;
+
+constexpr uint8_t kReplySucceeded = 0x00;
+constexpr uint8_t kReplyNotAllowed = 0x02;
+constexpr uint8_t kReplyHostUnreachable = 0x04;
+constexpr uint8_t kReplyConnectionRefused = 0x05;
+constexpr uint8_t kReplyCommandNotSupported = 0x07;
+constexpr uint8_t kReplyAddressNotSupported = 0x08;
+
+constexpr char kServiceSuffix[] = ".uwu";
+constexpr size_t kServiceSuffixLength = sizeof(kServiceSuffix) - 1;
+
+} // namespace
+
+// SocksServer implementation
+class SocksServer::Impl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class State {
+        GREETING,
+        REQUEST,
+        RESOLVING,   // Waiting for backend host names to be looked up
+        CONNECTING,
+        RELAY
+    };
+
+    // One direction of a relayed connection
+    struct Pipe {
+        uint8_t buf[kRelayBufferSize];
+        size_t off;
+        size_t len;
+        bool eof;   // Source reached end of stream
+        bool shut;  // Sink has been shut down for writing
+
+        void reset() {
+            off = 0;
+            len = 0;
+            eof = false;
+            shut = false;
+        }
+    };
+
+    struct Session {
+        int client_fd;
+        int upstream_fd;
+        State state;
+        uint64_t serial;        // Tells a recycled session from the one a lookup was for
+        Clock::time_point started;
+        std::string service;    // Requested service while RESOLVING
+        uint32_t client_events;
+        uint32_t upstream_events;
+        char client_ip[INET_ADDRSTRLEN];
+        Pipe up;    // Client to upstream; also holds the handshake while parsing
+        Pipe down;  // Upstream to client
+
+        void reset() {
+            client_fd = -1;
+            upstream_fd = -1;
+            state = State::GREETING;
+            started = Clock::now();
+            service.clear();
+            client_events = 0;
+            upstream_events = 0;
+            client_ip[0] = '\0';
+            up.reset();
+            down.reset();
+        }
+    };
+
+    // Lets lookups finishing on a resolver thread post to the loop only
+    // while the server exists
+    struct Liveness {
+        std::mutex mutex;
+        std::atomic<bool> alive{true};
+    };
+
+    EventLoop& loop_;
+    ServiceRegistry& registry_;
+    int listen_fd_;
+    uint16_t port_;
+    int handshake_timer_;
+    uint64_t next_serial_;
+    std::shared_ptr<Liveness> liveness_;
+
+    std::unordered_map<Session*, std::unique_ptr<Session>> sessions_;
+    std::vector<std::unique_ptr<Session>> free_sessions_;
+
+    // Reused across requests so registry lookups do not allocate
+    std::string lookup_key_;
+    std::string affinity_key_;
+
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> active_;
+    std::atomic<uint64_t> connected_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> connect_failures_;
+    std::atomic<uint64_t> bytes_relayed_;
+
+    Impl(EventLoop& loop, ServiceRegistry& registry)
+        : loop_(loop), registry_(registry), listen_fd_(-1), port_(0), handshake_timer_(-1), next_serial_(0),
+          liveness_(std::make_shared<Liveness>()), accepted_(0), active_(0), connected_(0), rejected_(0),
+          connect_failures_(0), bytes_relayed_(0) {
+        lookup_key_.reserve(256);
+        affinity_key_.reserve(INET_ADDRSTRLEN);
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(liveness_->mutex);
+            liveness_->alive = false;
+        }
+        stop();
+    }
+
+    bool start(uint16_t port, const std::string& listen_address) {
+        if (listen_fd_ != -1) {
+            KERMIT_WARN << "SOCKS server is already running";
+            return false;
+        }
+
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            KERMIT_ERROR << "Failed to create SOCKS socket: " << strerror(errno);
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, listen_address.c_str(), &addr.sin_addr) != 1) {
+            KERMIT_ERROR << "Invalid SOCKS listen address: " << listen_address;
+            closeListener();
+            return false;
+        }
+
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            KERMIT_ERROR << "Failed to bind SOCKS socket: " << strerror(errno);
+            closeListener();
+            return false;
+        }
+
+        if (listen(listen_fd_, SOMAXCONN) < 0) {
+            KERMIT_ERROR << "Failed to listen on SOCKS socket: " << strerror(errno);
+            closeListener();
+            return false;
+        }
+
+        socklen_t addr_len = sizeof(addr);
+        getsockname(listen_fd_, (sockaddr*)&addr, &addr_len);
+        port_ = ntohs(addr.sin_port);
+
+        if (!loop_.addFd(listen_fd_, EventLoop::READABLE, [this](uint32_t) { acceptClients(); })) {
+            closeListener();
+            return false;
+        }
+        handshake_timer_ = loop_.addTimer(kHandshakeCheckMs, [this] { expireHandshakes(); });
+
+        KERMIT_INFO << "SOCKS5 listening on " << listen_address << ":" << port_;
+        return true;
+    }
+
+    void stop() {
+        if (handshake_timer_ != -1) {
+            loop_.cancelTimer(handshake_timer_);
+            handshake_timer_ = -1;
+        }
+
+        if (listen_fd_ != -1) {
+            loop_.removeFd(listen_fd_);
+            closeListener();
+        }
+
+        while (!sessions_.empty()) {
+            closeSession(sessions_.begin()->first);
+        }
+        free_sessions_.clear();
+    }
+
+    void closeListener() {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    void acceptClients() {
+        while (true) {
+            sockaddr_in client_addr{};
+            socklen_t client_len = sizeof(client_addr);
+
+            int client_fd = accept4(listen_fd_, (sockaddr*)&client_addr, &client_len,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    KERMIT_ERROR << "SOCKS accept error: " << strerror(errno);
+                }
+                return;
+            }
+
+            int opt = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+            Session* session = allocateSession();
+            session->client_fd = client_fd;
+            inet_ntop(AF_INET, &client_addr.sin_addr, session->client_ip, sizeof(session->client_ip));
+
+            session->client_events = EventLoop::READABLE;
+            if (!loop_.addFd(client_fd, session->client_events,
+                             [this, session](uint32_t events) { onClientEvent(session, events); })) {
+                session->client_events = 0;
+                closeSession(session);
+                continue;
+            }
+
+            accepted_++;
+        }
+    }
+
+    Session* allocateSession() {
+        std::unique_ptr<Session> session;
+        if (!free_sessions_.empty()) {
+            session = std::move(free_sessions_.back());
+            free_sessions_.pop_back();
+        } else {
+            session = std::make_unique<Session>();
+        }
+
+        session->reset();
+        session->serial = ++next_serial_;
+        Session* raw = session.get();
+        sessions_[raw] = std::move(session);
+        active_++;
+        return raw;
+    }
+
+    void closeSession(Session* session) {
+        if (session->client_fd != -1) {
+            loop_.removeFd(session->client_fd);
+            close(session->client_fd);
+        }
+
+        if (session->upstream_fd != -1) {
+            loop_.removeFd(session->upstream_fd);
+            registry_.closeServiceConnection(session->upstream_fd);
+        }
+
+        auto it = sessions_.find(session);
+        if (it == sessions_.end()) {
+            return;
+        }
+
+        if (free_sessions_.size() < kMaxFreeSessions) {
+            free_sessions_.push_back(std::move(it->second));
+        }
+        sessions_.erase(it);
+        active_--;
+    }
+
+    // Close sessions still in the handshake past their deadline
+    void expireHandshakes() {
+        const auto deadline = Clock::now() - kHandshakeTimeout;
+        std::vector<Session*> expired;
+        for (const auto& entry : sessions_) {
+            Session* session = entry.first;
+            if (session->state != State::RELAY && session->started < deadline) {
+                expired.push_back(session);
+            }
+        }
+
+        for (Session* session : expired) {
+            if (session->state == State::CONNECTING) {
+                connect_failures_++;
+                loop_.removeFd(session->upstream_fd);
+                registry_.closeServiceConnection(session->upstream_fd, false, true);
+                session->upstream_fd = -1;
+            }
+            if (session->state == State::CONNECTING || session->state == State::RESOLVING) {
+                rejectRequest(session, kReplyHostUnreachable);
+            } else {
+                rejected_++;
+            }
+            closeSession(session);
+        }
+    }
+
+    void onClientEvent(Session* session, uint32_t events) {
+        if (session->state == State::GREETING || session->state == State::REQUEST) {
+            if (events & (EventLoop::READABLE | EventLoop::ERROR)) {
+                if (!readHandshake(session)) {
+                    closeSession(session);
+                }
+            }
+            return;
+        }
+
+        // Reads are held while resolving; only a hangup gets here
+        if (session->state == State::RESOLVING) {
+            if (events & EventLoop::ERROR) {
+                closeSession(session);
+            }
+            return;
+        }
+
+        bool ok = true;
+        if (events & EventLoop::WRITABLE) {
+            ok = flush(session->down, session->client_fd);
+        }
+        if (ok && (events & (EventLoop::READABLE | EventLoop::ERROR))) {
+            ok = fill(session->up, session->client_fd) && flush(session->up, session->upstream_fd);
+        }
+
+        // Hangup is level-triggered and cannot be masked; stop after one last drain
+        finishEvent(session, ok && !(events & EventLoop::ERROR));
+    }
+
+    void onUpstreamEvent(Session* session, uint32_t events) {
+        if (session->state == State::CONNECTING) {
+            if (events & (EventLoop::WRITABLE | EventLoop::ERROR)) {
+                finishConnect(session);
+            }
+            return;
+        }
+
+        bool ok = true;
+        if (events & EventLoop::WRITABLE) {
+            ok = flush(session->up, session->upstream_fd);
+        }
+        if (ok && (events & (EventLoop::READABLE | EventLoop::ERROR))) {
+            ok = fill(session->down, session->upstream_fd) && flush(session->down, session->client_fd);
+        }
+
+        finishEvent(session, ok && !(events & EventLoop::ERROR));
+    }
+
+    // Close the session once both directions are done, otherwise re-arm
+    void finishEvent(Session* session, bool ok) {
+        if (!ok || (session->up.shut && session->down.shut)) {
+            closeSession(session);
+            return;
+        }
+        updateInterest(session);
+    }
+
+    bool readHandshake(Session* session) {
+        Pipe& in = session->up;
+        ssize_t n = recv(session->client_fd, in.buf + in.len, kRelayBufferSize - in.len, 0);
+        if (n == 0) {
+            return false;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        in.len += static_cast<size_t>(n);
+        return parseHandshake(session);
+    }
+
+    // Parse as much of the greeting and request as is buffered
+    // Clients may send greeting, request and early data in one write
+    bool parseHandshake(Session* session) {
+        Pipe& in = session->up;
+
+        if (session->state == State::GREETING) {
+            if (in.len < 2) return true;
+            if (in.buf[0] != kSocksVersion) return false;
+
+            size_t greeting_len = 2 + in.buf[1];
+            if (in.len < greeting_len) return true;
+
+            bool no_auth = false;
+            for (size_t i = 2; i < greeting_len; ++i) {
+                if (in.buf[i] == kMethodNoAuth) {
+                    no_auth = true;
+                    break;
+                }
+            }
+
+            const uint8_t reply[2] = {kSocksVersion, no_auth ? kMethodNoAuth : kMethodNoAcceptable};
+            if (!sendReply(session->client_fd, reply, sizeof(reply)) || !no_auth) {
+                rejected_++;
+                return false;
+            }
+
+            consume(in, greeting_len);
+            session->state = State::REQUEST;
+        }
+
+        // Request: VER CMD RSV ATYP DST.ADDR DST.PORT
+        if (in.len < 5) return true;
+        if (in.buf[0] != kSocksVersion) return false;
+
+        const uint8_t command = in.buf[1];
+        const uint8_t address_type = in.buf[3];
+
+        size_t request_len;
+        switch (address_type) {
+            case kAtypIPv4: request_len = 4 + 4 + 2; break;
+            case kAtypDomain: request_len = 4 + 1 + in.buf[4] + 2; break;
+            case kAtypIPv6: request_len = 4 + 16 + 2; break;
+            default:
+                return rejectRequest(session, kReplyAddressNotSupported);
+        }
+        if (in.len < request_len) return true;
+
+        if (command != kCmdConnect) {
+            return rejectRequest(session, kReplyCommandNotSupported);
+        }
+
+        // Only hidden services are reachable through this port
+        const size_t name_len = in.buf[4];
+        const char* name = reinterpret_cast<const char*>(in.buf + 5);
+        if (address_type != kAtypDomain || name_len <= kServiceSuffixLength ||
+            memcmp(name + name_len - kServiceSuffixLength, kServiceSuffix, kServiceSuffixLength) != 0) {
+            return rejectRequest(session, kReplyNotAllowed);
+        }
+
+        lookup_key_.assign(name, name_len);
+        affinity_key_.assign(session->client_ip);
+        consume(in, request_len);
+
+        int upstream_fd = registry_.openServiceConnectionAsync(lookup_key_, affinity_key_);
+        if (upstream_fd == -1) {
+            if (waitForBackends(session)) {
+                return true;
+            }
+            return rejectRequest(session, kReplyHostUnreachable);
+        }
+        return beginConnect(session, upstream_fd);
+    }
+
+    // Look up the service's backend names off the loop and retry once they
+    // are in; false if there is nothing to look up
+    bool waitForBackends(Session* session) {
+        std::shared_ptr<Liveness> liveness = liveness_;
+        uint64_t serial = session->serial;
+        bool pending = registry_.resolveBackends(lookup_key_, [this, liveness, session, serial] {
+            std::lock_guard<std::mutex> lock(liveness->mutex);
+            if (!liveness->alive) return;
+            loop_.post([this, liveness, session, serial] {
+                if (liveness->alive) retryConnect(session, serial);
+            });
+        });
+        if (!pending) {
+            return false;
+        }
+
+        session->service = lookup_key_;
+        session->state = State::RESOLVING;
+        session->client_events = 0;
+        loop_.modifyFd(session->client_fd, session->client_events);
+        return true;
+    }
+
+    void retryConnect(Session* session, uint64_t serial) {
+        auto it = sessions_.find(session);
+        if (it == sessions_.end() || session->serial != serial || session->state != State::RESOLVING) {
+            return;  // Closed or timed out while the names were looked up
+        }
+
+        int upstream_fd = registry_.openServiceConnectionAsync(session->service, session->client_ip);
+        if (upstream_fd == -1) {
+            rejectRequest(session, kReplyHostUnreachable);
+            closeSession(session);
+            return;
+        }
+        if (!beginConnect(session, upstream_fd)) {
+            closeSession(session);
+        }
+    }
+
+    bool beginConnect(Session* session, int upstream_fd) {
+        session->upstream_fd = upstream_fd;
+        session->state = State::CONNECTING;
+        session->upstream_events = EventLoop::WRITABLE;
+        if (!loop_.addFd(upstream_fd, session->upstream_events,
+                         [this, session](uint32_t events) { onUpstreamEvent(session, events); })) {
+            registry_.closeServiceConnection(upstream_fd);
+            session->upstream_fd = -1;
+            return false;
+        }
+
+        // Hold client reads until the backend answers; early data stays buffered
+        session->client_events = 0;
+        loop_.modifyFd(session->client_fd, session->client_events);
+        return true;
+    }
+
+    void finishConnect(Session* session) {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (getsockopt(session->upstream_fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0 || so_error != 0) {
+            connect_failures_++;
+            loop_.removeFd(session->upstream_fd);
+            registry_.closeServiceConnection(session->upstream_fd, false, true);
+            session->upstream_fd = -1;
+
+            rejectRequest(session, kReplyConnectionRefused);
+            closeSession(session);
+            return;
+        }
+
+        // Bound address is not meaningful for hidden services
+        const uint8_t reply[10] = {kSocksVersion, kReplySucceeded, 0, kAtypIPv4, 0, 0, 0, 0, 0, 0};
+        if (!sendReply(session->client_fd, reply, sizeof(reply))) {
+            closeSession(session);
+            return;
+        }
+
+        connected_++;
+        session->state = State::RELAY;
+
+        // Forward any data the client sent ahead of the reply
+        finishEvent(session, flush(session->up, session->upstream_fd));
+    }
+
+    bool rejectRequest(Session* session, uint8_t code) {
+        rejected_++;
+        const uint8_t reply[10] = {kSocksVersion, code, 0, kAtypIPv4, 0, 0, 0, 0, 0, 0};
+        sendReply(session->client_fd, reply, sizeof(reply));
+        return false;
+    }
+
+    // Handshake replies are tiny and go out on an idle socket, so a short
+    // write only happens when the client is gone
+    static bool sendReply(int fd, const uint8_t* data, size_t len) {
+        return send(fd, data, len, MSG_NOSIGNAL) == static_cast<ssize_t>(len);
+    }
+
+    static void consume(Pipe& pipe, size_t count) {
+        pipe.len -= count;
+        if (pipe.len > 0) {
+            memmove(pipe.buf, pipe.buf + count, pipe.len);
+        }
+    }
+
+    // Read from fd into an empty pipe
+    bool fill(Pipe& pipe, int fd) {
+        if (pipe.len > 0 || pipe.eof) {
+            return true;
+        }
+
+        ssize_t n = recv(fd, pipe.buf, kRelayBufferSize, 0);
+        if (n > 0) {
+            pipe.off = 0;
+            pipe.len = static_cast<size_t>(n);
+            bytes_relayed_ += static_cast<uint64_t>(n);
+            return true;
+        }
+        if (n == 0) {
+            pipe.eof = true;
+            return true;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    // Write buffered data to fd, propagating end of stream once drained
+    static bool flush(Pipe& pipe, int fd) {
+        while (pipe.len > 0) {
+            ssize_t n = send(fd, pipe.buf + pipe.off, pipe.len, MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            pipe.off += static_cast<size_t>(n);
+            pipe.len -= static_cast<size_t>(n);
+        }
+
+        pipe.off = 0;
+        if (pipe.eof && !pipe.shut) {
+            shutdown(fd, SHUT_WR);
+            pipe.shut = true;
+        }
+        return true;
+    }
+
+    void updateInterest(Session* session) {
+        uint32_t client_events = 0;
+        uint32_t upstream_events = 0;
+
+        if (!session->up.eof && session->up.len == 0) client_events |= EventLoop::READABLE;
+        if (session->down.len > 0) client_events |= EventLoop::WRITABLE;
+        if (!session->down.eof && session->down.len == 0) upstream_events |= EventLoop::READABLE;
+        if (session->up.len > 0) upstream_events |= EventLoop::WRITABLE;
+
+        if (client_events != session->client_events) {
+            session->client_events = client_events;
+            loop_.modifyFd(session->client_fd, client_events);
+        }
+        if (upstream_events != session->upstream_events) {
+            session->upstream_events = upstream_events;
+            loop_.modifyFd(session->upstream_fd, upstream_events);
+        }
+    }
+
+    SocksServerStats getStats() const {
+        SocksServerStats stats;
+        stats.accepted = accepted_;
+        stats.active = active_;
+        stats.connected = connected_;
+        stats.rejected = rejected_;
+        stats.connect_failures = connect_failures_;
+        stats.bytes_relayed = bytes_relayed_;
+        return stats;
+    }
+};
+
+// SocksServer public interface
+SocksServer::SocksServer(EventLoop& loop, ServiceRegistry& registry)
+    : impl_(std::make_unique<Impl>(loop, registry)) {}
+
+SocksServer::~SocksServer() = default;
+
+bool SocksServer::start(uint16_t port, const std::string& listen_address) {
+    return impl_->start(port, listen_address);
+}
+
+void SocksServer::stop() {
+    impl_->stop();
+}
+
+uint16_t SocksServer::getPort() const {
+    return impl_->port_;
+}
+
+SocksServerStats SocksServer::getStats() const {
+    return impl_->getStats();
+}
+
+} // namespace kermit
@@ -16,7 +16,8 @@ void testServer() {
     kermit::NetworkManager network_manager;
     
     // Set up callbacks
-    network_manager.setConnectionCallback([](const std::string& conn_id, bool connected) {
+    network_manager.setConnectionCallback([&network_manager](kermit::ConnectionHandle conn, bool connected) {
+        std::string conn_id = network_manager.getConnectionName(conn);
         if (connected) {
             std::cout << "Server: Connection established with " << conn_id << std::endl;
         } else {
@@ -24,7 +25,8 @@ void testServer() {
         }
     });
     
-    network_manager.setDataCallback([](const std::string& conn_id, const std::vector<uint8_t>& data) {
+    network_manager.setDataCallback([&network_manager](kermit::ConnectionHandle conn, const std::vector<uint8_t>& data) {
+        std::string conn_id = network_manager.getConnectionName(conn);
         std::cout << "Server: Received " << data.size() << " bytes from " << conn_id << std::endl;
         std::string message(data.begin(), data.end());
         std::cout << "Server: Message: " << message << std::endl;
@@ -62,7 +64,8 @@ void testClient() {
     kermit::NetworkManager network_manager;
     
     // Set up callbacks
-    network_manager.setConnectionCallback([](const std::string& conn_id, bool connected) {
+    network_manager.setConnectionCallback([&network_manager](kermit::ConnectionHandle conn, bool connected) {
+        std::string conn_id = network_manager.getConnectionName(conn);
         if (connected) {
             std::cout << "Client: Connected to " << conn_id << std::endl;
         } else {
@@ -70,7 +73,8 @@ void testClient() {
         }
     });
     
-    network_manager.setDataCallback([](const std::string& conn_id, const std::vector<uint8_t>& data) {
+    network_manager.setDataCallback([&network_manager](kermit::ConnectionHandle conn, const std::vector<uint8_t>& data) {
+        std::string conn_id = network_manager.getConnectionName(conn);
         std::cout << "Client: Received " << data.size() << " bytes from " << conn_id << std::endl;
         std::string message(data.begin(), data.end());
         std::cout << "Client: Message: " << message << std::endl;
@@ -89,7 +93,8 @@ void testClient() {
     std::cout << "Client: Network manager started" << std::endl;
     
     // Connect to server
-    if (!network_manager.connect("127.0.0.1", 9051)) {
+    kermit::ConnectionHandle server = network_manager.connect("127.0.0.1", 9051);
+    if (server == kermit::kInvalidConnection) {
         std::cerr << "Failed to connect to server" << std::endl;
         return;
     }
@@ -101,7 +106,7 @@ void testClient() {
     std::string test_message = "Hello from Kermit network test!";
     std::vector<uint8_t> message_data(test_message.begin(), test_message.end());
     
-    if (!network_manager.sendData("127.0.0.1:9051", message_data)) {
+    if (!network_manager.sendData(server, message_data)) {
         std::cerr << "Failed to send data" << std::endl;
     } else {
         std::cout << "Client: Sent test message to server" << std::endl;